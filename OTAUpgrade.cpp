@@ -1,57 +1,271 @@
-#include <ArduinoOTA.h>
+#include "OTAUpgrade.hpp"
 #include "Arduino.h"
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
 #include <WiFiUdp.h>
+#include <WiFiClient.h>
+#include <Updater.h>
+#include <FS.h>
+#include "TallyBoxStateMachine.hpp"
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_OTA;
+
+#define OTA_INVITATION_MAX_SIZE   96    /*"command port size md5\n"*/
+
+typedef enum
+{
+  OTA_IDLE = 0,
+  OTA_INVITED,                  /*answered, the image is prepared and the sender connected from the idle time*/
+  OTA_RECEIVING,
+  OTA_RESTART_PENDING
+} otaState_t;
 
 static bool initialized = false;
+static otaState_t otaState = OTA_IDLE;
+static WiFiUDP otaUdp;
+static WiFiClient otaClient;
+static IPAddress senderAddress;
+static uint16_t senderPort = 0;
+static int imageCommand = U_FLASH;
+static char imageMd5[33] = {};
+static bool updateBegun = false;    /*the Updater is ours*/
+static uint32_t invitedAt = 0;
+static uint8_t chunk[OTA_CHUNK_SIZE];
+static uint32_t imageSize = 0;
+static uint32_t received = 0;
+static uint32_t startedAt = 0;
+static uint32_t lastDataAt = 0;
+static uint32_t prevTickUs = 0;
+static otaStats_t myStats = {};
 
-void OTAInitialize()
+
+static void failUpdate(const char *reason)
 {
-  ArduinoOTA.onStart([]() {
-    String type;
-    if (ArduinoOTA.getCommand() == U_FLASH) {
-        type = "sketch";
-    } else { // U_FS
-        type = "filesystem";
-    }
+  LOG_ERROR("update failed after %u bytes: %s", received, reason);
+  if(updateBegun)
+  {
+    Update.end();     /*an image that is not complete is dropped*/
+    updateBegun = false;
+  }
+  otaClient.stop();
+  myStats.failures++;
+  otaState = OTA_IDLE;
+}
+
+static void finishUpdate()
+{
+  if(!Update.end())
+  {
+    failUpdate(Update.getErrorString().c_str());
+    return;
+  }
+  updateBegun = false;
+  otaClient.print("OK");
+  otaClient.stop();
+
+  myStats.updates++;
+  myStats.bytes = received;
+  myStats.durationMs = millis() - startedAt;
+  myStats.bytesPerSecond = (myStats.durationMs > 0) ? (uint32_t)((uint64_t)received * 1000 / myStats.durationMs) : 0;
+  LOG_INFO("update of %u bytes in %u ms, %u B/s", received, myStats.durationMs, myStats.bytesPerSecond);
+  LOG_INFO("worst tally stall during the update %u us", myStats.worstStallUs);
+
+  otaState = OTA_RESTART_PENDING;
+}
+
+/*espota.py sends "command port size md5" over UDP and waits for the box to connect back. Only
+  the answer is sent from the tick: Update.begin() and the connection take place in OTAIdle().*/
+static void handleInvitation()
+{
+  char buf[OTA_INVITATION_MAX_SIZE];
+  int command;
+  int port;
+  unsigned size;
+  char md5[33] = {};
 
-    // NOTE: if updating FS this would be the place to unmount FS using FS.end()
-    Serial.println("Start updating " + type);
-  });
-
-  ArduinoOTA.onEnd([]() {
-    Serial.println("\nEnd");
-  });
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total) {
-    Serial.printf("Progress: %u%%\r", (progress / (total / 100)));
-  });
-  ArduinoOTA.onError([](ota_error_t error) {
-    Serial.printf("Error[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) {
-      Serial.println("Auth Failed");
-    } else if (error == OTA_BEGIN_ERROR) {
-      Serial.println("Begin Failed");
-    } else if (error == OTA_CONNECT_ERROR) {
-      Serial.println("Connect Failed");
-    } else if (error == OTA_RECEIVE_ERROR) {
-      Serial.println("Receive Failed");
-    } else if (error == OTA_END_ERROR) {
-      Serial.println("End Failed");
+  if(otaUdp.parsePacket() <= 0)
+  {
+    return;
+  }
+
+  int len = otaUdp.read(buf, sizeof(buf) - 1);
+  buf[max(len, 0)] = 0;
+
+  if((sscanf(buf, "%d %d %u %32s", &command, &port, &size, md5) != 4) || ((command != U_FLASH) && (command != U_FS)))
+  {
+    LOG_WARN("unsupported invitation (a password is not supported)");
+    return;
+  }
+  if(Update.isRunning())
+  {
+    LOG_WARN("invitation refused, another update is running");
+    return;
+  }
+
+  otaUdp.beginPacket(otaUdp.remoteIP(), otaUdp.remotePort());
+  otaUdp.print("OK");
+  otaUdp.endPacket();
+
+  senderAddress = otaUdp.remoteIP();
+  senderPort = (uint16_t)port;
+  imageCommand = command;
+  strlcpy(imageMd5, md5, sizeof(imageMd5));
+  imageSize = size;
+  received = 0;
+  invitedAt = millis();
+  otaState = OTA_INVITED;
+}
+
+/*one step per idle call: the Updater first, then connection attempts that fit in the idle time*/
+static void prepareUpdate(uint32_t idleMs)
+{
+  if(!updateBegun)
+  {
+    if(Update.isRunning())
+    {
+      failUpdate("another update is running");
+      return;
+    }
+    if(imageCommand == U_FS)
+    {
+      close_all_fs();
     }
-  });    
+    if(!Update.begin(imageSize, imageCommand))
+    {
+      failUpdate(Update.getErrorString().c_str());
+      return;
+    }
+    Update.setMD5(imageMd5);
+    updateBegun = true;
+    return;
+  }
 
-  ArduinoOTA.begin(false);
-  MDNS.enableArduino(8266);
+  if(idleMs < OTA_CONNECT_MIN_IDLE_MS)
+  {
+    return;
+  }
+  otaClient.setTimeout(idleMs);
+  if(otaClient.connect(senderAddress, senderPort))
+  {
+    otaClient.setNoDelay(true);
+    startedAt = millis();
+    lastDataAt = startedAt;
+    prevTickUs = 0;
+    myStats.worstStallUs = 0;
+    otaState = OTA_RECEIVING;
+    LOG_INFO("receiving %s image of %u bytes", ((imageCommand == U_FS) ? "filesystem" : "sketch"), imageSize);
+  }
+}
+
+void OTAInitialize()
+{
+  otaUdp.begin(OTA_PORT);
+  MDNS.enableArduino(OTA_PORT);
 
   initialized = true;
 }
 
-
 void OTAUpdate()
 {
-  if(initialized)
+  if(!initialized)
+  {
+    return;
+  }
+
+  switch(otaState)
   {
-    ArduinoOTA.handle();
+    case OTA_IDLE:
+      handleInvitation();
+      break;
+
+    case OTA_INVITED:
+      if((millis() - invitedAt) >= OTA_CONNECT_TIMEOUT_MS)
+      {
+        failUpdate("no connection to the sender");
+      }
+      break;
+
+    case OTA_RECEIVING:
+    {
+      uint32_t nowUs = micros();
+
+      /*the time between two ticks is the time the tally output has not been updated*/
+      if(prevTickUs != 0)
+      {
+        myStats.worstStallUs = max(myStats.worstStallUs, nowUs - prevTickUs);
+      }
+      prevTickUs = nowUs;
+
+      if((millis() - lastDataAt) >= OTA_RECEIVE_TIMEOUT_MS)
+      {
+        failUpdate("timeout");
+      }
+      else if(!otaClient.connected() && (otaClient.available() == 0))
+      {
+        failUpdate("connection closed");
+      }
+      break;
+    }
+
+    case OTA_RESTART_PENDING:
+    {
+      tallyBoxLiveState_t s;
+
+      /*without valid tally data the box shows no tally, so it may restart*/
+      tallyBoxGetLiveState(s);
+      if(!(s.dataIsValid && (s.preview || s.program)))
+      {
+        LOG_INFO("restarting into the new image");
+        ESP.restart();
+      }
+      break;
+    }
+
+    default:
+      break;
   }
-}
\ No newline at end of file
+}
+
+/*one chunk per call: at most one flash sector is erased and written per call*/
+void OTAIdle(uint32_t idleMs)
+{
+  if(otaState == OTA_INVITED)
+  {
+    prepareUpdate(idleMs);
+    return;
+  }
+  if(otaState != OTA_RECEIVING)
+  {
+    return;
+  }
+
+  int available = otaClient.available();
+
+  if(available > 0)
+  {
+    int len = otaClient.read(chunk, min((size_t)available, sizeof(chunk)));
+
+    if(len > 0)
+    {
+      if(Update.write(chunk, (size_t)len) != (size_t)len)
+      {
+        failUpdate(Update.getErrorString().c_str());
+        return;
+      }
+      received += len;
+      lastDataAt = millis();
+      otaClient.print(len);   /*espota.py waits for the count before it sends more*/
+
+      if(received >= imageSize)
+      {
+        finishUpdate();
+      }
+    }
+  }
+}
+
+const otaStats_t& OTAGetStats()
+{
+  return myStats;
+}
@@ -1,7 +1,32 @@
 #ifndef __OTAUPGRADE_HPP__
 #define __OTAUPGRADE_HPP__
+#include "Arduino.h"
+
+/*over-the-air update, compatible with espota.py and the Arduino IDE. The invitation is answered
+  in the tick. The Updater is started, the sender connected and the image received and written
+  in the idle time between the ticks, one step at a time, so tally reception and the outputs
+  keep running during the transfer. The restart into the new image waits until the box shows
+  neither program nor preview.*/
+
+#define OTA_PORT                8266
+#define OTA_CHUNK_SIZE          1460    /*read and written per idle call, one TCP segment*/
+#define OTA_CONNECT_TIMEOUT_MS  5000    /*espota.py waits 10 s for the box to connect back*/
+#define OTA_CONNECT_MIN_IDLE_MS 2       /*less idle time left: the connection waits for the next*/
+#define OTA_RECEIVE_TIMEOUT_MS  10000
+
+typedef struct
+{
+  uint32_t updates;                 /*images received completely*/
+  uint32_t failures;
+  uint32_t bytes;                   /*of the latest update*/
+  uint32_t durationMs;
+  uint32_t bytesPerSecond;
+  uint32_t worstStallUs;            /*longest time between two ticks during the latest update*/
+} otaStats_t;
 
 void OTAInitialize();
-void OTAUpdate();
+void OTAUpdate();                   /*from the tick*/
+void OTAIdle(uint32_t idleMs);      /*from the idle time between the ticks, idleMs until the next one*/
+const otaStats_t& OTAGetStats();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,131 @@
+#include "TallyBoxAssets.hpp"
+#include "Arduino.h"
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_ASSETS;
+
+#define ASSET_MAX_LINE  96
+
+static assetEntry_t assets[ASSET_MAX_ENTRIES];
+static uint8_t assetCount = 0;
+
+/*reads one line without the terminator, false at the end of the file*/
+static bool readLine(File& file, char *line, size_t maxLen)
+{
+  size_t len = 0;
+  int ch = -1;
+
+  while(file.available() && ((ch = file.read()) != '\n'))
+  {
+    if((ch != '\r') && (len < (maxLen - 1)))
+    {
+      line[len++] = (char)ch;
+    }
+  }
+  line[len] = 0;
+
+  return (len > 0) || (ch == '\n');
+}
+
+/*"path etag size content-type"*/
+static bool parseLine(const char *line, assetEntry_t& a)
+{
+  char etag[9];
+  unsigned long size = 0;
+
+  memset(&a, 0, sizeof(a));
+
+  if(sscanf(line, "%31s %8s %lu %27s", a.path, etag, &size, a.contentType) != 4)
+  {
+    return false;
+  }
+  if((a.path[0] != '/') || (strlen(etag) != 8))
+  {
+    return false;
+  }
+  snprintf(a.etag, sizeof(a.etag), "\"%s\"", etag);
+  a.size = size;
+
+  return true;
+}
+
+uint8_t tallyBoxAssetsInitialize(FS& fs)
+{
+  char line[ASSET_MAX_LINE];
+
+  assetCount = 0;
+
+  File file = fs.open(ASSET_INDEX_FILE, "r");
+  if(!file)
+  {
+    LOG_INFO("no asset index, static files are served as they are");
+    return 0;
+  }
+
+  while(readLine(file, line, sizeof(line)))
+  {
+    if(line[0] == 0)
+    {
+      continue;
+    }
+    if(assetCount >= ASSET_MAX_ENTRIES)
+    {
+      LOG_WARN("asset index full");
+      break;
+    }
+    if(parseLine(line, assets[assetCount]))
+    {
+      assetCount++;
+    }
+    else
+    {
+      LOG_WARN("asset index: bad line '%s'", line);
+    }
+  }
+  file.close();
+
+  LOG_INFO("asset index: %u assets", assetCount);
+  return assetCount;
+}
+
+assetEntry_t* tallyBoxAssetFind(const char *path)
+{
+  for(uint8_t i = 0; i < assetCount; i++)
+  {
+    if(strcmp(assets[i].path, path) == 0)
+    {
+      return &assets[i];
+    }
+  }
+  return NULL;
+}
+
+/*drops the entry of a file replaced or removed at runtime, path may be given with or without .gz*/
+bool tallyBoxAssetForget(const char *path)
+{
+  bool ret = false;
+
+  for(uint8_t i = 0; i < assetCount; i++)
+  {
+    size_t len = strlen(assets[i].path);
+
+    if((strncmp(assets[i].path, path, len) == 0)
+       && ((path[len] == 0) || (strcmp(path + len, ".gz") == 0)))
+    {
+      assets[i] = assets[--assetCount];
+      ret = true;
+      break;
+    }
+  }
+  return ret;
+}
+
+uint8_t tallyBoxAssetCount()
+{
+  return assetCount;
+}
+
+assetEntry_t& tallyBoxAssetGet(uint8_t index)
+{
+  return assets[index];
+}
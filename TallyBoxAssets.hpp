@@ -0,0 +1,34 @@
+#ifndef __TALLYBOXASSETS_HPP__
+#define __TALLYBOXASSETS_HPP__
+#include "Arduino.h"
+#include <FS.h>
+
+/*index of the precompressed static assets (tools/assets/bundle_assets.py). The index is read
+  once at startup, afterwards a request for an asset is answered without probing the filesystem:
+  the content is stored as <path>.gz and the etag is the crc32 of the uncompressed content.*/
+
+#define ASSET_INDEX_FILE        "/assets.idx"
+#define ASSET_MAX_ENTRIES       16
+#define ASSET_MAX_PATH          32
+#define ASSET_MAX_CONTENT_TYPE  28
+#define ASSET_CACHE_CONTROL     "max-age=86400"   /*urls are not versioned, revalidated with the etag after a day*/
+
+typedef struct
+{
+  char path[ASSET_MAX_PATH];                  /*url, e.g. /tallybox.css*/
+  char etag[11];                              /*quoted, as sent in the header*/
+  char contentType[ASSET_MAX_CONTENT_TYPE];
+  uint32_t size;                              /*compressed size*/
+  uint32_t requests;
+  uint32_t notModified;                       /*answered with 304*/
+  uint32_t bytesSent;
+  uint32_t lastRequestMs;
+} assetEntry_t;
+
+uint8_t tallyBoxAssetsInitialize(FS& fs);
+assetEntry_t* tallyBoxAssetFind(const char *path);
+bool tallyBoxAssetForget(const char *path);
+uint8_t tallyBoxAssetCount();
+assetEntry_t& tallyBoxAssetGet(uint8_t index);
+
+#endif
@@ -0,0 +1,179 @@
+#include "TallyBoxConfigJournal.hpp"
+#include "Arduino.h"
+
+static configJournalStats_t myStats = {};
+
+static bool generationIsNewer(uint32_t candidate, uint32_t reference)
+{
+  /*serial number arithmetic: survives the wrap-around of the counter*/
+  return ((int32_t)(candidate - reference) > 0);
+}
+
+static bool readSlot(const configJournalBackend_t& b, configRecordType_t type, uint8_t slot, uint8_t *buf, configJournalRecord_t& rec)
+{
+  bool ret = false;
+  uint16_t len = b.readSlot(b.ctx, type, slot, buf, CONFIG_RECORD_MAX_SIZE);
+
+  if(len > 0)
+  {
+    if(configRecordDecode(type, buf, len, rec.schemaVersion, rec.generation, rec.payload, rec.payloadLen))
+    {
+      rec.slot = slot;
+      ret = true;
+    }
+  }
+  return ret;
+}
+
+bool configJournalLoad(const configJournalBackend_t& b, configRecordType_t type, configJournalBuffer_t& buf, configJournalRecord_t& rec)
+{
+  bool ret = false;
+
+  for(uint8_t slot = 0; slot < CONFIG_JOURNAL_SLOTS; slot++)
+  {
+    configJournalRecord_t candidate;
+
+    if(readSlot(b, type, slot, buf.slot[slot], candidate))
+    {
+      if(!ret || generationIsNewer(candidate.generation, rec.generation))
+      {
+        rec = candidate;
+        ret = true;
+      }
+    }
+  }
+
+  return ret;
+}
+
+static void updateStats(bool success, uint32_t elapsed)
+{
+  myStats.lastCommitTimeUs = elapsed;
+  myStats.worstCommitTimeUs = max(myStats.worstCommitTimeUs, elapsed);
+  if(success)
+  {
+    myStats.commits++;
+  }
+  else
+  {
+    myStats.failedCommits++;
+  }
+}
+
+static bool selectTarget(const configJournalBackend_t& b, configRecordType_t type, configJournalBuffer_t& buf, uint8_t& target, uint32_t& generation)
+{
+  configJournalRecord_t active;
+
+  target = 0;
+  generation = 1;
+
+  /*the slot holding the newest valid record is never touched*/
+  if(configJournalLoad(b, type, buf, active))
+  {
+    target = (active.slot + 1) % CONFIG_JOURNAL_SLOTS;
+    generation = active.generation + 1;
+  }
+  return true;
+}
+
+static bool writeTarget(const configJournalBackend_t& b, configRecordType_t type, uint8_t schemaVersion, uint32_t generation, const uint8_t *payload, uint16_t payloadLen, uint8_t target, configJournalBuffer_t& buf)
+{
+  uint8_t *record = buf.slot[target];
+  uint16_t len = configRecordEncode(type, schemaVersion, generation, payload, payloadLen, record, CONFIG_RECORD_MAX_SIZE);
+
+  return ((len > 0) && b.writeSlot(b.ctx, type, target, record, len));
+}
+
+static bool verifyTarget(const configJournalBackend_t& b, configRecordType_t type, uint32_t generation, const uint8_t *payload, uint16_t payloadLen, uint8_t target, configJournalBuffer_t& buf)
+{
+  bool ret = false;
+  /*read back into the other buffer*/
+  uint8_t *verifyBuf = buf.slot[(target + 1) % CONFIG_JOURNAL_SLOTS];
+  configJournalRecord_t written;
+
+  if(readSlot(b, type, target, verifyBuf, written))
+  {
+    ret = ((written.generation == generation)
+            && (written.payloadLen == payloadLen)
+            && (memcmp(written.payload, payload, payloadLen) == 0));
+  }
+  return ret;
+}
+
+bool configJournalCommit(const configJournalBackend_t& b, configRecordType_t type, uint8_t schemaVersion, const uint8_t *payload, uint16_t payloadLen, configJournalBuffer_t& buf)
+{
+  uint32_t startedAt = micros();
+  uint8_t target;
+  uint32_t generation;
+
+  bool ret = (selectTarget(b, type, buf, target, generation)
+              && writeTarget(b, type, schemaVersion, generation, payload, payloadLen, target, buf)
+              && verifyTarget(b, type, generation, payload, payloadLen, target, buf));
+
+  updateStats(ret, micros() - startedAt);
+
+  return ret;
+}
+
+bool configJournalCommitStart(configJournalCommit_t& cm, configRecordType_t type, uint8_t schemaVersion, const uint8_t *payload, uint16_t payloadLen)
+{
+  bool ret = false;
+
+  if(payloadLen <= CONFIG_RECORD_MAX_PAYLOAD_SIZE)
+  {
+    cm.type = type;
+    cm.schemaVersion = schemaVersion;
+    memcpy(cm.payload, payload, payloadLen);  /*snapshot: later changes go to the next commit*/
+    cm.payloadLen = payloadLen;
+    cm.step = CONFIG_JOURNAL_STEP_SELECT;
+    cm.busyUs = 0;
+    ret = true;
+  }
+  return ret;
+}
+
+configJournalStep_t configJournalCommitStep(const configJournalBackend_t& b, configJournalCommit_t& cm)
+{
+  bool ok = true;
+  uint32_t stepStartedAt = micros();
+
+  switch(cm.step)
+  {
+    case CONFIG_JOURNAL_STEP_SELECT:
+      ok = selectTarget(b, cm.type, cm.buf, cm.target, cm.generation);
+      cm.step = CONFIG_JOURNAL_STEP_WRITE;
+      break;
+
+    case CONFIG_JOURNAL_STEP_WRITE:
+      ok = writeTarget(b, cm.type, cm.schemaVersion, cm.generation, cm.payload, cm.payloadLen, cm.target, cm.buf);
+      cm.step = CONFIG_JOURNAL_STEP_VERIFY;
+      break;
+
+    case CONFIG_JOURNAL_STEP_VERIFY:
+      ok = verifyTarget(b, cm.type, cm.generation, cm.payload, cm.payloadLen, cm.target, cm.buf);
+      cm.step = CONFIG_JOURNAL_STEP_DONE;
+      break;
+
+    default:
+      break;
+  }
+
+  cm.busyUs += (micros() - stepStartedAt);
+
+  if(!ok)
+  {
+    cm.step = CONFIG_JOURNAL_STEP_FAILED;
+    updateStats(false, cm.busyUs);
+  }
+  else if(cm.step == CONFIG_JOURNAL_STEP_DONE)
+  {
+    updateStats(true, cm.busyUs);
+  }
+
+  return cm.step;
+}
+
+const configJournalStats_t& configJournalGetStats()
+{
+  return myStats;
+}
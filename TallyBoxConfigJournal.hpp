@@ -0,0 +1,75 @@
+#ifndef __TALLYBOXCONFIGJOURNAL_HPP__
+#define __TALLYBOXCONFIGJOURNAL_HPP__
+#include "Arduino.h"
+#include "TallyBoxConfigRecord.hpp"
+
+/*A/B journal: every record type has two slots. A commit always writes the slot that does not
+  hold the newest valid record, using the next generation number, and reads it back for
+  verification. The newest valid generation wins at load time, so an interrupted commit leaves
+  the previous record in use.*/
+
+#define CONFIG_JOURNAL_SLOTS      2
+
+typedef struct
+{
+  /*reads a whole slot, returns the number of bytes read (0 = missing or empty)*/
+  uint16_t (*readSlot)(void *ctx, configRecordType_t type, uint8_t slot, uint8_t *buf, uint16_t maxLen);
+  /*replaces the content of a slot, returns true if all bytes were written*/
+  bool (*writeSlot)(void *ctx, configRecordType_t type, uint8_t slot, const uint8_t *buf, uint16_t len);
+  void *ctx;
+} configJournalBackend_t;
+
+typedef struct
+{
+  uint8_t slot[CONFIG_JOURNAL_SLOTS][CONFIG_RECORD_MAX_SIZE];
+} configJournalBuffer_t;
+
+typedef struct
+{
+  uint8_t slot;
+  uint32_t generation;
+  uint8_t schemaVersion;
+  uint8_t *payload;       /*points into the journal buffer*/
+  uint16_t payloadLen;
+} configJournalRecord_t;
+
+typedef enum
+{
+  CONFIG_JOURNAL_STEP_SELECT,     /*read both slots, pick the target slot and the generation*/
+  CONFIG_JOURNAL_STEP_WRITE,      /*write the record to the target slot*/
+  CONFIG_JOURNAL_STEP_VERIFY,     /*read back and compare*/
+  CONFIG_JOURNAL_STEP_DONE,
+  CONFIG_JOURNAL_STEP_FAILED
+} configJournalStep_t;
+
+/*state of a commit that is executed one step at a time*/
+typedef struct
+{
+  configRecordType_t type;
+  uint8_t schemaVersion;
+  uint8_t payload[CONFIG_RECORD_MAX_PAYLOAD_SIZE];
+  uint16_t payloadLen;
+  configJournalStep_t step;
+  uint8_t target;
+  uint32_t generation;
+  uint32_t busyUs;        /*time spent in the steps, idle gaps between them excluded*/
+  configJournalBuffer_t buf;
+} configJournalCommit_t;
+
+typedef struct
+{
+  uint32_t commits;
+  uint32_t failedCommits;
+  uint32_t lastCommitTimeUs;
+  uint32_t worstCommitTimeUs;
+} configJournalStats_t;
+
+bool configJournalLoad(const configJournalBackend_t& b, configRecordType_t type, configJournalBuffer_t& buf, configJournalRecord_t& rec);
+bool configJournalCommit(const configJournalBackend_t& b, configRecordType_t type, uint8_t schemaVersion, const uint8_t *payload, uint16_t payloadLen, configJournalBuffer_t& buf);
+
+/*the same commit split into bounded steps, for running it from idle time*/
+bool configJournalCommitStart(configJournalCommit_t& cm, configRecordType_t type, uint8_t schemaVersion, const uint8_t *payload, uint16_t payloadLen);
+configJournalStep_t configJournalCommitStep(const configJournalBackend_t& b, configJournalCommit_t& cm);
+const configJournalStats_t& configJournalGetStats();
+
+#endif
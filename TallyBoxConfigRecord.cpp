@@ -0,0 +1,71 @@
+#include "TallyBoxConfigRecord.hpp"
+#include "TallyBoxInfra.hpp"
+#include "Arduino.h"
+#include <Arduino_CRC32.h>
+
+uint16_t configRecordEncode(configRecordType_t type, uint8_t schemaVersion, uint32_t generation, const uint8_t *payload, uint16_t payloadLen, uint8_t *buf, uint16_t maxLen)
+{
+  uint16_t ret = 0;
+  uint16_t recordLen = CONFIG_RECORD_HEADER_SIZE + payloadLen + CONFIG_RECORD_FOOTER_SIZE;
+  Arduino_CRC32 crc32;
+
+  if((payloadLen <= CONFIG_RECORD_MAX_PAYLOAD_SIZE) && (maxLen >= recordLen))
+  {
+    uint8_t *p = buf;
+
+    /*header*/
+    putU32(&p, CONFIG_RECORD_IDENTIFIER_U32);
+    putU8(&p, (uint8_t)type);
+    putU8(&p, schemaVersion);
+    putU16(&p, payloadLen);
+    putU32(&p, generation);
+
+    /*payload*/
+    putBytes(&p, payload, payloadLen);
+
+    /*crc*/
+    uint32_t crc = crc32.calc(buf, CONFIG_RECORD_HEADER_SIZE + payloadLen);
+    putU32(&p, crc);
+
+    ret = recordLen;
+  }
+
+  return ret;
+}
+
+bool configRecordDecode(configRecordType_t type, uint8_t *buf, uint16_t len, uint8_t& schemaVersion, uint32_t& generation, uint8_t*& payload, uint16_t& payloadLen)
+{
+  bool ret = false;
+  Arduino_CRC32 crc32;
+
+  if(len >= CONFIG_RECORD_HEADER_SIZE + CONFIG_RECORD_FOOTER_SIZE)
+  {
+    uint8_t *p = buf;
+
+    if((getU32(&p) == CONFIG_RECORD_IDENTIFIER_U32) && (getU8(&p) == (uint8_t)type))
+    {
+      uint8_t version = getU8(&p);
+      uint16_t dataLen = getU16(&p);
+      uint32_t recordGeneration = getU32(&p);
+
+      /*the length field is checked before it is trusted for the crc range*/
+      if((dataLen <= CONFIG_RECORD_MAX_PAYLOAD_SIZE) && (len >= CONFIG_RECORD_HEADER_SIZE + dataLen + CONFIG_RECORD_FOOTER_SIZE))
+      {
+        uint8_t *crcPtr = p + dataLen;
+        uint32_t calculatedCrc = crc32.calc(buf, CONFIG_RECORD_HEADER_SIZE + dataLen);
+        uint32_t receivedCrc = getU32(&crcPtr);
+
+        if(receivedCrc == calculatedCrc)
+        {
+          schemaVersion = version;
+          generation = recordGeneration;
+          payload = p;
+          payloadLen = dataLen;
+          ret = true;
+        }
+      }
+    }
+  }
+
+  return ret;
+}
@@ -0,0 +1,23 @@
+#ifndef __TALLYBOXCONFIGRECORD_HPP__
+#define __TALLYBOXCONFIGRECORD_HPP__
+#include "Arduino.h"
+
+#define CONFIG_RECORD_IDENTIFIER_U32        0x54424346    /*'TBCF'*/
+#define CONFIG_RECORD_HEADER_SIZE           12
+#define CONFIG_RECORD_FOOTER_SIZE           4
+#define CONFIG_RECORD_MAX_PAYLOAD_SIZE      196     /*fleet profile: 12 user entries of 16 bytes*/
+#define CONFIG_RECORD_MAX_SIZE              (CONFIG_RECORD_HEADER_SIZE+CONFIG_RECORD_MAX_PAYLOAD_SIZE+CONFIG_RECORD_FOOTER_SIZE)
+
+typedef enum
+{
+  CONFIG_RECORD_NETWORK = 1,
+  CONFIG_RECORD_USER = 2,
+  CONFIG_RECORD_FLEET = 3
+} configRecordType_t;
+
+/*record layout: identifier(4) | type(1) | schema version(1) | payload length(2) | generation(4) | payload | crc32(4)
+  the crc covers everything before it*/
+uint16_t configRecordEncode(configRecordType_t type, uint8_t schemaVersion, uint32_t generation, const uint8_t *payload, uint16_t payloadLen, uint8_t *buf, uint16_t maxLen);
+bool configRecordDecode(configRecordType_t type, uint8_t *buf, uint16_t len, uint8_t& schemaVersion, uint32_t& generation, uint8_t*& payload, uint16_t& payloadLen);
+
+#endif
@@ -0,0 +1,715 @@
+#include "TallyBoxConfigSchema.hpp"
+#include "TallyBoxConfiguration.hpp"
+#include "TallyBoxOutput.hpp"   /*for default brightness*/
+#include "TallyBoxPeerCodec.hpp" /*inputs in the tally masks*/
+#include "TallyBoxInfra.hpp"
+#include "Arduino.h"
+#include <type_traits>
+
+/*the fields are found with offsetof, which is defined for standard layout structs only*/
+static_assert(std::is_standard_layout<tallyBoxNetworkConfig_t>::value, "network configuration must be standard layout");
+static_assert(std::is_standard_layout<tallyBoxUserConfig_t>::value, "user configuration must be standard layout");
+
+static const confField_t networkConfigFields[] =
+{
+  CONF_FIELD(tallyBoxNetworkConfig_t, wifiSSID,       CONF_FIELD_STRING,    "WifiSSID",          0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_SSID,     CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, wifiPasswd,     CONF_FIELD_STRING,    "Password",          0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_PASSWD,   CONF_FIELD_FLAG_SECRET),
+  CONF_FIELD(tallyBoxNetworkConfig_t, isMaster,       CONF_FIELD_BOOL,      "Master Device",     0, 1, TALLYBOX_CONFIGURATION_DEFAULT_ISMASTER, NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, hostAddress,    CONF_FIELD_IPADDRESS, "ATEM Host IP",      0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_HOSTIP,   CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, ownAddress,     CONF_FIELD_IPADDRESS, "Own IP",            0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_OWNIP,    CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, subnetMask,     CONF_FIELD_IPADDRESS, "Subnet mask",       0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_SUBNET,   CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, defaultGateway, CONF_FIELD_IPADDRESS, "Default gateway",   0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_GATEWAY,  CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, hasStaticIp,    CONF_FIELD_BOOL,      "Uses Static IP",    0, 1, TALLYBOX_CONFIGURATION_DEFAULT_HASOWNIP, NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, mdnsHostName,   CONF_FIELD_STRING,    "MDNS Host Name",    0, 0, 0, "tallybox",                              CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, switcherAddress2, CONF_FIELD_IPADDRESS, "Switcher 2 IP",   0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_SWITCHERIP, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, switcherAddress3, CONF_FIELD_IPADDRESS, "Switcher 3 IP",   0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_SWITCHERIP, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, switcherMergeRule, CONF_FIELD_U16,      "Switcher Merge",    0, 2, TALLYBOX_CONFIGURATION_DEFAULT_MERGERULE, NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, switcherProtocol, CONF_FIELD_U16,      "Switcher Protocol", 0, 1, TALLYBOX_CONFIGURATION_DEFAULT_PROTOCOL, NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, tslFirstCamera,   CONF_FIELD_U16,      "TSL First Camera",  0, 9999, TALLYBOX_CONFIGURATION_DEFAULT_TSLCAMERA, NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, umdDestination1,  CONF_FIELD_STRING,   "UMD Destination 1", 0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_UMD,     CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, umdDestination2,  CONF_FIELD_STRING,   "UMD Destination 2", 0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_UMD,     CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, umdDestination3,  CONF_FIELD_STRING,   "UMD Destination 3", 0, 0, 0, TALLYBOX_CONFIGURATION_DEFAULT_UMD,     CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxNetworkConfig_t, umdIntervalMs,    CONF_FIELD_U16,      "UMD Interval ms",   10, 1000, TALLYBOX_CONFIGURATION_DEFAULT_UMD_INTERVAL, NULL, CONF_FIELD_FLAG_NONE),
+};
+
+static const confField_t userConfigFields[] =
+{
+  CONF_FIELD(tallyBoxUserConfig_t, cameraId,               CONF_FIELD_U16,     "Camera ID",         1, 9999, TALLYBOX_CONFIGURATION_DEFAULT_CAMERA_ID, NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxUserConfig_t, greenBrightnessPercent, CONF_FIELD_PERCENT, "Green Brightness",  0, 100,  DEFAULT_GREEN_BRIGHTNESS_PCT,             NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxUserConfig_t, redBrightnessPercent,   CONF_FIELD_PERCENT, "Red Brightness",    0, 100,  DEFAULT_RED_BRIGHTNESS_PCT,               NULL, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxUserConfig_t, watchedInputs,          CONF_FIELD_INPUTSET, "Watched Inputs",   1, PEERNETWORK_TALLY_MASK_INPUTS, 0, TALLYBOX_CONFIGURATION_DEFAULT_WATCHED, CONF_FIELD_FLAG_NONE),
+  CONF_FIELD(tallyBoxUserConfig_t, watchRule,              CONF_FIELD_U16,     "Watch Rule",        0, 2,    TALLYBOX_CONFIGURATION_DEFAULT_WATCH_RULE, NULL, CONF_FIELD_FLAG_NONE),
+};
+
+const confSchema_t networkConfigSchema = {"Network", networkConfigFields, sizeof(networkConfigFields)/sizeof(networkConfigFields[0])};
+const confSchema_t userConfigSchema = {"User", userConfigFields, sizeof(userConfigFields)/sizeof(userConfigFields[0])};
+
+
+static uint8_t* fieldPtr(const confField_t& f, void *base)
+{
+  return ((uint8_t*)base) + f.offset;
+}
+
+static const uint8_t* fieldPtr(const confField_t& f, const void *base)
+{
+  return ((const uint8_t*)base) + f.offset;
+}
+
+static uint16_t fieldBinarySize(const confField_t& f)
+{
+  uint16_t ret = 0;
+
+  switch(f.type)
+  {
+    case CONF_FIELD_BOOL:      ret = 1; break;
+    case CONF_FIELD_U16:       ret = 2; break;
+    case CONF_FIELD_PERCENT:   ret = 2; break;
+    case CONF_FIELD_STRING:    ret = f.size; break;
+    case CONF_FIELD_IPADDRESS: ret = 4; break;
+    case CONF_FIELD_INPUTSET:  ret = 8; break;
+  }
+  return ret;
+}
+
+static bool parseIpAddress(const char *text, uint8_t octets[4])
+{
+  const char *p = text;
+
+  for(int i = 0; i < 4; i++)
+  {
+    char *end;
+    long value;
+
+    if((*p < '0') || (*p > '9'))
+    {
+      return false;
+    }
+    value = strtol(p, &end, 10);
+    if((value > 255) || (end == p))
+    {
+      return false;
+    }
+    if(i < 3)
+    {
+      if(*end != '.')
+      {
+        return false;
+      }
+      end++;
+    }
+    octets[i] = (uint8_t)value;
+    p = end;
+  }
+
+  return (*p == 0);
+}
+
+/*"1,5,12-14": inputs and ranges of inputs, an empty text is the empty set*/
+static bool parseInputSet(const char *text, int32_t maxInput, uint64_t& mask)
+{
+  const char *p = text;
+
+  mask = 0;
+  while(*p)
+  {
+    char *end;
+    long first;
+    long last;
+
+    if((*p < '0') || (*p > '9'))
+    {
+      return false;
+    }
+    first = strtol(p, &end, 10);
+    last = first;
+    if(*end == '-')
+    {
+      p = end + 1;
+      if((*p < '0') || (*p > '9'))
+      {
+        return false;
+      }
+      last = strtol(p, &end, 10);
+    }
+    if((first < 1) || (last < first) || (last > maxInput))
+    {
+      return false;
+    }
+    for(long i = first; i <= last; i++)
+    {
+      mask |= (1ULL << (i - 1));
+    }
+    if(*end == ',')
+    {
+      end++;
+      if(*end == 0)
+      {
+        return false;
+      }
+    }
+    else if(*end != 0)
+    {
+      return false;
+    }
+    p = end;
+  }
+  return true;
+}
+
+static int formatInputSet(uint64_t mask, char *out, size_t maxLen)
+{
+  int len = 0;
+
+  out[0] = 0;
+  for(int i = 0; (i < 64) && (len < (int)maxLen); i++)
+  {
+    if(mask & (1ULL << i))
+    {
+      int last = i;
+
+      while((last < 63) && (mask & (1ULL << (last + 1))))
+      {
+        last++;
+      }
+      if(last > i + 1)
+      {
+        len += snprintf(out + len, maxLen - len, "%s%d-%d", (len ? "," : ""), i + 1, last + 1);
+      }
+      else
+      {
+        len += snprintf(out + len, maxLen - len, "%s%d", (len ? "," : ""), i + 1);
+        last = i;
+      }
+      i = last;
+    }
+  }
+  return len;
+}
+
+const confField_t* confFindField(const confSchema_t& schema, const char *name)
+{
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    if(strcmp(schema.fields[i].name, name) == 0)
+    {
+      return &schema.fields[i];
+    }
+  }
+  return NULL;
+}
+
+static void setFieldDefault(const confField_t& f, void *base)
+{
+  uint8_t *p = fieldPtr(f, base);
+
+  switch(f.type)
+  {
+    case CONF_FIELD_BOOL:
+      *(bool*)p = (f.defaultNumber != 0);
+      break;
+    case CONF_FIELD_U16:
+      *(uint16_t*)p = (uint16_t)f.defaultNumber;
+      break;
+    case CONF_FIELD_PERCENT:
+      *(float*)p = (float)f.defaultNumber;
+      break;
+    case CONF_FIELD_STRING:
+    case CONF_FIELD_IPADDRESS:
+    case CONF_FIELD_INPUTSET:
+      if(!confFieldParse(f, base, f.defaultText))
+      {
+        memset(p, 0, f.size);
+      }
+      break;
+  }
+}
+
+void confSetDefaults(const confSchema_t& schema, void *base)
+{
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    setFieldDefault(schema.fields[i], base);
+  }
+}
+
+bool confFieldParse(const confField_t& f, void *base, const char *text)
+{
+  bool ret = false;
+  uint8_t *p = fieldPtr(f, base);
+  char *end;
+
+  if(text == NULL)
+  {
+    return false;
+  }
+
+  switch(f.type)
+  {
+    case CONF_FIELD_BOOL:
+      if((strcmp(text, "1") == 0) || (strcmp(text, "true") == 0) || (strcmp(text, "on") == 0) || (strcmp(text, f.name) == 0))
+      {
+        *(bool*)p = true;
+        ret = true;
+      }
+      else if((text[0] == 0) || (strcmp(text, "0") == 0) || (strcmp(text, "false") == 0) || (strcmp(text, "off") == 0))
+      {
+        *(bool*)p = false;
+        ret = true;
+      }
+      break;
+
+    case CONF_FIELD_U16:
+    {
+      long value = strtol(text, &end, 10);
+      if((end != text) && (*end == 0) && (value >= f.minValue) && (value <= f.maxValue))
+      {
+        *(uint16_t*)p = (uint16_t)value;
+        ret = true;
+      }
+      break;
+    }
+
+    case CONF_FIELD_PERCENT:
+    {
+      double value = strtod(text, &end);
+      if((end != text) && (*end == 0) && (value >= f.minValue) && (value <= f.maxValue))
+      {
+        *(float*)p = (float)(round(value * 100.0) / 100.0);  /*resolution of the binary record*/
+        ret = true;
+      }
+      break;
+    }
+
+    case CONF_FIELD_STRING:
+      if(strlen(text) < f.size)
+      {
+        strlcpy((char*)p, text, f.size);
+        ret = true;
+      }
+      break;
+
+    case CONF_FIELD_IPADDRESS:
+    {
+      uint8_t octets[4];
+      if(parseIpAddress(text, octets))
+      {
+        *(uint32_t*)p = (uint32_t)IPAddress(octets[0], octets[1], octets[2], octets[3]);
+        ret = true;
+      }
+      break;
+    }
+
+    case CONF_FIELD_INPUTSET:
+    {
+      uint64_t mask;
+      char formatted[CONF_TEXT_MAX_LEN];
+
+      /*the set has to show in full wherever it is formatted*/
+      if(parseInputSet(text, f.maxValue, mask) && (formatInputSet(mask, formatted, sizeof(formatted)) < (int)sizeof(formatted)))
+      {
+        *(uint64_t*)p = mask;
+        ret = true;
+      }
+      break;
+    }
+  }
+
+  return ret;
+}
+
+size_t confFieldFormat(const confField_t& f, const void *base, char *out, size_t maxLen)
+{
+  const uint8_t *p = fieldPtr(f, base);
+  int len = 0;
+
+  switch(f.type)
+  {
+    case CONF_FIELD_BOOL:
+      len = snprintf(out, maxLen, "%s", (*(const bool*)p ? "true" : "false"));
+      break;
+
+    case CONF_FIELD_U16:
+      len = snprintf(out, maxLen, "%u", *(const uint16_t*)p);
+      break;
+
+    case CONF_FIELD_PERCENT:
+      len = snprintf(out, maxLen, "%.2f", *(const float*)p);
+      /*drop the trailing zeros: 80.00 -> 80, 12.50 -> 12.5*/
+      while((len > 0) && (len < (int)maxLen) && (out[len-1] == '0'))
+      {
+        out[--len] = 0;
+      }
+      if((len > 0) && (len < (int)maxLen) && (out[len-1] == '.'))
+      {
+        out[--len] = 0;
+      }
+      break;
+
+    case CONF_FIELD_STRING:
+      len = snprintf(out, maxLen, "%s", (const char*)p);
+      break;
+
+    case CONF_FIELD_IPADDRESS:
+    {
+      IPAddress ip(*(const uint32_t*)p);
+      len = snprintf(out, maxLen, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+      break;
+    }
+
+    case CONF_FIELD_INPUTSET:
+      len = formatInputSet(*(const uint64_t*)p, out, maxLen);
+      break;
+  }
+
+  return (len < 0 ? 0 : min((size_t)len, maxLen-1));
+}
+
+void confDump(const confSchema_t& schema, const void *base, Print& out)
+{
+  char value[CONF_TEXT_MAX_LEN];
+
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    const confField_t& f = schema.fields[i];
+
+    if(f.flags & CONF_FIELD_FLAG_SECRET)
+    {
+      strlcpy(value, "<not shown>", sizeof(value));
+    }
+    else
+    {
+      confFieldFormat(f, base, value, sizeof(value));
+    }
+    out.printf(" - %-18s = %s\r\n", f.label, value);
+  }
+}
+
+uint16_t confBinarySize(const confSchema_t& schema)
+{
+  uint16_t size = 0;
+
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    size += fieldBinarySize(schema.fields[i]);
+  }
+  return size;
+}
+
+uint16_t confSerializeBinary(const confSchema_t& schema, const void *base, uint8_t *buf, uint16_t maxLen)
+{
+  uint8_t *p = buf;
+
+  if(maxLen < confBinarySize(schema))
+  {
+    return 0;
+  }
+
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    const confField_t& f = schema.fields[i];
+    const uint8_t *v = fieldPtr(f, base);
+
+    switch(f.type)
+    {
+      case CONF_FIELD_BOOL:
+        putU8(&p, *(const bool*)v);
+        break;
+      case CONF_FIELD_U16:
+        putU16(&p, *(const uint16_t*)v);
+        break;
+      case CONF_FIELD_PERCENT:
+        putU16(&p, (uint16_t)round(*(const float*)v * 100.0));
+        break;
+      case CONF_FIELD_STRING:
+      {
+        /*fixed size, zero padded to keep the record (and its crc) deterministic*/
+        uint16_t len = strnlen((const char*)v, f.size-1);
+        putBytes(&p, v, len);
+        memset(p, 0, f.size-len);
+        p += (f.size-len);
+        break;
+      }
+      case CONF_FIELD_IPADDRESS:
+        putU32(&p, *(const uint32_t*)v);
+        break;
+      case CONF_FIELD_INPUTSET:
+        putU32(&p, (uint32_t)(*(const uint64_t*)v >> 32));
+        putU32(&p, (uint32_t)*(const uint64_t*)v);
+        break;
+    }
+  }
+
+  return (uint16_t)(p - buf);
+}
+
+bool confDeSerializeBinary(const confSchema_t& schema, void *base, uint8_t *buf, uint16_t len)
+{
+  uint8_t *p = buf;
+  uint16_t remaining = len;
+  bool ret = true;
+
+  /*fields missing from an older record keep their defaults*/
+  confSetDefaults(schema, base);
+
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    const confField_t& f = schema.fields[i];
+    uint16_t fieldSize = fieldBinarySize(f);
+    uint8_t *v = fieldPtr(f, base);
+
+    if(remaining < fieldSize)
+    {
+      /*a record ending in the middle of a field is not a record of this schema*/
+      ret = (remaining == 0);
+      break;
+    }
+    remaining -= fieldSize;
+
+    switch(f.type)
+    {
+      case CONF_FIELD_BOOL:
+        *(bool*)v = (getU8(&p) != 0);
+        break;
+      case CONF_FIELD_U16:
+      {
+        uint16_t value = getU16(&p);
+        if((value < f.minValue) || (value > f.maxValue))
+        {
+          return false;
+        }
+        *(uint16_t*)v = value;
+        break;
+      }
+      case CONF_FIELD_PERCENT:
+      {
+        uint16_t value = getU16(&p);
+        if(value > f.maxValue * 100)
+        {
+          return false;
+        }
+        *(float*)v = (float)value / 100.0;
+        break;
+      }
+      case CONF_FIELD_STRING:
+        getBytes(&p, v, f.size);
+        v[f.size-1] = 0;
+        break;
+      case CONF_FIELD_IPADDRESS:
+        *(uint32_t*)v = getU32(&p);
+        break;
+      case CONF_FIELD_INPUTSET:
+        *(uint64_t*)v = (uint64_t)getU32(&p) << 32;
+        *(uint64_t*)v |= getU32(&p);
+        break;
+    }
+  }
+
+  return ret;
+}
+
+static size_t appendText(char *out, size_t maxLen, size_t pos, const char *text)
+{
+  size_t len = strlen(text);
+
+  if(pos + len < maxLen)
+  {
+    memcpy(out + pos, text, len + 1);
+    pos += len;
+  }
+  else
+  {
+    pos = maxLen;   /*overflow marker*/
+  }
+  return pos;
+}
+
+static size_t appendJsonString(char *out, size_t maxLen, size_t pos, const char *text)
+{
+  char esc[3] = {'\\', 0, 0};
+
+  pos = appendText(out, maxLen, pos, "\"");
+  for(const char *c = text; *c && (pos < maxLen); c++)
+  {
+    if((*c == '"') || (*c == '\\'))
+    {
+      esc[1] = *c;
+      pos = appendText(out, maxLen, pos, esc);
+    }
+    else if((uint8_t)*c >= 0x20)
+    {
+      char single[2] = {*c, 0};
+      pos = appendText(out, maxLen, pos, single);
+    }
+  }
+  return appendText(out, maxLen, pos, "\"");
+}
+
+size_t confSerializeJsonFields(const confSchema_t& schema, const void *base, const char *indent, char *out, size_t maxLen)
+{
+  char value[CONF_TEXT_MAX_LEN];
+  size_t pos = 0;
+
+  out[0] = 0;
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    const confField_t& f = schema.fields[i];
+
+    confFieldFormat(f, base, value, sizeof(value));
+
+    pos = appendText(out, maxLen, pos, (i == 0 ? "" : ",\r\n"));
+    pos = appendText(out, maxLen, pos, indent);
+    pos = appendText(out, maxLen, pos, "\"");
+    pos = appendText(out, maxLen, pos, f.name);
+    pos = appendText(out, maxLen, pos, "\": ");
+    if((f.type == CONF_FIELD_STRING) || (f.type == CONF_FIELD_IPADDRESS) || (f.type == CONF_FIELD_INPUTSET))
+    {
+      pos = appendJsonString(out, maxLen, pos, value);
+    }
+    else
+    {
+      pos = appendText(out, maxLen, pos, value);
+    }
+  }
+
+  /*zero length: did not fit*/
+  return (pos < maxLen ? pos : 0);
+}
+
+size_t confSerializeJson(const confSchema_t& schema, const void *base, uint8_t version, char *out, size_t maxLen)
+{
+  char value[CONF_TEXT_MAX_LEN];
+  size_t pos = 0;
+  size_t len;
+
+  snprintf(value, sizeof(value), "%u", version);
+  pos = appendText(out, maxLen, pos, "{\r\n  \"versionOfConfiguration\": ");
+  pos = appendText(out, maxLen, pos, value);
+  pos = appendText(out, maxLen, pos, ",\r\n");
+
+  if(pos >= maxLen)
+  {
+    return 0;
+  }
+
+  len = confSerializeJsonFields(schema, base, "  ", out + pos, maxLen - pos);
+  if(len == 0)
+  {
+    return 0;
+  }
+  pos = appendText(out, maxLen, pos + len, "\r\n}");
+
+  /*zero length: did not fit*/
+  return (pos < maxLen ? pos : 0);
+}
+
+uint8_t confParseForm(const confSchema_t& schema, void *base, confArgLookup_t lookup, void *ctx)
+{
+  uint8_t rejected = 0;
+  char value[CONF_TEXT_MAX_LEN + 8];
+
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    const confField_t& f = schema.fields[i];
+
+    if(lookup(ctx, f.name, value, sizeof(value)))
+    {
+      if(!confFieldParse(f, base, value))
+      {
+        rejected++;
+      }
+    }
+    else if(f.type == CONF_FIELD_BOOL)
+    {
+      /*unchecked check boxes are not posted at all*/
+      *(bool*)fieldPtr(f, base) = false;
+    }
+  }
+  return rejected;
+}
+
+static size_t escapeHtml(const char *text, char *out, size_t maxLen)
+{
+  size_t pos = 0;
+
+  out[0] = 0;
+  for(const char *c = text; *c; c++)
+  {
+    const char *entity = NULL;
+
+    switch(*c)
+    {
+      case '&':  entity = "&amp;"; break;
+      case '<':  entity = "&lt;"; break;
+      case '>':  entity = "&gt;"; break;
+      case '"':  entity = "&quot;"; break;
+      case '\'': entity = "&#39;"; break;
+      default: break;
+    }
+
+    if(entity)
+    {
+      pos = appendText(out, maxLen, pos, entity);
+    }
+    else
+    {
+      char single[2] = {*c, 0};
+      pos = appendText(out, maxLen, pos, single);
+    }
+
+    if(pos >= maxLen)
+    {
+      break;
+    }
+  }
+  return min(pos, maxLen-1);
+}
+
+bool confResolvePlaceholder(const confSchema_t& schema, const void *base, const char *placeholder, char *out, size_t maxLen)
+{
+  char name[CONF_TEXT_MAX_LEN];
+  const char *modifier = strchr(placeholder, ':');
+  size_t nameLen = (modifier ? (size_t)(modifier - placeholder) : strlen(placeholder));
+
+  if(nameLen >= sizeof(name))
+  {
+    return false;
+  }
+  memcpy(name, placeholder, nameLen);
+  name[nameLen] = 0;
+
+  const confField_t* f = confFindField(schema, name);
+  if(f == NULL)
+  {
+    return false;
+  }
+
+  if(modifier == NULL)
+  {
+    char value[CONF_TEXT_MAX_LEN];
+    confFieldFormat(*f, base, value, sizeof(value));
+    escapeHtml(value, out, maxLen);
+  }
+  else
+  {
+    bool state = ((f->type == CONF_FIELD_BOOL) && *(const bool*)fieldPtr(*f, base));
+
+    modifier++;
+    if(strcmp(modifier, "checked") == 0)
+    {
+      strlcpy(out, (state ? "checked" : ""), maxLen);
+    }
+    else if(strcmp(modifier, "unchecked") == 0)
+    {
+      strlcpy(out, (state ? "" : "checked"), maxLen);
+    }
+    else if(strcmp(modifier, "enabled") == 0)
+    {
+      strlcpy(out, (state ? "enabled" : "disabled"), maxLen);
+    }
+    else
+    {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,76 @@
+#ifndef __TALLYBOXCONFIGSCHEMA_HPP__
+#define __TALLYBOXCONFIGSCHEMA_HPP__
+#include "Arduino.h"
+#include <stddef.h>
+
+/*Single description of the configuration fields. Defaults, dumps, binary records, json,
+  form parsing and page rendering all walk the same table, so adding a field to a configuration
+  struct takes one CONF_FIELD() line in TallyBoxConfigSchema.cpp. Fields are stored to the binary
+  record in table order: add new fields to the end, older records then load with the default
+  for the new field.*/
+
+typedef enum
+{
+  CONF_FIELD_BOOL,
+  CONF_FIELD_U16,
+  CONF_FIELD_PERCENT,     /*float 0...100, stored as 1/100 percent*/
+  CONF_FIELD_STRING,      /*char array, size includes the terminator*/
+  CONF_FIELD_IPADDRESS,
+  CONF_FIELD_INPUTSET     /*uint64_t, bit 0 = input 1, text "1,5,12-14", maxValue is the highest input*/
+} confFieldType_t;
+
+#define CONF_FIELD_FLAG_NONE      0x00
+#define CONF_FIELD_FLAG_SECRET    0x01    /*not shown in dumps*/
+
+typedef struct
+{
+  const char *name;           /*json key, form field, placeholder and terminal name*/
+  const char *label;
+  confFieldType_t type;
+  uint16_t offset;
+  uint16_t size;
+  int32_t minValue;
+  int32_t maxValue;
+  int32_t defaultNumber;      /*bool, u16, percent*/
+  const char *defaultText;    /*string, ip address*/
+  uint8_t flags;
+} confField_t;
+
+typedef struct
+{
+  const char *name;
+  const confField_t *fields;
+  uint8_t count;
+} confSchema_t;
+
+#define CONF_FIELD(conf, member, type, label, minValue, maxValue, defaultNumber, defaultText, flags) \
+  { #member, label, type, (uint16_t)offsetof(conf, member), (uint16_t)sizeof(((conf*)0)->member), minValue, maxValue, defaultNumber, defaultText, flags }
+
+#define CONF_TEXT_MAX_LEN         48    /*longest formatted value: input sets up to 47 characters*/
+
+extern const confSchema_t networkConfigSchema;
+extern const confSchema_t userConfigSchema;
+
+const confField_t* confFindField(const confSchema_t& schema, const char *name);
+
+void confSetDefaults(const confSchema_t& schema, void *base);
+bool confFieldParse(const confField_t& f, void *base, const char *text);
+size_t confFieldFormat(const confField_t& f, const void *base, char *out, size_t maxLen);
+void confDump(const confSchema_t& schema, const void *base, Print& out);
+
+uint16_t confBinarySize(const confSchema_t& schema);
+uint16_t confSerializeBinary(const confSchema_t& schema, const void *base, uint8_t *buf, uint16_t maxLen);
+bool confDeSerializeBinary(const confSchema_t& schema, void *base, uint8_t *buf, uint16_t len);
+
+size_t confSerializeJson(const confSchema_t& schema, const void *base, uint8_t version, char *out, size_t maxLen);
+size_t confSerializeJsonFields(const confSchema_t& schema, const void *base, const char *indent, char *out, size_t maxLen);
+
+/*form values are fetched through a callback, absent check boxes read as false*/
+typedef bool (*confArgLookup_t)(void *ctx, const char *name, char *value, size_t maxLen);
+uint8_t confParseForm(const confSchema_t& schema, void *base, confArgLookup_t lookup, void *ctx);
+
+/*page placeholders: %name% is the html escaped value, %name:checked% and %name:unchecked%
+  give "checked" for a true/false bool, %name:enabled% gives "enabled" or "disabled"*/
+bool confResolvePlaceholder(const confSchema_t& schema, const void *base, const char *placeholder, char *out, size_t maxLen);
+
+#endif
@@ -1,26 +1,62 @@
 #include "TallyBoxConfiguration.hpp"
-#include "TallyBoxOutput.hpp"   /*for default brightness*/
+#include "TallyBoxConfigSchema.hpp"
+#include "TallyBoxConfigRecord.hpp"
+#include "TallyBoxConfigJournal.hpp"
+#include "TallyBoxInfra.hpp"
 #include "Arduino.h"
 #include <Arduino_CRC32.h>
 #include "LittleFS.h"
 #include <ArduinoJson.h>
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_CONFIG;
 
 static FS* filesystem = &LittleFS;
 
-const char fileNameNetworkConfig[] = "config_network.json";
-const char fileNameUserConfig[] = "config_user.json";
+/*kept off the 4 kB stack: records are loaded and stored one at a time, from the boot or from
+  the write-behind queue*/
+static configJournalBuffer_t journalBuffer;
+static uint8_t payloadBuffer[CONFIG_RECORD_MAX_PAYLOAD_SIZE];
+
+const char fileNameNetworkConfig[] = "config_network";
+const char fileNameUserConfig[] = "config_user";
+const char fileNameFleetConfig[] = "config_fleet";
+
+/*A/B slots of the journaled records*/
+const char* const fileNamesNetworkConfigSlot[CONFIG_JOURNAL_SLOTS] = {"config_network.a.bin", "config_network.b.bin"};
+const char* const fileNamesUserConfigSlot[CONFIG_JOURNAL_SLOTS] = {"config_user.a.bin", "config_user.b.bin"};
+const char* const fileNamesFleetConfigSlot[CONFIG_JOURNAL_SLOTS] = {"config_fleet.a.bin", "config_fleet.b.bin"};
+
+/*legacy json files: migrated to the binary records on first boot*/
+const char fileNameNetworkConfigJson[] = "config_network.json";
+const char fileNameUserConfigJson[] = "config_user.json";
+const char fileNameFleetConfigJson[] = "config_fleet.json";   /*never existed, only for the generic migration path*/
 
-void setDefaults(tallyBoxNetworkConfig_t& c);
-void setDefaults(tallyBoxUserConfig_t& c);
-void dumpConf(String confName, tallyBoxNetworkConfig_t& c);
-void dumpConf(String confName, tallyBoxUserConfig_t& c);
+const confSchema_t& getSchema(tallyBoxNetworkConfig_t& c);
+const confSchema_t& getSchema(tallyBoxUserConfig_t& c);
 const char* getFileName(tallyBoxNetworkConfig_t& c);
 const char* getFileName(tallyBoxUserConfig_t& c);
-void serializeToByteArray(tallyBoxNetworkConfig_t& c, char* jsonBuf, size_t maxBytes);
-void serializeToByteArray(tallyBoxUserConfig_t& c, char* jsonBuf, size_t maxBytes);
-bool deSerializeFromJson(tallyBoxNetworkConfig_t& c, char* jsonBuf);
-bool deSerializeFromJson(tallyBoxUserConfig_t& c, char* jsonBuf);
+const char* getFileName(tallyBoxFleetConfig_t& c);
+const char* getJsonFileName(tallyBoxNetworkConfig_t& c);
+const char* getJsonFileName(tallyBoxUserConfig_t& c);
+const char* getJsonFileName(tallyBoxFleetConfig_t& c);
+configRecordType_t getRecordType(tallyBoxNetworkConfig_t& c);
+configRecordType_t getRecordType(tallyBoxUserConfig_t& c);
+configRecordType_t getRecordType(tallyBoxFleetConfig_t& c);
+
+template <typename T>
+void setDefaults(T& c);
+
+template <typename T>
+void dumpConf(T& c);
 
+/*the fleet profile is a list of user configurations, it does not fit the field schema as such*/
+void setDefaults(tallyBoxFleetConfig_t& c);
+void dumpConf(tallyBoxFleetConfig_t& c);
+uint16_t serializeToPayload(tallyBoxFleetConfig_t& c, uint8_t* buf, uint16_t maxLen);
+bool deSerializeFromPayload(tallyBoxFleetConfig_t& c, uint8_t* buf, uint16_t len);
+void serializeToByteArray(tallyBoxFleetConfig_t& c, char* jsonBuf, size_t maxBytes);
+bool deSerializeFromJson(tallyBoxFleetConfig_t& c, char* jsonBuf);
 
 template <typename T>
 uint32_t calcChecksum(T& c);
@@ -28,156 +64,325 @@ uint32_t calcChecksum(T& c);
 template <typename T>
 bool validateConfiguration(T& c);
 
-template <typename T>
-bool configurationGet(T& c);
+const confSchema_t& getSchema(tallyBoxNetworkConfig_t& c)
+{
+  return networkConfigSchema;
+}
+
+const confSchema_t& getSchema(tallyBoxUserConfig_t& c)
+{
+  return userConfigSchema;
+}
 
 template <typename T>
-bool configurationPut(T& c);
+void setDefaults(T& c)
+{
+  c.sizeOfConfiguration = sizeof(T);
+  c.versionOfConfiguration = TALLYBOX_CONFIGURATION_VERSION;
+
+  confSetDefaults(getSchema(c), &c);
+}
 
 template <typename T>
-void writeFactoryDefaultConfiguration(T& c);
+void dumpConf(T& c)
+{
+  Serial.printf("Configuration: '%s'.\r\n", getSchema(c).name);
+  Serial.printf(" - Version            = %u\r\n", c.versionOfConfiguration);
+  Serial.printf(" - Size               = %u\r\n", (unsigned)c.sizeOfConfiguration);
+  Serial.printf(" - Checksum           = 0x%08X\r\n", calcChecksum(c));
+  confDump(getSchema(c), &c, Serial);
+}
+
 
 template <typename T>
-void handleConfigurationRead(T& c);
+bool validateConfiguration(T& c)
+{
+  bool ret = false;
+  if(c.versionOfConfiguration == TALLYBOX_CONFIGURATION_VERSION)
+  {
+    if(c.sizeOfConfiguration == sizeof(T))
+    {
+      ret = true;
+    }
+    else
+    {
+      LOG_ERROR("validateConfiguration: size check failed");
+    }
+  }
+  else
+  {
+    LOG_ERROR("validateConfiguration: version check failed");
+  }
 
-void tallyBoxConfiguration(tallyBoxConfig_t& c);
+  return ret;
+}
 
+const char* getFileName(tallyBoxNetworkConfig_t& c)
+{
+  return fileNameNetworkConfig;
+}
 
+const char* getFileName(tallyBoxUserConfig_t& c)
+{
+  return fileNameUserConfig;
+}
 
-void setDefaults(tallyBoxNetworkConfig_t& c)
+const char* getFileName(tallyBoxFleetConfig_t& c)
 {
-  c.sizeOfConfiguration = sizeof(tallyBoxNetworkConfig_t);
-  c.versionOfConfiguration = TALLYBOX_CONFIGURATION_VERSION;
+  return fileNameFleetConfig;
+}
 
-  strlcpy(c.wifiSSID, TALLYBOX_CONFIGURATION_DEFAULT_SSID, sizeof(c.wifiSSID));
-  strlcpy(c.wifiPasswd, TALLYBOX_CONFIGURATION_DEFAULT_PASSWD, sizeof(c.wifiPasswd));
 
-  c.isMaster = TALLYBOX_CONFIGURATION_DEFAULT_ISMASTER; 
+const char* getJsonFileName(tallyBoxNetworkConfig_t& c)
+{
+  return fileNameNetworkConfigJson;
+}
 
-  IPAddress ip;
-  ip.fromString(String(TALLYBOX_CONFIGURATION_DEFAULT_HOSTIP));
-  c.hostAddress = ip;
+const char* getJsonFileName(tallyBoxUserConfig_t& c)
+{
+  return fileNameUserConfigJson;
+}
 
-  ip.fromString(String(TALLYBOX_CONFIGURATION_DEFAULT_OWNIP));
-  c.ownAddress = ip;
+const char* getJsonFileName(tallyBoxFleetConfig_t& c)
+{
+  return fileNameFleetConfigJson;
+}
 
-  ip.fromString(String(TALLYBOX_CONFIGURATION_DEFAULT_SUBNET));
-  c.subnetMask = ip;
+configRecordType_t getRecordType(tallyBoxNetworkConfig_t& c)
+{
+  return CONFIG_RECORD_NETWORK;
+}
 
-  ip.fromString(String(TALLYBOX_CONFIGURATION_DEFAULT_GATEWAY));
-  c.defaultGateway = ip;
+configRecordType_t getRecordType(tallyBoxUserConfig_t& c)
+{
+  return CONFIG_RECORD_USER;
+}
 
-  c.hasStaticIp = TALLYBOX_CONFIGURATION_DEFAULT_HASOWNIP; 
+configRecordType_t getRecordType(tallyBoxFleetConfig_t& c)
+{
+  return CONFIG_RECORD_FLEET;
+}
+
+template <typename T>
+uint16_t serializeToPayload(T& c, uint8_t* buf, uint16_t maxLen)
+{
+  return confSerializeBinary(getSchema(c), &c, buf, maxLen);
+}
 
-  strlcpy(c.mdnsHostName, "tallybox", sizeof(c.mdnsHostName));
+template <typename T>
+bool deSerializeFromPayload(T& c, uint8_t* buf, uint16_t len)
+{
+  return confDeSerializeBinary(getSchema(c), &c, buf, len);
 }
 
-void setDefaults(tallyBoxUserConfig_t& c)
+void setDefaults(tallyBoxFleetConfig_t& c)
 {
-  c.sizeOfConfiguration = sizeof(tallyBoxUserConfig_t);
+  c.sizeOfConfiguration = sizeof(tallyBoxFleetConfig_t);
   c.versionOfConfiguration = TALLYBOX_CONFIGURATION_VERSION;
+  c.overrideCount = 0;
 
-  c.cameraId = TALLYBOX_CONFIGURATION_DEFAULT_CAMERA_ID;
-  c.greenBrightnessPercent = DEFAULT_GREEN_BRIGHTNESS_PCT;
-  c.redBrightnessPercent = DEFAULT_RED_BRIGHTNESS_PCT;
+  for(uint8_t i = 0; i < CONF_FLEET_MAX_OVERRIDES; i++)
+  {
+    setDefaults(c.overrides[i]);
+  }
 }
 
-void dumpConf(String confName, tallyBoxNetworkConfig_t& c)
+void dumpConf(tallyBoxFleetConfig_t& c)
 {
-  Serial.println("Configuration: '" + confName + "'.");
-  Serial.println(" - Version            = "+String(c.versionOfConfiguration));
-  Serial.println(" - Size               = "+String(c.sizeOfConfiguration));
-  Serial.println(" - Master Device      = "+String(c.isMaster));
-  Serial.println(" - ATEM Host IP       = "+c.hostAddress.toString());
-  Serial.println(" - Uses Static IP     = "+String(c.hasStaticIp));
-  Serial.println(" - Own IP             = "+c.ownAddress.toString());
-  Serial.println(" - Subnet mask        = "+c.subnetMask.toString());
-  Serial.println(" - Default gateway    = "+c.defaultGateway.toString());
-  Serial.println(" - MDNS Host Name     = "+String(c.mdnsHostName));
-  Serial.print(" - WifiSSID           = ");
-  Serial.println(c.wifiSSID);
-  Serial.println(" - Password           = <not shown>");
+  Serial.println("Configuration: 'Fleet'.");
+  Serial.printf(" - Version            = %u\r\n", c.versionOfConfiguration);
+  Serial.printf(" - Size               = %u\r\n", (unsigned)c.sizeOfConfiguration);
+  Serial.printf(" - Checksum           = 0x%08X\r\n", calcChecksum(c));
+  Serial.printf(" - Overrides          = %u\r\n", c.overrideCount);
+
+  for(uint8_t i = 0; i < c.overrideCount; i++)
+  {
+    confDump(userConfigSchema, &c.overrides[i], Serial);
+  }
 }
 
-void dumpConf(String confName, tallyBoxUserConfig_t& c)
+uint16_t serializeToPayload(tallyBoxFleetConfig_t& c, uint8_t* buf, uint16_t maxLen)
 {
-  Serial.println("Configuration: '" + confName + "'.");
-  Serial.println(" - Version            = "+String(c.versionOfConfiguration));
-  Serial.println(" - Size               = "+String(c.sizeOfConfiguration));
-  Serial.println(" - Camera ID          = "+String(c.cameraId));
-  Serial.println(" - Green Brightness   = "+String(c.greenBrightnessPercent, 0)+"%");
-  Serial.println(" - Red Brightness     = "+String(c.redBrightnessPercent, 0)+"%");
-}
+  /*count(1) | entry size(1) | entries: the entry size lets older firmware skip fields it does not know*/
+  uint16_t entrySize = confBinarySize(userConfigSchema);
+  uint16_t ret = 0;
 
+  if((c.overrideCount <= CONF_FLEET_MAX_OVERRIDES) && (maxLen >= 2 + c.overrideCount * entrySize))
+  {
+    uint8_t *p = buf;
 
-template <typename T>
-bool validateConfiguration(T& c)
+    putU8(&p, c.overrideCount);
+    putU8(&p, (uint8_t)entrySize);
+    for(uint8_t i = 0; i < c.overrideCount; i++)
+    {
+      p += confSerializeBinary(userConfigSchema, &c.overrides[i], p, entrySize);
+    }
+    ret = (uint16_t)(p - buf);
+  }
+  return ret;
+}
+
+bool deSerializeFromPayload(tallyBoxFleetConfig_t& c, uint8_t* buf, uint16_t len)
 {
   bool ret = false;
-  if(c.versionOfConfiguration == TALLYBOX_CONFIGURATION_VERSION)
+
+  if(len >= 2)
   {
-    if(c.sizeOfConfiguration == sizeof(T))
+    uint8_t *p = buf;
+    uint8_t count = getU8(&p);
+    uint8_t entrySize = getU8(&p);
+
+    if((count <= CONF_FLEET_MAX_OVERRIDES) && (len == 2 + count * entrySize))
     {
       ret = true;
-    }
-    else
-    {
-      Serial.println("validateConfiguration: size check failed");
+      for(uint8_t i = 0; (i < count) && ret; i++)
+      {
+        ret = confDeSerializeBinary(userConfigSchema, &c.overrides[i], p, entrySize);
+        c.overrides[i].sizeOfConfiguration = sizeof(tallyBoxUserConfig_t);
+        c.overrides[i].versionOfConfiguration = c.versionOfConfiguration;
+        p += entrySize;
+      }
+      c.overrideCount = (ret ? count : 0);
     }
   }
-  else
+  return ret;
+}
+
+template <typename T>
+uint32_t calcChecksum(T& c)
+{
+  uint16_t payloadLen = serializeToPayload(c, payloadBuffer, sizeof(payloadBuffer));
+  Arduino_CRC32 crc32;
+
+  return crc32.calc(payloadBuffer, payloadLen);
+}
+
+static const char* getSlotFileName(configRecordType_t type, uint8_t slot)
+{
+  const char* ret;
+
+  switch(type)
   {
-    Serial.println("validateConfiguration: version check failed");
+    case CONFIG_RECORD_NETWORK:
+      ret = fileNamesNetworkConfigSlot[slot];
+      break;
+    case CONFIG_RECORD_USER:
+      ret = fileNamesUserConfigSlot[slot];
+      break;
+    default:
+      ret = fileNamesFleetConfigSlot[slot];
+      break;
   }
-
   return ret;
 }
 
-const char* getFileName(tallyBoxNetworkConfig_t& c)
+static uint16_t fileSystemReadSlot(void *ctx, configRecordType_t type, uint8_t slot, uint8_t *buf, uint16_t maxLen)
 {
-  return fileNameNetworkConfig;
+  uint16_t ret = 0;
+  const char* fileName = getSlotFileName(type, slot);
+
+  if(filesystem->exists(fileName))
+  {
+    File f = filesystem->open(fileName, "r");
+    size_t fileSize = f.size();
+
+    if((fileSize > 0) && (fileSize <= maxLen))
+    {
+      ret = (uint16_t)f.read(buf, fileSize);
+    }
+    f.close();
+  }
+  return ret;
 }
 
-const char* getFileName(tallyBoxUserConfig_t& c)
+static bool fileSystemWriteSlot(void *ctx, configRecordType_t type, uint8_t slot, const uint8_t *buf, uint16_t len)
 {
-  return fileNameUserConfig;
+  bool ret = false;
+  File f = filesystem->open(getSlotFileName(type, slot), "w");
+
+  if(f)
+  {
+    ret = (f.write(buf, len) == len);
+    f.close();
+  }
+  return ret;
 }
 
+static const configJournalBackend_t fileSystemJournal = {fileSystemReadSlot, fileSystemWriteSlot, NULL};
+
 template <typename T>
 bool configurationGet(T& c)
 {
   bool ret = false;
-  const char* fileName = getFileName(c);
+  configJournalRecord_t rec;
+
+  if(!configJournalLoad(fileSystemJournal, getRecordType(c), journalBuffer, rec))
+  {
+    /*no valid record in either slot: first boot after upgrading from json based firmware*/
+    return configurationMigrateFromJson(c);
+  }
+
+  T loaded = c;
+  loaded.sizeOfConfiguration = sizeof(T);
+  loaded.versionOfConfiguration = rec.schemaVersion;
+
+  if(deSerializeFromPayload(loaded, rec.payload, rec.payloadLen) && validateConfiguration(loaded))
+  {
+    LOG_INFO("configurationGet(): '%s' generation %u from slot %u", getFileName(c), rec.generation, rec.slot);
+    c = loaded;
+    ret = true;
+  }
+  else
+  {
+    LOG_ERROR("configurationGet(): payload does not match the schema");
+  }
+
+  return ret;
+}
 
-  File f = filesystem->open(fileName, "r");
+template <typename T>
+bool configurationMigrateFromJson(T& c)
+{
+  bool ret = false;
+  const char* jsonFileName = getJsonFileName(c);
 
-  if(f.size() > 0)
+  if(filesystem->exists(jsonFileName))
   {
-    char buf[512];
+    File f = filesystem->open(jsonFileName, "r");
+    char *buf = (char*)malloc(f.size()+1);  /*only once per device lifetime, keep it off the stack*/
 
-    if(f.read((uint8_t*)buf, sizeof(buf)) > 0)
+    if(buf)
     {
-      if(deSerializeFromJson(c, buf))
+      size_t len = f.read((uint8_t*)buf, f.size());
+      buf[len] = 0;
+      f.close();
+
+      setDefaults(c);
+      if(deSerializeFromJson(c, buf) && validateConfiguration(c))
       {
-        ret = validateConfiguration(c);
+        if(configurationPut(c))
+        {
+          LOG_INFO("configurationMigrateFromJson(): '%s' migrated to '%s'", jsonFileName, getFileName(c));
+          filesystem->remove(jsonFileName);
+          ret = true;
+        }
       }
       else
       {
-        Serial.println("configurationGet(): json deserialization failed");
+        LOG_ERROR("configurationMigrateFromJson(): json deserialization failed");
       }
+      free(buf);
     }
     else
     {
-      Serial.printf("configurationGet(): read failed\r\n");
+      f.close();
     }
   }
   else
   {
-    Serial.printf("configurationGet(): file is empty\r\n");
+    LOG_WARN("configurationGet(): '%s' not found", getFileName(c));
   }
 
-  f.close();
-
   return ret;
 }
 
@@ -186,73 +391,80 @@ template <typename T>
 bool configurationPut(T& c)
 {
   bool ret = false;
-  const char* fileName = getFileName(c);
 
   if(validateConfiguration(c))
   {
-    File f = filesystem->open(fileName, "w");
-    char bufToBeStored[512];
-
-    serializeToByteArray(c, bufToBeStored, sizeof(bufToBeStored));
-
-    size_t len = strlen(bufToBeStored);
-
-    Serial.println("configurationPut: preparing to write "+String(len)+" bytes.");
+    uint16_t payloadLen = serializeToPayload(c, payloadBuffer, sizeof(payloadBuffer));
 
-    if(f.write(bufToBeStored, len) == len)
+    if(configJournalCommit(fileSystemJournal, getRecordType(c), c.versionOfConfiguration, payloadBuffer, payloadLen, journalBuffer))
     {
-      Serial.println("success!");
+      const configJournalStats_t& stats = configJournalGetStats();
+      LOG_INFO("configurationPut(): '%s' committed in %u us (worst %u us)", getFileName(c), stats.lastCommitTimeUs, stats.worstCommitTimeUs);
       ret = true;
     }
     else
     {
-      Serial.printf("configurationPut(): write failed\r\n");
+      LOG_ERROR("configurationPut(): commit of '%s' failed", getFileName(c));
     }
   }
   return ret;
 }
 
 
-void serializeToByteArray(tallyBoxNetworkConfig_t& c, char* jsonBuf, size_t maxBytes)
+template <typename T>
+void serializeToByteArray(T& c, char* jsonBuf, size_t maxBytes)
 {
-  StaticJsonDocument<512> doc;
-  
-  doc["sizeOfConfiguration"] = c.sizeOfConfiguration;
-  doc["versionOfConfiguration"] = c.versionOfConfiguration;
-  doc["wifiSSID"] = String(c.wifiSSID);
-  doc["wifiPasswd"] = String(c.wifiPasswd);
-  doc["isMaster"] = c.isMaster;
-  doc["hostAddress"] = c.hostAddress.toString();
-  doc["ownAddress"] = c.ownAddress.toString();
-  doc["subnetMask"] = c.subnetMask.toString();
-  doc["defaultGateway"] = c.defaultGateway.toString();
-  doc["hasStaticIp"] = c.hasStaticIp;
-  doc["mdnsHostName"] = String(c.mdnsHostName);
-
-  serializeJsonPretty(doc, jsonBuf, maxBytes);
-
-  Serial.println("json='"+String(jsonBuf)+"'");
-
+  if(confSerializeJson(getSchema(c), &c, c.versionOfConfiguration, jsonBuf, maxBytes) == 0)
+  {
+    jsonBuf[0] = 0;
+  }
 }
 
-void serializeToByteArray(tallyBoxUserConfig_t& c, char* jsonBuf, size_t maxBytes)
+static bool deSerializeFieldsFromJson(const confSchema_t& schema, void *base, JsonVariant obj)
 {
-  StaticJsonDocument<512> doc;
-  
-  doc["sizeOfConfiguration"] = c.sizeOfConfiguration;
-  doc["versionOfConfiguration"] = c.versionOfConfiguration;
-  doc["cameraId"] = c.cameraId;
-  doc["greenBrightnessPercent"] = c.greenBrightnessPercent;
-  doc["redBrightnessPercent"] = c.redBrightnessPercent;
+  char text[CONF_TEXT_MAX_LEN + 8];
+  uint8_t rejected = 0;
 
-  serializeJsonPretty(doc, jsonBuf, maxBytes);
+  /*fields missing from the document keep their current value*/
+  for(uint8_t i = 0; i < schema.count; i++)
+  {
+    const confField_t& f = schema.fields[i];
+    JsonVariant v = obj[f.name];
 
-  Serial.println("json='"+String(jsonBuf)+"'");
-}
+    if(v.isNull())
+    {
+      continue;
+    }
 
+    if(v.is<const char*>())
+    {
+      strlcpy(text, v.as<const char*>(), sizeof(text));
+    }
+    else if(v.is<bool>())
+    {
+      strlcpy(text, (v.as<bool>() ? "1" : "0"), sizeof(text));
+    }
+    else if(f.type == CONF_FIELD_PERCENT)
+    {
+      snprintf(text, sizeof(text), "%.2f", v.as<double>());
+    }
+    else
+    {
+      snprintf(text, sizeof(text), "%ld", v.as<long>());
+    }
+
+    if(!confFieldParse(f, base, text))
+    {
+      LOG_WARN("deSerializeFromJson(): invalid value for '%s'", f.name);
+      rejected++;
+    }
+  }
 
+  return (rejected == 0);
+}
 
-bool deSerializeFromJson(tallyBoxNetworkConfig_t& c, char* jsonBuf)
+template <typename T>
+bool deSerializeFromJson(T& c, char* jsonBuf)
 {
   bool ret = false;
   StaticJsonDocument<512> doc;
@@ -261,55 +473,82 @@ bool deSerializeFromJson(tallyBoxNetworkConfig_t& c, char* jsonBuf)
 
   if(error == DeserializationError::Ok)
   {
-    c.sizeOfConfiguration = doc["sizeOfConfiguration"];
+    c.sizeOfConfiguration = sizeof(c); /*describes the in-memory struct, the value in the file is not portable*/
     c.versionOfConfiguration = doc["versionOfConfiguration"];
-    
-    String ssid = doc["wifiSSID"];
-    strlcpy(c.wifiSSID, ssid.c_str(), CONF_NETWORK_NAME_LEN_SSID);
-    String pwd = doc["wifiPasswd"];
-    strlcpy(c.wifiPasswd, pwd.c_str(), CONF_NETWORK_NAME_LEN_PASSWD);
-
-    c.isMaster = doc["isMaster"];
 
-    String ha = doc["hostAddress"];
-    c.hostAddress.fromString(ha);
-
-    String oa = doc["ownAddress"];
-    c.ownAddress.fromString(oa);
-
-    String snm = doc["subnetMask"];
-    c.subnetMask.fromString(snm);
+    ret = deSerializeFieldsFromJson(getSchema(c), &c, doc.as<JsonVariant>());
+  }
 
-    String dg = doc["defaultGateway"];
-    c.defaultGateway.fromString(dg);
+  return ret;
+}
 
-    c.hasStaticIp = doc["hasStaticIp"];
-    String mdnshost = doc["mdnsHostName"];
-    strlcpy(c.mdnsHostName, mdnshost.c_str(), CONF_NETWORK_NAME_LEN_MDNS_NAME);
+void serializeToByteArray(tallyBoxFleetConfig_t& c, char* jsonBuf, size_t maxBytes)
+{
+  size_t pos = snprintf(jsonBuf, maxBytes, "{\r\n  \"versionOfConfiguration\": %u,\r\n  \"overrides\": [", c.versionOfConfiguration);
 
-    ret = true;
+  for(uint8_t i = 0; (i < c.overrideCount) && (pos < maxBytes); i++)
+  {
+    pos += snprintf(jsonBuf + pos, maxBytes - pos, "%s\r\n    {\r\n", (i == 0 ? "" : ","));
+    if(pos < maxBytes)
+    {
+      size_t len = confSerializeJsonFields(userConfigSchema, &c.overrides[i], "      ", jsonBuf + pos, maxBytes - pos);
+      pos = ((len == 0) ? maxBytes : pos + len);
+    }
+    if(pos < maxBytes)
+    {
+      pos += snprintf(jsonBuf + pos, maxBytes - pos, "\r\n    }");
+    }
+  }
+  if(pos < maxBytes)
+  {
+    pos += snprintf(jsonBuf + pos, maxBytes - pos, "\r\n  ]\r\n}");
   }
 
-  return ret;
+  if(pos >= maxBytes)
+  {
+    jsonBuf[0] = 0;   /*did not fit*/
+  }
 }
 
-bool deSerializeFromJson(tallyBoxUserConfig_t& c, char* jsonBuf)
+bool deSerializeFromJson(tallyBoxFleetConfig_t& c, char* jsonBuf)
 {
   bool ret = false;
-  StaticJsonDocument<512> doc;
+  DynamicJsonDocument doc(2048);  /*import only: keep it off the stack*/
 
   DeserializationError error = deserializeJson(doc, jsonBuf);
 
   if(error == DeserializationError::Ok)
   {
-    c.sizeOfConfiguration = doc["sizeOfConfiguration"];
+    JsonArray overrides = doc["overrides"].as<JsonArray>();
+
+    c.sizeOfConfiguration = sizeof(c);
     c.versionOfConfiguration = doc["versionOfConfiguration"];
+    c.overrideCount = 0;
+    ret = (overrides.size() <= CONF_FLEET_MAX_OVERRIDES);
 
-    c.cameraId = doc["cameraId"];
-    c.greenBrightnessPercent = doc["greenBrightnessPercent"];
-    c.redBrightnessPercent = doc["redBrightnessPercent"];
+    for(JsonVariant entry : overrides)
+    {
+      if(!ret)
+      {
+        break;
+      }
 
-    ret = true;
+      tallyBoxUserConfig_t& o = c.overrides[c.overrideCount];
+      setDefaults(o);
+      ret = (deSerializeFieldsFromJson(userConfigSchema, &o, entry) && !entry["cameraId"].isNull());
+
+      /*one override per camera*/
+      for(uint8_t i = 0; (i < c.overrideCount) && ret; i++)
+      {
+        ret = (c.overrides[i].cameraId != o.cameraId);
+      }
+      c.overrideCount++;
+    }
+
+    if(!ret)
+    {
+      LOG_WARN("deSerializeFromJson(): invalid fleet override list");
+    }
   }
 
   return ret;
@@ -319,13 +558,11 @@ bool deSerializeFromJson(tallyBoxUserConfig_t& c, char* jsonBuf)
 template <typename T>
 void writeFactoryDefaultConfiguration(T& c)
 {
-  const char* fName = getFileName(c);
-
   setDefaults(c);
 
   if(!configurationPut(c))
   {
-    Serial.println("Write FAILED!");
+    LOG_ERROR("writing the default configuration FAILED");
   }
 }
 
@@ -335,16 +572,11 @@ void handleConfigurationRead(T& c)
 {
   const char* fName = getFileName(c);
 
-  configurationGet(c);
-
-  if(!validateConfiguration(c))
+  if(!configurationGet(c))
   {
-    #if T == tallyBoxUserConfig_t
-    Serial.printf("Loading configuration '%s' failed. Trying anyway.\r\n", fName);
-    #else
-    Serial.printf("Loading configuration '%s' failed. Cannot continue without networking settings.\r\n", fName);
-    while(1);
-    #endif
+    /*never stop here: a box with defaults can still be reached and reconfigured*/
+    LOG_ERROR("Loading configuration '%s' failed. Continuing with defaults.", fName);
+    setDefaults(c);
   }
 }
 
@@ -352,18 +584,88 @@ void writeFactoryDefault(tallyBoxConfig_t& c)
 {
   writeFactoryDefaultConfiguration(c.network);
   writeFactoryDefaultConfiguration(c.user);
+  writeFactoryDefaultConfiguration(c.fleet);
 }
 
 #define BUTTON_ACTIVE   LOW
 
-bool tallyBoxWriteConfiguration(tallyBoxNetworkConfig_t& c)
+template <typename T>
+bool configurationCommitStart(T& c, configJournalCommit_t& cm)
+{
+  bool ret = false;
+
+  if(validateConfiguration(c))
+  {
+    uint16_t payloadLen = serializeToPayload(c, payloadBuffer, sizeof(payloadBuffer));
+
+    ret = configJournalCommitStart(cm, getRecordType(c), c.versionOfConfiguration, payloadBuffer, payloadLen);
+  }
+  return ret;
+}
+
+bool tallyBoxStartConfigurationCommit(tallyBoxNetworkConfig_t& c, configJournalCommit_t& cm)
+{
+  return configurationCommitStart(c, cm);
+}
+
+bool tallyBoxStartConfigurationCommit(tallyBoxUserConfig_t& c, configJournalCommit_t& cm)
+{
+  return configurationCommitStart(c, cm);
+}
+
+bool tallyBoxStartConfigurationCommit(tallyBoxFleetConfig_t& c, configJournalCommit_t& cm)
 {
-  return configurationPut(c);
+  return configurationCommitStart(c, cm);
 }
 
-bool tallyBoxWriteConfiguration(tallyBoxUserConfig_t& c)
+configJournalStep_t tallyBoxStepConfigurationCommit(configJournalCommit_t& cm)
 {
-  return configurationPut(c);
+  return configJournalCommitStep(fileSystemJournal, cm);
+}
+
+template <typename T>
+bool configurationImportJson(T& c, char* jsonBuf)
+{
+  bool ret = false;
+  T imported = c;
+
+  /*c is changed only by a complete and valid document, the caller schedules the write*/
+  if(deSerializeFromJson(imported, jsonBuf) && validateConfiguration(imported))
+  {
+    c = imported;
+    ret = true;
+  }
+  return ret;
+}
+
+void tallyBoxExportConfiguration(tallyBoxNetworkConfig_t& c, char* jsonBuf, size_t maxBytes)
+{
+  serializeToByteArray(c, jsonBuf, maxBytes);
+}
+
+void tallyBoxExportConfiguration(tallyBoxUserConfig_t& c, char* jsonBuf, size_t maxBytes)
+{
+  serializeToByteArray(c, jsonBuf, maxBytes);
+}
+
+void tallyBoxExportConfiguration(tallyBoxFleetConfig_t& c, char* jsonBuf, size_t maxBytes)
+{
+  serializeToByteArray(c, jsonBuf, maxBytes);
+}
+
+bool tallyBoxImportConfiguration(tallyBoxNetworkConfig_t& c, char* jsonBuf)
+{
+  return configurationImportJson(c, jsonBuf);
+}
+
+bool tallyBoxImportConfiguration(tallyBoxUserConfig_t& c, char* jsonBuf)
+{
+  return configurationImportJson(c, jsonBuf);
+}
+
+bool tallyBoxImportConfiguration(tallyBoxFleetConfig_t& c, char* jsonBuf)
+{
+  return configurationImportJson(c, jsonBuf);
 }
 
 void tallyBoxConfiguration(tallyBoxConfig_t& c)
@@ -405,15 +707,23 @@ void tallyBoxConfiguration(tallyBoxConfig_t& c)
   writeFactoryDefault(c);
   #endif
 
+  uint32_t loadStartedAt = micros();
+
   /*handle network configuration part*/
   handleConfigurationRead(c.network);
 
   /*handle user configuration part*/
   handleConfigurationRead(c.user);
 
+  /*fleet profile: only used by the master, but loaded everywhere to keep the boot path common*/
+  handleConfigurationRead(c.fleet);
+
+  Serial.printf("Configuration loaded in %u us\r\n", (uint32_t)(micros() - loadStartedAt));
+
   Serial.println("*******************\r\nStarting with configuration:");
-  dumpConf("Network", c.network);
-  dumpConf("User", c.user);
+  dumpConf(c.network);
+  dumpConf(c.user);
+  dumpConf(c.fleet);
   Serial.println("*******************\r\n");
 
 }
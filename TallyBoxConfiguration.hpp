@@ -5,6 +5,7 @@
 #include <ESP8266WiFi.h>
 #include <EEPROM.h>
 #include "TallyBoxDefaultConfiguration.hpp"
+#include "TallyBoxConfigJournal.hpp"
 
 #define TALLYBOX_CONFIGURATION_VERSION          1
 #define TALLYBOX_EEPROM_STORAGE_ADDRESS         0
@@ -13,6 +14,17 @@
 #define CONF_NETWORK_NAME_LEN_SSID              20
 #define CONF_NETWORK_NAME_LEN_PASSWD            20
 #define CONF_NETWORK_NAME_LEN_MDNS_NAME         20
+#define CONF_NETWORK_NAME_LEN_UMD_DESTINATION   25      /*"tcp:255.255.255.255:65535"*/
+
+#define CONF_FLEET_MAX_OVERRIDES                12
+
+/*how the watched inputs of a box add to its own camera input*/
+typedef enum
+{
+  TALLY_WATCH_ALL = 0,                /*program and preview of every watched input*/
+  TALLY_WATCH_PROGRAM_FIRST,          /*no preview while any watched input is in program*/
+  TALLY_WATCH_PROGRAM_ONLY            /*the other inputs show program only, preview is the camera's own*/
+} tallyWatchRule_t;
 
 typedef struct
 {
@@ -22,12 +34,21 @@ typedef struct
   char wifiSSID[CONF_NETWORK_NAME_LEN_SSID+1];
   char wifiPasswd[CONF_NETWORK_NAME_LEN_PASSWD+1];
   bool isMaster;
-  IPAddress hostAddress;
-  IPAddress ownAddress;
-  IPAddress subnetMask;
-  IPAddress defaultGateway;
+  uint32_t hostAddress;         /*addresses as (uint32_t)IPAddress: keeps the struct standard layout*/
+  uint32_t ownAddress;
+  uint32_t subnetMask;
+  uint32_t defaultGateway;
   bool hasStaticIp;
   char mdnsHostName[CONF_NETWORK_NAME_LEN_MDNS_NAME+1];
+  uint32_t switcherAddress2;    /*hostAddress is the first switcher*/
+  uint32_t switcherAddress3;
+  uint16_t switcherMergeRule;   /*switcherMergeRule_t*/
+  uint16_t switcherProtocol;    /*switcherProtocol_t*/
+  uint16_t tslFirstCamera;      /*camera id of TSL display 0, received and republished*/
+  char umdDestination1[CONF_NETWORK_NAME_LEN_UMD_DESTINATION+1];   /*[udp:|tcp:]address[:port]*/
+  char umdDestination2[CONF_NETWORK_NAME_LEN_UMD_DESTINATION+1];
+  char umdDestination3[CONF_NETWORK_NAME_LEN_UMD_DESTINATION+1];
+  uint16_t umdIntervalMs;
 } tallyBoxNetworkConfig_t;
 
 typedef struct
@@ -38,17 +59,44 @@ typedef struct
   uint16_t cameraId;
   float greenBrightnessPercent;
   float redBrightnessPercent;
+  uint64_t watchedInputs;       /*bit 0 = switcher input 1, in addition to cameraId*/
+  uint16_t watchRule;           /*tallyWatchRule_t*/
 } tallyBoxUserConfig_t;
 
+/*fleet profile, used by the master only: user settings distributed to the other boxes.
+  The master's own user configuration is the fleet wide default, an override replaces it
+  for the box whose camera id matches.*/
+typedef struct
+{
+  size_t sizeOfConfiguration;
+  uint8_t versionOfConfiguration;
+
+  uint8_t overrideCount;
+  tallyBoxUserConfig_t overrides[CONF_FLEET_MAX_OVERRIDES];
+} tallyBoxFleetConfig_t;
+
 
 typedef struct
 {
   tallyBoxNetworkConfig_t network;
   tallyBoxUserConfig_t user;
+  tallyBoxFleetConfig_t fleet;
 } tallyBoxConfig_t;
 
-bool tallyBoxWriteConfiguration(tallyBoxNetworkConfig_t& c);
-bool tallyBoxWriteConfiguration(tallyBoxUserConfig_t& c);
+/*stepwise commit, used by the write-behind queue (TallyBoxPersistence)*/
+bool tallyBoxStartConfigurationCommit(tallyBoxNetworkConfig_t& c, configJournalCommit_t& cm);
+bool tallyBoxStartConfigurationCommit(tallyBoxUserConfig_t& c, configJournalCommit_t& cm);
+bool tallyBoxStartConfigurationCommit(tallyBoxFleetConfig_t& c, configJournalCommit_t& cm);
+configJournalStep_t tallyBoxStepConfigurationCommit(configJournalCommit_t& cm);
+
+/*json is kept as the export/import format, the storage itself uses binary records. An import
+  only changes c, storing it is left to the write-behind queue (TallyBoxPersistence).*/
+void tallyBoxExportConfiguration(tallyBoxNetworkConfig_t& c, char* jsonBuf, size_t maxBytes);
+void tallyBoxExportConfiguration(tallyBoxUserConfig_t& c, char* jsonBuf, size_t maxBytes);
+void tallyBoxExportConfiguration(tallyBoxFleetConfig_t& c, char* jsonBuf, size_t maxBytes);
+bool tallyBoxImportConfiguration(tallyBoxNetworkConfig_t& c, char* jsonBuf);
+bool tallyBoxImportConfiguration(tallyBoxUserConfig_t& c, char* jsonBuf);
+bool tallyBoxImportConfiguration(tallyBoxFleetConfig_t& c, char* jsonBuf);
 
 void tallyBoxConfiguration(tallyBoxConfig_t& c);
 
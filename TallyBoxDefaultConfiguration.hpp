@@ -9,11 +9,19 @@
 #define TALLYBOX_CONFIGURATION_DEFAULT_OWNIP           "192.168.1.90"
 #define TALLYBOX_CONFIGURATION_DEFAULT_SUBNET          "255.255.255.0"
 #define TALLYBOX_CONFIGURATION_DEFAULT_GATEWAY         "192.168.1.254"
+#define TALLYBOX_CONFIGURATION_DEFAULT_SWITCHERIP      "0.0.0.0"               /*additional switchers, 0.0.0.0 = not in use*/
+#define TALLYBOX_CONFIGURATION_DEFAULT_MERGERULE       0                       /*SWITCHER_MERGE_OR*/
+#define TALLYBOX_CONFIGURATION_DEFAULT_PROTOCOL        0                       /*SWITCHER_PROTOCOL_ATEM*/
+#define TALLYBOX_CONFIGURATION_DEFAULT_TSLCAMERA       1                       /*camera id of TSL display 0*/
+#define TALLYBOX_CONFIGURATION_DEFAULT_UMD             ""                      /*TSL republishing, "" = not in use*/
+#define TALLYBOX_CONFIGURATION_DEFAULT_UMD_INTERVAL    40                      /*ms between two TSL packets*/
 
 #define TALLYBOX_CONFIGURATION_DEFAULT_HASOWNIP        false
 
 #define TALLYBOX_CONFIGURATION_DEFAULT_CAMERA_ID       1
 #define TALLYBOX_CONFIGURATION_DEFAULT_ISMASTER        (TALLYBOX_CONFIGURATION_DEFAULT_CAMERA_ID==1)
+#define TALLYBOX_CONFIGURATION_DEFAULT_WATCHED         ""                      /*inputs besides the camera id*/
+#define TALLYBOX_CONFIGURATION_DEFAULT_WATCH_RULE      0                       /*TALLY_WATCH_ALL*/
 
 #define TALLYBOX_PROGRAM_FORCE_WRITE_DEFAULTS          0       /*enable this for writing the default values to network config file, disable for normal operation*/
 
@@ -0,0 +1,319 @@
+#include "TallyBoxFirmware.hpp"
+#include "TallyBoxRollout.hpp"
+#include "TallyBoxPeerNetwork.hpp"
+#include "TallyBoxFleet.hpp"
+#include "TallyBoxStateMachine.hpp"
+#include "Arduino.h"
+#include <Updater.h>
+#include "LittleFS.h"
+#include "TallyBoxLog.hpp"
+#include "TallyBoxInfra.hpp"
+
+static const logModule_t logModule = LOG_MODULE_FIRMWARE;
+
+typedef struct
+{
+  uint32_t imageId;
+  uint8_t pending;                /*written, not yet seen running*/
+  char sketchMd5[33];             /*sketch running when the record was written*/
+} installedRecord_t;
+
+static FS* filesystem = &LittleFS;
+
+static const char* const phaseNames[] = {"idle", "preparing", "running", "finished"};
+
+/*master*/
+static rolloutMaster_t master;
+static File image;
+
+/*slave*/
+static rolloutSlave_t slave;
+static bool restartPending = false;
+static uint32_t restartAtMs = 0;
+
+
+/*** master backend ******************************************/
+
+static void masterSend(void *ctx, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len)
+{
+  peerNetworkSendMessage(PEERNETWORK_ROLLOUT_OFFER_IDENTIFIER_U16 + type, payload, len, IPAddress(to));
+}
+
+static bool masterReadImage(void *ctx, uint32_t offset, uint8_t *buf, uint16_t len)
+{
+  return (image && image.seek(offset) && (image.read(buf, len) == len));
+}
+
+static bool masterIsOnAir(void *ctx, uint16_t cameraId)
+{
+  return tallyBoxCameraIsOnAir(cameraId);
+}
+
+static const rolloutMasterBackend_t masterBackend = {masterSend, masterReadImage, masterIsOnAir, NULL};
+
+/*** slave backend *******************************************/
+
+static void writeInstalledRecord(uint32_t imageId, bool pending)
+{
+  installedRecord_t r = {};
+  File f = filesystem->open(FIRMWARE_INSTALLED_PATH, "w");
+
+  r.imageId = imageId;
+  r.pending = pending;
+  strlcpy(r.sketchMd5, ESP.getSketchMD5().c_str(), sizeof(r.sketchMd5));
+  if(!f || (f.write((uint8_t*)&r, sizeof(r)) != sizeof(r)))
+  {
+    LOG_ERROR("%s not written", FIRMWARE_INSTALLED_PATH);
+  }
+  f.close();
+}
+
+static void slaveSend(void *ctx, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len)
+{
+  peerNetworkSendMessage(PEERNETWORK_ROLLOUT_OFFER_IDENTIFIER_U16 + type, payload, len, IPAddress(to));
+}
+
+static bool slaveFlashBegin(void *ctx, uint32_t size)
+{
+  bool ret = Update.begin(size, U_FLASH);
+
+  if(!ret)
+  {
+    LOG_ERROR("no room for an image of %u bytes: %s", size, Update.getErrorString());
+  }
+  return ret;
+}
+
+static bool slaveFlashWrite(void *ctx, const uint8_t *data, uint16_t len)
+{
+  return (Update.write((uint8_t*)data, len) == len);
+}
+
+/*an image that is not complete is dropped by Update.end()*/
+static bool slaveFlashEnd(void *ctx, bool commit)
+{
+  bool ret = Update.end();
+
+  if(commit && ret)
+  {
+    /*the boot loader copies the image at the next restart, whatever causes it*/
+    writeInstalledRecord(slave.imageId, true);
+  }
+  else if(commit)
+  {
+    LOG_ERROR("image not taken: %s", Update.getErrorString());
+  }
+  return ret;
+}
+
+static bool slaveIsOnAir(void *ctx)
+{
+  return tallyBoxIsOnAir();
+}
+
+static void slaveRestart(void *ctx, uint32_t imageId)
+{
+  LOG_INFO("restarting into image %08X", imageId);
+  restartPending = true;
+  restartAtMs = millis() + FIRMWARE_RESTART_DELAY_MS;
+}
+
+static const rolloutSlaveBackend_t slaveBackend = {slaveSend, slaveFlashBegin, slaveFlashWrite, slaveFlashEnd, slaveIsOnAir, slaveRestart, NULL};
+
+static void logSlaveState(uint8_t prevState)
+{
+  if(slave.state != prevState)
+  {
+    switch(slave.state)
+    {
+      case ROLLOUT_SLAVE_RECEIVING:
+        LOG_INFO("receiving image %08X, %u bytes", slave.imageId, slave.imageSize);
+        break;
+      case ROLLOUT_SLAVE_VERIFIED:
+        LOG_INFO("image %08X verified", slave.imageId);
+        break;
+      case ROLLOUT_SLAVE_FAILED:
+        LOG_ERROR("image %08X failed: %s", slave.imageId, rolloutErrorName(slave.error));
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/*************************************************************/
+
+/*the id is valid only while the sketch it was written with, or the pending one, is running*/
+void tallyBoxFirmwareInitialize()
+{
+  installedRecord_t r = {};
+  uint32_t installedId = 0;
+  File f = filesystem->open(FIRMWARE_INSTALLED_PATH, "r");
+
+  if(f && (f.read((uint8_t*)&r, sizeof(r)) == sizeof(r)))
+  {
+    bool sameSketch;
+
+    f.close();
+    r.sketchMd5[sizeof(r.sketchMd5) - 1] = 0;
+    sameSketch = (strcmp(ESP.getSketchMD5().c_str(), r.sketchMd5) == 0);
+
+    if(r.pending && !sameSketch)
+    {
+      installedId = r.imageId;
+      writeInstalledRecord(r.imageId, false);
+      LOG_INFO("running rolled out image %08X", r.imageId);
+    }
+    else if(!r.pending && sameSketch)
+    {
+      installedId = r.imageId;
+    }
+    else if(r.pending)
+    {
+      LOG_WARN("image %08X was not taken into use", r.imageId);
+    }
+  }
+  f.close();
+
+  rolloutSlaveInitialize(slave, installedId);
+}
+
+void tallyBoxFirmwareUpdate(tallyBoxConfig_t& c)
+{
+  if(c.network.isMaster)
+  {
+    uint8_t prevPhase = master.phase;
+
+    rolloutMasterUpdate(masterBackend, master, millis());
+    if((master.phase == ROLLOUT_FINISHED) && (prevPhase != ROLLOUT_FINISHED))
+    {
+      image.close();
+      LOG_INFO("rollout finished: %u done, %u failed", rolloutMasterCount(master, ROLLOUT_BOX_DONE),
+               rolloutMasterCount(master, ROLLOUT_BOX_FAILED));
+    }
+  }
+  else
+  {
+    rolloutSlaveUpdate(slaveBackend, slave);
+    if(restartPending && ((int32_t)(millis() - restartAtMs) >= 0))
+    {
+      ESP.restart();
+    }
+  }
+}
+
+void tallyBoxFirmwareReceive(tallyBoxConfig_t& c, uint16_t messageId, uint8_t *payload, uint16_t len, IPAddress from)
+{
+  rolloutMessage_t type = (rolloutMessage_t)(messageId - PEERNETWORK_ROLLOUT_OFFER_IDENTIFIER_U16);
+
+  if(c.network.isMaster)
+  {
+    if(type == ROLLOUT_MESSAGE_STATUS)
+    {
+      rolloutMasterReceive(masterBackend, master, (uint32_t)from, payload, len, millis());
+    }
+  }
+  else if(type != ROLLOUT_MESSAGE_STATUS)
+  {
+    uint8_t prevState = slave.state;
+
+    rolloutSlaveReceive(slaveBackend, slave, type, (uint32_t)from, payload, len);
+    logSlaveState(prevState);
+  }
+}
+
+/*the received blocks are written here, one per call: Update.write() erases and writes a flash
+  sector at a time, which does not belong in the tick*/
+void tallyBoxFirmwareIdle()
+{
+  uint8_t prevState = slave.state;
+
+  rolloutSlaveIdle(slaveBackend, slave);
+  logSlaveState(prevState);
+}
+
+bool tallyBoxFirmwareRolloutBusy()
+{
+  return ((master.phase == ROLLOUT_PREPARING) || (master.phase == ROLLOUT_RUNNING));
+}
+
+/*the boxes online at the start are the targets, a box that comes later needs the next rollout*/
+bool tallyBoxFirmwareRolloutStart(uint8_t concurrency)
+{
+  bool ret = false;
+
+  if(!tallyBoxFirmwareRolloutBusy())
+  {
+    IPAddress addresses[ROLLOUT_MAX_TARGETS];
+    uint16_t cameraIds[ROLLOUT_MAX_TARGETS];
+    uint8_t count = tallyBoxFleetOnlineBoxes(addresses, cameraIds, ROLLOUT_MAX_TARGETS);
+
+    image = filesystem->open(FIRMWARE_IMAGE_PATH, "r");
+    rolloutMasterInitialize(master);
+    for(uint8_t i = 0; i < count; i++)
+    {
+      rolloutMasterAddTarget(master, (uint32_t)addresses[i], cameraIds[i]);
+    }
+
+    ret = (image && rolloutMasterStart(master, image.size(), concurrency, millis()));
+    if(ret)
+    {
+      LOG_INFO("rollout of %u bytes to %u boxes, %u at a time", master.imageSize, count, master.concurrency);
+    }
+    else
+    {
+      LOG_WARN("rollout not started: %u boxes online, image %s", count, (image ? "found" : "missing"));
+      image.close();
+    }
+  }
+  return ret;
+}
+
+void tallyBoxFirmwareRolloutAbort()
+{
+  if(tallyBoxFirmwareRolloutBusy())
+  {
+    rolloutMasterAbort(master, millis());
+    image.close();
+    LOG_WARN("rollout aborted");
+  }
+}
+
+/*piece 0 is the rollout, 1..targetCount the boxes, then the end of the document*/
+static int formatPiece(uint8_t index, char *out, size_t maxLen)
+{
+  uint32_t now = millis();
+  int n = 0;
+
+  if(index == 0)
+  {
+    uint32_t elapsedMs = (master.startedAt == 0) ? 0 : ((master.phase == ROLLOUT_FINISHED ? master.finishedAt : now) - master.startedAt);
+
+    n = snprintf(out, maxLen, "{\"phase\": \"%s\", \"imageSize\": %u, \"imageId\": \"%08X\", \"concurrency\": %u, \"waves\": %u, "
+                 "\"elapsedMs\": %u, \"blocksSent\": %u, \"done\": %u, \"failed\": %u, \"boxes\": [",
+                 phaseNames[master.phase], master.imageSize, master.imageId, master.concurrency, master.waves, elapsedMs,
+                 master.blocksSent, rolloutMasterCount(master, ROLLOUT_BOX_DONE), rolloutMasterCount(master, ROLLOUT_BOX_FAILED));
+  }
+  else if(index <= master.targetCount)
+  {
+    rolloutTarget_t& t = master.targets[index - 1];
+    IPAddress address(t.address);
+    uint32_t durationMs = (t.startedAt == 0) ? 0 : ((t.finishedAt != 0 ? t.finishedAt : now) - t.startedAt);
+    uint8_t progress = (master.imageSize == 0) ? 0 : (uint8_t)((uint64_t)t.ackedOffset * 100 / master.imageSize);
+
+    n = snprintf(out, maxLen, "%s\n{\"cameraId\": %u, \"address\": \"%u.%u.%u.%u\", \"state\": \"%s\", \"error\": \"%s\", "
+                 "\"wave\": %u, \"attempts\": %u, \"progress\": %u, \"durationMs\": %u, \"resentBlocks\": %u}",
+                 ((index > 1) ? "," : ""), t.cameraId, address[0], address[1], address[2], address[3],
+                 rolloutBoxStateName(t.state), rolloutErrorName(t.error), t.wave, t.attempts, progress, durationMs, t.resentBlocks);
+  }
+  else
+  {
+    n = snprintf(out, maxLen, "\n]}\n");
+  }
+  return n;
+}
+
+size_t tallyBoxFirmwareRolloutRead(uint8_t& next, char *out, size_t maxLen)
+{
+  return readPieces(formatPiece, master.targetCount + 2, next, out, maxLen);
+}
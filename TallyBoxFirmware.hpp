@@ -0,0 +1,29 @@
+#ifndef __TALLYBOXFIRMWARE_HPP__
+#define __TALLYBOXFIRMWARE_HPP__
+#include "Arduino.h"
+#include <ESP8266WiFi.h>
+#include "TallyBoxConfiguration.hpp"
+
+/*firmware rollout on the boxes (protocol in TallyBoxRollout). The master reads the image from
+  its file system and sends it over the peer network to the boxes of the fleet that are online
+  when the rollout is started. A box writes the image with the Updater, and remembers which
+  image it restarted into, so that the master can tell when the box runs it.*/
+
+#define FIRMWARE_IMAGE_PATH             "/rollout.bin"
+#define FIRMWARE_INSTALLED_PATH         "/firmware.id"
+#define FIRMWARE_RESTART_DELAY_MS       200     /*lets the last status reach the master*/
+
+void tallyBoxFirmwareInitialize();
+void tallyBoxFirmwareUpdate(tallyBoxConfig_t& c);
+void tallyBoxFirmwareReceive(tallyBoxConfig_t& c, uint16_t messageId, uint8_t *payload, uint16_t len, IPAddress from);
+void tallyBoxFirmwareIdle();             /*from the idle time between the ticks*/
+
+/*master*/
+bool tallyBoxFirmwareRolloutStart(uint8_t concurrency);
+void tallyBoxFirmwareRolloutAbort();
+bool tallyBoxFirmwareRolloutBusy();         /*the image file is in use*/
+
+/*progress as json, rendered piece by piece: start with next = 0, done when 0 is returned*/
+size_t tallyBoxFirmwareRolloutRead(uint8_t& next, char *out, size_t maxLen);
+
+#endif
@@ -0,0 +1,452 @@
+#include "TallyBoxFleet.hpp"
+#include "TallyBoxPeerNetwork.hpp"
+#include "TallyBoxConfigSchema.hpp"
+#include "TallyBoxPersistence.hpp"
+#include "TallyBoxOutput.hpp"
+#include "TallyBoxInfra.hpp"
+#include "Arduino.h"
+#include <Arduino_CRC32.h>
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_FLEET;
+
+#define FLEET_ANNOUNCE_HEADER_SIZE      9     /*version(4) bsm enabled(1) bsm channel(1) bsm counter(2) count(1)*/
+#define FLEET_ANNOUNCE_ENTRY_SIZE       6     /*camera id(2) revision(4)*/
+#define FLEET_REQUEST_SIZE              7     /*camera id(2) index(1) revision(4)*/
+#define FLEET_PIECE_HEADER_SIZE         8     /*index(1) camera id(2) revision(4) length(1)*/
+#define FLEET_STATUS_SIZE               6     /*camera id(2) applied profile version(4)*/
+
+typedef struct
+{
+  uint16_t cameraId;              /*0 = all cameras without an own piece*/
+  uint32_t revision;              /*crc32 of the payload: unchanged content keeps its revision over reboots*/
+  uint8_t payloadLen;
+  uint8_t payload[FLEET_PIECE_MAX_PAYLOAD];
+} fleetPiece_t;
+
+typedef struct
+{
+  IPAddress address;
+  uint16_t cameraId;
+  uint32_t appliedVersion;
+  uint32_t lastSeenAt;
+} fleetBox_t;
+
+/*master*/
+static fleetPiece_t pieces[FLEET_MAX_PIECES];
+static fleetBox_t boxes[FLEET_MAX_BOXES];
+static fleetRolloutStatus_t myStatus = {};
+static uint32_t lastAnnounceAt = 0;
+static uint8_t prevBsmEnabled = 0;
+static uint16_t prevBsmChannel = 0;
+static uint32_t profileRevision = 0;   /*configuration revision the pieces were built at*/
+
+/*slave*/
+static bool pieceApplied = false;
+static uint16_t appliedCameraId = 0;
+static uint32_t appliedRevision = 0;
+static uint32_t runningVersion = 0;     /*profile version this box is up to date with*/
+static uint32_t requestedVersion = 0;
+
+static Arduino_CRC32 crc32;
+
+
+static void buildPiece(fleetPiece_t& piece, uint16_t cameraId, tallyBoxUserConfig_t& user)
+{
+  piece.cameraId = cameraId;
+  piece.payloadLen = (uint8_t)confSerializeBinary(userConfigSchema, &user, piece.payload, sizeof(piece.payload));
+  piece.revision = crc32.calc(piece.payload, piece.payloadLen);
+}
+
+/*returns true when the profile version changed*/
+static bool buildProfile(tallyBoxConfig_t& c)
+{
+  uint8_t manifest[FLEET_MAX_PIECES * FLEET_ANNOUNCE_ENTRY_SIZE];
+  uint8_t *p = manifest;
+  uint8_t count = 0;
+
+  /*the master's own user settings are the fleet wide default*/
+  buildPiece(pieces[count++], 0, c.user);
+
+  for(uint8_t i = 0; (i < c.fleet.overrideCount) && (count < FLEET_MAX_PIECES); i++)
+  {
+    buildPiece(pieces[count++], c.fleet.overrides[i].cameraId, c.fleet.overrides[i]);
+  }
+
+  for(uint8_t i = 0; i < count; i++)
+  {
+    putU16(&p, pieces[i].cameraId);
+    putU32(&p, pieces[i].revision);
+  }
+
+  uint32_t version = crc32.calc(manifest, (size_t)(p - manifest));
+  bool changed = ((version != myStatus.profileVersion) || (count != myStatus.pieces));
+
+  myStatus.profileVersion = version;
+  myStatus.pieces = count;
+
+  return changed;
+}
+
+static void sendAnnounce()
+{
+  uint8_t buf[FLEET_ANNOUNCE_HEADER_SIZE + FLEET_MAX_PIECES * FLEET_ANNOUNCE_ENTRY_SIZE];
+  uint8_t *p = buf;
+  uint8_t bsmEnabled;
+  uint16_t bsmCounter;
+  uint16_t bsmChannel;
+
+  /*brightness setting visualization rides along: it is not configuration, but not per tick either*/
+  getOutputTxData(bsmEnabled, bsmCounter, bsmChannel);
+
+  putU32(&p, myStatus.profileVersion);
+  putU8(&p, bsmEnabled);
+  putU8(&p, (uint8_t)bsmChannel);
+  putU16(&p, bsmCounter);
+  putU8(&p, myStatus.pieces);
+  for(uint8_t i = 0; i < myStatus.pieces; i++)
+  {
+    putU16(&p, pieces[i].cameraId);
+    putU32(&p, pieces[i].revision);
+  }
+
+  peerNetworkSendMessage(PEERNETWORK_FLEET_ANNOUNCE_IDENTIFIER_U16, buf, (uint16_t)(p - buf), IPAddress(0,0,0,0));
+
+  prevBsmEnabled = bsmEnabled;
+  prevBsmChannel = bsmChannel;
+  lastAnnounceAt = millis();
+}
+
+static void updateRolloutStatus()
+{
+  uint32_t now = millis();
+  uint8_t online = 0;
+  uint8_t upToDate = 0;
+
+  for(int i = 0; i < FLEET_MAX_BOXES; i++)
+  {
+    if(boxes[i].lastSeenAt && (now - boxes[i].lastSeenAt < FLEET_BOX_TIMEOUT_MS))
+    {
+      online++;
+      if(boxes[i].appliedVersion == myStatus.profileVersion)
+      {
+        upToDate++;
+      }
+    }
+  }
+
+  if((online != myStatus.boxesOnline) || (upToDate != myStatus.boxesUpToDate))
+  {
+    LOG_INFO("profile %08X applied by %u/%u boxes", myStatus.profileVersion, upToDate, online);
+  }
+  myStatus.boxesOnline = online;
+  myStatus.boxesUpToDate = upToDate;
+}
+
+static void handleRequest(uint8_t *payload, uint16_t len, IPAddress from)
+{
+  if(len != FLEET_REQUEST_SIZE)
+  {
+    return;
+  }
+
+  uint8_t *p = payload;
+  uint16_t cameraId = getU16(&p);
+  uint8_t index = getU8(&p);
+
+  /*the current piece is sent even if the request refers to an older revision: the box checks it*/
+  if((index < myStatus.pieces) && (pieces[index].cameraId == cameraId))
+  {
+    uint8_t buf[FLEET_PIECE_HEADER_SIZE + FLEET_PIECE_MAX_PAYLOAD];
+    fleetPiece_t& piece = pieces[index];
+
+    p = buf;
+    putU8(&p, index);
+    putU16(&p, piece.cameraId);
+    putU32(&p, piece.revision);
+    putU8(&p, piece.payloadLen);
+    putBytes(&p, piece.payload, piece.payloadLen);
+
+    peerNetworkSendMessage(PEERNETWORK_FLEET_PIECE_IDENTIFIER_U16, buf, (uint16_t)(p - buf), from);
+  }
+}
+
+static void handleStatus(uint8_t *payload, uint16_t len, IPAddress from)
+{
+  if(len != FLEET_STATUS_SIZE)
+  {
+    return;
+  }
+
+  uint8_t *p = payload;
+  uint32_t now = millis();
+  int slot = -1;
+
+  /*boxes are tracked by address, a box may change its camera id*/
+  for(int i = 0; (i < FLEET_MAX_BOXES) && (slot < 0); i++)
+  {
+    if(boxes[i].lastSeenAt && (boxes[i].address == from))
+    {
+      slot = i;
+    }
+  }
+
+  /*new box: free slot, or the one not heard of for the longest time*/
+  for(int i = 0; (i < FLEET_MAX_BOXES) && (slot < 0); i++)
+  {
+    if(boxes[i].lastSeenAt == 0)
+    {
+      slot = i;
+    }
+  }
+  if(slot < 0)
+  {
+    slot = 0;
+    for(int i = 1; i < FLEET_MAX_BOXES; i++)
+    {
+      if(now - boxes[i].lastSeenAt > now - boxes[slot].lastSeenAt)
+      {
+        slot = i;
+      }
+    }
+  }
+
+  boxes[slot].address = from;
+  boxes[slot].cameraId = getU16(&p);
+  boxes[slot].appliedVersion = getU32(&p);
+  boxes[slot].lastSeenAt = max(now, (uint32_t)1);   /*0 = free slot*/
+}
+
+static void sendStatus(tallyBoxConfig_t& c, IPAddress to)
+{
+  uint8_t buf[FLEET_STATUS_SIZE];
+  uint8_t *p = buf;
+
+  putU16(&p, c.user.cameraId);
+  putU32(&p, runningVersion);
+  peerNetworkSendMessage(PEERNETWORK_FLEET_STATUS_IDENTIFIER_U16, buf, sizeof(buf), to);
+}
+
+static void handleAnnounce(tallyBoxConfig_t& c, uint8_t *payload, uint16_t len, IPAddress from)
+{
+  if(len < FLEET_ANNOUNCE_HEADER_SIZE)
+  {
+    return;
+  }
+
+  uint8_t *p = payload;
+  uint32_t version = getU32(&p);
+  uint8_t bsmEnabled = getU8(&p);
+  uint8_t bsmChannel = getU8(&p);
+  uint16_t bsmCounter = getU16(&p);
+  uint8_t count = getU8(&p);
+  int wanted = -1;
+  uint16_t wantedCameraId = 0;
+  uint32_t wantedRevision = 0;
+
+  if((count > FLEET_MAX_PIECES) || (len != FLEET_ANNOUNCE_HEADER_SIZE + count * FLEET_ANNOUNCE_ENTRY_SIZE))
+  {
+    return;
+  }
+
+  putOutputRxData(bsmEnabled, bsmCounter, bsmChannel);
+
+  /*own piece if there is one, otherwise the fleet wide one*/
+  for(uint8_t i = 0; i < count; i++)
+  {
+    uint16_t cameraId = getU16(&p);
+    uint32_t revision = getU32(&p);
+
+    if((cameraId == c.user.cameraId) || ((cameraId == 0) && (wanted < 0)))
+    {
+      wanted = i;
+      wantedCameraId = cameraId;
+      wantedRevision = revision;
+    }
+  }
+
+  if(wanted >= 0)
+  {
+    if(pieceApplied && (appliedCameraId == wantedCameraId) && (appliedRevision == wantedRevision))
+    {
+      runningVersion = version;
+    }
+    else
+    {
+      uint8_t buf[FLEET_REQUEST_SIZE];
+
+      p = buf;
+      putU16(&p, wantedCameraId);
+      putU8(&p, (uint8_t)wanted);
+      putU32(&p, wantedRevision);
+      requestedVersion = version;
+      peerNetworkSendMessage(PEERNETWORK_FLEET_REQUEST_IDENTIFIER_U16, buf, sizeof(buf), from);
+    }
+  }
+
+  sendStatus(c, from);
+}
+
+static void handlePiece(tallyBoxConfig_t& c, uint8_t *payload, uint16_t len, IPAddress from)
+{
+  if(len < FLEET_PIECE_HEADER_SIZE)
+  {
+    return;
+  }
+
+  uint8_t *p = payload;
+  getU8(&p);  /*index*/
+  uint16_t cameraId = getU16(&p);
+  uint32_t revision = getU32(&p);
+  uint8_t payloadLen = getU8(&p);
+
+  if((len != FLEET_PIECE_HEADER_SIZE + payloadLen) || (crc32.calc(p, payloadLen) != revision)
+      || ((cameraId != 0) && (cameraId != c.user.cameraId)))
+  {
+    return;
+  }
+
+  tallyBoxUserConfig_t received = c.user;
+
+  if(confDeSerializeBinary(userConfigSchema, &received, p, payloadLen))
+  {
+    uint8_t before[FLEET_PIECE_MAX_PAYLOAD];
+    uint8_t after[FLEET_PIECE_MAX_PAYLOAD];
+
+    /*the camera id is the address of the box, never taken from the profile. The inputs a box
+      watches are its own too, only an override for its camera sets them.*/
+    received.cameraId = c.user.cameraId;
+    if(cameraId == 0)
+    {
+      received.watchedInputs = c.user.watchedInputs;
+      received.watchRule = c.user.watchRule;
+    }
+    received.sizeOfConfiguration = c.user.sizeOfConfiguration;
+    received.versionOfConfiguration = c.user.versionOfConfiguration;
+
+    uint16_t beforeLen = confSerializeBinary(userConfigSchema, &c.user, before, sizeof(before));
+    uint16_t afterLen = confSerializeBinary(userConfigSchema, &received, after, sizeof(after));
+
+    if((beforeLen != afterLen) || (memcmp(before, after, afterLen) != 0))
+    {
+      c.user = received;
+      tallyBoxScheduleConfigurationWrite(c.user);
+      LOG_INFO("applied piece %u revision %08X", cameraId, revision);
+    }
+
+    pieceApplied = true;
+    appliedCameraId = cameraId;
+    appliedRevision = revision;
+    runningVersion = requestedVersion;
+
+    sendStatus(c, from);
+  }
+}
+
+void tallyBoxFleetUpdate(tallyBoxConfig_t& c)
+{
+  uint8_t bsmEnabled;
+  uint16_t bsmCounter;
+  uint16_t bsmChannel;
+  bool profileChanged = false;
+
+  getOutputTxData(bsmEnabled, bsmCounter, bsmChannel);
+
+  /*the pieces and their checksums only change with the configuration*/
+  if(profileRevision != tallyBoxGetConfigurationRevision())
+  {
+    profileRevision = tallyBoxGetConfigurationRevision();
+    profileChanged = buildProfile(c);
+  }
+
+  if(profileChanged || (bsmEnabled != prevBsmEnabled) || (bsmChannel != prevBsmChannel)
+      || (millis() - lastAnnounceAt >= FLEET_ANNOUNCE_PERIOD_MS))
+  {
+    sendAnnounce();
+    updateRolloutStatus();
+  }
+}
+
+void tallyBoxFleetReceive(tallyBoxConfig_t& c, uint16_t messageId, uint8_t *payload, uint16_t len, IPAddress from)
+{
+  if(c.network.isMaster)
+  {
+    switch(messageId)
+    {
+      case PEERNETWORK_FLEET_REQUEST_IDENTIFIER_U16:
+        handleRequest(payload, len, from);
+        break;
+      case PEERNETWORK_FLEET_STATUS_IDENTIFIER_U16:
+        handleStatus(payload, len, from);
+        break;
+      default:
+        break;
+    }
+  }
+  else
+  {
+    switch(messageId)
+    {
+      case PEERNETWORK_FLEET_ANNOUNCE_IDENTIFIER_U16:
+        handleAnnounce(c, payload, len, from);
+        break;
+      case PEERNETWORK_FLEET_PIECE_IDENTIFIER_U16:
+        handlePiece(c, payload, len, from);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+const fleetRolloutStatus_t& tallyBoxFleetGetStatus()
+{
+  return myStatus;
+}
+
+uint8_t tallyBoxFleetOnlineBoxes(IPAddress *addresses, uint16_t *cameraIds, uint8_t maxBoxes)
+{
+  uint32_t now = millis();
+  uint8_t count = 0;
+
+  for(int i = 0; (i < FLEET_MAX_BOXES) && (count < maxBoxes); i++)
+  {
+    if(boxes[i].lastSeenAt && (now - boxes[i].lastSeenAt < FLEET_BOX_TIMEOUT_MS))
+    {
+      addresses[count] = boxes[i].address;
+      cameraIds[count] = boxes[i].cameraId;
+      count++;
+    }
+  }
+  return count;
+}
+
+size_t tallyBoxFleetStatusJson(char *out, size_t maxLen)
+{
+  uint32_t now = millis();
+  size_t pos = snprintf(out, maxLen, "{\"profileVersion\": \"%08X\", \"pieces\": %u, \"boxesOnline\": %u, \"boxesUpToDate\": %u, \"boxes\": [",
+                        myStatus.profileVersion, myStatus.pieces, myStatus.boxesOnline, myStatus.boxesUpToDate);
+  bool first = true;
+
+  for(int i = 0; (i < FLEET_MAX_BOXES) && (pos < maxLen); i++)
+  {
+    fleetBox_t& b = boxes[i];
+
+    if(b.lastSeenAt == 0)
+    {
+      continue;
+    }
+    pos += snprintf(out + pos, maxLen - pos, "%s{\"cameraId\": %u, \"address\": \"%u.%u.%u.%u\", \"online\": %s, \"upToDate\": %s, \"lastSeenMs\": %u}",
+                    (first ? "" : ", "), b.cameraId, b.address[0], b.address[1], b.address[2], b.address[3],
+                    ((now - b.lastSeenAt < FLEET_BOX_TIMEOUT_MS) ? "true" : "false"),
+                    ((b.appliedVersion == myStatus.profileVersion) ? "true" : "false"),
+                    (uint32_t)(now - b.lastSeenAt));
+    first = false;
+  }
+  if(pos < maxLen)
+  {
+    pos += snprintf(out + pos, maxLen - pos, "]}");
+  }
+
+  return (pos < maxLen ? pos : 0);
+}
@@ -0,0 +1,36 @@
+#ifndef __TALLYBOXFLEET_HPP__
+#define __TALLYBOXFLEET_HPP__
+#include "Arduino.h"
+#include <ESP8266WiFi.h>
+#include "TallyBoxConfiguration.hpp"
+
+/*Configuration distribution from the master to the other boxes. The master announces the
+  manifest of its fleet profile (one piece per camera id, 0 = all cameras) once per second and
+  on every change. A box fetches only the piece meant for it, and only when its revision differs
+  from the one already applied, then reports the profile version it is running. The tally
+  frames carry no configuration.*/
+
+#define FLEET_MAX_PIECES                (1 + CONF_FLEET_MAX_OVERRIDES)
+#define FLEET_MAX_BOXES                 32
+#define FLEET_PIECE_MAX_PAYLOAD         32
+#define FLEET_ANNOUNCE_PERIOD_MS        1000
+#define FLEET_BOX_TIMEOUT_MS            5000    /*box not heard of in this time is shown offline*/
+
+typedef struct
+{
+  uint32_t profileVersion;
+  uint8_t pieces;
+  uint8_t boxesOnline;
+  uint8_t boxesUpToDate;
+} fleetRolloutStatus_t;
+
+void tallyBoxFleetUpdate(tallyBoxConfig_t& c);
+void tallyBoxFleetReceive(tallyBoxConfig_t& c, uint16_t messageId, uint8_t *payload, uint16_t len, IPAddress from);
+
+const fleetRolloutStatus_t& tallyBoxFleetGetStatus();
+size_t tallyBoxFleetStatusJson(char *out, size_t maxLen);
+
+/*boxes heard of within FLEET_BOX_TIMEOUT_MS, returns the count*/
+uint8_t tallyBoxFleetOnlineBoxes(IPAddress *addresses, uint16_t *cameraIds, uint8_t maxBoxes);
+
+#endif
@@ -0,0 +1,1077 @@
+#include "TallyBoxHttp.hpp"
+#include "Arduino.h"
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_HTTP;
+
+typedef enum
+{
+  CONN_FREE = 0,
+  CONN_REQUEST_LINE,
+  CONN_HEADERS,
+  CONN_BODY,            /*body kept in ram: form or plain*/
+  CONN_UPLOAD,          /*multipart body streamed to the upload handler*/
+  CONN_HANDLE,
+  CONN_SEND,
+  CONN_CLOSING          /*response written, waiting for it to be acknowledged*/
+} connState_t;
+
+typedef enum
+{
+  BODY_NONE,
+  BODY_TEXT,
+  BODY_FILE,
+  BODY_READER
+} bodySource_t;
+
+typedef enum
+{
+  PART_PREAMBLE,        /*before the first boundary*/
+  PART_DELIMITER_LINE,  /*rest of the boundary line: "" or "--" after the last part*/
+  PART_HEADERS,
+  PART_DATA,
+  PART_DONE
+} partState_t;
+
+typedef struct
+{
+  const char *name;
+  const char *value;
+} httpArg_t;
+
+typedef struct
+{
+  const char *path;
+  httpMethod_t method;
+  httpHandler_t handler;
+  httpUploadHandler_t upload;
+} route_t;
+
+struct httpConnection_s
+{
+  WiFiClient client;
+  connState_t state;
+  uint32_t lastActivityMs;
+  size_t idleSendBuffer;          /*availableForWrite() with nothing in flight*/
+
+  /*request*/
+  httpMethod_t method;
+  const route_t *route;
+  char line[HTTP_MAX_LINE];
+  uint16_t lineLen;
+  char path[HTTP_MAX_PATH];
+  char query[HTTP_MAX_QUERY];
+  char ifNoneMatch[16];
+  bool isForm;
+  char boundary[HTTP_MAX_BOUNDARY];
+  uint8_t boundaryLen;            /*0 = not multipart*/
+  uint32_t contentLength;
+  uint32_t bodyReceived;
+  char *body;                     /*only while the request is handled*/
+  httpArg_t args[HTTP_MAX_ARGS];
+  uint8_t argCount;
+
+  /*multipart upload*/
+  partState_t partState;
+  bool partIsFile;
+  uint8_t matched;                /*bytes of the boundary matched so far*/
+  char fileName[HTTP_MAX_PATH];
+  char fields[HTTP_MAX_FORM_FIELDS];  /*"name\0value\0" of the parts other than files*/
+  uint16_t fieldsLen;
+  int16_t fieldName;              /*offset of the name of the current field, -1 = none*/
+  uint16_t fieldValue;
+
+  /*response*/
+  bool responded;
+  char headers[HTTP_MAX_HEADERS];
+  uint16_t headersLen;
+  bodySource_t source;
+  String text;
+  uint32_t textPos;
+  File file;
+  httpBodyReader_t reader;
+  char out[HTTP_OUT_BUFFER_SIZE]; /*also collects upload data*/
+  uint16_t outLen;
+  uint16_t outPos;
+  uint32_t context[HTTP_CONTEXT_SIZE / sizeof(uint32_t)];
+};
+
+typedef struct
+{
+  const char *path;
+  httpUpgradeHandler_t handler;
+} upgrade_t;
+
+static WiFiServer *myServer = NULL;
+static httpConnection_t connections[HTTP_MAX_CONNECTIONS];
+static route_t routes[HTTP_MAX_ROUTES];
+static uint8_t routeCount = 0;
+static httpHandler_t notFoundHandler = NULL;
+static upgrade_t upgrade = {NULL, NULL};
+static httpStats_t myStats = {};
+static uint8_t nextConnection = 0;    /*round robin start*/
+
+static const char* statusText(int code)
+{
+  switch(code)
+  {
+    case 200: return "OK";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    default:  return "";
+  }
+}
+
+/*** request parsing *****************************************/
+
+static void urlDecode(char *s)
+{
+  char *out = s;
+
+  while(*s)
+  {
+    if((*s == '%') && isxdigit((unsigned char)s[1]) && isxdigit((unsigned char)s[2]))
+    {
+      char hex[3] = {s[1], s[2], 0};
+      *out++ = (char)strtol(hex, NULL, 16);
+      s += 3;
+    }
+    else if(*s == '+')
+    {
+      *out++ = ' ';
+      s++;
+    }
+    else
+    {
+      *out++ = *s++;
+    }
+  }
+  *out = 0;
+}
+
+/*"a=1&b=2", split and decoded in place*/
+static void parseArgs(httpConnection_t& conn, char *s)
+{
+  while(s && *s && (conn.argCount < HTTP_MAX_ARGS))
+  {
+    char *next = strchr(s, '&');
+    char *eq;
+
+    if(next)
+    {
+      *next++ = 0;
+    }
+    eq = strchr(s, '=');
+    if(eq)
+    {
+      *eq++ = 0;
+    }
+    urlDecode(s);
+    if(eq)
+    {
+      urlDecode(eq);
+    }
+    conn.args[conn.argCount].name = s;
+    conn.args[conn.argCount].value = (eq ? eq : "");
+    conn.argCount++;
+    s = next;
+  }
+}
+
+static httpMethod_t parseMethod(const char *m)
+{
+  if(strcmp(m, "GET") == 0) return HTTP_METHOD_GET;
+  if(strcmp(m, "POST") == 0) return HTTP_METHOD_POST;
+  if(strcmp(m, "PUT") == 0) return HTTP_METHOD_PUT;
+  if(strcmp(m, "DELETE") == 0) return HTTP_METHOD_DELETE;
+  return HTTP_METHOD_OTHER;
+}
+
+/*collects one line, true when complete. Characters beyond the buffer are dropped*/
+static bool readLine(httpConnection_t& conn, char ch)
+{
+  if(ch == '\n')
+  {
+    if((conn.lineLen > 0) && (conn.line[conn.lineLen - 1] == '\r'))
+    {
+      conn.lineLen--;
+    }
+    conn.line[conn.lineLen] = 0;
+    return true;
+  }
+  if(conn.lineLen < (sizeof(conn.line) - 1))
+  {
+    conn.line[conn.lineLen++] = ch;
+  }
+  return false;
+}
+
+static bool parseRequestLine(httpConnection_t& conn)
+{
+  char *target = strchr(conn.line, ' ');
+  char *version;
+  char *query;
+
+  if(!target)
+  {
+    return false;
+  }
+  *target++ = 0;
+  version = strchr(target, ' ');
+  if(!version)
+  {
+    return false;
+  }
+  *version = 0;
+
+  conn.method = parseMethod(conn.line);
+
+  query = strchr(target, '?');
+  if(query)
+  {
+    *query++ = 0;
+    strlcpy(conn.query, query, sizeof(conn.query));
+  }
+  strlcpy(conn.path, target, sizeof(conn.path));
+  urlDecode(conn.path);
+
+  return (conn.path[0] == '/');
+}
+
+static void parseHeader(httpConnection_t& conn)
+{
+  char *value = strchr(conn.line, ':');
+
+  if(!value)
+  {
+    return;
+  }
+  *value++ = 0;
+  while(*value == ' ')
+  {
+    value++;
+  }
+
+  if(strcasecmp(conn.line, "Content-Length") == 0)
+  {
+    conn.contentLength = strtoul(value, NULL, 10);
+  }
+  else if(strcasecmp(conn.line, "If-None-Match") == 0)
+  {
+    strlcpy(conn.ifNoneMatch, value, sizeof(conn.ifNoneMatch));
+  }
+  else if(strcasecmp(conn.line, "Content-Type") == 0)
+  {
+    const char *b = strstr(value, "boundary=");
+
+    conn.isForm = (strncasecmp(value, "application/x-www-form-urlencoded", 33) == 0);
+
+    if((strncasecmp(value, "multipart/form-data", 19) == 0) && b)
+    {
+      b += 9;
+      snprintf(conn.boundary, sizeof(conn.boundary), "\r\n--%s", b);
+      conn.boundaryLen = strlen(conn.boundary);
+    }
+  }
+}
+
+static const route_t* findRoute(httpConnection_t& conn)
+{
+  for(uint8_t i = 0; i < routeCount; i++)
+  {
+    if((strcmp(routes[i].path, conn.path) == 0)
+       && ((routes[i].method == HTTP_METHOD_ANY) || (routes[i].method == conn.method)))
+    {
+      return &routes[i];
+    }
+  }
+  return NULL;
+}
+
+/*** response ************************************************/
+
+static void respond(httpConnection_t& conn, int code, const char *contentType, bodySource_t source, int32_t contentLength)
+{
+  int len;
+
+  if(conn.responded)
+  {
+    return;
+  }
+  conn.responded = true;
+  conn.source = source;
+
+  len = snprintf(conn.out, sizeof(conn.out), "HTTP/1.1 %d %s\r\nContent-Type: %s\r\n", code, statusText(code), contentType);
+  if((contentLength >= 0) && (len < (int)sizeof(conn.out)))
+  {
+    len += snprintf(conn.out + len, sizeof(conn.out) - len, "Content-Length: %d\r\n", contentLength);
+  }
+  else if((source == BODY_READER) && (len < (int)sizeof(conn.out)))
+  {
+    len += snprintf(conn.out + len, sizeof(conn.out) - len, "Transfer-Encoding: chunked\r\n");
+  }
+  if(len < (int)sizeof(conn.out))
+  {
+    len += snprintf(conn.out + len, sizeof(conn.out) - len, "%sConnection: close\r\n\r\n", conn.headers);
+  }
+  conn.outLen = min(len, (int)sizeof(conn.out) - 1);
+  conn.outPos = 0;
+}
+
+/*a reader's output is sent chunked: the length as hex (fixed width, leading zeros are allowed),
+  CRLF, the data and CRLF. The chunk of length 0 ends the body.*/
+static size_t fillChunk(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  size_t len = conn.reader(conn, out + HTTP_CHUNK_HEADER_SIZE, maxLen - HTTP_CHUNK_HEADER_SIZE - 2);
+  char header[HTTP_CHUNK_HEADER_SIZE + 1];
+  size_t ret = 5;
+
+  if(len == 0)
+  {
+    conn.source = BODY_NONE;    /*nothing follows the last chunk*/
+    memcpy(out, "0\r\n\r\n", ret);
+  }
+  else
+  {
+    snprintf(header, sizeof(header), "%03X\r\n", (unsigned)len);
+    memcpy(out, header, HTTP_CHUNK_HEADER_SIZE);
+    memcpy(out + HTTP_CHUNK_HEADER_SIZE + len, "\r\n", 2);
+    ret = HTTP_CHUNK_HEADER_SIZE + len + 2;
+  }
+  return ret;
+}
+
+static size_t fillBody(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  size_t len = 0;
+
+  switch(conn.source)
+  {
+    case BODY_TEXT:
+      len = min((size_t)(conn.text.length() - conn.textPos), maxLen);
+      memcpy(out, conn.text.c_str() + conn.textPos, len);
+      conn.textPos += len;
+      break;
+    case BODY_FILE:
+      len = conn.file.read((uint8_t*)out, maxLen);
+      break;
+    case BODY_READER:
+      len = fillChunk(conn, out, maxLen);
+      break;
+    default:
+      break;
+  }
+  return len;
+}
+
+/*** connection handling *************************************/
+
+static void notifyUpload(httpConnection_t& conn, httpUploadStatus_t status, const uint8_t *data, size_t len);
+
+static void resetConnection(httpConnection_t& conn)
+{
+  conn.state = CONN_FREE;
+  conn.route = NULL;
+  conn.lineLen = 0;
+  conn.path[0] = 0;
+  conn.query[0] = 0;
+  conn.ifNoneMatch[0] = 0;
+  conn.isForm = false;
+  conn.boundaryLen = 0;
+  conn.contentLength = 0;
+  conn.bodyReceived = 0;
+  conn.argCount = 0;
+  conn.partState = PART_PREAMBLE;
+  conn.partIsFile = false;
+  conn.matched = 0;
+  conn.fieldsLen = 0;
+  conn.fieldName = -1;
+  conn.responded = false;
+  conn.headers[0] = 0;
+  conn.headersLen = 0;
+  conn.source = BODY_NONE;
+  conn.textPos = 0;
+  conn.reader = NULL;
+  conn.outLen = 0;
+  conn.outPos = 0;
+}
+
+static void closeConnection(httpConnection_t& conn)
+{
+  if((conn.state == CONN_UPLOAD) && (conn.partState == PART_DATA))
+  {
+    notifyUpload(conn, HTTP_UPLOAD_ABORTED, NULL, 0);
+  }
+  if(conn.body)
+  {
+    free(conn.body);
+    conn.body = NULL;
+  }
+  if(conn.file)
+  {
+    conn.file.close();
+  }
+  conn.text = String();
+  conn.client.stop();
+  resetConnection(conn);
+}
+
+static void startHandling(httpConnection_t& conn)
+{
+  conn.route = findRoute(conn);
+
+  if((conn.contentLength == 0) || (conn.method == HTTP_METHOD_GET))
+  {
+    conn.state = CONN_HANDLE;
+  }
+  else if(conn.boundaryLen > 0)
+  {
+    conn.partState = PART_PREAMBLE;
+    conn.matched = 2;             /*the body starts with the boundary without the leading "\r\n"*/
+    conn.outLen = 0;
+    conn.state = CONN_UPLOAD;
+  }
+  else if((conn.contentLength <= HTTP_MAX_BODY) && ((conn.body = (char*)malloc(conn.contentLength + 1)) != NULL))
+  {
+    conn.state = CONN_BODY;
+  }
+  else
+  {
+    myStats.rejected++;
+    httpSend(conn, 413, "text/plain", "Request too large");
+    conn.state = CONN_SEND;
+  }
+}
+
+static bool stepRequestLine(httpConnection_t& conn)
+{
+  bool progress = false;
+
+  for(int i = 0; (i < HTTP_READ_PER_STEP) && conn.client.available(); i++)
+  {
+    progress = true;
+    if(readLine(conn, (char)conn.client.read()))
+    {
+      conn.lineLen = 0;
+
+      if(conn.line[0] == 0)
+      {
+        continue;   /*empty lines before the request are allowed*/
+      }
+      myStats.requests++;
+      METRIC_INC(METRIC_HTTP_REQUESTS);
+
+      if(!parseRequestLine(conn))
+      {
+        myStats.rejected++;
+        httpSend(conn, 400, "text/plain", "Bad request");
+        conn.state = CONN_SEND;
+        break;
+      }
+
+      /*hand over before the headers are read, the new owner reads them itself*/
+      if(upgrade.handler && (conn.method == HTTP_METHOD_GET) && (strcmp(conn.path, upgrade.path) == 0))
+      {
+        char url[HTTP_MAX_PATH + HTTP_MAX_QUERY + 1];
+
+        snprintf(url, sizeof(url), "%s%s%s", conn.path, (conn.query[0] ? "?" : ""), conn.query);
+        if(upgrade.handler(conn.client, url))
+        {
+          conn.client = WiFiClient();   /*forget without closing*/
+          resetConnection(conn);
+          break;
+        }
+      }
+
+      parseArgs(conn, conn.query);
+      conn.state = CONN_HEADERS;
+      break;
+    }
+  }
+  return progress;
+}
+
+static bool stepHeaders(httpConnection_t& conn)
+{
+  bool progress = false;
+
+  for(int i = 0; (i < HTTP_READ_PER_STEP) && conn.client.available(); i++)
+  {
+    progress = true;
+    if(readLine(conn, (char)conn.client.read()))
+    {
+      conn.lineLen = 0;
+
+      if(conn.line[0] == 0)
+      {
+        startHandling(conn);
+        break;
+      }
+      parseHeader(conn);
+    }
+  }
+  return progress;
+}
+
+static bool stepBody(httpConnection_t& conn)
+{
+  size_t want = min((size_t)(conn.contentLength - conn.bodyReceived), (size_t)HTTP_READ_PER_STEP);
+  int got = conn.client.read((uint8_t*)conn.body + conn.bodyReceived, want);
+
+  if(got <= 0)
+  {
+    return false;
+  }
+  conn.bodyReceived += got;
+
+  if(conn.bodyReceived >= conn.contentLength)
+  {
+    conn.body[conn.bodyReceived] = 0;
+    if(conn.isForm)
+    {
+      parseArgs(conn, conn.body);
+    }
+    conn.state = CONN_HANDLE;
+  }
+  return true;
+}
+
+static void notifyUpload(httpConnection_t& conn, httpUploadStatus_t status, const uint8_t *data, size_t len)
+{
+  if(conn.partIsFile && conn.route && conn.route->upload)
+  {
+    conn.route->upload(conn, status, conn.fileName, data, len);
+  }
+}
+
+static void uploadFlush(httpConnection_t& conn)
+{
+  if(conn.outLen > 0)
+  {
+    notifyUpload(conn, HTTP_UPLOAD_WRITE, (const uint8_t*)conn.out, conn.outLen);
+  }
+  conn.outLen = 0;
+}
+
+/*the data of a file goes to the upload handler, the value of a field to the args*/
+static void uploadData(httpConnection_t& conn, const char *data, size_t len)
+{
+  while(len-- > 0)
+  {
+    if(conn.partIsFile)
+    {
+      conn.out[conn.outLen++] = *data++;
+      if(conn.outLen >= sizeof(conn.out))
+      {
+        uploadFlush(conn);
+      }
+    }
+    else if((conn.fieldName >= 0) && (conn.fieldsLen < (sizeof(conn.fields) - 1)))
+    {
+      conn.fields[conn.fieldsLen++] = *data++;
+    }
+    else
+    {
+      data++;   /*too long or no name, dropped*/
+    }
+  }
+}
+
+static void uploadEndPart(httpConnection_t& conn)
+{
+  uploadFlush(conn);
+  notifyUpload(conn, HTTP_UPLOAD_END, NULL, 0);
+
+  if((conn.fieldName >= 0) && (conn.argCount < HTTP_MAX_ARGS))
+  {
+    conn.fields[conn.fieldsLen++] = 0;
+    conn.args[conn.argCount].name = conn.fields + conn.fieldName;
+    conn.args[conn.argCount].value = conn.fields + conn.fieldValue;
+    conn.argCount++;
+  }
+  conn.fieldName = -1;
+  conn.partIsFile = false;
+}
+
+/*copies the quoted value following key, false when not there*/
+static bool dispositionParameter(const char *line, const char *key, char *out, size_t maxLen)
+{
+  const char *v = strstr(line, key);
+  const char *end;
+  size_t len;
+
+  if(!v)
+  {
+    return false;
+  }
+  v += strlen(key);
+  end = strchr(v, '"');
+  len = (end ? (size_t)(end - v) : strlen(v));
+  len = min(len, maxLen - 1);
+  memcpy(out, v, len);
+  out[len] = 0;
+  return true;
+}
+
+static void uploadPartHeader(httpConnection_t& conn)
+{
+  /*Content-Disposition: form-data; name="data"; filename="x.htm"*/
+  if(strncasecmp(conn.line, "Content-Disposition:", 20) == 0)
+  {
+    char name[HTTP_MAX_PATH];
+
+    if(dispositionParameter(conn.line, "filename=\"", conn.fileName, sizeof(conn.fileName)))
+    {
+      conn.partIsFile = true;
+    }
+    else if(dispositionParameter(conn.line, " name=\"", name, sizeof(name))
+            && ((conn.fieldsLen + strlen(name) + 2) <= sizeof(conn.fields)))
+    {
+      conn.fieldName = conn.fieldsLen;
+      strcpy(conn.fields + conn.fieldsLen, name);
+      conn.fieldsLen += strlen(name) + 1;
+      conn.fieldValue = conn.fieldsLen;
+    }
+  }
+}
+
+/*the boundary starts with '\r' and has no other '\r', so a failed match never hides the start of another*/
+static void uploadByte(httpConnection_t& conn, char ch)
+{
+  switch(conn.partState)
+  {
+    case PART_PREAMBLE:
+    case PART_DATA:
+      if(ch == conn.boundary[conn.matched])
+      {
+        if(++conn.matched == conn.boundaryLen)
+        {
+          if(conn.partState == PART_DATA)
+          {
+            uploadEndPart(conn);
+          }
+          conn.matched = 0;
+          conn.lineLen = 0;
+          conn.partState = PART_DELIMITER_LINE;
+        }
+        break;
+      }
+      if(conn.partState == PART_DATA)
+      {
+        uploadData(conn, conn.boundary, conn.matched);
+      }
+      conn.matched = 0;
+      if(ch == conn.boundary[0])
+      {
+        conn.matched = 1;
+      }
+      else if(conn.partState == PART_DATA)
+      {
+        uploadData(conn, &ch, 1);
+      }
+      break;
+
+    case PART_DELIMITER_LINE:
+      if(readLine(conn, ch))
+      {
+        conn.lineLen = 0;
+        conn.partState = ((strncmp(conn.line, "--", 2) == 0) ? PART_DONE : PART_HEADERS);
+      }
+      break;
+
+    case PART_HEADERS:
+      if(readLine(conn, ch))
+      {
+        conn.lineLen = 0;
+        if(conn.line[0] == 0)
+        {
+          conn.partState = PART_DATA;
+          conn.outLen = 0;
+          notifyUpload(conn, HTTP_UPLOAD_START, NULL, 0);
+        }
+        else
+        {
+          uploadPartHeader(conn);
+        }
+      }
+      break;
+
+    default:
+      break;    /*epilogue*/
+  }
+}
+
+static bool stepUpload(httpConnection_t& conn)
+{
+  char buf[HTTP_READ_PER_STEP];
+  size_t want = min((size_t)(conn.contentLength - conn.bodyReceived), sizeof(buf));
+  int got = conn.client.read((uint8_t*)buf, want);
+
+  if(got <= 0)
+  {
+    return false;
+  }
+  conn.bodyReceived += got;
+
+  for(int i = 0; i < got; i++)
+  {
+    uploadByte(conn, buf[i]);
+  }
+  if(conn.partState == PART_DATA)
+  {
+    uploadFlush(conn);
+  }
+
+  if(conn.bodyReceived >= conn.contentLength)
+  {
+    if(conn.partState == PART_DATA)
+    {
+      notifyUpload(conn, HTTP_UPLOAD_ABORTED, NULL, 0);
+    }
+    conn.partIsFile = false;
+    conn.fieldName = -1;
+    conn.outLen = 0;
+    conn.state = CONN_HANDLE;
+  }
+  return true;
+}
+
+static void stepHandle(httpConnection_t& conn)
+{
+  if(conn.route)
+  {
+    conn.route->handler(conn);
+  }
+  else if(notFoundHandler)
+  {
+    notFoundHandler(conn);
+  }
+
+  if(!conn.responded)
+  {
+    httpSend(conn, 404, "text/plain", "FileNotFound");
+  }
+  if(conn.body)
+  {
+    free(conn.body);
+    conn.body = NULL;
+  }
+  conn.state = CONN_SEND;
+}
+
+static bool stepSend(httpConnection_t& conn)
+{
+  size_t room;
+  size_t n;
+
+  if(conn.outPos >= conn.outLen)
+  {
+    conn.outLen = fillBody(conn, conn.out, sizeof(conn.out));
+    conn.outPos = 0;
+    if(conn.outLen == 0)
+    {
+      conn.state = CONN_CLOSING;
+      return true;
+    }
+  }
+
+  room = conn.client.availableForWrite();
+  if(room == 0)
+  {
+    return false;
+  }
+  n = min(room, (size_t)(conn.outLen - conn.outPos));
+  conn.client.write((const uint8_t*)conn.out + conn.outPos, n);
+  conn.outPos += n;
+  return true;
+}
+
+/*one bounded piece of work, true when something was done*/
+static bool stepConnection(httpConnection_t& conn)
+{
+  bool progress = false;
+
+  switch(conn.state)
+  {
+    case CONN_REQUEST_LINE:
+      progress = stepRequestLine(conn);
+      break;
+    case CONN_HEADERS:
+      progress = stepHeaders(conn);
+      break;
+    case CONN_BODY:
+      progress = stepBody(conn);
+      break;
+    case CONN_UPLOAD:
+      progress = stepUpload(conn);
+      break;
+    case CONN_HANDLE:
+      stepHandle(conn);
+      progress = true;
+      break;
+    case CONN_SEND:
+      progress = stepSend(conn);
+      break;
+    case CONN_CLOSING:
+      /*close once the peer has everything, stop() would wait for it otherwise*/
+      if(((size_t)conn.client.availableForWrite() >= conn.idleSendBuffer) || !conn.client.connected())
+      {
+        closeConnection(conn);
+        progress = true;
+      }
+      break;
+    default:
+      break;
+  }
+
+  if(conn.state == CONN_FREE)
+  {
+    return progress;
+  }
+
+  if(progress)
+  {
+    conn.lastActivityMs = millis();
+  }
+  else if(!conn.client.connected() && (conn.client.available() == 0))
+  {
+    closeConnection(conn);
+  }
+  else if((millis() - conn.lastActivityMs) > HTTP_IDLE_TIMEOUT_MS)
+  {
+    myStats.timeouts++;
+    closeConnection(conn);
+  }
+  return progress;
+}
+
+static void acceptConnections()
+{
+  for(uint8_t i = 0; (i < HTTP_MAX_CONNECTIONS) && myServer->hasClient(); i++)
+  {
+    httpConnection_t& conn = connections[i];
+
+    if(conn.state == CONN_FREE)
+    {
+      /*connections beyond the free slots wait in the backlog of the server*/
+      resetConnection(conn);
+      conn.client = myServer->accept();
+      conn.client.setNoDelay(true);
+      conn.idleSendBuffer = conn.client.availableForWrite();
+      conn.lastActivityMs = millis();
+      conn.state = CONN_REQUEST_LINE;
+    }
+  }
+}
+
+/*** interface ***********************************************/
+
+void tallyBoxHttpInitialize(uint16_t port)
+{
+  for(uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+  {
+    connections[i].body = NULL;
+    resetConnection(connections[i]);
+  }
+
+  myServer = new WiFiServer(port);
+  myServer->begin();
+}
+
+void tallyBoxHttpOn(const char *path, httpMethod_t method, httpHandler_t handler, httpUploadHandler_t upload)
+{
+  if(routeCount < HTTP_MAX_ROUTES)
+  {
+    routes[routeCount].path = path;
+    routes[routeCount].method = method;
+    routes[routeCount].handler = handler;
+    routes[routeCount].upload = upload;
+    routeCount++;
+  }
+  else
+  {
+    LOG_ERROR("no room for route %s", path);
+  }
+}
+
+void tallyBoxHttpOnNotFound(httpHandler_t handler)
+{
+  notFoundHandler = handler;
+}
+
+void tallyBoxHttpOnUpgrade(const char *path, httpUpgradeHandler_t handler)
+{
+  upgrade.path = path;
+  upgrade.handler = handler;
+}
+
+void tallyBoxHttpUpdate(uint32_t budgetUs)
+{
+  uint32_t start = micros();
+  bool progress = true;
+
+  if(myServer == NULL)
+  {
+    return;
+  }
+
+  acceptConnections();
+
+  /*round robin over the connections until nothing moves or the budget is used*/
+  while(progress && ((micros() - start) < budgetUs))
+  {
+    progress = false;
+
+    for(uint8_t n = 0; (n < HTTP_MAX_CONNECTIONS) && ((micros() - start) < budgetUs); n++)
+    {
+      httpConnection_t& conn = connections[(nextConnection + n) % HTTP_MAX_CONNECTIONS];
+
+      if(conn.state != CONN_FREE)
+      {
+        uint32_t stepStart = micros();
+
+        if(stepConnection(conn))
+        {
+          progress = true;
+        }
+        myStats.worstStepUs = max(myStats.worstStepUs, (uint32_t)(micros() - stepStart));
+      }
+    }
+    nextConnection = (nextConnection + 1) % HTTP_MAX_CONNECTIONS;
+  }
+
+  myStats.connections = 0;
+  for(uint8_t i = 0; i < HTTP_MAX_CONNECTIONS; i++)
+  {
+    myStats.connections += (connections[i].state != CONN_FREE);
+  }
+  myStats.lastUpdateUs = micros() - start;
+  myStats.worstUpdateUs = max(myStats.worstUpdateUs, myStats.lastUpdateUs);
+  METRIC_SET(METRIC_HTTP_CONNECTIONS, myStats.connections);
+  METRIC_MAX_OF(METRIC_HTTP_UPDATE_MAX_US, myStats.lastUpdateUs);
+}
+
+const httpStats_t& tallyBoxGetHttpStats()
+{
+  return myStats;
+}
+
+httpMethod_t httpMethod(httpConnection_t& conn)
+{
+  return conn.method;
+}
+
+const char* httpPath(httpConnection_t& conn)
+{
+  return conn.path;
+}
+
+bool httpHasArg(httpConnection_t& conn, const char *name)
+{
+  for(uint8_t i = 0; i < conn.argCount; i++)
+  {
+    if(strcmp(conn.args[i].name, name) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* httpArg(httpConnection_t& conn, const char *name)
+{
+  for(uint8_t i = 0; i < conn.argCount; i++)
+  {
+    if(strcmp(conn.args[i].name, name) == 0)
+    {
+      return conn.args[i].value;
+    }
+  }
+  return "";
+}
+
+uint8_t httpArgCount(httpConnection_t& conn)
+{
+  return conn.argCount;
+}
+
+const char* httpArgValue(httpConnection_t& conn, uint8_t index)
+{
+  return ((index < conn.argCount) ? conn.args[index].value : "");
+}
+
+const char* httpBody(httpConnection_t& conn)
+{
+  return ((conn.body && !conn.isForm) ? conn.body : "");
+}
+
+const char* httpIfNoneMatch(httpConnection_t& conn)
+{
+  return conn.ifNoneMatch;
+}
+
+void httpAddHeader(httpConnection_t& conn, const char *name, const char *value)
+{
+  int len = snprintf(conn.headers + conn.headersLen, sizeof(conn.headers) - conn.headersLen, "%s: %s\r\n", name, value);
+
+  if((len > 0) && ((conn.headersLen + len) < (int)sizeof(conn.headers)))
+  {
+    conn.headersLen += len;
+  }
+  else
+  {
+    conn.headers[conn.headersLen] = 0;   /*does not fit, left out*/
+  }
+}
+
+void httpSend(httpConnection_t& conn, int code, const char *contentType, const char *content)
+{
+  if(!conn.responded)
+  {
+    conn.text = content;
+    conn.textPos = 0;
+    respond(conn, code, contentType, BODY_TEXT, conn.text.length());
+  }
+}
+
+void httpSend(httpConnection_t& conn, int code, const char *contentType, const String& content)
+{
+  if(!conn.responded)
+  {
+    conn.text = content;
+    conn.textPos = 0;
+    respond(conn, code, contentType, BODY_TEXT, conn.text.length());
+  }
+}
+
+void httpSendFile(httpConnection_t& conn, int code, const char *contentType, File& file)
+{
+  if(!conn.responded)
+  {
+    conn.file = file;
+    respond(conn, code, contentType, BODY_FILE, conn.file.size());
+  }
+}
+
+void httpSendReader(httpConnection_t& conn, int code, const char *contentType, httpBodyReader_t reader)
+{
+  if(!conn.responded)
+  {
+    conn.reader = reader;
+    respond(conn, code, contentType, BODY_READER, -1);   /*chunked, the length is not known*/
+  }
+}
+
+void* httpContext(httpConnection_t& conn, size_t size)
+{
+  return ((size <= sizeof(conn.context)) ? (void*)conn.context : NULL);
+}
+
+File& httpFile(httpConnection_t& conn)
+{
+  return conn.file;
+}
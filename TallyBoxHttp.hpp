@@ -0,0 +1,98 @@
+#ifndef __TALLYBOXHTTP_HPP__
+#define __TALLYBOXHTTP_HPP__
+#include "Arduino.h"
+#include <ESP8266WiFi.h>
+#include <FS.h>
+
+/*event driven HTTP/1.1 server: several connections are kept open at a time, requests are
+  parsed as the bytes arrive and every connection advances in small steps (a bounded read,
+  one handler call, a bounded write). tallyBoxHttpUpdate() runs steps until the time budget
+  of the call is used, so serving a page or receiving an upload never holds the tick for
+  longer than one step. Responses are sent with "Connection: close", bodies are pulled from
+  a text, a file or a reader function as the socket has room for them. A reader's body has no
+  known length and is sent with "Transfer-Encoding: chunked".*/
+
+#define HTTP_MAX_CONNECTIONS        4
+#define HTTP_MAX_ROUTES             32
+#define HTTP_MAX_LINE               160     /*longer header lines are cut, only a few headers are used*/
+#define HTTP_MAX_PATH               64
+#define HTTP_MAX_QUERY              128
+#define HTTP_MAX_ARGS               16
+#define HTTP_MAX_BODY               2048    /*bodies other than uploads are kept in ram*/
+#define HTTP_MAX_FORM_FIELDS        128     /*names and values of the multipart parts other than files*/
+#define HTTP_MAX_BOUNDARY           76      /*"\r\n--" + multipart boundary*/
+#define HTTP_MAX_HEADERS            128     /*extra response headers*/
+#define HTTP_OUT_BUFFER_SIZE        384
+#define HTTP_CHUNK_HEADER_SIZE      5       /*"17A\r\n": three hex digits cover the out buffer*/
+#define HTTP_CONTEXT_SIZE           448     /*per connection storage for a body reader*/
+#define HTTP_READ_PER_STEP          256
+#define HTTP_IDLE_TIMEOUT_MS        5000
+#define HTTP_LOOP_BUDGET_US         3000
+
+typedef enum
+{
+  HTTP_METHOD_ANY = 0,
+  HTTP_METHOD_GET,
+  HTTP_METHOD_POST,
+  HTTP_METHOD_PUT,
+  HTTP_METHOD_DELETE,
+  HTTP_METHOD_OTHER
+} httpMethod_t;
+
+typedef enum
+{
+  HTTP_UPLOAD_START,
+  HTTP_UPLOAD_WRITE,
+  HTTP_UPLOAD_END,
+  HTTP_UPLOAD_ABORTED
+} httpUploadStatus_t;
+
+typedef struct
+{
+  uint32_t requests;
+  uint32_t timeouts;
+  uint32_t rejected;          /*bad request or body too large*/
+  uint8_t connections;        /*open right now*/
+  uint32_t lastUpdateUs;      /*time spent in the latest tallyBoxHttpUpdate()*/
+  uint32_t worstUpdateUs;
+  uint32_t worstStepUs;
+} httpStats_t;
+
+typedef struct httpConnection_s httpConnection_t;
+
+/*called once the request has been received, must set the response*/
+typedef void (*httpHandler_t)(httpConnection_t& conn);
+/*called for the file parts of a multipart/form-data request, one bounded piece at a time*/
+typedef void (*httpUploadHandler_t)(httpConnection_t& conn, httpUploadStatus_t status, const char *fileName, const uint8_t *data, size_t len);
+/*fills out with the next piece of the body, 0 = end of the body*/
+typedef size_t (*httpBodyReader_t)(httpConnection_t& conn, char *out, size_t maxLen);
+/*takes over the connection (e.g. a WebSocket), false = not taken*/
+typedef bool (*httpUpgradeHandler_t)(WiFiClient& client, const char *url);
+
+void tallyBoxHttpInitialize(uint16_t port);
+void tallyBoxHttpOn(const char *path, httpMethod_t method, httpHandler_t handler, httpUploadHandler_t upload = NULL);
+void tallyBoxHttpOnNotFound(httpHandler_t handler);
+void tallyBoxHttpOnUpgrade(const char *path, httpUpgradeHandler_t handler);
+void tallyBoxHttpUpdate(uint32_t budgetUs = HTTP_LOOP_BUDGET_US);
+const httpStats_t& tallyBoxGetHttpStats();
+
+/*request*/
+httpMethod_t httpMethod(httpConnection_t& conn);
+const char* httpPath(httpConnection_t& conn);
+bool httpHasArg(httpConnection_t& conn, const char *name);
+const char* httpArg(httpConnection_t& conn, const char *name);      /*"" when not given*/
+uint8_t httpArgCount(httpConnection_t& conn);
+const char* httpArgValue(httpConnection_t& conn, uint8_t index);
+const char* httpBody(httpConnection_t& conn);                       /*body other than a form, "" when none*/
+const char* httpIfNoneMatch(httpConnection_t& conn);
+
+/*response, one per request*/
+void httpAddHeader(httpConnection_t& conn, const char *name, const char *value);
+void httpSend(httpConnection_t& conn, int code, const char *contentType, const char *content);
+void httpSend(httpConnection_t& conn, int code, const char *contentType, const String& content);
+void httpSendFile(httpConnection_t& conn, int code, const char *contentType, File& file);
+void httpSendReader(httpConnection_t& conn, int code, const char *contentType, httpBodyReader_t reader);
+void* httpContext(httpConnection_t& conn, size_t size);             /*storage for the reader, NULL if too large*/
+File& httpFile(httpConnection_t& conn);                             /*closed by the server when done*/
+
+#endif
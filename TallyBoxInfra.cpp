@@ -1,6 +1,5 @@
 #include "TallyBoxInfra.hpp"
 #include "Arduino.h"
-#include "TallyBoxPeerNetwork.hpp"
 
 #define TIME_TICK_PRESCALER           10
 #define TIME_SPLITS                   32    /*must be 32 because of the 32-bit led sequence values*/
@@ -29,4 +28,90 @@ uint16_t getCurrentTick(bool nonCompensated)
 }
 
 
+/*big endian buffer helpers shared by the peer network and configuration storage*/
+void putU8(uint8_t** bufPtr, uint8_t value)
+{
+  *((*bufPtr)++) = value;
+}
+
+uint8_t getU8(uint8_t** bufPtr)
+{
+  uint8_t value = *(*bufPtr);
+  (*bufPtr)++;
+  return value;
+}
+
+void putU16(uint8_t** bufPtr, uint16_t value)
+{
+  putU8(bufPtr, (value>>8)&0x00FF);
+  putU8(bufPtr, value&0x00FF);
+}
+
+uint16_t getU16(uint8_t** bufPtr)
+{
+  uint16_t val;
+
+  val = getU8(bufPtr);
+  val <<= 8;
+  val |= getU8(bufPtr);
+
+  return val;
+}
+
+void putU32(uint8_t** bufPtr, uint32_t value)
+{
+  putU8(bufPtr, (value>>24)&0x000000FF);
+  putU8(bufPtr, (value>>16)&0x000000FF);
+  putU8(bufPtr, (value>>8)&0x000000FF);
+  putU8(bufPtr, value&0x000000FF);
+}
 
+uint32_t getU32(uint8_t** bufPtr)
+{
+  uint32_t val;
+
+  val = getU8(bufPtr);
+  val <<= 8;
+  val |= getU8(bufPtr);
+  val <<= 8;
+  val |= getU8(bufPtr);
+  val <<= 8;
+  val |= getU8(bufPtr);
+
+  return val;
+}
+
+void putBytes(uint8_t** bufPtr, const uint8_t* src, uint16_t len)
+{
+  memcpy(*bufPtr, src, len);
+  (*bufPtr) += len;
+}
+
+void getBytes(uint8_t** bufPtr, uint8_t* dst, uint16_t len)
+{
+  memcpy(dst, *bufPtr, len);
+  (*bufPtr) += len;
+}
+
+size_t readPieces(pieceFormatter_t format, uint8_t count, uint8_t& next, char *out, size_t maxLen)
+{
+  size_t len = 0;
+
+  while(next < count)
+  {
+    int n = format(next, out + len, maxLen - len);
+
+    if((n < 0) || ((size_t)n >= (maxLen - len)))
+    {
+      if(len == 0)
+      {
+        next++;   /*never fits, skip it*/
+        continue;
+      }
+      break;
+    }
+    len += n;
+    next++;
+  }
+  return len;
+}
@@ -6,4 +6,19 @@ uint16_t getCurrentTick(bool nonCompensated=false);
 int32_t getTickCompensationValue();
 void setTickCompensationValue(int32_t comp);
 
+void putU8(uint8_t** bufPtr, uint8_t value);
+uint8_t getU8(uint8_t** bufPtr);
+void putU16(uint8_t** bufPtr, uint16_t value);
+uint16_t getU16(uint8_t** bufPtr);
+void putU32(uint8_t** bufPtr, uint32_t value);
+uint32_t getU32(uint8_t** bufPtr);
+void putBytes(uint8_t** bufPtr, const uint8_t* src, uint16_t len);
+void getBytes(uint8_t** bufPtr, uint8_t* dst, uint16_t len);
+
+/*documents rendered piece by piece for a body reader. A formatter returns what snprintf does;
+  readPieces() puts whole pieces from next on into out and skips a piece that never fits.
+  Returns 0 when all count pieces have been rendered.*/
+typedef int (*pieceFormatter_t)(uint8_t index, char *out, size_t maxLen);
+size_t readPieces(pieceFormatter_t format, uint8_t count, uint8_t& next, char *out, size_t maxLen);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,244 @@
+#include "TallyBoxLive.hpp"
+#include "Arduino.h"
+#include <WebSocketsServer.h>
+#include "TallyBoxHttp.hpp"
+#include "TallyBoxStateMachine.hpp"
+#include "TallyBoxOutput.hpp"
+#include "TallyBoxPersistence.hpp"
+#include "TallyBoxConfigSchema.hpp"
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_LIVE;
+
+/*what is shown in the browser, a push is done when any of this changes*/
+typedef struct
+{
+  tallyBoxLiveState_t tally;
+  bool bsmEnabled;
+  tallyBoxOutput_t bsmChannel;
+  bool identify;
+  uint16_t cameraId;
+  float greenBrightnessPercent;
+  float redBrightnessPercent;
+} liveSnapshot_t;
+
+/*takes connections accepted by the http layer, the same way WebSockets4WebServer does for
+  the ESP8266WebServer*/
+class LiveWebSocket : public WebSocketsServerCore
+{
+  public:
+    LiveWebSocket() : WebSocketsServerCore("", "arduino")
+    {
+      begin();
+    }
+
+    void adopt(WiFiClient& tcpClient, const char *url)
+    {
+      WSclient_t *client = handleNewClient(new WiFiClient(tcpClient));
+
+      if(client)
+      {
+        /*the request line has been read by the http layer, the headers are read here*/
+        String headerLine = "GET ";
+
+        headerLine += url;
+        handleHeader(client, &headerLine);
+      }
+    }
+};
+
+static LiveWebSocket webSocket;
+static tallyBoxConfig_t *myConf = NULL;
+static liveSnapshot_t lastPushed;
+static bool pushRequested = false;      /*new client, send the status even without changes*/
+static liveStats_t myStats = {};
+
+static char rxQueue[LIVE_RX_QUEUE_SIZE][LIVE_MAX_MESSAGE_LEN];
+static uint8_t rxHead = 0;
+static uint8_t rxCount = 0;
+
+const char* const bsmChannelNames[] = {"none", "green", "red", "linked"};
+
+static void takeSnapshot(liveSnapshot_t& s)
+{
+  /*cleared as a whole, the snapshots are compared with memcmp*/
+  memset(&s, 0, sizeof(s));
+
+  tallyBoxGetLiveState(s.tally);
+  s.bsmEnabled = getBrightnessSettingMode(s.bsmChannel);
+  s.identify = getIdentify();
+  s.cameraId = myConf->user.cameraId;
+  s.greenBrightnessPercent = myConf->user.greenBrightnessPercent;
+  s.redBrightnessPercent = myConf->user.redBrightnessPercent;
+}
+
+static size_t formatStatus(const liveSnapshot_t& s, char *out, size_t maxLen)
+{
+  char green[16];
+  char red[16];
+  const confField_t *f;
+
+  green[0] = red[0] = 0;
+  if((f = confFindField(userConfigSchema, "greenBrightnessPercent")) != NULL)
+  {
+    confFieldFormat(*f, &myConf->user, green, sizeof(green));
+  }
+  if((f = confFindField(userConfigSchema, "redBrightnessPercent")) != NULL)
+  {
+    confFieldFormat(*f, &myConf->user, red, sizeof(red));
+  }
+
+  return snprintf(out, maxLen,
+                  "{\"state\":\"%s\",\"valid\":%u,\"preview\":%u,\"program\":%u,\"transition\":%u,"
+                  "\"bsm\":\"%s\",\"identify\":%u,\"cameraId\":%u,"
+                  "\"greenBrightnessPercent\":%s,\"redBrightnessPercent\":%s}",
+                  tallyBoxGetStateName(s.tally.state), s.tally.dataIsValid, s.tally.preview, s.tally.program,
+                  s.tally.inTransition, bsmChannelNames[s.bsmEnabled ? s.bsmChannel : OUTPUT_NONE],
+                  s.identify, s.cameraId, green, red);
+}
+
+/*"identify" or "name=value" of a user configuration field*/
+static bool applyControl(char *msg)
+{
+  bool ret = false;
+  const confField_t *f;
+  char *val = strchr(msg, '=');
+
+  if(strcmp(msg, "identify") == 0)
+  {
+    startIdentify();
+    ret = true;
+  }
+  else if(val != NULL)
+  {
+    *val++ = 0;
+
+    if(((f = confFindField(userConfigSchema, msg)) != NULL) && confFieldParse(*f, &myConf->user, val))
+    {
+      /*slider steps are merged by the write-behind queue*/
+      tallyBoxScheduleConfigurationWrite(myConf->user);
+
+      /*show the brightness being set, like the web form does*/
+      if(strcmp(f->name, "greenBrightnessPercent") == 0)
+      {
+        setBrightnessSettingMode(OUTPUT_GREEN, true);
+      }
+      else if(strcmp(f->name, "redBrightnessPercent") == 0)
+      {
+        setBrightnessSettingMode(OUTPUT_RED, true);
+      }
+      ret = true;
+    }
+  }
+  return ret;
+}
+
+/*called from webSocket.loop(), only queues, the messages are applied by tallyBoxLiveUpdate()*/
+static void webSocketEvent(uint8_t num, WStype_t type, uint8_t *payload, size_t length)
+{
+  switch(type)
+  {
+    case WStype_CONNECTED:
+      if(webSocket.connectedClients() > LIVE_MAX_CLIENTS)
+      {
+        LOG_WARN("client %u rejected, too many clients", num);
+        webSocket.disconnect(num);
+      }
+      else
+      {
+        pushRequested = true;
+      }
+      break;
+
+    case WStype_TEXT:
+      myStats.received++;
+      if((rxCount < LIVE_RX_QUEUE_SIZE) && (length < LIVE_MAX_MESSAGE_LEN))
+      {
+        char *slot = rxQueue[(rxHead + rxCount) % LIVE_RX_QUEUE_SIZE];
+
+        memcpy(slot, payload, length);
+        slot[length] = 0;
+        rxCount++;
+      }
+      else
+      {
+        myStats.dropped++;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static bool upgradeHandler(WiFiClient& client, const char *url)
+{
+  webSocket.adopt(client, url);
+  return true;
+}
+
+void tallyBoxLiveInitialize(tallyBoxConfig_t& c)
+{
+  myConf = &c;
+  takeSnapshot(lastPushed);
+
+  webSocket.onEvent(webSocketEvent);
+  tallyBoxHttpOnUpgrade(LIVE_WEBSOCKET_PATH, upgradeHandler);
+}
+
+void tallyBoxLiveUpdate()
+{
+  liveSnapshot_t now;
+  uint8_t handled = 0;
+
+  if(myConf == NULL)
+  {
+    return;
+  }
+
+  webSocket.loop();
+
+  while((rxCount > 0) && (handled < LIVE_MAX_MESSAGES_PER_UPDATE))
+  {
+    if(applyControl(rxQueue[rxHead]))
+    {
+      myStats.applied++;
+    }
+    else
+    {
+      myStats.rejected++;
+    }
+    rxHead = (rxHead + 1) % LIVE_RX_QUEUE_SIZE;
+    rxCount--;
+    handled++;
+  }
+
+  takeSnapshot(now);
+
+  if(pushRequested || (memcmp(&now, &lastPushed, sizeof(now)) != 0))
+  {
+    if(webSocket.connectedClients() > 0)
+    {
+      char status[LIVE_MAX_STATUS_LEN];
+      size_t len = formatStatus(now, status, sizeof(status));
+
+      if(len < sizeof(status))
+      {
+        webSocket.broadcastTXT(status, len);
+        myStats.pushed++;
+      }
+    }
+    lastPushed = now;
+    pushRequested = false;
+  }
+}
+
+uint8_t tallyBoxLiveClients()
+{
+  return webSocket.connectedClients();
+}
+
+const liveStats_t& tallyBoxGetLiveStats()
+{
+  return myStats;
+}
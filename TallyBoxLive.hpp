@@ -0,0 +1,34 @@
+#ifndef __TALLYBOXLIVE_HPP__
+#define __TALLYBOXLIVE_HPP__
+#include "Arduino.h"
+#include "TallyBoxConfiguration.hpp"
+
+/*live status and control channel of the web interface: a WebSocket at /ws on the port of the
+  web server, the http layer hands the connection over after the request line. Changes of the
+  tally, connection and brightness setting state are pushed as soon as they are seen. The
+  browser sends "name=value" for the user configuration fields and "identify". Received
+  messages are queued by the socket callback and applied from the update, a bounded number per
+  call, so that a browser cannot take the time of the tally handling.*/
+
+#define LIVE_WEBSOCKET_PATH           "/ws"
+#define LIVE_MAX_CLIENTS              2
+#define LIVE_RX_QUEUE_SIZE            4       /*messages waiting to be applied, more are dropped*/
+#define LIVE_MAX_MESSAGES_PER_UPDATE  2
+#define LIVE_MAX_MESSAGE_LEN          48
+#define LIVE_MAX_STATUS_LEN           256
+
+typedef struct
+{
+  uint32_t received;
+  uint32_t applied;
+  uint32_t rejected;      /*unknown field or invalid value*/
+  uint32_t dropped;       /*queue full or message too long*/
+  uint32_t pushed;        /*status messages sent*/
+} liveStats_t;
+
+void tallyBoxLiveInitialize(tallyBoxConfig_t& c);
+void tallyBoxLiveUpdate();
+uint8_t tallyBoxLiveClients();
+const liveStats_t& tallyBoxGetLiveStats();
+
+#endif
@@ -0,0 +1,328 @@
+#include "TallyBoxLog.hpp"
+#include "Arduino.h"
+
+/*rate limit state of one call site*/
+typedef struct
+{
+  const char *fmt;
+  uint8_t level;
+  uint8_t module;
+  uint8_t count;                  /*records in the current window*/
+  uint16_t suppressed;            /*not yet reported*/
+  uint32_t windowStartMs;
+} rateSlot_t;
+
+uint8_t tallyBoxLogLevel = LOG_DEFAULT_LEVEL;
+
+static logRecord_t ring[LOG_RING_SIZE];
+static uint32_t head = 0;         /*sequence number of the next record*/
+static rateSlot_t rateSlots[LOG_RATE_SLOTS] = {};
+static logStats_t myStats = {};
+
+/*the line being written to Serial, written as the uart has room*/
+static uint32_t serialCursor = 0;
+static char serialLine[LOG_MAX_LINE];
+static uint16_t serialLineLen = 0;
+static uint16_t serialLinePos = 0;
+
+static const char levelChars[LOG_LEVEL_MAX] = {'E', 'W', 'I', 'D'};
+static const char* const levelNames[LOG_LEVEL_MAX] = {"error", "warn", "info", "debug"};
+static const char* const moduleNames[LOG_MODULE_MAX] =
+{
+  "main", "state", "config", "persist", "peer", "fleet", "web", "http", "live", "assets", "terminal", "ota", "firmware", "switcher", "umd"
+};
+
+static rateSlot_t& findRateSlot(const char *fmt)
+{
+  rateSlot_t *victim = NULL;
+  uint32_t now = millis();
+
+  for(uint8_t i = 0; i < LOG_RATE_SLOTS; i++)
+  {
+    if(rateSlots[i].fmt == fmt)
+    {
+      return rateSlots[i];
+    }
+  }
+
+  /*a free slot, else the one idle for longest; unreported suppressions are kept if possible*/
+  for(uint8_t i = 0; (i < LOG_RATE_SLOTS) && ((victim == NULL) || (victim->fmt != NULL)); i++)
+  {
+    rateSlot_t *s = &rateSlots[i];
+
+    if((victim == NULL) || (s->fmt == NULL)
+       || ((s->suppressed == 0) && (victim->suppressed != 0))
+       || (((s->suppressed == 0) == (victim->suppressed == 0)) && ((now - s->windowStartMs) > (now - victim->windowStartMs))))
+    {
+      victim = s;
+    }
+  }
+
+  memset(victim, 0, sizeof(*victim));
+  victim->fmt = fmt;
+  victim->windowStartMs = now - LOG_RATE_WINDOW_MS;
+  return *victim;
+}
+
+static logRecord_t* newRecord(uint8_t level, uint8_t module, const char *fmt)
+{
+  logRecord_t *r = &ring[head % LOG_RING_SIZE];
+
+  /*the oldest record is overwritten, also if Serial has not had it yet*/
+  if((head - serialCursor) >= LOG_RING_SIZE)
+  {
+    serialCursor++;
+    myStats.overwritten++;
+  }
+
+  r->timeMs = millis();
+  r->fmt = fmt;
+  r->level = level;
+  r->module = module;
+  r->argCount = 0;
+  r->argTypes = 0;
+  r->suppressed = 0;
+  r->summary = false;
+  r->textLen = 0;
+  r->text[0] = 0;
+  return r;
+}
+
+logRecord_t* tallyBoxLogBegin(logLevel_t level, logModule_t module, const char *fmt)
+{
+  rateSlot_t& slot = findRateSlot(fmt);
+  logRecord_t *r;
+  uint32_t now = millis();
+
+  if((now - slot.windowStartMs) >= LOG_RATE_WINDOW_MS)
+  {
+    slot.windowStartMs = now;
+    slot.count = 0;
+  }
+  if(slot.count >= LOG_RATE_BURST)
+  {
+    slot.level = level;
+    slot.module = module;
+    if(slot.suppressed < 0xFFFF)
+    {
+      slot.suppressed++;
+    }
+    myStats.suppressed++;
+    return NULL;
+  }
+  slot.count++;
+
+  r = newRecord(level, module, fmt);
+  r->suppressed = slot.suppressed;
+  slot.suppressed = 0;
+  return r;
+}
+
+void tallyBoxLogCommit()
+{
+  head++;
+  myStats.written++;
+}
+
+/*copies the conversion of one argument, the length modifiers are dropped as the record knows the type*/
+static int formatArg(const logRecord_t& r, uint8_t arg, const char *spec, char conv, char *out, size_t maxLen)
+{
+  char fmt[16];
+  uint8_t type = (r.argTypes >> (2 * arg)) & 0x03;
+  uint32_t v = r.args[arg];
+  float f;
+
+  memcpy(&f, &v, sizeof(f));
+  snprintf(fmt, sizeof(fmt), "%s%c", spec, conv);
+
+  switch(conv)
+  {
+    case 's':
+      return snprintf(out, maxLen, fmt, ((type == LOG_ARG_STRING) ? (r.text + v) : "?"));
+    case 'f':
+    case 'e':
+    case 'g':
+      return snprintf(out, maxLen, fmt, ((type == LOG_ARG_FLOAT) ? (double)f : (type == LOG_ARG_INT) ? (double)(int32_t)v : (double)v));
+    case 'd':
+    case 'i':
+      return snprintf(out, maxLen, fmt, ((type == LOG_ARG_FLOAT) ? (int)f : (int)(int32_t)v));
+    case 'u':
+    case 'x':
+    case 'X':
+    case 'o':
+    case 'c':
+      return snprintf(out, maxLen, fmt, (unsigned)v);
+    default:
+      return snprintf(out, maxLen, "?");
+  }
+}
+
+static size_t formatRecord(const logRecord_t& r, char *out, size_t maxLen)
+{
+  int n;
+  size_t len = 0;
+  uint8_t arg = 0;
+
+  n = snprintf(out, maxLen, "%5u.%03u %c %s: ", (unsigned)(r.timeMs / 1000), (unsigned)(r.timeMs % 1000),
+               levelChars[r.level], moduleNames[r.module]);
+  len = min((size_t)max(n, 0), maxLen - 1);
+
+  if(r.summary)
+  {
+    n = snprintf(out + len, maxLen - len, "suppressed %u times: %s", r.suppressed, r.fmt);
+    len += min((size_t)max(n, 0), maxLen - 1 - len);
+  }
+  else
+  {
+    for(const char *p = r.fmt; *p && (len < (maxLen - 1)); p++)
+    {
+      char spec[12];
+      uint8_t specLen = 0;
+
+      if((p[0] != '%') || (p[1] == '%'))
+      {
+        out[len++] = *p;
+        p += (p[0] == '%');
+        continue;
+      }
+
+      spec[specLen++] = *p++;
+      while(*p && strchr("-+ #0123456789.", *p) && (specLen < (sizeof(spec) - 1)))
+      {
+        spec[specLen++] = *p++;
+      }
+      spec[specLen] = 0;
+      while(*p && strchr("hlzjt", *p))
+      {
+        p++;
+      }
+      if(!*p)
+      {
+        break;
+      }
+
+      n = ((arg < r.argCount) ? formatArg(r, arg++, spec, *p, out + len, maxLen - len) : snprintf(out + len, maxLen - len, "?"));
+      len += min((size_t)max(n, 0), maxLen - 1 - len);
+    }
+    out[len] = 0;
+
+    if(r.suppressed > 0)
+    {
+      n = snprintf(out + len, maxLen - len, " (%u suppressed before)", r.suppressed);
+      len += min((size_t)max(n, 0), maxLen - 1 - len);
+    }
+  }
+
+  /*the line end always fits*/
+  len = min(len, maxLen - 3);
+  out[len++] = '\r';
+  out[len++] = '\n';
+  out[len] = 0;
+  return len;
+}
+
+/*call sites that went quiet while suppressed: report how much was dropped*/
+static void reportSuppressed()
+{
+  uint32_t now = millis();
+
+  for(uint8_t i = 0; i < LOG_RATE_SLOTS; i++)
+  {
+    rateSlot_t& slot = rateSlots[i];
+
+    if((slot.suppressed > 0) && ((now - slot.windowStartMs) >= LOG_RATE_WINDOW_MS))
+    {
+      logRecord_t *r = newRecord(slot.level, slot.module, slot.fmt);
+
+      r->suppressed = slot.suppressed;
+      r->summary = true;
+      tallyBoxLogCommit();
+      slot.suppressed = 0;
+    }
+  }
+}
+
+void tallyBoxLogUpdate()
+{
+  uint8_t formatted = 0;
+
+  reportSuppressed();
+
+  /*never blocks: only what the uart fifo takes is written*/
+  while(true)
+  {
+    int room;
+
+    if(serialLinePos >= serialLineLen)
+    {
+      if((serialCursor == head) || (formatted >= LOG_DRAIN_PER_UPDATE))
+      {
+        break;
+      }
+      serialLineLen = formatRecord(ring[serialCursor % LOG_RING_SIZE], serialLine, sizeof(serialLine));
+      serialLinePos = 0;
+      serialCursor++;
+      formatted++;
+    }
+
+    room = Serial.availableForWrite();
+    if(room <= 0)
+    {
+      break;
+    }
+    room = min(room, (int)(serialLineLen - serialLinePos));
+    Serial.write((const uint8_t*)serialLine + serialLinePos, room);
+    serialLinePos += room;
+  }
+}
+
+void tallyBoxLogSetLevel(logLevel_t level)
+{
+  if(level < LOG_LEVEL_MAX)
+  {
+    tallyBoxLogLevel = level;
+  }
+}
+
+const char* tallyBoxLogLevelName(logLevel_t level)
+{
+  return ((level < LOG_LEVEL_MAX) ? levelNames[level] : "?");
+}
+
+uint32_t tallyBoxLogOldest()
+{
+  return ((head > LOG_RING_SIZE) ? (head - LOG_RING_SIZE) : 0);
+}
+
+/*formats whole records from cursor up to end, 0 when there are no more. maxLen must take one
+  record, LOG_MAX_LINE*/
+size_t tallyBoxLogRead(uint32_t& cursor, uint32_t end, char *out, size_t maxLen)
+{
+  char line[LOG_MAX_LINE];
+  size_t len = 0;
+
+  /*records overwritten since the previous read are skipped*/
+  if(cursor < tallyBoxLogOldest())
+  {
+    cursor = tallyBoxLogOldest();
+  }
+
+  while((cursor < end) && (cursor < head))
+  {
+    size_t n = formatRecord(ring[cursor % LOG_RING_SIZE], line, sizeof(line));
+
+    if(n > (maxLen - len))
+    {
+      break;
+    }
+    memcpy(out + len, line, n);
+    len += n;
+    cursor++;
+  }
+  return len;
+}
+
+const logStats_t& tallyBoxGetLogStats()
+{
+  return myStats;
+}
@@ -0,0 +1,171 @@
+#ifndef __TALLYBOXLOG_HPP__
+#define __TALLYBOXLOG_HPP__
+#include "Arduino.h"
+#include <type_traits>
+
+/*logging with levels and module tags. A log call only copies its format string pointer and
+  arguments into a fixed ring of binary records; the text is produced later, when the record is
+  drained to Serial in the idle time between the ticks or read by the terminal or /log. The
+  format string must be a literal, string arguments are copied (LOG_MAX_TEXT bytes in all).
+  A call site logging more than LOG_RATE_BURST records within LOG_RATE_WINDOW_MS is suppressed
+  for the rest of the window and the number of suppressed records is logged afterwards.*/
+
+#define LOG_RING_SIZE           48      /*records, the oldest are overwritten*/
+#define LOG_MAX_ARGS            4
+#define LOG_MAX_TEXT            24      /*string arguments of one record, cut when longer*/
+#define LOG_MAX_LINE            160     /*formatted record*/
+#define LOG_RATE_SLOTS          12      /*call sites tracked for rate limiting*/
+#define LOG_RATE_BURST          5
+#define LOG_RATE_WINDOW_MS      1000
+#define LOG_DRAIN_PER_UPDATE    4       /*records formatted for Serial per idle call*/
+#define LOG_DEFAULT_LEVEL       LOG_LEVEL_INFO
+
+typedef enum
+{
+  LOG_LEVEL_ERROR = 0,
+  LOG_LEVEL_WARN,
+  LOG_LEVEL_INFO,
+  LOG_LEVEL_DEBUG,
+  /**************/
+  LOG_LEVEL_MAX
+} logLevel_t;
+
+typedef enum
+{
+  LOG_MODULE_MAIN = 0,
+  LOG_MODULE_STATE,
+  LOG_MODULE_CONFIG,
+  LOG_MODULE_PERSIST,
+  LOG_MODULE_PEER,
+  LOG_MODULE_FLEET,
+  LOG_MODULE_WEB,
+  LOG_MODULE_HTTP,
+  LOG_MODULE_LIVE,
+  LOG_MODULE_ASSETS,
+  LOG_MODULE_TERMINAL,
+  LOG_MODULE_OTA,
+  LOG_MODULE_FIRMWARE,
+  LOG_MODULE_SWITCHER,
+  LOG_MODULE_UMD,
+  /**************/
+  LOG_MODULE_MAX
+} logModule_t;
+
+typedef enum
+{
+  LOG_ARG_UINT = 0,
+  LOG_ARG_INT,
+  LOG_ARG_FLOAT,
+  LOG_ARG_STRING      /*offset to the text of the record*/
+} logArgType_t;
+
+typedef struct
+{
+  uint32_t timeMs;
+  const char *fmt;
+  uint8_t level;
+  uint8_t module;
+  uint8_t argCount;
+  uint8_t argTypes;                 /*2 bits per argument*/
+  uint32_t args[LOG_MAX_ARGS];
+  uint16_t suppressed;              /*records of this call site dropped before this one*/
+  bool summary;                     /*only reports suppressed records, no arguments*/
+  uint8_t textLen;
+  char text[LOG_MAX_TEXT];
+} logRecord_t;
+
+typedef struct
+{
+  uint32_t written;                 /*records logged, also the sequence number of the next one*/
+  uint32_t suppressed;              /*by the rate limit*/
+  uint32_t overwritten;             /*not yet drained to Serial when overwritten*/
+} logStats_t;
+
+extern uint8_t tallyBoxLogLevel;
+
+/*one record in the ring, NULL when suppressed*/
+logRecord_t* tallyBoxLogBegin(logLevel_t level, logModule_t module, const char *fmt);
+void tallyBoxLogCommit();
+
+/*argument packing, integers and floats are stored as they are, strings are copied*/
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type logPack(logRecord_t& r, T value)
+{
+  r.argTypes |= ((std::is_signed<T>::value ? LOG_ARG_INT : LOG_ARG_UINT) << (2 * r.argCount));
+  r.args[r.argCount++] = (uint32_t)value;
+}
+
+inline void logPack(logRecord_t& r, double value)
+{
+  float f = (float)value;
+
+  r.argTypes |= (LOG_ARG_FLOAT << (2 * r.argCount));
+  memcpy(&r.args[r.argCount++], &f, sizeof(f));
+}
+
+inline void logPack(logRecord_t& r, const char *value)
+{
+  uint8_t start = r.textLen;
+
+  while(value && *value && (r.textLen < (LOG_MAX_TEXT - 1)))
+  {
+    r.text[r.textLen++] = *value++;
+  }
+  r.text[r.textLen] = 0;
+  if(r.textLen < (LOG_MAX_TEXT - 1))
+  {
+    r.textLen++;
+  }
+  r.argTypes |= (LOG_ARG_STRING << (2 * r.argCount));
+  r.args[r.argCount++] = start;
+}
+
+inline void logPack(logRecord_t& r, const String& value)
+{
+  logPack(r, value.c_str());
+}
+
+inline void logPackAll(logRecord_t& r)
+{
+}
+
+template <typename T, typename... Rest>
+void logPackAll(logRecord_t& r, T first, Rest... rest)
+{
+  static_assert(sizeof...(rest) < LOG_MAX_ARGS, "too many log arguments");
+  logPack(r, first);
+  logPackAll(r, rest...);
+}
+
+template <typename... Args>
+void tallyBoxLog(logLevel_t level, logModule_t module, const char *fmt, Args... args)
+{
+  logRecord_t *r = tallyBoxLogBegin(level, module, fmt);
+
+  if(r)
+  {
+    logPackAll(*r, args...);
+    tallyBoxLogCommit();
+  }
+}
+
+/*each source file sets its tag once: static const logModule_t logModule = LOG_MODULE_XXX;
+  arguments are not evaluated when the level is filtered out*/
+#define LOG_AT(level, fmt, ...) \
+  do { if((level) <= tallyBoxLogLevel) { tallyBoxLog((level), logModule, fmt, ##__VA_ARGS__); } } while(0)
+
+#define LOG_ERROR(fmt, ...)     LOG_AT(LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)      LOG_AT(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)      LOG_AT(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)     LOG_AT(LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+
+void tallyBoxLogUpdate();             /*drains to Serial, call from the idle time*/
+void tallyBoxLogSetLevel(logLevel_t level);
+const char* tallyBoxLogLevelName(logLevel_t level);
+
+/*reading the ring: the cursor is a sequence number, start from tallyBoxLogOldest()*/
+uint32_t tallyBoxLogOldest();
+size_t tallyBoxLogRead(uint32_t& cursor, uint32_t end, char *out, size_t maxLen);
+const logStats_t& tallyBoxGetLogStats();
+
+#endif
@@ -0,0 +1,77 @@
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxInfra.hpp"
+#include "Arduino.h"
+
+typedef enum
+{
+  METRIC_TYPE_COUNTER,
+  METRIC_TYPE_GAUGE
+} metricType_t;
+
+typedef struct
+{
+  const char *name;
+  const char *help;
+  metricType_t type;
+  uint8_t decimals;     /*value is scaled by 10^decimals, e.g. ticks shown as seconds*/
+} metricInfo_t;
+
+uint32_t tallyBoxMetrics[METRIC_MAX] = {};
+
+/*same order as metricId_t*/
+static const metricInfo_t metricInfo[METRIC_MAX] =
+{
+  {"tallybox_uptime_seconds",             "Time since start",                                   METRIC_TYPE_GAUGE,   0},
+  {"tallybox_ticks_total",                "10 ms ticks processed",                              METRIC_TYPE_COUNTER, 0},
+  {"tallybox_tick_overruns_total",        "Ticks skipped or taking longer than 10 ms",          METRIC_TYPE_COUNTER, 0},
+  {"tallybox_loop_time_microseconds",     "Processing time of the latest tick",                 METRIC_TYPE_GAUGE,   0},
+  {"tallybox_loop_time_max_microseconds", "Longest processing time of a tick",                  METRIC_TYPE_GAUGE,   0},
+  {"tallybox_peer_frames_sent_total",     "Peer network frames sent",                           METRIC_TYPE_COUNTER, 0},
+  {"tallybox_peer_frames_received_total", "Valid peer network frames received",                 METRIC_TYPE_COUNTER, 0},
+  {"tallybox_peer_crc_errors_total",      "Peer network frames with CRC failure",               METRIC_TYPE_COUNTER, 0},
+  {"tallybox_peer_unknown_version_total", "Peer network frames of an unknown protocol version", METRIC_TYPE_COUNTER, 0},
+  {"tallybox_peer_malformed_total",       "Peer network frames with bad length or identifier",  METRIC_TYPE_COUNTER, 0},
+  {"tallybox_atem_reconnects_total",      "Reconnections to an ATEM switcher",                  METRIC_TYPE_COUNTER, 0},
+  {"tallybox_switchers_connected",        "ATEM switchers connected to the master",             METRIC_TYPE_GAUGE,   0},
+  {"tallybox_umd_packets_sent_total",     "TSL UMD packets republished",                        METRIC_TYPE_COUNTER, 0},
+  {"tallybox_umd_dropped_total",          "TSL UMD packets dropped for a slow destination",     METRIC_TYPE_COUNTER, 0},
+  {"tallybox_master_frozen_seconds_total","Time without valid data from the ATEM or master",    METRIC_TYPE_COUNTER, 2},
+  {"tallybox_http_requests_total",        "HTTP requests served",                               METRIC_TYPE_COUNTER, 0},
+  {"tallybox_http_connections",           "Open HTTP connections",                              METRIC_TYPE_GAUGE,   0},
+  {"tallybox_http_update_max_microseconds","Longest time spent serving HTTP in one loop",        METRIC_TYPE_GAUGE,   0},
+  {"tallybox_config_writes_total",        "Configuration commits to flash",                     METRIC_TYPE_COUNTER, 0},
+  {"tallybox_heap_free_bytes",            "Free heap",                                          METRIC_TYPE_GAUGE,   0},
+  {"tallybox_heap_min_free_bytes",        "Lowest free heap seen",                              METRIC_TYPE_GAUGE,   0}
+};
+
+static const char* const metricTypeNames[] = {"counter", "gauge"};
+
+void tallyBoxMetricsInitialize()
+{
+  METRIC_SET(METRIC_HEAP_MIN_FREE, 0xFFFFFFFF);
+}
+
+static int formatMetric(uint8_t id, char *out, size_t maxLen)
+{
+  const metricInfo_t& m = metricInfo[id];
+  uint32_t value = tallyBoxMetrics[id];    /*taken once, a counter may change while rendering*/
+  char number[16];
+
+  if(m.decimals == 2)
+  {
+    snprintf(number, sizeof(number), "%u.%02u", value / 100, value % 100);
+  }
+  else
+  {
+    snprintf(number, sizeof(number), "%u", value);
+  }
+
+  return snprintf(out, maxLen, "# HELP %s %s\n# TYPE %s %s\n%s %s\n",
+                  m.name, m.help, m.name, metricTypeNames[m.type], m.name, number);
+}
+
+/*renders whole metrics from next on into out, returns 0 when all have been rendered*/
+size_t tallyBoxMetricsRead(uint8_t& next, char *out, size_t maxLen)
+{
+  return readPieces(formatMetric, METRIC_MAX, next, out, maxLen);
+}
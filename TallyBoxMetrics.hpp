@@ -0,0 +1,49 @@
+#ifndef __TALLYBOXMETRICS_HPP__
+#define __TALLYBOXMETRICS_HPP__
+#include "Arduino.h"
+
+/*counters and gauges for the /metrics endpoint (Prometheus text format). The values are plain
+  uint32_t updated in place by the macros below, nothing is allocated when they change. The
+  text is rendered only when scraped, a few metrics at a time.*/
+
+typedef enum
+{
+  METRIC_UPTIME_SECONDS = 0,
+  METRIC_TICKS,
+  METRIC_TICK_OVERRUNS,             /*ticks skipped or longer than a tick*/
+  METRIC_LOOP_TIME_US,              /*processing time of the latest tick*/
+  METRIC_LOOP_TIME_MAX_US,
+  METRIC_PEER_FRAMES_SENT,
+  METRIC_PEER_FRAMES_RECEIVED,
+  METRIC_PEER_CRC_ERRORS,
+  METRIC_PEER_UNKNOWN_VERSION,
+  METRIC_PEER_MALFORMED,            /*wrong length or protocol identifier*/
+  METRIC_ATEM_RECONNECTS,
+  METRIC_SWITCHERS_CONNECTED,
+  METRIC_UMD_PACKETS_SENT,
+  METRIC_UMD_DROPPED,               /*packets a slow TSL destination had no room for*/
+  METRIC_MASTER_FROZEN_TICKS,       /*time without valid data from the ATEM or the master*/
+  METRIC_HTTP_REQUESTS,
+  METRIC_HTTP_CONNECTIONS,          /*open right now*/
+  METRIC_HTTP_UPDATE_MAX_US,        /*longest time the web server held the loop*/
+  METRIC_CONFIG_WRITES,
+  METRIC_HEAP_FREE,
+  METRIC_HEAP_MIN_FREE,             /*low-water mark*/
+  /**************/
+  METRIC_MAX
+} metricId_t;
+
+extern uint32_t tallyBoxMetrics[METRIC_MAX];
+
+#define METRIC_INC(id)          (tallyBoxMetrics[(id)]++)
+#define METRIC_ADD(id, n)       (tallyBoxMetrics[(id)] += (uint32_t)(n))
+#define METRIC_SET(id, v)       (tallyBoxMetrics[(id)] = (uint32_t)(v))
+#define METRIC_MAX_OF(id, v)    do { if((uint32_t)(v) > tallyBoxMetrics[(id)]) tallyBoxMetrics[(id)] = (uint32_t)(v); } while(0)
+#define METRIC_MIN_OF(id, v)    do { if((uint32_t)(v) < tallyBoxMetrics[(id)]) tallyBoxMetrics[(id)] = (uint32_t)(v); } while(0)
+
+#define METRICS_CONTENT_TYPE    "text/plain; version=0.0.4"
+
+void tallyBoxMetricsInitialize();
+size_t tallyBoxMetricsRead(uint8_t& next, char *out, size_t maxLen);
+
+#endif
@@ -9,6 +9,23 @@ static bool myRedState = false;
 static bool brightnessSettingModeEnabled = false;
 static uint16_t brightnessSettingModeCounter = 0;
 static tallyBoxOutput_t brightnessSettingModeChannel;
+static uint16_t identifyCounter = 0;   /*local only, not taken over from the master*/
+
+/*fade tables for following the transition position: index 0 = dark, FADE_TABLE_STEPS = full brightness*/
+#define FADE_TABLE_STEPS        32
+
+/*perceptual curve (gamma 2.2) scaled to 0...1024, i.e. round(1024*(i/32)^2.2)*/
+static const uint16_t fadeCurve[FADE_TABLE_STEPS+1] =
+{
+     0,    0,    2,    6,   11,   17,   26,   36,   49,   63,   79,
+    98,  118,  141,  166,  193,  223,  255,  289,  325,  364,  405,
+   449,  495,  544,  595,  649,  705,  763,  825,  888,  955, 1024
+};
+
+static uint16_t fadeTableGreen[FADE_TABLE_STEPS+1];
+static uint16_t fadeTableRed[FADE_TABLE_STEPS+1];
+static uint16_t fadeTableGreenRaw = 0xFFFF;   /*brightness the table has been calculated for*/
+static uint16_t fadeTableRedRaw = 0xFFFF;
 
 void setOutputState(tallyBoxOutput_t ch, bool outputState);
 bool getOutputState(tallyBoxOutput_t ch);
@@ -24,26 +41,20 @@ float convertBrightnessValueToPercent(uint16_t raw)
   return (float)((100.0 * (float)raw) / (float)MAX_BRIGHTNESS);
 }
 
-void getOutputTxData(tallyBoxConfig_t& c, uint8_t& bsmEnabled, uint16_t& bsmCounter, uint16_t& bsmChannel, uint16_t& greenBrightness, uint16_t& redBrightness)
+void getOutputTxData(uint8_t& bsmEnabled, uint16_t& bsmCounter, uint16_t& bsmChannel)
 {
   /*PeerNetwork master: sending out data to slaves*/
   bsmEnabled = (uint8_t)brightnessSettingModeEnabled;
   bsmCounter = brightnessSettingModeCounter;  /*10 us ticks -> 1000 = 10 seconds*/
   bsmChannel = (uint16_t)brightnessSettingModeChannel;
-
-  greenBrightness = convertBrightnessValueToRaw(c.user.greenBrightnessPercent); /*send as raw*/
-  redBrightness = convertBrightnessValueToRaw(c.user.redBrightnessPercent); /*send as raw*/
 }
 
-void putOutputRxData(tallyBoxConfig_t& c, uint8_t& bsmEnabled, uint16_t& bsmCounter, uint16_t& bsmChannel, uint16_t& greenBrightness, uint16_t& redBrightness)
+void putOutputRxData(uint8_t bsmEnabled, uint16_t bsmCounter, uint16_t bsmChannel)
 {
-  /*PeerNetwork slave: receiving data from master*/
+  /*PeerNetwork slave: receiving data from master. The brightness values come with the fleet profile*/
   brightnessSettingModeEnabled = (bool)bsmEnabled;
   brightnessSettingModeCounter = bsmCounter;  /*10 us ticks -> 1000 = 10 seconds*/
-  brightnessSettingModeChannel = (tallyBoxOutput_t)bsmChannel;
-
-  c.user.greenBrightnessPercent = convertBrightnessValueToPercent(greenBrightness);
-  c.user.redBrightnessPercent = convertBrightnessValueToPercent(redBrightness);
+  brightnessSettingModeChannel = (bsmChannel <= OUTPUT_LINKED ? (tallyBoxOutput_t)bsmChannel : OUTPUT_NONE);
 }
 
 void setBrightnessSettingMode(tallyBoxOutput_t ch, bool enable)
@@ -71,6 +82,16 @@ bool getBrightnessSettingMode(tallyBoxOutput_t& ch)
   return ret;
 }
 
+void startIdentify()
+{
+  identifyCounter = IDENTIFY_DURATION_TICKS;
+}
+
+bool getIdentify()
+{
+  return (identifyCounter > 0);
+}
+
 void setOutputState(tallyBoxOutput_t ch, bool outputState)
 {
   switch(ch)
@@ -91,9 +112,40 @@ bool getOutputState(tallyBoxOutput_t ch)
   return ((ch==OUTPUT_GREEN) ? myGreenState : myRedState);
 }
 
-static void getWarningLevels(uint16_t currentTick, int32_t& greenLevel, int32_t& redLevel)
+static void calculateFadeTable(uint16_t *table, uint16_t raw)
+{
+  for(int i = 0; i <= FADE_TABLE_STEPS; i++)
+  {
+    table[i] = (uint16_t)(((uint32_t)raw * fadeCurve[i]) >> 10);
+  }
+}
+
+static void updateFadeTables(tallyBoxConfig_t& c)
+{
+  /*recalculate only when the brightness has been changed*/
+  uint16_t greenRaw = convertBrightnessValueToRaw(c.user.greenBrightnessPercent);
+  uint16_t redRaw = convertBrightnessValueToRaw(c.user.redBrightnessPercent);
+
+  if(greenRaw != fadeTableGreenRaw)
+  {
+    calculateFadeTable(fadeTableGreen, greenRaw);
+    fadeTableGreenRaw = greenRaw;
+  }
+  if(redRaw != fadeTableRedRaw)
+  {
+    calculateFadeTable(fadeTableRed, redRaw);
+    fadeTableRedRaw = redRaw;
+  }
+}
+
+static uint16_t getFadeTableIndex(uint16_t transitionPosition)
+{
+  uint32_t pos = min(transitionPosition, (uint16_t)TRANSITION_POSITION_MAX);
+  return (uint16_t)((pos * FADE_TABLE_STEPS + (TRANSITION_POSITION_MAX / 2)) / TRANSITION_POSITION_MAX);
+}
+
+void getWarningLevels(uint16_t currentTick, int32_t& greenLevel, int32_t& redLevel)
 {
-  static uint16_t prevTick = 0;
   const int32_t wcMaxRed = 480;  /*0...1023*/
   const int32_t wcMinRed = 0;  /*0...1023*/
   const int32_t wcMaxGrn = 1023;  /*0...1023*/
@@ -116,6 +168,15 @@ static void getWarningLevels(uint16_t currentTick, int32_t& greenLevel, int32_t&
   }
 }
 
+/*the built-in LED shows one bit of the 32 bit sequence per 10 ticks, it is active low*/
+void outputUpdateStatusLed(uint32_t sequence, uint16_t currentTick)
+{
+  uint16_t bit = currentTick / 10;
+  bool state = (sequence >> bit) & 0x00000001;
+
+  digitalWrite(LED_BUILTIN, (state ? LOW : HIGH));
+}
+
 bool handleBrightnessSettingMode(tallyBoxConfig_t& c)
 {
   bool skipRealOutput = false;
@@ -163,7 +224,26 @@ bool handleBrightnessSettingMode(tallyBoxConfig_t& c)
   return skipRealOutput;
 }
 
-void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool tallyPreview, bool tallyProgram, bool inTransition)
+/*alternates green and red so that the box can be found among the others*/
+static bool handleIdentify(tallyBoxConfig_t& c, uint16_t currentTick)
+{
+  bool skipRealOutput = false;
+
+  if(identifyCounter > 0)
+  {
+    bool greenPhase = ((currentTick / 25) & 0x01) == 0;
+
+    identifyCounter--;
+
+    analogWrite(PIN_GREEN, (greenPhase ? convertBrightnessValueToRaw(c.user.greenBrightnessPercent) : 0));
+    analogWrite(PIN_RED, (greenPhase ? 0 : convertBrightnessValueToRaw(c.user.redBrightnessPercent)));
+
+    skipRealOutput = true;
+  }
+  return skipRealOutput;
+}
+
+void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool tallyPreview, bool tallyProgram, bool inTransition, uint16_t transitionPosition)
 {
   if(dataIsValid)
   {
@@ -171,11 +251,16 @@ void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, b
     setOutputState(OUTPUT_RED, tallyProgram);
   }
   
-  outputUpdate(c, currentTick, dataIsValid, inTransition);
+  outputUpdate(c, currentTick, dataIsValid, inTransition, transitionPosition);
 }
 
-void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool inTransition)
+void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool inTransition, uint16_t transitionPosition)
 {
+  if(handleIdentify(c, currentTick))
+  {
+    return;
+  }
+
   if(handleBrightnessSettingMode(c))
   {
     /*we are in the mode that visualizes the brightness setting*/
@@ -187,18 +272,32 @@ void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, b
   {
     if(inTransition)
     {
-      if(myGreenState || myRedState)
+      /*while in transition, follow the on-air blend: the outgoing program source fades out
+        and the incoming preview source fades in from green to red*/
+      uint16_t fadeIn = getFadeTableIndex(transitionPosition);
+      uint16_t fadeOut = FADE_TABLE_STEPS - fadeIn;
+      uint16_t green = 0;
+      uint16_t red = 0;
+
+      updateFadeTables(c);
+
+      if(myGreenState && myRedState)
       {
-        /*while in transition - either on program/preview - we are actually in program, so let's show RED*/
-        analogWrite(PIN_GREEN, 0);
-        analogWrite(PIN_RED, convertBrightnessValueToRaw(c.user.redBrightnessPercent));
+        /*both sides of the transition are from this camera: we stay on air*/
+        red = fadeTableRed[FADE_TABLE_STEPS];
       }
-      else
+      else if(myRedState)
       {
-        /*otherwise, show nothing*/
-        analogWrite(PIN_GREEN, 0);
-        analogWrite(PIN_RED, 0);
+        red = fadeTableRed[fadeOut];
       }
+      else if(myGreenState)
+      {
+        green = fadeTableGreen[fadeOut];
+        red = fadeTableRed[fadeIn];
+      }
+
+      analogWrite(PIN_GREEN, green);
+      analogWrite(PIN_RED, red);
     }
     else
     {
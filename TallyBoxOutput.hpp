@@ -7,6 +7,9 @@
 #define DEFAULT_RED_BRIGHTNESS_PCT    20
 #define DEFAULT_GREEN_BRIGHTNESS_PCT  80
 
+#define TRANSITION_POSITION_MAX       10000   /*ATEM reports the transition position in range 0...9999*/
+#define IDENTIFY_DURATION_TICKS       500     /*10 ms ticks -> 5 seconds*/
+
 typedef enum
 {
   OUTPUT_NONE,    /*used by terminal interface*/
@@ -16,14 +19,20 @@ typedef enum
 } tallyBoxOutput_t;
 
 
-void getOutputTxData(tallyBoxConfig_t& c, uint8_t& bsmEnabled, uint16_t& bsmCounter, uint16_t& bsmChannel, uint16_t& greenBrightness, uint16_t& redBrightness);
-void putOutputRxData(tallyBoxConfig_t& c, uint8_t& bsmEnabled, uint16_t& bsmCounter, uint16_t& bsmChannel, uint16_t& greenBrightness, uint16_t& redBrightness);
+void getOutputTxData(uint8_t& bsmEnabled, uint16_t& bsmCounter, uint16_t& bsmChannel);
+void putOutputRxData(uint8_t bsmEnabled, uint16_t bsmCounter, uint16_t bsmChannel);
 
 void setBrightnessSettingMode(tallyBoxOutput_t ch, bool enable);
 bool getBrightnessSettingMode(tallyBoxOutput_t& ch);
 
-void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool tallyPreview, bool tallyProgram, bool inTransition);
-void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool inTransition);
+void startIdentify();
+bool getIdentify();
+
+void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool tallyPreview, bool tallyProgram, bool inTransition, uint16_t transitionPosition);
+void outputUpdate(tallyBoxConfig_t& c, uint16_t currentTick, bool dataIsValid, bool inTransition, uint16_t transitionPosition);
+
+void outputUpdateStatusLed(uint32_t sequence, uint16_t currentTick);
+void getWarningLevels(uint16_t currentTick, int32_t& greenLevel, int32_t& redLevel);
 
 uint16_t convertBrightnessValueToRaw(float percent);
 float convertBrightnessValueToPercent(uint16_t raw);
@@ -0,0 +1,120 @@
+#include "TallyBoxPeerCodec.hpp"
+#include "TallyBoxInfra.hpp"
+#include <Arduino_CRC32.h>
+
+static Arduino_CRC32 crc32;
+
+
+uint16_t peerNetworkSerialize(uint16_t messageId, uint16_t tick, const uint8_t *payload, uint16_t payloadLen, uint8_t *buf, uint16_t maxLen)
+{
+  uint16_t ret = 0;
+
+  if(maxLen >= PEERNETWORK_HEADER_SIZE + payloadLen + PEERNETWORK_FOOTER_SIZE)
+  {
+    uint8_t *p = buf;
+
+    /*header*/
+    putU32(&p, PEERNETWORK_PROTOCOL_IDENTIFIER_U32);
+    putU8(&p, PEERNETWORK_PROTOCOL_VERSION_U8);
+    putU16(&p, messageId);
+    putU16(&p, tick);
+
+    putBytes(&p, payload, payloadLen);
+
+    /*crc*/
+    uint16_t lenWithoutCrc = (uint16_t)(p - buf);
+    uint32_t crc = crc32.calc(buf, lenWithoutCrc);
+
+    putU32(&p, crc);
+
+    ret = lenWithoutCrc + PEERNETWORK_FOOTER_SIZE;
+  }
+
+  return ret;
+}
+
+peerFrameResult_t peerNetworkDeSerialize(uint8_t *buf, uint16_t len, uint16_t& messageId, uint16_t& tick, uint8_t*& payload, uint16_t& payloadLen)
+{
+  peerFrameResult_t ret = PEER_FRAME_ILLEGAL_LENGTH;
+
+  if(len >= PEERNETWORK_HEADER_SIZE + PEERNETWORK_FOOTER_SIZE)
+  {
+    uint8_t *p = buf;
+    uint8_t *crcAt = buf + len - PEERNETWORK_FOOTER_SIZE;
+
+    /*check the whole frame before anything of it is used*/
+    uint32_t calculatedCrc = crc32.calc(buf, len - PEERNETWORK_FOOTER_SIZE);
+    uint32_t receivedCrc = getU32(&crcAt);
+
+    if(receivedCrc != calculatedCrc)
+    {
+      ret = PEER_FRAME_CRC_ERROR;
+    }
+    else if(getU32(&p) != PEERNETWORK_PROTOCOL_IDENTIFIER_U32)
+    {
+      ret = PEER_FRAME_UNKNOWN_PROTOCOL;
+    }
+    else if(getU8(&p) != PEERNETWORK_PROTOCOL_VERSION_U8)
+    {
+      ret = PEER_FRAME_UNKNOWN_VERSION;
+    }
+    else
+    {
+      messageId = getU16(&p);
+      tick = getU16(&p);
+      payload = p;
+      payloadLen = len - PEERNETWORK_HEADER_SIZE - PEERNETWORK_FOOTER_SIZE;
+      ret = PEER_FRAME_OK;
+    }
+  }
+  return ret;
+}
+
+void peerTallyEncode(const peerTally_t& t, uint8_t *payload)
+{
+  uint8_t *p = payload;
+  uint64_t greenMask = t.greenMask | peerTallyInputBit(t.greenChannel);
+  uint64_t redMask = t.redMask | peerTallyInputBit(t.redChannel);
+
+  putU16(&p, t.greenChannel);
+  putU16(&p, t.redChannel);
+  putU8(&p, t.inTransition);
+  putU16(&p, t.transitionPosition);
+  putU32(&p, (uint32_t)(greenMask >> 32));
+  putU32(&p, (uint32_t)greenMask);
+  putU32(&p, (uint32_t)(redMask >> 32));
+  putU32(&p, (uint32_t)redMask);
+}
+
+bool peerTallyDecode(const uint8_t *payload, uint16_t payloadLen, peerTally_t& t)
+{
+  bool ret = false;
+
+  if(payloadLen == PEERNETWORK_TALLY_PAYLOAD_SIZE)
+  {
+    uint8_t *p = (uint8_t*)payload;
+
+    t.greenChannel = getU16(&p);
+    t.redChannel = getU16(&p);
+    t.inTransition = getU8(&p);
+    t.transitionPosition = getU16(&p);
+    t.greenMask = (uint64_t)getU32(&p) << 32;
+    t.greenMask |= getU32(&p);
+    t.redMask = (uint64_t)getU32(&p) << 32;
+    t.redMask |= getU32(&p);
+    ret = true;
+  }
+  return ret;
+}
+
+uint64_t peerTallyInputBit(uint16_t input)
+{
+  return (((input >= 1) && (input <= PEERNETWORK_TALLY_MASK_INPUTS)) ? (1ULL << (input - 1)) : 0);
+}
+
+bool peerTallyHasInput(uint64_t mask, uint16_t channel, uint16_t input)
+{
+  uint64_t bit = peerTallyInputBit(input);
+
+  return ((bit != 0) ? ((mask & bit) != 0) : (channel == input));
+}
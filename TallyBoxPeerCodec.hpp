@@ -0,0 +1,64 @@
+#ifndef __TALLYBOXPEERCODEC_HPP__
+#define __TALLYBOXPEERCODEC_HPP__
+#include "Arduino.h"
+
+/*frames of the peer network: header (protocol, version, message id, tick), payload and a crc32
+  over both. No network dependency, the host tools (master daemon, benchmarks) use the same code.*/
+
+#define PEERNETWORK_PORT                                7493
+#define PEERNETWORK_MAX_MESSAGE_SIZE                    560     /*a firmware block with its headers*/
+
+#define PEERNETWORK_PROTOCOL_VERSION_U8                 4
+#define PEERNETWORK_PROTOCOL_IDENTIFIER_U32             0x7A61696D
+#define PEERNETWORK_HEADER_SIZE                         9
+#define PEERNETWORK_FOOTER_SIZE                         4
+#define PEERNETWORK_TALLY_PAYLOAD_SIZE                  23
+#define PEERNETWORK_TALLY_MASK_INPUTS                   64      /*inputs 1...64 have a bit in the tally masks*/
+
+/*message identifiers*/
+#define PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16      0x0001  /*master -> all, every tick*/
+#define PEERNETWORK_FLEET_ANNOUNCE_IDENTIFIER_U16       0x0002  /*master -> all, profile manifest*/
+#define PEERNETWORK_FLEET_REQUEST_IDENTIFIER_U16        0x0003  /*slave -> master, fetch a piece*/
+#define PEERNETWORK_FLEET_PIECE_IDENTIFIER_U16          0x0004  /*master -> slave, requested piece*/
+#define PEERNETWORK_FLEET_STATUS_IDENTIFIER_U16         0x0005  /*slave -> master, applied profile*/
+#define PEERNETWORK_ROLLOUT_OFFER_IDENTIFIER_U16        0x0006  /*master -> slave, firmware image offered*/
+#define PEERNETWORK_ROLLOUT_BLOCK_IDENTIFIER_U16        0x0007  /*master -> slave, firmware block*/
+#define PEERNETWORK_ROLLOUT_STATUS_IDENTIFIER_U16       0x0008  /*slave -> master, transfer progress*/
+#define PEERNETWORK_ROLLOUT_COMMIT_IDENTIFIER_U16       0x0009  /*master -> slave, restart into the image*/
+
+typedef enum
+{
+  PEER_FRAME_OK = 0,
+  PEER_FRAME_ILLEGAL_LENGTH,
+  PEER_FRAME_CRC_ERROR,
+  PEER_FRAME_UNKNOWN_PROTOCOL,
+  PEER_FRAME_UNKNOWN_VERSION
+} peerFrameResult_t;
+
+/*the channels and the transition are those of the leading switcher, the masks hold the inputs
+  of all switchers of the master (TallyBoxSwitchers)*/
+typedef struct
+{
+  uint16_t greenChannel;
+  uint16_t redChannel;
+  bool inTransition;
+  uint16_t transitionPosition;
+  uint64_t greenMask;           /*bit 0 = input 1, the channels are always included*/
+  uint64_t redMask;
+} peerTally_t;
+
+/*returns the frame length, 0 when it does not fit*/
+uint16_t peerNetworkSerialize(uint16_t messageId, uint16_t tick, const uint8_t *payload, uint16_t payloadLen, uint8_t *buf, uint16_t maxLen);
+
+/*the whole frame is checked before anything of it is returned, the payload points into buf*/
+peerFrameResult_t peerNetworkDeSerialize(uint8_t *buf, uint16_t len, uint16_t& messageId, uint16_t& tick, uint8_t*& payload, uint16_t& payloadLen);
+
+void peerTallyEncode(const peerTally_t& t, uint8_t *payload);
+bool peerTallyDecode(const uint8_t *payload, uint16_t payloadLen, peerTally_t& t);
+
+/*bit of the input in the masks, 0 for the inputs above PEERNETWORK_TALLY_MASK_INPUTS*/
+uint64_t peerTallyInputBit(uint16_t input);
+/*input in the mask, or the channel for the inputs that have no bit*/
+bool peerTallyHasInput(uint64_t mask, uint16_t channel, uint16_t input);
+
+#endif
@@ -1,20 +1,23 @@
 #include "ESP8266WiFi.h"
 #include "Arduino.h"
 #include <WiFiUdp.h>
+#include "TallyBoxMetrics.hpp"
 #include "TallyBoxPeerNetwork.hpp"
 #include "TallyBoxInfra.hpp"
-#include "TallyBoxOutput.hpp"
-#include <Arduino_CRC32.h>
+#include "TallyBoxFleet.hpp"
+#include "TallyBoxFirmware.hpp"
+#include "TallyBoxLog.hpp"
 
-#define PEERNETWORK_PROTOCOL_VERSION_U8                  1
-#define PEERNETWORK_PROTOCOL_IDENTIFIER_U32             0x7A61696D
-#define PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16      0x0001
+static const logModule_t logModule = LOG_MODULE_PEER;
+
+#define PEERNETWORK_MAX_MESSAGES_PER_CALL               4   /*bounded work per tick*/
 
 WiFiUDP Udp;
+static uint8_t txBuf[PEERNETWORK_MAX_MESSAGE_SIZE];   /*too large for the stack*/
+static uint8_t rxBuf[PEERNETWORK_MAX_MESSAGE_SIZE];
 
 /*** INTERNAL FUNCTIONS **************************************/
-static uint16_t peerNetworkSerialize(uint16_t& grn, uint16_t& red, uint8_t *buf, uint16_t maxLen);
-static bool peerNetworkDeSerialize(uint16_t& grn, uint16_t& red, uint8_t *buf, uint16_t len);
+static bool peerNetworkDispatch(tallyBoxConfig_t& c, int size, peerTally_t& t);
 /*************************************************************/
 
 
@@ -43,230 +46,151 @@ static void syncLocalTick(uint16_t tick)
 }
 
 
-static void putU8(uint8_t** bufPtr, uint8_t value)
+/*counts and reports a frame that was not accepted*/
+static bool checkFrame(peerFrameResult_t result, uint16_t len)
 {
-  *((*bufPtr)++) = value;
-}
-
-static uint8_t getU8(uint8_t** bufPtr)
-{
-  uint8_t value = *(*bufPtr);
-  (*bufPtr)++;
-  return value;
-}
-
-static void putU16(uint8_t** bufPtr, uint16_t value)
-{
-  putU8(bufPtr, (value>>8)&0x00FF);
-  putU8(bufPtr, value&0x00FF);
+  switch(result)
+  {
+    case PEER_FRAME_OK:
+      METRIC_INC(METRIC_PEER_FRAMES_RECEIVED);
+      break;
+    case PEER_FRAME_CRC_ERROR:
+      METRIC_INC(METRIC_PEER_CRC_ERRORS);
+      LOG_WARN("CRC failure in reception");
+      break;
+    case PEER_FRAME_UNKNOWN_PROTOCOL:
+      METRIC_INC(METRIC_PEER_MALFORMED);
+      LOG_WARN("Unknown protocol");
+      break;
+    case PEER_FRAME_UNKNOWN_VERSION:
+      METRIC_INC(METRIC_PEER_UNKNOWN_VERSION);
+      LOG_WARN("Unknown protocol version");
+      break;
+    default:
+      METRIC_INC(METRIC_PEER_MALFORMED);
+      LOG_WARN("Illegal frame length %u", len);
+      break;
+  }
+  return (result == PEER_FRAME_OK);
 }
 
-static uint16_t getU16(uint8_t** bufPtr)
+bool peerNetworkSendMessage(uint16_t messageId, const uint8_t *payload, uint16_t payloadLen, IPAddress to)
 {
-  uint16_t val;
-
-  val = getU8(bufPtr);
-  val <<= 8;
-  val |= getU8(bufPtr);
-
-  return val;
-}
+  bool ret = false;
 
-static void putU32(uint8_t** bufPtr, uint32_t value)
-{
-  putU8(bufPtr, (value>>24)&0x000000FF);
-  putU8(bufPtr, (value>>16)&0x000000FF);
-  putU8(bufPtr, (value>>8)&0x000000FF);
-  putU8(bufPtr, value&0x000000FF);
+  uint16_t bufLen = peerNetworkSerialize(messageId, getCurrentTick(), payload, payloadLen, txBuf, sizeof(txBuf));
+  if(bufLen > 0)
+  {
+    Udp.beginPacket(to, PEERNETWORK_PORT);
+    Udp.write(txBuf, bufLen);
+    ret = (Udp.endPacket() != 0);
+    if(ret)
+    {
+      METRIC_INC(METRIC_PEER_FRAMES_SENT);
+    }
+  }
+  return ret;
 }
 
-static uint32_t getU32(uint8_t** bufPtr)
+void peerNetworkSend(tallyBoxConfig_t& c, const peerTally_t& t)
 {
-  uint32_t val;
-
-  val = getU8(bufPtr);
-  val <<= 8;
-  val |= getU8(bufPtr);
-  val <<= 8;
-  val |= getU8(bufPtr);
-  val <<= 8;
-  val |= getU8(bufPtr);
+  uint8_t payload[PEERNETWORK_TALLY_PAYLOAD_SIZE];
 
-  return val;
-}
+  /*tally signals only: configuration travels in the fleet messages (TallyBoxFleet)*/
+  peerTallyEncode(t, payload);
 
-static uint16_t getBufLength(uint8_t* ptrFirst, uint8_t* ptrAfterLast)
-{
-  uint16_t len = (uint16_t)(((size_t)(ptrAfterLast))-((size_t)(ptrFirst)));
-  return len;
+  peerNetworkSendMessage(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, payload, sizeof(payload), IPAddress(0,0,0,0));
 }
 
-static uint16_t peerNetworkSerialize(tallyBoxConfig_t& c, uint16_t& grn, uint16_t& red, bool inTransition, uint8_t *buf, uint16_t maxLen)
+/*handles one received message of size bytes, returns true for a valid tally frame*/
+static bool peerNetworkDispatch(tallyBoxConfig_t& c, int size, peerTally_t& t)
 {
-  uint16_t ret = 0;
-  const uint16_t headerSize = 7;
-  const uint16_t footerSize = 4;
-  const uint16_t msgSize = headerSize + 16 +  footerSize;
-  Arduino_CRC32 crc32;
+  bool ret = false;
+  int len;
+  uint16_t messageId;
+  uint16_t masterTick;
+  uint8_t *payload;
+  uint16_t payloadLen;
 
-  if(maxLen >= msgSize)
+  if(size > (int)sizeof(rxBuf))
   {
-    uint8_t *p = buf;
-    uint16_t myTick = getCurrentTick();
-
-    /*header*/
-    putU32(&p, PEERNETWORK_PROTOCOL_IDENTIFIER_U32);
-    putU8(&p, PEERNETWORK_PROTOCOL_VERSION_U8);
-    putU16(&p, PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16);
-    putU16(&p, myTick);
-
-    /*payload: tally signals*/
-    putU16(&p, grn);
-    putU16(&p, red);
-
-    /*payload: brightness setting and visualization*/
-    uint8_t bsmEnabled;
-    uint16_t bsmCounter;
-    uint16_t bsmChannel;
-    uint16_t greenBrightness;
-    uint16_t redBrightness;
-    getOutputTxData(c, bsmEnabled, bsmCounter, bsmChannel, greenBrightness, redBrightness);
-    putU8(&p, bsmEnabled);
-    putU16(&p, bsmCounter);
-    putU16(&p, bsmChannel);
-    putU16(&p, greenBrightness);
-    putU16(&p, redBrightness);
-
-    putU8(&p, inTransition);
-
-    /*crc*/
-    uint16_t lenWithoutCrc = getBufLength(buf, p);
-    uint32_t crc = crc32.calc(buf, lenWithoutCrc);
-
-    putU32(&p, crc);
-
-    ret = lenWithoutCrc + 4;
+    /*not read: a frame cut to the buffer size must not be checked as if it were complete*/
+    return checkFrame(PEER_FRAME_ILLEGAL_LENGTH, (uint16_t)min(size, 0xFFFF));
   }
 
-  return ret;
-}
-
-static bool peerNetworkDeSerialize(tallyBoxConfig_t& c, uint16_t& grn, uint16_t& red, bool& inTransition, uint8_t *buf, uint16_t len)
-{
-  bool ret = false;
-  const uint16_t headerSize = 7;
-  const uint16_t footerSize = 4;
-  const uint16_t msgSize = headerSize + 16 + footerSize;
-  Arduino_CRC32 crc32;
-  uint16_t masterTick;
-  
-  if(len == msgSize)
+  len = Udp.read(rxBuf, sizeof(rxBuf));
+  if((len <= 0) || !checkFrame(peerNetworkDeSerialize(rxBuf, (uint16_t)len, messageId, masterTick, payload, payloadLen), (uint16_t)len))
   {
-    uint8_t *p = buf;
+    return false;
+  }
 
-    /*check incoming header*/
-    if(getU32(&p) == PEERNETWORK_PROTOCOL_IDENTIFIER_U32)
-    {
-      if(getU8(&p) == PEERNETWORK_PROTOCOL_VERSION_U8)
+  switch(messageId)
+  {
+    case PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16:
+      if(c.network.isMaster)
       {
-        if(getU16(&p) == PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16)
-        {
-          masterTick = getU16(&p);
-
-          /*header check passed, handle payload*/
-          grn = getU16(&p);
-          red = getU16(&p);
-
-          /*payload: brightness setting and visualization*/
-          uint8_t bsmEnabled = getU8(&p);
-          uint16_t bsmCounter = getU16(&p);
-          uint16_t bsmChannel = getU16(&p);
-          uint16_t greenBrightness = getU16(&p);
-          uint16_t redBrightness = getU16(&p);
-          putOutputRxData(c, bsmEnabled, bsmCounter, bsmChannel, greenBrightness, redBrightness);
-
-          inTransition = getU8(&p);
-
-          /*crc check*/
-          uint16_t lenWithoutCrc = getBufLength(buf, p);
-          uint32_t calculatedCrc = crc32.calc(buf, lenWithoutCrc);
-          uint32_t receivedCrc = getU32(&p);
-
-          if(receivedCrc == calculatedCrc)
-          {
-            /*successfully handled message!*/
-            /*provide basis for local time concept*/
-            syncLocalTick(masterTick);
-            ret = true;
-          }
-          else
-          {
-            Serial.print("PeerNetwork: CRC failure in reception. Received: 0x");
-            Serial.print(receivedCrc, HEX);
-            Serial.print(", Calculated: 0x");
-            Serial.println(calculatedCrc, HEX);
-          }
-        }
-        else
-        {
-          Serial.println("PeerNetwork: Unknown message identifier");
-        }
+        break;  /*our own broadcast*/
+      }
+      if(peerTallyDecode(payload, payloadLen, t))
+      {
+        /*provide basis for local time concept*/
+        syncLocalTick(masterTick);
+        ret = true;
       }
       else
       {
-        Serial.println("PeerNetwork: Unknown protocol version");
+        METRIC_INC(METRIC_PEER_MALFORMED);
+        LOG_WARN("Illegal message length %u", payloadLen);
       }
-    }
-    else
-    {
-      Serial.println("PeerNetwork: Unknown protocol");
-    }
-  }
-  else
-  {
-    Serial.println("PeerNetwork: Illegal message length");
+      break;
+
+    case PEERNETWORK_FLEET_ANNOUNCE_IDENTIFIER_U16:
+    case PEERNETWORK_FLEET_REQUEST_IDENTIFIER_U16:
+    case PEERNETWORK_FLEET_PIECE_IDENTIFIER_U16:
+    case PEERNETWORK_FLEET_STATUS_IDENTIFIER_U16:
+      tallyBoxFleetReceive(c, messageId, payload, payloadLen, Udp.remoteIP());
+      break;
+
+    case PEERNETWORK_ROLLOUT_OFFER_IDENTIFIER_U16:
+    case PEERNETWORK_ROLLOUT_BLOCK_IDENTIFIER_U16:
+    case PEERNETWORK_ROLLOUT_STATUS_IDENTIFIER_U16:
+    case PEERNETWORK_ROLLOUT_COMMIT_IDENTIFIER_U16:
+      tallyBoxFirmwareReceive(c, messageId, payload, payloadLen, Udp.remoteIP());
+      break;
+
+    default:
+      LOG_WARN("Unknown message identifier 0x%04X", messageId);
+      break;
   }
   return ret;
 }
 
-void peerNetworkSend(tallyBoxConfig_t& c, uint16_t greenChannel, uint16_t redChannel, bool inTransition)
-{
-  uint8_t buf[32];
-
-  uint16_t bufLen = peerNetworkSerialize(c, greenChannel, redChannel, inTransition, buf, sizeof(buf));
-  if(bufLen > 0)
-  {
-    Udp.beginPacket(IPAddress(0,0,0,0), 7493);
-    Udp.write(buf, bufLen);
-    Udp.endPacket();
-  }
-}
-
-bool peerNetworkReceive(tallyBoxConfig_t& c, uint16_t& greenChannel, uint16_t& redChannel, bool& inTransition)
+bool peerNetworkReceive(tallyBoxConfig_t& c, peerTally_t& t)
 {
   bool ret = false;
+  int size;
 
-  int packetSize = Udp.parsePacket();
-  if(packetSize)
+  for(int i = 0; (i < PEERNETWORK_MAX_MESSAGES_PER_CALL) && ((size = Udp.parsePacket()) > 0); i++)
   {
-    uint8_t buf[32];
-    int len = Udp.read(buf, 32);
-    uint16_t tmpGreen;
-    uint16_t tmpRed;
-    bool tmpInTransition;
+    peerTally_t tmp;
 
-    if(peerNetworkDeSerialize(c, tmpGreen, tmpRed, tmpInTransition, buf, packetSize))
+    if(peerNetworkDispatch(c, size, tmp))
     {
-      greenChannel = tmpGreen;
-      redChannel = tmpRed;
-      inTransition = tmpInTransition;
-
+      t = tmp;
       ret = true;
     }
   }
   return ret;
 }
 
+void peerNetworkPoll(tallyBoxConfig_t& c)
+{
+  peerTally_t t;
+
+  /*master side: only the fleet messages are of interest*/
+  peerNetworkReceive(c, t);
+}
+
 void peerNetworkInitialize(uint16_t localPort)
 {
   Udp.begin(localPort);  
@@ -3,9 +3,14 @@
 #include "Arduino.h"
 #include <WiFiUdp.h>
 #include "TallyBoxConfiguration.hpp"
+#include "TallyBoxPeerCodec.hpp"
 
 void peerNetworkInitialize(uint16_t localPort);
-void peerNetworkSend(tallyBoxConfig_t& c, uint16_t greenChannel, uint16_t redChannel, bool inTransition);
-bool peerNetworkReceive(tallyBoxConfig_t& c, uint16_t& greenChannel, uint16_t& redChannel, bool& inTransition);
+void peerNetworkSend(tallyBoxConfig_t& c, const peerTally_t& t);
+bool peerNetworkReceive(tallyBoxConfig_t& c, peerTally_t& t);
 
-#endif
\ No newline at end of file
+/*other than tally messages: the address 0.0.0.0 broadcasts the same way as the tally frames*/
+bool peerNetworkSendMessage(uint16_t messageId, const uint8_t *payload, uint16_t payloadLen, IPAddress to);
+void peerNetworkPoll(tallyBoxConfig_t& c);
+
+#endif
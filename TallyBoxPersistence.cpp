@@ -0,0 +1,248 @@
+#include "TallyBoxPersistence.hpp"
+#include "Arduino.h"
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_PERSIST;
+
+typedef enum
+{
+  PERSISTENCE_ITEM_NETWORK = 0,
+  PERSISTENCE_ITEM_USER,
+  PERSISTENCE_ITEM_FLEET,
+  /*************/
+  PERSISTENCE_ITEM_MAX
+} persistenceItem_t;
+
+typedef struct
+{
+  persistenceStatus_t status;
+  bool dirtyWhileWriting;       /*changed again after the snapshot was taken*/
+  uint32_t firstRequestAt;
+  uint32_t latestRequestAt;
+} persistenceEntry_t;
+
+static tallyBoxConfig_t *myConf = NULL;
+static persistenceEntry_t entries[PERSISTENCE_ITEM_MAX] = {};
+static persistenceStats_t myStats = {};
+static configJournalCommit_t commit;                        /*one commit at a time*/
+static persistenceItem_t commitItem = PERSISTENCE_ITEM_MAX; /*MAX = no commit in progress*/
+static uint16_t prevTick = 0xFFFF;
+static uint32_t revision = 1;     /*0 is never current: built at 0 means not built yet*/
+
+const char* const itemNames[PERSISTENCE_ITEM_MAX] = {"network", "user", "fleet"};
+const char* const statusTexts[] = {"stored", "waiting to be stored", "being stored", "storing FAILED, retrying"};
+
+static void scheduleWrite(persistenceItem_t item)
+{
+  persistenceEntry_t& e = entries[item];
+  uint32_t now = millis();
+
+  myStats.requests++;
+  e.latestRequestAt = now;
+  revision++;
+
+  switch(e.status)
+  {
+    case PERSISTENCE_STATUS_CLEAN:
+      e.status = PERSISTENCE_STATUS_PENDING;
+      e.firstRequestAt = now;
+      break;
+
+    case PERSISTENCE_STATUS_PENDING:
+    case PERSISTENCE_STATUS_FAILED:
+      /*merged into the write that is already waiting*/
+      myStats.mergedRequests++;
+      break;
+
+    case PERSISTENCE_STATUS_WRITING:
+      if(e.dirtyWhileWriting)
+      {
+        myStats.mergedRequests++;
+      }
+      e.dirtyWhileWriting = true;
+      break;
+  }
+}
+
+static bool isDue(persistenceEntry_t& e, uint32_t now)
+{
+  bool ret = false;
+
+  if(e.status == PERSISTENCE_STATUS_PENDING)
+  {
+    ret = ((now - e.latestRequestAt >= PERSISTENCE_SETTLE_TIME_MS)
+            || (now - e.firstRequestAt >= PERSISTENCE_MAX_DEFER_TIME_MS));
+  }
+  else if(e.status == PERSISTENCE_STATUS_FAILED)
+  {
+    ret = (now - e.latestRequestAt >= PERSISTENCE_RETRY_TIME_MS);
+  }
+  return ret;
+}
+
+static bool startCommit(persistenceItem_t item)
+{
+  bool ret;
+
+  switch(item)
+  {
+    case PERSISTENCE_ITEM_NETWORK:
+      ret = tallyBoxStartConfigurationCommit(myConf->network, commit);
+      break;
+    case PERSISTENCE_ITEM_USER:
+      ret = tallyBoxStartConfigurationCommit(myConf->user, commit);
+      break;
+    default:
+      ret = tallyBoxStartConfigurationCommit(myConf->fleet, commit);
+      break;
+  }
+  return ret;
+}
+
+static void finishCommit(persistenceItem_t item, bool success)
+{
+  persistenceEntry_t& e = entries[item];
+  uint32_t now = millis();
+
+  if(success)
+  {
+    uint32_t latency = now - e.firstRequestAt;
+
+    myStats.commits++;
+    METRIC_INC(METRIC_CONFIG_WRITES);
+    myStats.lastFlushLatencyMs = latency;
+    myStats.worstFlushLatencyMs = max(myStats.worstFlushLatencyMs, latency);
+
+    if(e.dirtyWhileWriting)
+    {
+      /*the snapshot is already outdated, go again*/
+      e.status = PERSISTENCE_STATUS_PENDING;
+      e.firstRequestAt = e.latestRequestAt;
+    }
+    else
+    {
+      e.status = PERSISTENCE_STATUS_CLEAN;
+    }
+  }
+  else
+  {
+    myStats.failedCommits++;
+    e.status = PERSISTENCE_STATUS_FAILED;
+    e.latestRequestAt = now;  /*retry timer*/
+  }
+  e.dirtyWhileWriting = false;
+
+  if(success)
+  {
+    LOG_INFO("%s configuration stored, flush latency %u ms", itemNames[item], myStats.lastFlushLatencyMs);
+  }
+  else
+  {
+    LOG_ERROR("storing %s configuration FAILED", itemNames[item]);
+  }
+}
+
+void tallyBoxPersistenceInitialize(tallyBoxConfig_t& c)
+{
+  myConf = &c;
+}
+
+void tallyBoxPersistenceUpdate(uint16_t currentTick)
+{
+  if(myConf == NULL)
+  {
+    return;
+  }
+
+  /*at most one bounded step per tick*/
+  if(currentTick == prevTick)
+  {
+    return;
+  }
+  prevTick = currentTick;
+
+  if(commitItem == PERSISTENCE_ITEM_MAX)
+  {
+    uint32_t now = millis();
+
+    for(int i = 0; i < PERSISTENCE_ITEM_MAX; i++)
+    {
+      if(isDue(entries[i], now))
+      {
+        persistenceItem_t item = (persistenceItem_t)i;
+
+        if(startCommit(item))
+        {
+          entries[i].status = PERSISTENCE_STATUS_WRITING;
+          commitItem = item;
+        }
+        else
+        {
+          finishCommit(item, false);
+        }
+        break;
+      }
+    }
+  }
+  else
+  {
+    configJournalStep_t step = tallyBoxStepConfigurationCommit(commit);
+
+    if((step == CONFIG_JOURNAL_STEP_DONE) || (step == CONFIG_JOURNAL_STEP_FAILED))
+    {
+      finishCommit(commitItem, (step == CONFIG_JOURNAL_STEP_DONE));
+      commitItem = PERSISTENCE_ITEM_MAX;
+    }
+  }
+}
+
+void tallyBoxScheduleConfigurationWrite(tallyBoxNetworkConfig_t& c)
+{
+  scheduleWrite(PERSISTENCE_ITEM_NETWORK);
+}
+
+void tallyBoxScheduleConfigurationWrite(tallyBoxUserConfig_t& c)
+{
+  scheduleWrite(PERSISTENCE_ITEM_USER);
+}
+
+void tallyBoxScheduleConfigurationWrite(tallyBoxFleetConfig_t& c)
+{
+  scheduleWrite(PERSISTENCE_ITEM_FLEET);
+}
+
+persistenceStatus_t tallyBoxGetConfigurationWriteStatus(tallyBoxNetworkConfig_t& c)
+{
+  return entries[PERSISTENCE_ITEM_NETWORK].status;
+}
+
+persistenceStatus_t tallyBoxGetConfigurationWriteStatus(tallyBoxUserConfig_t& c)
+{
+  return entries[PERSISTENCE_ITEM_USER].status;
+}
+
+persistenceStatus_t tallyBoxGetConfigurationWriteStatus(tallyBoxFleetConfig_t& c)
+{
+  return entries[PERSISTENCE_ITEM_FLEET].status;
+}
+
+const char* tallyBoxGetConfigurationWriteStatusText(persistenceStatus_t status)
+{
+  return statusTexts[status];
+}
+
+void tallyBoxConfigurationChanged()
+{
+  revision++;
+}
+
+uint32_t tallyBoxGetConfigurationRevision()
+{
+  return revision;
+}
+
+const persistenceStats_t& tallyBoxGetPersistenceStats()
+{
+  return myStats;
+}
@@ -0,0 +1,51 @@
+#ifndef __TALLYBOXPERSISTENCE_HPP__
+#define __TALLYBOXPERSISTENCE_HPP__
+#include "Arduino.h"
+#include "TallyBoxConfiguration.hpp"
+
+/*write-behind queue for configuration changes: callers only mark a configuration dirty, the
+  actual flash write is done later from idle time, one bounded step per tick. The data is taken
+  from the configuration given at initialization when the write starts.*/
+
+#define PERSISTENCE_SETTLE_TIME_MS        1000    /*wait this long after the latest change, so that e.g. slider adjustments are merged*/
+#define PERSISTENCE_MAX_DEFER_TIME_MS     5000    /*but never defer a pending change longer than this*/
+#define PERSISTENCE_RETRY_TIME_MS         5000
+
+typedef enum
+{
+  PERSISTENCE_STATUS_CLEAN,       /*stored configuration matches the requested one*/
+  PERSISTENCE_STATUS_PENDING,     /*waiting for the changes to settle*/
+  PERSISTENCE_STATUS_WRITING,     /*commit in progress*/
+  PERSISTENCE_STATUS_FAILED       /*latest commit failed, it will be retried*/
+} persistenceStatus_t;
+
+typedef struct
+{
+  uint32_t requests;
+  uint32_t commits;
+  uint32_t failedCommits;
+  uint32_t mergedRequests;          /*writes saved by merging requests into a pending one*/
+  uint32_t lastFlushLatencyMs;      /*from the first pending request to the finished commit*/
+  uint32_t worstFlushLatencyMs;
+} persistenceStats_t;
+
+void tallyBoxPersistenceInitialize(tallyBoxConfig_t& c);
+void tallyBoxPersistenceUpdate(uint16_t currentTick);
+
+void tallyBoxScheduleConfigurationWrite(tallyBoxNetworkConfig_t& c);
+void tallyBoxScheduleConfigurationWrite(tallyBoxUserConfig_t& c);
+void tallyBoxScheduleConfigurationWrite(tallyBoxFleetConfig_t& c);
+persistenceStatus_t tallyBoxGetConfigurationWriteStatus(tallyBoxNetworkConfig_t& c);
+persistenceStatus_t tallyBoxGetConfigurationWriteStatus(tallyBoxUserConfig_t& c);
+persistenceStatus_t tallyBoxGetConfigurationWriteStatus(tallyBoxFleetConfig_t& c);
+const char* tallyBoxGetConfigurationWriteStatusText(persistenceStatus_t status);
+
+/*every change of a configuration in RAM, stored or not yet, counts up the revision. What is
+  derived from the configuration is rebuilt when the revision differs from the one it was built
+  at. Scheduling a write counts as a change, others are reported with tallyBoxConfigurationChanged.*/
+void tallyBoxConfigurationChanged();
+uint32_t tallyBoxGetConfigurationRevision();
+
+const persistenceStats_t& tallyBoxGetPersistenceStats();
+
+#endif
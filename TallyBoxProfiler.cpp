@@ -0,0 +1,153 @@
+#include "TallyBoxProfiler.hpp"
+
+typedef struct
+{
+  uint32_t count;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint16_t buckets[PROF_BUCKETS];
+} profHistogram_t;
+
+static profHistogram_t histograms[PROF_MAX];
+
+static const char* const sectionNames[PROF_MAX] =
+{
+  "tick", "state", "output", "led", "terminal", "webserver", "ota", "mdns"
+};
+
+static const uint8_t percentiles[] = {50, 90, 99};
+
+static uint8_t bucketOf(uint32_t cycles)
+{
+  uint8_t e;
+
+  if(cycles < (1UL << PROF_MIN_SHIFT))
+  {
+    return 0;
+  }
+  e = 31 - __builtin_clz(cycles);
+  if(e >= (PROF_MIN_SHIFT + PROF_OCTAVES))
+  {
+    return PROF_BUCKETS - 1;
+  }
+  /*the bit below the highest one picks the lower or upper half of the octave*/
+  return 1 + (2 * (e - PROF_MIN_SHIFT)) + ((cycles >> (e - 1)) & 1);
+}
+
+/*largest value that falls into the bucket*/
+static uint32_t bucketLimit(uint8_t bucket)
+{
+  uint8_t e;
+
+  if(bucket == 0)
+  {
+    return (1UL << PROF_MIN_SHIFT) - 1;
+  }
+  if(bucket >= (PROF_BUCKETS - 1))
+  {
+    return 0xFFFFFFFF;
+  }
+  e = PROF_MIN_SHIFT + ((bucket - 1) / 2);
+  return ((bucket - 1) & 1) ? ((2UL << e) - 1) : ((1UL << e) + (1UL << (e - 1)) - 1);
+}
+
+void tallyBoxProfilerRecord(profSection_t section, uint32_t cycles)
+{
+  profHistogram_t& h = histograms[section];
+  uint8_t b = bucketOf(cycles);
+
+  if((h.count == 0) || (cycles < h.minCycles))
+  {
+    h.minCycles = cycles;
+  }
+  if(cycles > h.maxCycles)
+  {
+    h.maxCycles = cycles;
+  }
+  h.count++;
+
+  if(h.buckets[b] == 0xFFFF)
+  {
+    for(uint8_t i = 0; i < PROF_BUCKETS; i++)
+    {
+      h.buckets[i] /= 2;
+    }
+  }
+  h.buckets[b]++;
+}
+
+void tallyBoxProfilerReset()
+{
+  memset(histograms, 0, sizeof(histograms));
+}
+
+static uint32_t percentile(const profHistogram_t& h, uint8_t p)
+{
+  uint32_t total = 0;
+  uint32_t sum = 0;
+  uint8_t i;
+
+  for(i = 0; i < PROF_BUCKETS; i++)
+  {
+    total += h.buckets[i];
+  }
+  for(i = 0; i < PROF_BUCKETS; i++)
+  {
+    sum += h.buckets[i];
+    if((sum * 100) >= (total * p))
+    {
+      break;
+    }
+  }
+  return min(bucketLimit(min(i, (uint8_t)(PROF_BUCKETS - 1))), h.maxCycles);
+}
+
+/*cycles as microseconds with one decimal*/
+static void formatUs(uint32_t cycles, char *out, size_t maxLen)
+{
+  uint32_t tenths = (uint32_t)(((uint64_t)cycles * 10) / ESP.getCpuFreqMHz());
+
+  snprintf(out, maxLen, "%u.%u", tenths / 10, tenths % 10);
+}
+
+static int formatSection(uint8_t s, char *out, size_t maxLen)
+{
+  const profHistogram_t h = histograms[s];  /*a copy, the tick may add samples meanwhile*/
+  char v[2 + sizeof(percentiles)][12];
+
+  formatUs(h.minCycles, v[0], sizeof(v[0]));
+  for(uint8_t i = 0; i < sizeof(percentiles); i++)
+  {
+    formatUs(percentile(h, percentiles[i]), v[1 + i], sizeof(v[1 + i]));
+  }
+  formatUs(h.maxCycles, v[1 + sizeof(percentiles)], sizeof(v[0]));
+
+  return snprintf(out, maxLen, "%-10s %10u %9s %9s %9s %9s %9s\r\n",
+                  sectionNames[s], h.count, v[0], v[1], v[2], v[3], v[4]);
+}
+
+size_t tallyBoxProfilerRead(uint8_t& next, char *out, size_t maxLen)
+{
+  size_t len = 0;
+  int n;
+
+  while(next <= PROF_MAX)
+  {
+    if(next == 0)
+    {
+      n = snprintf(out + len, maxLen - len, "%-10s %10s %9s %9s %9s %9s %9s\r\n",
+                   (PROFILER_ENABLED ? "section" : "disabled"), "count", "min us", "p50 us", "p90 us", "p99 us", "max us");
+    }
+    else
+    {
+      n = formatSection(next - 1, out + len, maxLen - len);
+    }
+    if((n < 0) || ((size_t)n >= (maxLen - len)))
+    {
+      break;
+    }
+    len += n;
+    next++;
+  }
+  return len;
+}
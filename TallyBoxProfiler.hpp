@@ -0,0 +1,62 @@
+#ifndef __TALLYBOXPROFILER_HPP__
+#define __TALLYBOXPROFILER_HPP__
+#include "Arduino.h"
+
+/*execution time of the stages of the tick, measured with the cpu cycle counter. Every sample
+  goes to a fixed histogram of its section: two buckets per power of two, from 64 cycles up.
+  A bucket that fills halves all buckets of its section, so the shape is kept for any run time.
+  Min and max are exact, percentiles are the upper bound of their bucket (at most 41% high).
+  With PROFILER_ENABLED 0 the markers compile to nothing.*/
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED          1
+#endif
+
+#define PROF_MIN_SHIFT            6       /*the first bucket takes everything below 64 cycles*/
+#define PROF_OCTAVES              20      /*up to 2^26 cycles, 0.8 s at 80 MHz*/
+#define PROF_BUCKETS              (1 + (2 * PROF_OCTAVES) + 1)
+#define PROF_MAX_LINE             96
+
+typedef enum
+{
+  PROF_TICK = 0,                  /*the whole tick*/
+  PROF_STATE,
+  PROF_OUTPUT,
+  PROF_LED,
+  PROF_TERMINAL,
+  PROF_WEB_SERVER,
+  PROF_OTA,
+  PROF_MDNS,
+  /**************/
+  PROF_MAX
+} profSection_t;
+
+void tallyBoxProfilerRecord(profSection_t section, uint32_t cycles);
+void tallyBoxProfilerReset();
+
+/*renders whole lines from next on, 0 when all sections have been rendered*/
+size_t tallyBoxProfilerRead(uint8_t& next, char *out, size_t maxLen);
+
+#if PROFILER_ENABLED
+/*a marker pair within one block: PROF_START(PROF_OTA); OTAUpdate(); PROF_STOP(PROF_OTA);*/
+#define PROF_START(section)       uint32_t profStart_##section = ESP.getCycleCount()
+#define PROF_STOP(section)        tallyBoxProfilerRecord((section), ESP.getCycleCount() - profStart_##section)
+
+/*measures until the end of the enclosing block*/
+class profScope
+{
+public:
+  profScope(profSection_t section) : mySection(section), myStart(ESP.getCycleCount()) {}
+  ~profScope() { tallyBoxProfilerRecord(mySection, ESP.getCycleCount() - myStart); }
+private:
+  profSection_t mySection;
+  uint32_t myStart;
+};
+#define PROF_SCOPE(section)       profScope profScope_##section(section)
+#else
+#define PROF_START(section)
+#define PROF_STOP(section)
+#define PROF_SCOPE(section)
+#endif
+
+#endif
@@ -0,0 +1,648 @@
+#include "TallyBoxRollout.hpp"
+#include "TallyBoxInfra.hpp"
+#include <Arduino_CRC32.h>
+
+#define ROLLOUT_OFFER_SIZE            8     /*image id(4) size(4)*/
+#define ROLLOUT_BLOCK_HEADER_SIZE     12    /*image id(4) offset(4) block crc(4)*/
+#define ROLLOUT_STATUS_SIZE           14    /*image id(4) next offset(4) state(1) error(1) installed image(4)*/
+#define ROLLOUT_COMMIT_SIZE           4     /*image id(4)*/
+
+static Arduino_CRC32 crc32;
+
+static const char* const boxStateNames[] = {"pending", "transfer", "verified", "restarting", "done", "failed"};
+static const char* const errorNames[ROLLOUT_ERROR_MAX] = {"", "no room", "write", "image", "timeout", "read"};
+
+uint32_t rolloutChainStart(uint32_t imageSize)
+{
+  return imageSize;
+}
+
+uint32_t rolloutChainAdd(uint32_t chain, uint32_t blockCrc)
+{
+  uint8_t buf[8];
+  uint8_t *p = buf;
+
+  putU32(&p, chain);
+  putU32(&p, blockCrc);
+  return crc32.calc(buf, sizeof(buf));
+}
+
+/*** master **************************************************/
+
+void rolloutMasterInitialize(rolloutMaster_t& m)
+{
+  memset(&m, 0, sizeof(m));
+}
+
+bool rolloutMasterAddTarget(rolloutMaster_t& m, uint32_t address, uint16_t cameraId)
+{
+  bool ret = false;
+
+  if((m.phase != ROLLOUT_RUNNING) && (m.phase != ROLLOUT_PREPARING) && (m.targetCount < ROLLOUT_MAX_TARGETS))
+  {
+    rolloutTarget_t& t = m.targets[m.targetCount++];
+
+    memset(&t, 0, sizeof(t));
+    t.address = address;
+    t.cameraId = cameraId;
+    ret = true;
+  }
+  return ret;
+}
+
+bool rolloutMasterStart(rolloutMaster_t& m, uint32_t imageSize, uint8_t concurrency, uint32_t nowMs)
+{
+  bool ret = false;
+
+  if((m.phase != ROLLOUT_RUNNING) && (m.phase != ROLLOUT_PREPARING) && (imageSize > 0) && (m.targetCount > 0))
+  {
+    m.phase = ROLLOUT_PREPARING;
+    m.concurrency = max((uint8_t)1, min(concurrency, (uint8_t)ROLLOUT_MAX_CONCURRENCY));
+    m.waves = 0;
+    m.nextTarget = 0;
+    m.imageSize = imageSize;
+    m.imageId = rolloutChainStart(imageSize);
+    m.preparedOffset = 0;
+    m.startedAt = nowMs;
+    m.finishedAt = 0;
+    m.blocksSent = 0;
+    ret = true;
+  }
+  return ret;
+}
+
+static bool isActive(const rolloutTarget_t& t)
+{
+  return ((t.state == ROLLOUT_BOX_TRANSFER) || (t.state == ROLLOUT_BOX_VERIFIED) || (t.state == ROLLOUT_BOX_RESTARTING));
+}
+
+static void finishTarget(rolloutTarget_t& t, rolloutBoxState_t state, rolloutError_t error, uint32_t nowMs)
+{
+  t.state = state;
+  t.error = error;
+  t.finishedAt = nowMs;
+}
+
+void rolloutMasterAbort(rolloutMaster_t& m, uint32_t nowMs)
+{
+  for(uint8_t i = 0; i < m.targetCount; i++)
+  {
+    rolloutTarget_t& t = m.targets[i];
+
+    if((t.state != ROLLOUT_BOX_DONE) && (t.state != ROLLOUT_BOX_FAILED))
+    {
+      finishTarget(t, ROLLOUT_BOX_FAILED, ROLLOUT_ERROR_NONE, nowMs);
+    }
+  }
+  m.phase = ROLLOUT_FINISHED;
+  m.finishedAt = nowMs;
+}
+
+uint8_t rolloutMasterCount(const rolloutMaster_t& m, rolloutBoxState_t state)
+{
+  uint8_t count = 0;
+
+  for(uint8_t i = 0; i < m.targetCount; i++)
+  {
+    count += (m.targets[i].state == state);
+  }
+  return count;
+}
+
+const char* rolloutBoxStateName(uint8_t state)
+{
+  return ((state < (sizeof(boxStateNames) / sizeof(boxStateNames[0]))) ? boxStateNames[state] : "?");
+}
+
+const char* rolloutErrorName(uint8_t error)
+{
+  return ((error < ROLLOUT_ERROR_MAX) ? errorNames[error] : "?");
+}
+
+/*the image id needs every block once, read a few blocks per update*/
+static void prepareImage(const rolloutMasterBackend_t& b, rolloutMaster_t& m, uint32_t nowMs)
+{
+  uint8_t block[ROLLOUT_BLOCK_SIZE];
+
+  for(uint8_t i = 0; (i < ROLLOUT_BLOCKS_PER_UPDATE) && (m.preparedOffset < m.imageSize); i++)
+  {
+    uint16_t len = (uint16_t)min((uint32_t)ROLLOUT_BLOCK_SIZE, m.imageSize - m.preparedOffset);
+
+    if(!b.readImage(b.ctx, m.preparedOffset, block, len))
+    {
+      for(uint8_t j = 0; j < m.targetCount; j++)
+      {
+        finishTarget(m.targets[j], ROLLOUT_BOX_FAILED, ROLLOUT_ERROR_READ, nowMs);
+      }
+      m.phase = ROLLOUT_FINISHED;
+      m.finishedAt = nowMs;
+      return;
+    }
+    m.imageId = rolloutChainAdd(m.imageId, crc32.calc(block, len));
+    m.preparedOffset += len;
+  }
+
+  if(m.preparedOffset >= m.imageSize)
+  {
+    for(uint8_t i = 0; i < m.targetCount; i++)
+    {
+      rolloutTarget_t& t = m.targets[i];
+
+      t.state = ROLLOUT_BOX_PENDING;
+      t.error = ROLLOUT_ERROR_NONE;
+      t.attempts = 0;
+      t.wave = 0;
+      t.startedAt = 0;
+      t.finishedAt = 0;
+      t.resentBlocks = 0;
+    }
+    m.phase = ROLLOUT_RUNNING;
+  }
+}
+
+static void sendOffer(const rolloutMasterBackend_t& b, rolloutMaster_t& m, rolloutTarget_t& t, uint32_t nowMs)
+{
+  uint8_t buf[ROLLOUT_OFFER_SIZE];
+  uint8_t *p = buf;
+
+  putU32(&p, m.imageId);
+  putU32(&p, m.imageSize);
+  b.send(b.ctx, ROLLOUT_MESSAGE_OFFER, t.address, buf, sizeof(buf));
+  t.lastSentAt = nowMs;
+}
+
+static void sendCommit(const rolloutMasterBackend_t& b, rolloutMaster_t& m, rolloutTarget_t& t, uint32_t nowMs)
+{
+  uint8_t buf[ROLLOUT_COMMIT_SIZE];
+  uint8_t *p = buf;
+
+  putU32(&p, m.imageId);
+  b.send(b.ctx, ROLLOUT_MESSAGE_COMMIT, t.address, buf, sizeof(buf));
+  t.lastSentAt = nowMs;
+}
+
+static bool sendBlock(const rolloutMasterBackend_t& b, rolloutMaster_t& m, rolloutTarget_t& t, uint32_t nowMs)
+{
+  uint8_t buf[ROLLOUT_MAX_PAYLOAD];
+  uint8_t *p = buf;
+  uint16_t len = (uint16_t)min((uint32_t)ROLLOUT_BLOCK_SIZE, m.imageSize - t.sentOffset);
+  uint8_t *data = buf + ROLLOUT_BLOCK_HEADER_SIZE;
+
+  if(!b.readImage(b.ctx, t.sentOffset, data, len))
+  {
+    finishTarget(t, ROLLOUT_BOX_FAILED, ROLLOUT_ERROR_READ, nowMs);
+    return false;
+  }
+  putU32(&p, m.imageId);
+  putU32(&p, t.sentOffset);
+  putU32(&p, crc32.calc(data, len));
+  b.send(b.ctx, ROLLOUT_MESSAGE_BLOCK, t.address, buf, ROLLOUT_BLOCK_HEADER_SIZE + len);
+
+  t.sentOffset += len;
+  t.lastSentAt = nowMs;
+  m.blocksSent++;
+  return true;
+}
+
+/*a box that does not move is put back for a later wave, it resumes where it stopped*/
+static void checkTimeouts(const rolloutMasterBackend_t& b, rolloutMaster_t& m, rolloutTarget_t& t, uint32_t nowMs)
+{
+  switch(t.state)
+  {
+    case ROLLOUT_BOX_TRANSFER:
+      if((nowMs - t.lastProgressAt) >= ROLLOUT_STALL_TIMEOUT_MS)
+      {
+        if(t.attempts >= ROLLOUT_MAX_ATTEMPTS)
+        {
+          finishTarget(t, ROLLOUT_BOX_FAILED, ROLLOUT_ERROR_TIMEOUT, nowMs);
+        }
+        else
+        {
+          t.state = ROLLOUT_BOX_PENDING;
+        }
+      }
+      else if((nowMs - t.lastSentAt) >= ROLLOUT_RETRY_MS)
+      {
+        if(!t.accepted)
+        {
+          sendOffer(b, m, t, nowMs);
+        }
+        else
+        {
+          /*go back to the acknowledged block*/
+          t.resentBlocks += (t.sentOffset - t.ackedOffset + ROLLOUT_BLOCK_SIZE - 1) / ROLLOUT_BLOCK_SIZE;
+          t.sentOffset = t.ackedOffset;
+          t.lastSentAt = nowMs;
+        }
+      }
+      break;
+
+    case ROLLOUT_BOX_RESTARTING:
+      if((nowMs - t.lastProgressAt) >= ROLLOUT_REBOOT_TIMEOUT_MS)
+      {
+        finishTarget(t, ROLLOUT_BOX_FAILED, ROLLOUT_ERROR_TIMEOUT, nowMs);
+      }
+      else if((nowMs - t.lastSentAt) >= ROLLOUT_RETRY_MS)
+      {
+        /*asks the box which image it runs once it is back*/
+        sendOffer(b, m, t, nowMs);
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+static void startTarget(const rolloutMasterBackend_t& b, rolloutMaster_t& m, rolloutTarget_t& t, uint32_t nowMs)
+{
+  t.state = ROLLOUT_BOX_TRANSFER;
+  t.attempts++;
+  t.wave = m.waves;
+  t.accepted = false;
+  t.rewound = false;
+  t.ackedOffset = 0;
+  t.sentOffset = 0;
+  t.lastProgressAt = nowMs;
+  if(t.startedAt == 0)
+  {
+    t.startedAt = max(nowMs, (uint32_t)1);
+  }
+  sendOffer(b, m, t, nowMs);
+}
+
+/*fills the free places, off air cameras first. On air cameras are started too when nothing
+  else is left: the transfer does not disturb them, only the restart waits*/
+static void startWave(const rolloutMasterBackend_t& b, rolloutMaster_t& m, uint32_t nowMs)
+{
+  uint8_t active = 0;
+  uint8_t started = 0;
+
+  for(uint8_t i = 0; i < m.targetCount; i++)
+  {
+    active += isActive(m.targets[i]);
+  }
+
+  for(uint8_t pass = 0; (pass < 2) && (active < m.concurrency); pass++)
+  {
+    for(uint8_t i = 0; (i < m.targetCount) && (active < m.concurrency); i++)
+    {
+      rolloutTarget_t& t = m.targets[i];
+
+      if((t.state == ROLLOUT_BOX_PENDING) && ((pass == 1) || !b.isOnAir(b.ctx, t.cameraId)))
+      {
+        if(started == 0)
+        {
+          m.waves++;
+        }
+        startTarget(b, m, t, nowMs);
+        active++;
+        started++;
+      }
+    }
+  }
+}
+
+void rolloutMasterUpdate(const rolloutMasterBackend_t& b, rolloutMaster_t& m, uint32_t nowMs)
+{
+  uint8_t sent = 0;
+  uint8_t idle = 0;
+  bool unfinished = false;
+
+  if(m.phase == ROLLOUT_PREPARING)
+  {
+    prepareImage(b, m, nowMs);
+    return;
+  }
+  if(m.phase != ROLLOUT_RUNNING)
+  {
+    return;
+  }
+
+  for(uint8_t i = 0; i < m.targetCount; i++)
+  {
+    rolloutTarget_t& t = m.targets[i];
+
+    checkTimeouts(b, m, t, nowMs);
+
+    /*the restart is asked for again until the box reports it*/
+    if((t.state == ROLLOUT_BOX_VERIFIED) && ((nowMs - t.lastSentAt) >= ROLLOUT_RETRY_MS) && !b.isOnAir(b.ctx, t.cameraId))
+    {
+      sendCommit(b, m, t, nowMs);
+    }
+    unfinished |= ((t.state != ROLLOUT_BOX_DONE) && (t.state != ROLLOUT_BOX_FAILED));
+  }
+
+  if(!unfinished)
+  {
+    m.phase = ROLLOUT_FINISHED;
+    m.finishedAt = nowMs;
+    return;
+  }
+
+  startWave(b, m, nowMs);
+
+  /*blocks round robin over the boxes, a window of blocks per box*/
+  while((sent < ROLLOUT_BLOCKS_PER_UPDATE) && (idle < m.targetCount))
+  {
+    rolloutTarget_t& t = m.targets[m.nextTarget];
+
+    m.nextTarget = (m.nextTarget + 1) % m.targetCount;
+    if((t.state == ROLLOUT_BOX_TRANSFER) && t.accepted && (t.sentOffset < m.imageSize)
+       && ((t.sentOffset - t.ackedOffset) < (ROLLOUT_WINDOW_BLOCKS * ROLLOUT_BLOCK_SIZE))
+       && sendBlock(b, m, t, nowMs))
+    {
+      sent++;
+      idle = 0;
+    }
+    else
+    {
+      idle++;
+    }
+  }
+}
+
+void rolloutMasterReceive(const rolloutMasterBackend_t& b, rolloutMaster_t& m, uint32_t from, const uint8_t *payload, uint16_t len, uint32_t nowMs)
+{
+  rolloutTarget_t *t = NULL;
+  uint8_t *p = (uint8_t*)payload;
+
+  if((m.phase != ROLLOUT_RUNNING) || (len != ROLLOUT_STATUS_SIZE))
+  {
+    return;
+  }
+  for(uint8_t i = 0; (i < m.targetCount) && (t == NULL); i++)
+  {
+    if(m.targets[i].address == from)
+    {
+      t = &m.targets[i];
+    }
+  }
+  if((t == NULL) || !isActive(*t))
+  {
+    return;
+  }
+
+  uint32_t imageId = getU32(&p);
+  uint32_t nextOffset = getU32(&p);
+  uint8_t state = getU8(&p);
+  uint8_t error = getU8(&p);
+  uint32_t installedId = getU32(&p);
+
+  /*the error is kept and shown, a code this master does not know is not taken*/
+  if(error >= ROLLOUT_ERROR_MAX)
+  {
+    return;
+  }
+  if(installedId == m.imageId)
+  {
+    finishTarget(*t, ROLLOUT_BOX_DONE, ROLLOUT_ERROR_NONE, nowMs);
+    return;
+  }
+  if(imageId != m.imageId)
+  {
+    /*the box has lost the transfer, e.g. restarted: offer again, it starts over*/
+    if((t->state == ROLLOUT_BOX_TRANSFER) && t->accepted)
+    {
+      t->accepted = false;
+      t->lastSentAt = nowMs - ROLLOUT_RETRY_MS;
+    }
+    return;
+  }
+
+  switch(state)
+  {
+    case ROLLOUT_SLAVE_RECEIVING:
+      if(t->state == ROLLOUT_BOX_TRANSFER)
+      {
+        if(!t->accepted || (nextOffset > t->ackedOffset))
+        {
+          t->lastProgressAt = nowMs;
+          t->rewound = false;
+        }
+        else if((nextOffset == t->ackedOffset) && (t->sentOffset > nextOffset) && !t->rewound)
+        {
+          /*the box has skipped a block that did not arrive, go back once per gap without
+            waiting for the retry time*/
+          t->resentBlocks += (t->sentOffset - nextOffset + ROLLOUT_BLOCK_SIZE - 1) / ROLLOUT_BLOCK_SIZE;
+          t->sentOffset = nextOffset;
+          t->rewound = true;
+        }
+        /*a resumed transfer continues from where the box is*/
+        if(!t->accepted || (nextOffset > t->sentOffset))
+        {
+          t->sentOffset = nextOffset;
+        }
+        t->accepted = true;
+        t->ackedOffset = nextOffset;
+      }
+      break;
+
+    case ROLLOUT_SLAVE_VERIFIED:
+      if(t->state == ROLLOUT_BOX_TRANSFER)
+      {
+        t->ackedOffset = m.imageSize;
+        t->state = ROLLOUT_BOX_VERIFIED;
+        t->lastProgressAt = nowMs;
+        t->lastSentAt = nowMs - ROLLOUT_RETRY_MS;   /*commit right away if off air*/
+      }
+      break;
+
+    case ROLLOUT_SLAVE_RESTARTING:
+      if(t->state != ROLLOUT_BOX_RESTARTING)
+      {
+        t->state = ROLLOUT_BOX_RESTARTING;
+        t->lastProgressAt = nowMs;
+      }
+      break;
+
+    case ROLLOUT_SLAVE_FAILED:
+      if(t->attempts >= ROLLOUT_MAX_ATTEMPTS)
+      {
+        finishTarget(*t, ROLLOUT_BOX_FAILED, (rolloutError_t)error, nowMs);
+      }
+      else
+      {
+        t->state = ROLLOUT_BOX_PENDING;
+        t->error = error;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+/*** box *****************************************************/
+
+void rolloutSlaveInitialize(rolloutSlave_t& s, uint32_t installedId)
+{
+  memset(&s, 0, sizeof(s));
+  s.installedId = installedId;
+}
+
+static void sendStatus(const rolloutSlaveBackend_t& b, rolloutSlave_t& s)
+{
+  uint8_t buf[ROLLOUT_STATUS_SIZE];
+  uint8_t *p = buf;
+
+  putU32(&p, s.imageId);
+  putU32(&p, s.nextOffset);
+  putU8(&p, s.state);
+  putU8(&p, s.error);
+  putU32(&p, s.installedId);
+  b.send(b.ctx, ROLLOUT_MESSAGE_STATUS, s.master, buf, sizeof(buf));
+}
+
+static void failSlave(const rolloutSlaveBackend_t& b, rolloutSlave_t& s, rolloutError_t error)
+{
+  b.flashEnd(b.ctx, false);
+  s.state = ROLLOUT_SLAVE_FAILED;
+  s.error = error;
+  s.queueCount = 0;
+}
+
+static void handleOffer(const rolloutSlaveBackend_t& b, rolloutSlave_t& s, const uint8_t *payload, uint16_t len)
+{
+  uint8_t *p = (uint8_t*)payload;
+  uint32_t imageId = getU32(&p);
+  uint32_t imageSize = getU32(&p);
+  bool sameImage = (imageId == s.imageId);
+
+  /*the image in progress or already verified is kept, any other is started from the beginning*/
+  if((s.installedId != imageId) && (s.state != ROLLOUT_SLAVE_RESTARTING)
+     && !(sameImage && ((s.state == ROLLOUT_SLAVE_RECEIVING) || (s.state == ROLLOUT_SLAVE_VERIFIED))))
+  {
+    if(s.state == ROLLOUT_SLAVE_RECEIVING)
+    {
+      b.flashEnd(b.ctx, false);
+    }
+    s.imageId = imageId;
+    s.imageSize = imageSize;
+    s.nextOffset = 0;
+    s.writtenOffset = 0;
+    s.queueStart = 0;
+    s.queueCount = 0;
+    s.chain = rolloutChainStart(imageSize);
+    s.error = ROLLOUT_ERROR_NONE;
+    s.restartRequested = false;
+    s.state = (b.flashBegin(b.ctx, imageSize) ? ROLLOUT_SLAVE_RECEIVING : ROLLOUT_SLAVE_FAILED);
+    if(s.state == ROLLOUT_SLAVE_FAILED)
+    {
+      s.error = ROLLOUT_ERROR_BEGIN;
+    }
+  }
+}
+
+/*the flash is not written here, inside the tick: the block is queued for rolloutSlaveIdle()*/
+static void handleBlock(const rolloutSlaveBackend_t& b, rolloutSlave_t& s, const uint8_t *payload, uint16_t len)
+{
+  uint8_t *p = (uint8_t*)payload;
+  uint32_t imageId = getU32(&p);
+  uint32_t offset = getU32(&p);
+  uint32_t blockCrc = getU32(&p);
+  uint16_t dataLen = len - ROLLOUT_BLOCK_HEADER_SIZE;
+  uint8_t slot = (s.queueStart + s.queueCount) % ROLLOUT_SLAVE_QUEUE_BLOCKS;
+
+  /*only the next block in order is taken, anything else is answered with the offset needed*/
+  if((s.state != ROLLOUT_SLAVE_RECEIVING) || (imageId != s.imageId) || (offset != s.nextOffset)
+     || (dataLen == 0) || (dataLen > (s.imageSize - s.nextOffset)) || (s.queueCount >= ROLLOUT_SLAVE_QUEUE_BLOCKS)
+     || (crc32.calc(p, dataLen) != blockCrc))
+  {
+    return;
+  }
+
+  memcpy(s.queue[slot], p, dataLen);
+  s.queueLen[slot] = dataLen;
+  s.queueCount++;
+  s.chain = rolloutChainAdd(s.chain, blockCrc);
+  s.nextOffset += dataLen;
+}
+
+void rolloutSlaveReceive(const rolloutSlaveBackend_t& b, rolloutSlave_t& s, rolloutMessage_t type, uint32_t from, const uint8_t *payload, uint16_t len)
+{
+  uint8_t *p = (uint8_t*)payload;
+
+  switch(type)
+  {
+    case ROLLOUT_MESSAGE_OFFER:
+      if(len != ROLLOUT_OFFER_SIZE)
+      {
+        return;
+      }
+      s.master = from;
+      handleOffer(b, s, payload, len);
+      break;
+
+    case ROLLOUT_MESSAGE_BLOCK:
+      if((len <= ROLLOUT_BLOCK_HEADER_SIZE) || (from != s.master))
+      {
+        return;
+      }
+      handleBlock(b, s, payload, len);
+      break;
+
+    case ROLLOUT_MESSAGE_COMMIT:
+      if(len != ROLLOUT_COMMIT_SIZE)
+      {
+        return;
+      }
+      /*a box that has restarted since only reports the image it runs*/
+      s.master = from;
+      if((getU32(&p) == s.imageId) && (s.state == ROLLOUT_SLAVE_VERIFIED))
+      {
+        s.restartRequested = true;
+      }
+      break;
+
+    default:
+      return;
+  }
+  sendStatus(b, s);
+}
+
+/*the restart is taken only when the own camera is off air*/
+void rolloutSlaveUpdate(const rolloutSlaveBackend_t& b, rolloutSlave_t& s)
+{
+  if(s.restartRequested && (s.state == ROLLOUT_SLAVE_VERIFIED) && !b.isOnAir(b.ctx))
+  {
+    s.state = ROLLOUT_SLAVE_RESTARTING;
+    sendStatus(b, s);
+    b.restart(b.ctx, s.imageId);
+  }
+}
+
+/*one block per call from the idle time, the image is checked after its last block*/
+void rolloutSlaveIdle(const rolloutSlaveBackend_t& b, rolloutSlave_t& s)
+{
+  if((s.state != ROLLOUT_SLAVE_RECEIVING) || (s.queueCount == 0))
+  {
+    return;
+  }
+
+  uint16_t len = s.queueLen[s.queueStart];
+
+  if(!b.flashWrite(b.ctx, s.queue[s.queueStart], len))
+  {
+    failSlave(b, s, ROLLOUT_ERROR_WRITE);
+    sendStatus(b, s);
+    return;
+  }
+  s.queueStart = (s.queueStart + 1) % ROLLOUT_SLAVE_QUEUE_BLOCKS;
+  s.queueCount--;
+  s.writtenOffset += len;
+
+  if(s.writtenOffset == s.imageSize)
+  {
+    if((s.chain != s.imageId) || !b.flashEnd(b.ctx, true))
+    {
+      s.state = ROLLOUT_SLAVE_FAILED;
+      s.error = ROLLOUT_ERROR_IMAGE;
+    }
+    else
+    {
+      s.state = ROLLOUT_SLAVE_VERIFIED;
+    }
+    sendStatus(b, s);
+  }
+}
@@ -0,0 +1,174 @@
+#ifndef __TALLYBOXROLLOUT_HPP__
+#define __TALLYBOXROLLOUT_HPP__
+#include "Arduino.h"
+
+/*firmware rollout from the master to the other boxes. The master holds one image and pushes it
+  to several boxes at a time in blocks, each block with its own crc. A box takes the blocks in
+  order into a short queue, writes them to the flash from the idle time between the ticks and
+  acknowledges the offset it has taken; the master keeps a few blocks in flight per
+  box and sends again from the acknowledged offset when nothing moves. An interrupted transfer
+  continues from that offset as long as the box has not restarted. The image is identified by a
+  crc chain over the block crcs, which the box rebuilds from the blocks it has written and
+  compares before the image is taken into use.
+
+  Boxes are started in waves of at most `concurrency` boxes, cameras that are not in program or
+  preview first. A box with a complete image is told to restart only when its camera is off air,
+  and the box checks that again itself before restarting.
+
+  The protocol is independent of the network and the flash: the master and the box use the
+  backends below, so the same code runs against simulated boxes on a Linux host.*/
+
+#define ROLLOUT_BLOCK_SIZE            512
+#define ROLLOUT_WINDOW_BLOCKS         4         /*blocks in flight per box*/
+#define ROLLOUT_MAX_TARGETS           32
+#define ROLLOUT_DEFAULT_CONCURRENCY   4
+#define ROLLOUT_MAX_CONCURRENCY       8
+#define ROLLOUT_BLOCKS_PER_UPDATE     4         /*sent or hashed per master update, the peer network reads 4 frames per tick*/
+#define ROLLOUT_RETRY_MS              300       /*no progress: send again from the acknowledged offset*/
+#define ROLLOUT_STALL_TIMEOUT_MS      10000     /*no progress: the box waits for a later wave*/
+#define ROLLOUT_REBOOT_TIMEOUT_MS     60000     /*restarted box has not reported the new image*/
+#define ROLLOUT_MAX_ATTEMPTS          3
+#define ROLLOUT_MAX_PAYLOAD           (12 + ROLLOUT_BLOCK_SIZE)
+#define ROLLOUT_SLAVE_QUEUE_BLOCKS    ROLLOUT_WINDOW_BLOCKS   /*taken, not yet written: a full queue drops the block*/
+
+typedef enum
+{
+  ROLLOUT_MESSAGE_OFFER = 0,      /*master -> box: image id and size, starts or resumes a transfer*/
+  ROLLOUT_MESSAGE_BLOCK,          /*master -> box: image id, offset, block crc, data*/
+  ROLLOUT_MESSAGE_STATUS,         /*box -> master: image id, next offset, state, error, installed image*/
+  ROLLOUT_MESSAGE_COMMIT          /*master -> box: take the verified image into use*/
+} rolloutMessage_t;
+
+typedef enum
+{
+  ROLLOUT_BOX_PENDING = 0,        /*waits for a wave*/
+  ROLLOUT_BOX_TRANSFER,
+  ROLLOUT_BOX_VERIFIED,           /*complete and checked, the restart waits for the camera to be off air*/
+  ROLLOUT_BOX_RESTARTING,
+  ROLLOUT_BOX_DONE,
+  ROLLOUT_BOX_FAILED
+} rolloutBoxState_t;
+
+typedef enum
+{
+  ROLLOUT_SLAVE_IDLE = 0,
+  ROLLOUT_SLAVE_RECEIVING,
+  ROLLOUT_SLAVE_VERIFIED,
+  ROLLOUT_SLAVE_RESTARTING,
+  ROLLOUT_SLAVE_FAILED
+} rolloutSlaveState_t;
+
+typedef enum
+{
+  ROLLOUT_ERROR_NONE = 0,
+  ROLLOUT_ERROR_BEGIN,            /*no room for the image*/
+  ROLLOUT_ERROR_WRITE,
+  ROLLOUT_ERROR_IMAGE,            /*crc chain or image check failed*/
+  ROLLOUT_ERROR_TIMEOUT,          /*master side: no progress or no restart*/
+  ROLLOUT_ERROR_READ,             /*master side: image file*/
+  /**************/
+  ROLLOUT_ERROR_MAX
+} rolloutError_t;
+
+typedef struct
+{
+  void (*send)(void *ctx, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len);
+  bool (*readImage)(void *ctx, uint32_t offset, uint8_t *buf, uint16_t len);
+  bool (*isOnAir)(void *ctx, uint16_t cameraId);
+  void *ctx;
+} rolloutMasterBackend_t;
+
+typedef struct
+{
+  void (*send)(void *ctx, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len);
+  bool (*flashBegin)(void *ctx, uint32_t size);
+  bool (*flashWrite)(void *ctx, const uint8_t *data, uint16_t len);
+  bool (*flashEnd)(void *ctx, bool commit);     /*commit = false aborts the image*/
+  bool (*isOnAir)(void *ctx);
+  void (*restart)(void *ctx, uint32_t imageId);
+  void *ctx;
+} rolloutSlaveBackend_t;
+
+typedef struct
+{
+  uint32_t address;
+  uint16_t cameraId;
+  uint8_t state;
+  uint8_t error;
+  uint8_t attempts;
+  uint8_t wave;
+  bool accepted;                  /*the box has answered the offer*/
+  bool rewound;                   /*sent again from the acknowledged offset, until it moves*/
+  uint32_t ackedOffset;           /*written by the box*/
+  uint32_t sentOffset;
+  uint32_t startedAt;
+  uint32_t finishedAt;
+  uint32_t lastProgressAt;
+  uint32_t lastSentAt;
+  uint32_t resentBlocks;
+} rolloutTarget_t;
+
+typedef enum
+{
+  ROLLOUT_IDLE = 0,
+  ROLLOUT_PREPARING,              /*the image id is being computed*/
+  ROLLOUT_RUNNING,
+  ROLLOUT_FINISHED
+} rolloutPhase_t;
+
+typedef struct
+{
+  uint8_t phase;
+  uint8_t concurrency;
+  uint8_t waves;
+  uint8_t targetCount;
+  uint8_t nextTarget;             /*round robin of the block sending*/
+  uint32_t imageSize;
+  uint32_t imageId;
+  uint32_t preparedOffset;
+  uint32_t startedAt;
+  uint32_t finishedAt;
+  uint32_t blocksSent;
+  rolloutTarget_t targets[ROLLOUT_MAX_TARGETS];
+} rolloutMaster_t;
+
+typedef struct
+{
+  uint8_t state;
+  uint8_t error;
+  bool restartRequested;
+  uint32_t master;
+  uint32_t imageId;
+  uint32_t imageSize;
+  uint32_t nextOffset;            /*taken so far, written or queued*/
+  uint32_t writtenOffset;
+  uint32_t chain;                 /*crc chain of the blocks taken so far*/
+  uint32_t installedId;           /*image this box is running, 0 = not known*/
+  uint8_t queueStart;
+  uint8_t queueCount;
+  uint16_t queueLen[ROLLOUT_SLAVE_QUEUE_BLOCKS];
+  uint8_t queue[ROLLOUT_SLAVE_QUEUE_BLOCKS][ROLLOUT_BLOCK_SIZE];
+} rolloutSlave_t;
+
+/*the id of an image: chain = size, then chain = crc32(chain, block crc) for every block*/
+uint32_t rolloutChainStart(uint32_t imageSize);
+uint32_t rolloutChainAdd(uint32_t chain, uint32_t blockCrc);
+
+/*master*/
+void rolloutMasterInitialize(rolloutMaster_t& m);
+bool rolloutMasterAddTarget(rolloutMaster_t& m, uint32_t address, uint16_t cameraId);
+bool rolloutMasterStart(rolloutMaster_t& m, uint32_t imageSize, uint8_t concurrency, uint32_t nowMs);
+void rolloutMasterAbort(rolloutMaster_t& m, uint32_t nowMs);
+void rolloutMasterUpdate(const rolloutMasterBackend_t& b, rolloutMaster_t& m, uint32_t nowMs);
+void rolloutMasterReceive(const rolloutMasterBackend_t& b, rolloutMaster_t& m, uint32_t from, const uint8_t *payload, uint16_t len, uint32_t nowMs);
+uint8_t rolloutMasterCount(const rolloutMaster_t& m, rolloutBoxState_t state);
+const char* rolloutBoxStateName(uint8_t state);
+const char* rolloutErrorName(uint8_t error);
+
+/*box*/
+void rolloutSlaveInitialize(rolloutSlave_t& s, uint32_t installedId);
+void rolloutSlaveUpdate(const rolloutSlaveBackend_t& b, rolloutSlave_t& s);
+void rolloutSlaveReceive(const rolloutSlaveBackend_t& b, rolloutSlave_t& s, rolloutMessage_t type, uint32_t from, const uint8_t *payload, uint16_t len);
+void rolloutSlaveIdle(const rolloutSlaveBackend_t& b, rolloutSlave_t& s);   /*writes one queued block*/
+
+#endif
@@ -1,8 +1,5 @@
 #include "TallyBoxStateMachine.hpp"
 #include "Arduino.h"
-#include <ATEMbase.h>
-#include <ATEMstd.h>
-#include <SkaarhojPgmspace.h>
 
 #include <ESP8266WiFi.h>
 #include <ESP8266mDNS.h>
@@ -14,6 +11,16 @@
 #include "TallyBoxInfra.hpp"
 #include "TallyBoxTerminal.hpp"
 #include "TallyBoxWebServer.hpp"
+#include "TallyBoxPersistence.hpp"
+#include "TallyBoxFleet.hpp"
+#include "TallyBoxFirmware.hpp"
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxLog.hpp"
+#include "TallyBoxProfiler.hpp"
+#include "TallyBoxSwitchers.hpp"
+#include "TallyBoxUmd.hpp"
+
+static const logModule_t logModule = LOG_MODULE_STATE;
 
 
 #define SEQUENCE_SINGLE_SHORT       0x00000001
@@ -26,10 +33,14 @@
 #define SEQUENCE_CONSTANT_ON        0xFFFFFFFF
 
 
-ATEMstd AtemSwitcher;
 static bool tallyPreview = false;
 static bool tallyProgram = false;
+static uint16_t tallyPreviewChannel = 0;
+static uint16_t tallyProgramChannel = 0;
+static uint64_t tallyPreviewMask = 0;
+static uint64_t tallyProgramMask = 0;
 static bool tallyInTransition = false;
+static uint16_t tallyTransitionPosition = 0;
 static bool masterCommunicationFrozen = false;
 static tallyBoxState_t myState = CONNECTING_TO_WIFI; /*start from here*/
 static uint32_t lastReceivedMasterMessageInTicks = 0;
@@ -46,6 +57,16 @@ const uint32_t ledSequence[STATE_MAX] =
   SEQUENCE_SINGLE_LONG    /*ERROR*/
 };
 
+const char* const stateNames[STATE_MAX] =
+{
+  "CONNECTING_TO_WIFI",
+  "CONNECTING_TO_ATEM_HOST",
+  "CONNECTING_TO_PEERNETWORK_HOST",
+  "RUNNING_ATEM",
+  "RUNNING_PEERNETWORK",
+  "ERROR"
+};
+
 
 
 /*** INTERNAL FUNCTIONS **************************************/
@@ -53,7 +74,8 @@ static uint32_t getLedSequenceForRunState();
 static void updateLed(uint16_t tick);
 static void MDnsInitialize(tallyBoxConfig_t& c);
 static void MDnsUpdate();
-static void setTallySignals(tallyBoxNetworkConfig_t& c, uint16_t greenChannel, uint16_t redChannel);
+static uint32_t idleMsBeforeNextTick(uint32_t tickStartUs);
+static void setTallySignals(tallyBoxConfig_t& c, const peerTally_t& t);
 static void stateConnectingToWifi(tallyBoxNetworkConfig_t& c, uint8_t *internalState);
 static void stateConnectingToAtemHost(tallyBoxNetworkConfig_t& c, uint8_t *internalState);
 static void stateConnectingToPeerNetworkHost(tallyBoxNetworkConfig_t& c, uint8_t *internalState);
@@ -83,28 +105,24 @@ static uint32_t getLedSequenceForRunState()
 
 static void updateLed(uint16_t currentTick)
 {
-  uint16_t tick = currentTick / 10;
   bool isRunning = (myState==RUNNING_ATEM || myState==RUNNING_PEERNETWORK);
-  uint32_t seq = (isRunning ? getLedSequenceForRunState() : ledSequence[myState]);
-  bool state = (seq >> tick) & 0x00000001;
-  int ledState = (state ? LOW : HIGH);
 
-  digitalWrite(LED_BUILTIN, ledState);
+  outputUpdateStatusLed((isRunning ? getLedSequenceForRunState() : ledSequence[myState]), currentTick);
 }
 
 
 static void connectToWifi(tallyBoxConfig_t& c)
 {
-  Serial.printf("Connecting to WiFi ('%s')", c.network.wifiSSID); 
+  LOG_INFO("Connecting to WiFi ('%s')", c.network.wifiSSID);
 
   if(c.network.hasStaticIp)
   {
     IPAddress primaryDNS(8, 8, 8, 8);   //optional
     IPAddress secondaryDNS(8, 8, 4, 4); //optional
 
-    if(!WiFi.config(c.network.ownAddress, c.network.defaultGateway, c.network.subnetMask, primaryDNS, secondaryDNS)) 
+    if(!WiFi.config(IPAddress(c.network.ownAddress), IPAddress(c.network.defaultGateway), IPAddress(c.network.subnetMask), primaryDNS, secondaryDNS)) 
     {
-      Serial.println("STA Failed to configure");
+      LOG_ERROR("STA Failed to configure");
     }
   }
 
@@ -117,45 +135,33 @@ static void connectToWifi(tallyBoxConfig_t& c)
 
 static void stateConnectingToWifi(tallyBoxConfig_t& c, uint8_t *internalState)
 {
-  static int ownCounter = 0;
-  const int dotPrintPeriod = 200;
-
   switch(internalState[CONNECTING_TO_WIFI])
   {
     case 0: /*init wifi device*/
       connectToWifi(c);
-      ownCounter = 0;
       internalState[CONNECTING_TO_WIFI] = 1;
       break;
 
     case 1: /*wait*/
-      if(WiFi.status() != WL_CONNECTED)
-      {
-        if(ownCounter % dotPrintPeriod == 0)
-        {
-          Serial.print(".");
-        }
-        ownCounter = ((ownCounter + 1) % dotPrintPeriod);
-      }
-      else
+      if(WiFi.status() == WL_CONNECTED)
       {
         internalState[CONNECTING_TO_WIFI] = 2;
       }
       break;
 
     case 2: /*advance to next*/
-      Serial.print("\r\nWifi connected: ");
-      Serial.println(WiFi.localIP());
+      LOG_INFO("Wifi connected: %u.%u.%u.%u", WiFi.localIP()[0], WiFi.localIP()[1], WiFi.localIP()[2], WiFi.localIP()[3]);
       internalState[CONNECTING_TO_WIFI] = 0;
 
+      /*master listens too: the boxes fetch their configuration from it*/
+      peerNetworkInitialize(PEERNETWORK_PORT);
+
       if(c.network.isMaster)
       {
         myState = CONNECTING_TO_ATEM_HOST;
       }
       else
       {
-        /*start listening for peerNetwork updates from master box*/
-        peerNetworkInitialize(7493);
         myState = CONNECTING_TO_PEERNETWORK_HOST;
       }  
 
@@ -168,7 +174,7 @@ static void stateConnectingToWifi(tallyBoxConfig_t& c, uint8_t *internalState)
       break;
 
     default:
-      Serial.println("*** Error: illegal internalstate (CONNECTING_TO_WIFI) ***");
+      LOG_ERROR("illegal internalstate (CONNECTING_TO_WIFI)");
       internalState[CONNECTING_TO_WIFI] = 0;
       break;
   }      
@@ -179,29 +185,30 @@ static void stateConnectingToAtemHost(tallyBoxConfig_t& c, uint8_t *internalStat
   switch(internalState[CONNECTING_TO_ATEM_HOST])
   {
     case 0:
-      AtemSwitcher.begin(c.network.hostAddress);
-      AtemSwitcher.serialOutput(0x80);
-      AtemSwitcher.connect();
+      tallyBoxSwitchersBegin(c.network);
+      tallyBoxUmdBegin(c.network);
       internalState[CONNECTING_TO_ATEM_HOST] = 1;
-      Serial.println("Connecting to ATEM"); 
       break;
 
-    case 1:
-      AtemSwitcher.runLoop();
-      if(AtemSwitcher.isConnected())
+    case 1:   /*the switcher sessions reconnect by themselves*/
+    {
+      peerTally_t t;
+
+      if(tallyBoxSwitchersUpdate(c.network, t))
       {
         internalState[CONNECTING_TO_ATEM_HOST] = 2;
       }          
       break;
+    }
     
     case 2: /*advance to next*/
-      Serial.println("\r\nConnected to ATEM host!");
+      LOG_INFO("Connected to ATEM host!");
       internalState[CONNECTING_TO_ATEM_HOST] = 0;
       myState = RUNNING_ATEM;
       break;
 
     default:
-      Serial.println("*** Error: illegal internalstate (CONNECTING_TO_ATEM_HOST) ***");
+      LOG_ERROR("illegal internalstate (CONNECTING_TO_ATEM_HOST)");
       internalState[CONNECTING_TO_WIFI] = 0;
       break;
   }
@@ -212,60 +219,101 @@ static void stateConnectingToPeerNetworkHost(tallyBoxConfig_t& c, uint8_t *inter
   myState = RUNNING_PEERNETWORK;
 }
 
-static void setTallySignals(tallyBoxConfig_t& c, uint16_t greenChannel, uint16_t redChannel, bool inTransition)
+/*the watched inputs are compiled into one mask per signal when the user configuration changes,
+  so a frame costs one test per signal however many inputs are watched. Camera ids above the
+  mask inputs have no bit and fall back to the channel comparison.*/
+static uint64_t programWatchMask = 0;
+static uint64_t previewWatchMask = 0;
+static bool previewYieldsToProgram = false;
+static bool watchByChannel = false;
+static uint32_t watchRevision = 0;
+
+static void compileWatchMasks(const tallyBoxUserConfig_t& u)
+{
+  uint64_t cameraBit = peerTallyInputBit(u.cameraId);
+
+  programWatchMask = u.watchedInputs | cameraBit;
+  previewWatchMask = ((u.watchRule == TALLY_WATCH_PROGRAM_ONLY) ? cameraBit : programWatchMask);
+  previewYieldsToProgram = (u.watchRule == TALLY_WATCH_PROGRAM_FIRST);
+  watchByChannel = (cameraBit == 0);
+}
+
+static void setTallySignals(tallyBoxConfig_t& c, const peerTally_t& t)
 {
-  tallyPreview = (greenChannel == c.user.cameraId);
-  tallyProgram = (redChannel == c.user.cameraId);
-  tallyInTransition = inTransition;
+  if(watchRevision != tallyBoxGetConfigurationRevision())
+  {
+    watchRevision = tallyBoxGetConfigurationRevision();
+    compileWatchMasks(c.user);
+  }
+
+  tallyPreviewChannel = t.greenChannel;
+  tallyProgramChannel = t.redChannel;
+  tallyPreviewMask = t.greenMask;
+  tallyProgramMask = t.redMask;
+  tallyProgram = ((t.redMask & programWatchMask) != 0);
+  tallyPreview = ((t.greenMask & previewWatchMask) != 0);
+  if(watchByChannel)
+  {
+    tallyProgram = tallyProgram || (t.redChannel == c.user.cameraId);
+    tallyPreview = tallyPreview || (t.greenChannel == c.user.cameraId);
+  }
+  if(previewYieldsToProgram && tallyProgram)
+  {
+    tallyPreview = false;
+  }
+  tallyInTransition = t.inTransition;
+  tallyTransitionPosition = (t.inTransition ? t.transitionPosition : 0);
 }
 
-#define INCOMING_FAULT_TOLERANCE_IN_10MS_TICKS                200
+#define TICK_LENGTH_US                                        10000
 
 
 static void stateRunningAtem(tallyBoxConfig_t& c, uint8_t *internalState)
 {
   static bool prevCommFrozen = false;
-  AtemSwitcher.runLoop();
+  peerTally_t t;
 
-  if(AtemSwitcher.isConnected())
+  if(tallyBoxSwitchersUpdate(c.network, t))
   {
     masterCommunicationFrozen = false;
     lastReceivedMasterMessageInTicks = cumulativeTickCounter;
   }
   else
   {
-    Serial.println("ATEM Disconnection!!");   
+    LOG_DEBUG("ATEM Disconnection!!");
   }
 
   if(cumulativeTickCounter - lastReceivedMasterMessageInTicks > INCOMING_FAULT_TOLERANCE_IN_10MS_TICKS)
   {
     masterCommunicationFrozen = true;
 
-    /*jump to reconnection*/
+    /*wait for any of the switchers to come back*/
     myState = CONNECTING_TO_ATEM_HOST;
-    internalState[CONNECTING_TO_ATEM_HOST] = 0;
+    internalState[CONNECTING_TO_ATEM_HOST] = 1;
   }
 
   if(!masterCommunicationFrozen)
   {
-    uint16_t greenChannel = AtemSwitcher.getPreviewInput();
-    uint16_t redChannel = AtemSwitcher.getProgramInput();
-    bool inTransition = AtemSwitcher.getTransitionInTransition(0);
-
-    setTallySignals(c, greenChannel, redChannel, inTransition);
-    peerNetworkSend(c, greenChannel, redChannel, inTransition);
+    setTallySignals(c, t);
+    peerNetworkSend(c, t);
   }
+  tallyBoxUmdUpdate(c.network, t, !masterCommunicationFrozen);
+
+  /*configuration and firmware distribution to the other boxes*/
+  peerNetworkPoll(c);
+  tallyBoxFleetUpdate(c);
+  tallyBoxFirmwareUpdate(c);
 
   /*report state changes*/
   if(masterCommunicationFrozen != prevCommFrozen)
   {
     if(masterCommunicationFrozen)
     {
-      Serial.println("No connection to ATEM, trying to reconnect...");
+      LOG_WARN("No connection to ATEM, trying to reconnect...");
     }
     else
     {
-      Serial.println("Connection with ATEM established!");
+      LOG_INFO("Connection with ATEM established!");
     }    
 
     prevCommFrozen = masterCommunicationFrozen;
@@ -275,12 +323,11 @@ static void stateRunningAtem(tallyBoxConfig_t& c, uint8_t *internalState)
 static void stateRunningPeerNetwork(tallyBoxConfig_t& c, uint8_t *internalState)
 {
   static bool prevCommFrozen = false;
-  uint16_t greenChannel, redChannel;
-  bool inTransition;
+  peerTally_t t;
 
-  if(peerNetworkReceive(c, greenChannel, redChannel, inTransition))
+  if(peerNetworkReceive(c, t))
   {
-    setTallySignals(c, greenChannel, redChannel, inTransition);
+    setTallySignals(c, t);
     lastReceivedMasterMessageInTicks = cumulativeTickCounter;
     masterCommunicationFrozen = false;
   }
@@ -290,16 +337,19 @@ static void stateRunningPeerNetwork(tallyBoxConfig_t& c, uint8_t *internalState)
     masterCommunicationFrozen = true;
   }
 
+  /*a received firmware image is taken into use when the camera is off air*/
+  tallyBoxFirmwareUpdate(c);
+
   /*report state changes*/
   if(masterCommunicationFrozen != prevCommFrozen)
   {
     if(masterCommunicationFrozen)
     {
-      Serial.println("No message received from master, waiting...");
+      LOG_WARN("No message received from master, waiting...");
     }
     else
     {
-      Serial.println("Message received from master!");      
+      LOG_INFO("Message received from master!");
     }    
 
     prevCommFrozen = masterCommunicationFrozen;
@@ -316,55 +366,63 @@ bool tallyDataIsValid()
   return ret;
 }
 
-#define CPU_TIME_DEBUG                  false
+/*without valid tally data every camera is taken as on air*/
+bool tallyBoxCameraIsOnAir(uint16_t cameraId)
+{
+  bool ret = true;
+  if(tallyDataIsValid())
+  {
+    ret = (peerTallyHasInput(tallyPreviewMask, tallyPreviewChannel, cameraId) || peerTallyHasInput(tallyProgramMask, tallyProgramChannel, cameraId));
+  }
+  return ret;
+}
 
-#if CPU_TIME_DEBUG
-#define DIAG_LED_LOOP_FULL              D0
-#define DIAG_LED_LOOP_OTA               D1
-#define DIAG_LED_LOOP_STATEMACHINE      D3
-#define DIAG_LED_LOOP_TALLY_OUTPUT      D4
-#define DIAG_LED_LOOP_WEB_SERVER        D5
+void tallyBoxGetLiveState(tallyBoxLiveState_t& s)
+{
+  s.state = myState;
+  s.dataIsValid = tallyDataIsValid();
+  s.preview = tallyPreview;
+  s.program = tallyProgram;
+  s.inTransition = tallyInTransition;
+}
 
-#define LED_ON                          HIGH
-#define LED_OFF                         LOW
+/*the watched inputs and the watch rule count, not only the camera id. Without valid tally data
+  the box cannot tell, so it is taken as on air.*/
+bool tallyBoxIsOnAir()
+{
+  tallyBoxLiveState_t s;
 
-#define DEBUG_PULSE_START(x)            digitalWrite((x), LED_ON);
-#define DEBUG_PULSE_STOP(x)             digitalWrite((x), LED_OFF);
+  tallyBoxGetLiveState(s);
+  return (!s.dataIsValid || s.preview || s.program);
+}
 
-#else
-#define DEBUG_PULSE_START(x)
-#define DEBUG_PULSE_STOP(x)
-#endif
+const char* tallyBoxGetStateName(tallyBoxState_t state)
+{
+  return (state < STATE_MAX ? stateNames[state] : "INVALID");
+}
 
 void tallyBoxStateMachineInitialize(tallyBoxConfig_t& c)
 {
   randomSeed(analogRead(5));  /*random needed by ATEM library*/
 
-#if CPU_TIME_DEBUG
-  pinMode(DIAG_LED_LOOP_FULL, OUTPUT);
-  pinMode(DIAG_LED_LOOP_STATEMACHINE, OUTPUT);
-  pinMode(DIAG_LED_LOOP_OTA, OUTPUT);
-  pinMode(DIAG_LED_LOOP_TALLY_OUTPUT, OUTPUT);
-  pinMode(DIAG_LED_LOOP_WEB_SERVER, OUTPUT);
-#endif
+  tallyBoxMetricsInitialize();
 
+  tallyBoxPersistenceInitialize(c);
+  tallyBoxFirmwareInitialize();
 }
 
 static void MDnsInitialize(tallyBoxConfig_t& c)
 {
-  Serial.print("IP address: ");
-  Serial.println(WiFi.localIP());
-
-  Serial.println("Starting mDNS with hostname '"+String(c.network.mdnsHostName)+"'");
+  LOG_INFO("Starting mDNS with hostname '%s'", c.network.mdnsHostName);
 
   if(!MDNS.begin(c.network.mdnsHostName)) 
   {
-    Serial.println("Error setting up MDNS responder!");
+    LOG_ERROR("Error setting up MDNS responder!");
   }
   else
   {
     MDNS.addService("http", "tcp", 80);
-    Serial.println("mDNS responder started");
+    LOG_INFO("mDNS responder started");
     mDnsInitialized = true;
   }
 }
@@ -379,22 +437,46 @@ static void MDnsUpdate()
 }
 
 
+/*estimated from the start of the latest tick, the ticks follow each other TICK_LENGTH_US apart*/
+static uint32_t idleMsBeforeNextTick(uint32_t tickStartUs)
+{
+  uint32_t elapsedUs = micros() - tickStartUs;
+
+  return ((elapsedUs < TICK_LENGTH_US) ? ((TICK_LENGTH_US - elapsedUs) / 1000) : 0);
+}
+
 void tallyBoxStateMachineUpdate(tallyBoxConfig_t& c, tallyBoxState_t switchToState)
 {
   static tallyBoxState_t prevState = STATE_MAX; /*force printing out the first state*/
   static uint8_t internalState[STATE_MAX] = {};
   static uint16_t prevTick = 0;
+  static uint32_t prevTickStartUs = 0;
   uint16_t currentTick = getCurrentTick();  /*0...319,0...319...*/
-  bool printStateName = false;
-
-  DEBUG_PULSE_START(DIAG_LED_LOOP_FULL);
+  uint32_t tickStartUs;
+  uint32_t freeHeap;
 
   /*only run state machine once per tick*/
   if(currentTick == prevTick)
   {
+    /*idle time between the ticks: background work that does not need to be in the tick*/
+    tallyBoxPersistenceUpdate(currentTick);
+    tallyBoxLogUpdate();
+    OTAIdle(idleMsBeforeNextTick(prevTickStartUs));
+    tallyBoxFirmwareIdle();
+    tallyBoxUmdIdle(idleMsBeforeNextTick(prevTickStartUs));
     return; 
   }
   prevTick = currentTick;
+  tickStartUs = micros();
+  PROF_START(PROF_TICK);
+
+  /*more than one tick since the previous one: the loop has been held up, by a long tick or
+    by the idle work. The only place overruns are counted.*/
+  if((prevTickStartUs != 0) && ((tickStartUs - prevTickStartUs) >= (2 * TICK_LENGTH_US)))
+  {
+    METRIC_ADD(METRIC_TICK_OVERRUNS, ((tickStartUs - prevTickStartUs) / TICK_LENGTH_US) - 1);
+  }
+  prevTickStartUs = tickStartUs;
 
   /*cumulative tick counter (10ms ticks) for timeout handling*/
   cumulativeTickCounter++;
@@ -406,73 +488,89 @@ void tallyBoxStateMachineUpdate(tallyBoxConfig_t& c, tallyBoxState_t switchToSta
     internalState[myState] = 0;
   }
 
-  /*check whether to print out the state name*/
-  printStateName = (myState != prevState);
+  /*report state changes*/
+  if(myState != prevState)
+  {
+    LOG_INFO("state %s", tallyBoxGetStateName(myState));
+  }
   prevState = myState;
 
   /*process functionality*/
-  DEBUG_PULSE_START(DIAG_LED_LOOP_STATEMACHINE);
+  PROF_START(PROF_STATE);
   switch(myState)
   {
     case CONNECTING_TO_WIFI:
-      if(printStateName) Serial.println("CONNECTING_TO_WIFI");
-
       stateConnectingToWifi(c, internalState);
       break;
 
     case CONNECTING_TO_ATEM_HOST:
-      if(printStateName) Serial.println("CONNECTING_TO_ATEM_HOST");
       stateConnectingToAtemHost(c, internalState);
       break;
 
     case CONNECTING_TO_PEERNETWORK_HOST:
-      if(printStateName) Serial.println("CONNECTING_TO_PEERNETWORK_HOST");
       stateConnectingToPeerNetworkHost(c, internalState);
       break;
 
     case RUNNING_ATEM:
-      if(printStateName) Serial.println("RUNNING_ATEM");
       stateRunningAtem(c, internalState);
       break;
 
     case RUNNING_PEERNETWORK:
-      if(printStateName) Serial.println("RUNNING_PEERNETWORK");
       stateRunningPeerNetwork(c, internalState);
       break;
 
     case ERROR:
-      Serial.println("*** ERROR ***");
+      LOG_ERROR("*** ERROR ***");
       break;
 
     default:
-      Serial.println("*** INVALID STATE ***");
+      LOG_ERROR("*** INVALID STATE ***");
       break;
   }
-  DEBUG_PULSE_STOP(DIAG_LED_LOOP_STATEMACHINE);
+  PROF_STOP(PROF_STATE);
 
   /*update main output: Red&Green tally lights*/
-  DEBUG_PULSE_START(DIAG_LED_LOOP_TALLY_OUTPUT);
-  outputUpdate(c, currentTick, tallyDataIsValid(), tallyPreview, tallyProgram, tallyInTransition);
-  DEBUG_PULSE_STOP(DIAG_LED_LOOP_TALLY_OUTPUT);
+  PROF_START(PROF_OUTPUT);
+  outputUpdate(c, currentTick, tallyDataIsValid(), tallyPreview, tallyProgram, tallyInTransition, tallyTransitionPosition);
+  PROF_STOP(PROF_OUTPUT);
 
   /*update diagnostic led to indicate running state*/
+  PROF_START(PROF_LED);
   updateLed(currentTick);
+  PROF_STOP(PROF_LED);
 
   /*run terminal here*/
+  PROF_START(PROF_TERMINAL);
   tallyBoxTerminalUpdate(c);
+  PROF_STOP(PROF_TERMINAL);
 
   /*run webserver here*/
-  DEBUG_PULSE_START(DIAG_LED_LOOP_WEB_SERVER);
+  PROF_START(PROF_WEB_SERVER);
   tallyBoxWebServerUpdate();
-  DEBUG_PULSE_STOP(DIAG_LED_LOOP_WEB_SERVER);
+  PROF_STOP(PROF_WEB_SERVER);
 
-  /*call over-the-air update mechanism from here to provide faster speed*/
-  DEBUG_PULSE_START(DIAG_LED_LOOP_OTA);
+  /*over-the-air update: invitation and restart, the image is written in the idle time*/
+  PROF_START(PROF_OTA);
   OTAUpdate();
-  DEBUG_PULSE_STOP(DIAG_LED_LOOP_OTA);
+  PROF_STOP(PROF_OTA);
 
   /*run mDns*/
+  PROF_START(PROF_MDNS);
   MDnsUpdate();
+  PROF_STOP(PROF_MDNS);
+
+  /*metrics of this tick*/
+  METRIC_INC(METRIC_TICKS);
+  METRIC_SET(METRIC_UPTIME_SECONDS, millis() / 1000);
+  METRIC_SET(METRIC_LOOP_TIME_US, micros() - tickStartUs);
+  METRIC_MAX_OF(METRIC_LOOP_TIME_MAX_US, tallyBoxMetrics[METRIC_LOOP_TIME_US]);
+  if(masterCommunicationFrozen)
+  {
+    METRIC_INC(METRIC_MASTER_FROZEN_TICKS);
+  }
+  freeHeap = ESP.getFreeHeap();
+  METRIC_SET(METRIC_HEAP_FREE, freeHeap);
+  METRIC_MIN_OF(METRIC_HEAP_MIN_FREE, freeHeap);
 
-  DEBUG_PULSE_STOP(DIAG_LED_LOOP_FULL);
+  PROF_STOP(PROF_TICK);
 }
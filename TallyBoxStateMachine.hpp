@@ -3,6 +3,10 @@
 #include <arduino.h>
 #include "TallyBoxConfiguration.hpp"
 
+/*ticks without a message from the ATEM or the master before the tally data is taken as
+  frozen (also used by the impairment simulation in tools/host)*/
+#define INCOMING_FAULT_TOLERANCE_IN_10MS_TICKS                200
+
 typedef enum
 {
   CONNECTING_TO_WIFI = 0,
@@ -15,8 +19,22 @@ typedef enum
   STATE_MAX
 } tallyBoxState_t;
 
+/*snapshot of what the box is showing, for the live status of the web interface*/
+typedef struct
+{
+  tallyBoxState_t state;
+  bool dataIsValid;
+  bool preview;
+  bool program;
+  bool inTransition;
+} tallyBoxLiveState_t;
+
 void tallyBoxStateMachineInitialize(tallyBoxConfig_t& c);
 void tallyBoxStateMachineUpdate(tallyBoxConfig_t& c, tallyBoxState_t switchToState = STATE_MAX);
 bool tallyDataIsValid();
+bool tallyBoxCameraIsOnAir(uint16_t cameraId);   /*in preview or program*/
+void tallyBoxGetLiveState(tallyBoxLiveState_t& s);
+bool tallyBoxIsOnAir();               /*the box's own light: preview or program, or no valid tally data*/
+const char* tallyBoxGetStateName(tallyBoxState_t state);
 
 #endif
@@ -0,0 +1,536 @@
+#include "TallyBoxSwitchers.hpp"
+#include "Arduino.h"
+#include <ATEMbase.h>
+#include <ATEMstd.h>
+#include <SkaarhojPgmspace.h>
+#include <WiFiUdp.h>
+#include "TallyBoxInfra.hpp"
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxLog.hpp"
+#include "TallyBoxTsl.hpp"
+
+static const logModule_t logModule = LOG_MODULE_SWITCHER;
+
+#define ATEM_HEADER_SIZE          12
+#define ATEM_COMMAND_HEADER_SIZE  8
+
+/*header flags of the ATEM protocol, upper 5 bits of the first byte*/
+#define ATEM_FLAG_ACK_REQUEST     0x01
+#define ATEM_FLAG_HELLO           0x02
+#define ATEM_FLAG_ACK             0x10
+
+typedef struct
+{
+  IPAddress address;              /*0.0.0.0 = not in use*/
+  uint16_t sessionId;
+  uint16_t program;
+  uint16_t preview;
+  uint16_t transitionPosition;
+  bool inTransition;
+  bool connected;
+  bool changed;                   /*not merged yet*/
+  uint32_t lastReceivedAt;        /*or the latest connection attempt*/
+  uint32_t connectedSince;
+} switcherSession_t;
+
+ATEMstd AtemSwitcher;             /*session 0*/
+static WiFiUDP leanUdp;           /*sessions 1... */
+static switcherSession_t sessions[SWITCHER_MAX_SESSIONS];
+static uint8_t scratch[16];       /*commands are read in pieces, the state dump does not fit in RAM*/
+static peerTally_t merged = {};
+static int8_t leader = -1;
+static uint16_t mergedRule = SWITCHER_MERGE_MAX;
+static uint16_t protocol = SWITCHER_PROTOCOL_ATEM;
+
+static WiFiUDP tslUdp;
+static WiFiServer tslServer(TSL_PORT);
+static WiFiClient tslClient;
+static uint8_t tslBuf[TSL_MAX_PACKET];    /*udp datagram or unstuffed tcp packet, one at a time*/
+static tslStream_t tslStream = {tslBuf, sizeof(tslBuf), 0, false, false};
+static tslTallyState_t tslState;
+static uint32_t tslReceivedAt = 0;
+static bool tslReceived = false;
+static bool tslListening = false;
+
+/*** INTERNAL FUNCTIONS **************************************/
+static bool sessionInUse(switcherSession_t& s);
+static void setConnected(uint8_t index, bool connected, uint32_t nowMs);
+static void updatePrimary(uint32_t nowMs);
+static void leanSend(switcherSession_t& s, uint8_t flags, uint16_t ackId, const uint8_t *payload, uint16_t payloadLen);
+static void leanHello(switcherSession_t& s, uint32_t nowMs);
+static void leanSkip(uint16_t len);
+static void leanParseCommands(switcherSession_t& s, uint16_t len);
+static void leanReceive(uint32_t nowMs);
+static void leanCheckTimeouts(uint32_t nowMs);
+static void mergeSessions(uint16_t rule, uint32_t nowMs);
+static void tslListen(tallyBoxNetworkConfig_t& c);
+static void tslApply(uint16_t len, uint32_t nowMs);
+static bool tslUpdate(uint32_t nowMs, peerTally_t& t);
+/*************************************************************/
+
+
+static bool sessionInUse(switcherSession_t& s)
+{
+  return ((uint32_t)s.address != 0);
+}
+
+static void setConnected(uint8_t index, bool connected, uint32_t nowMs)
+{
+  switcherSession_t& s = sessions[index];
+
+  if(connected != s.connected)
+  {
+    s.connected = connected;
+    s.changed = true;
+    if(connected)
+    {
+      s.connectedSince = nowMs;
+      LOG_INFO("Connected to switcher %u", index + 1);
+    }
+    else
+    {
+      METRIC_INC(METRIC_ATEM_RECONNECTS);
+      LOG_WARN("Switcher %u lost, connecting again", index + 1);
+    }
+  }
+}
+
+static void updatePrimary(uint32_t nowMs)
+{
+  switcherSession_t& s = sessions[0];
+
+  AtemSwitcher.runLoop();
+
+  if(AtemSwitcher.isConnected())
+  {
+    uint16_t preview = AtemSwitcher.getPreviewInput();
+    uint16_t program = AtemSwitcher.getProgramInput();
+    bool inTransition = AtemSwitcher.getTransitionInTransition(0);
+    uint16_t position = (inTransition ? AtemSwitcher.getTransitionPosition(0) : 0);
+
+    if((preview != s.preview) || (program != s.program) || (inTransition != s.inTransition) || (position != s.transitionPosition))
+    {
+      s.preview = preview;
+      s.program = program;
+      s.inTransition = inTransition;
+      s.transitionPosition = position;
+      s.changed = true;
+    }
+    s.lastReceivedAt = nowMs;
+    setConnected(0, true, nowMs);
+  }
+  else
+  {
+    setConnected(0, false, nowMs);
+    if((nowMs - s.lastReceivedAt) >= SWITCHER_TIMEOUT_MS)
+    {
+      AtemSwitcher.begin(s.address);
+      AtemSwitcher.connect();
+      s.lastReceivedAt = nowMs;
+    }
+  }
+}
+
+static void leanSend(switcherSession_t& s, uint8_t flags, uint16_t ackId, const uint8_t *payload, uint16_t payloadLen)
+{
+  uint8_t buf[ATEM_HEADER_SIZE + 8];
+  uint8_t *p = buf;
+  uint16_t len = ATEM_HEADER_SIZE + payloadLen;
+
+  putU16(&p, (uint16_t)((flags << 11) | len));
+  putU16(&p, s.sessionId);
+  putU16(&p, ackId);
+  putU16(&p, 0);
+  putU16(&p, 0);
+  putU16(&p, 0);    /*own packet id: only acknowledgements are sent, they are not numbered*/
+  putBytes(&p, payload, payloadLen);
+
+  leanUdp.beginPacket(s.address, SWITCHER_ATEM_PORT);
+  leanUdp.write(buf, len);
+  leanUdp.endPacket();
+}
+
+static void leanHello(switcherSession_t& s, uint32_t nowMs)
+{
+  static const uint8_t hello[8] = {0x01, 0, 0, 0, 0, 0, 0, 0};
+
+  s.sessionId = (uint16_t)(0x1000 + random(0x1000));
+  s.lastReceivedAt = nowMs;
+  leanSend(s, ATEM_FLAG_HELLO, 0, hello, sizeof(hello));
+}
+
+static void leanSkip(uint16_t len)
+{
+  while(len > 0)
+  {
+    uint16_t n = ((len > sizeof(scratch)) ? sizeof(scratch) : len);
+
+    if(leanUdp.read(scratch, n) <= 0)
+    {
+      break;
+    }
+    len -= n;
+  }
+}
+
+/*the commands that carry the tally of mix effect 1, the others are skipped*/
+static void leanParseCommands(switcherSession_t& s, uint16_t len)
+{
+  while(len >= ATEM_COMMAND_HEADER_SIZE)
+  {
+    uint8_t *p = scratch;
+    uint16_t cmdLen;
+    uint16_t dataLen;
+    uint16_t readLen;
+
+    if(leanUdp.read(scratch, ATEM_COMMAND_HEADER_SIZE) != ATEM_COMMAND_HEADER_SIZE)
+    {
+      break;
+    }
+    cmdLen = getU16(&p);
+    if((cmdLen < ATEM_COMMAND_HEADER_SIZE) || (cmdLen > len))
+    {
+      break;
+    }
+    len -= cmdLen;
+    dataLen = cmdLen - ATEM_COMMAND_HEADER_SIZE;
+
+    bool isProgram = (memcmp(scratch + 4, "PrgI", 4) == 0);
+    bool isPreview = (memcmp(scratch + 4, "PrvI", 4) == 0);
+    bool isTransition = (memcmp(scratch + 4, "TrPs", 4) == 0);
+
+    if(isProgram || isPreview || isTransition)
+    {
+      readLen = ((dataLen > 6) ? 6 : dataLen);
+      if(leanUdp.read(scratch, readLen) != readLen)
+      {
+        break;
+      }
+
+      if((isProgram || isPreview) && (readLen >= 4) && (scratch[0] == 0))
+      {
+        p = scratch + 2;
+        uint16_t source = getU16(&p);
+        uint16_t& target = (isProgram ? s.program : s.preview);
+
+        s.changed |= (source != target);
+        target = source;
+      }
+      else if(isTransition && (readLen >= 6) && (scratch[0] == 0))
+      {
+        bool inTransition = (scratch[1] & 0x01);
+        p = scratch + 4;
+        uint16_t position = (inTransition ? getU16(&p) : 0);
+
+        s.changed |= ((inTransition != s.inTransition) || (position != s.transitionPosition));
+        s.inTransition = inTransition;
+        s.transitionPosition = position;
+      }
+      leanSkip(dataLen - readLen);   /*after the parsing: the same scratch buffer*/
+    }
+    else
+    {
+      leanSkip(dataLen);
+    }
+  }
+}
+
+static void leanReceive(uint32_t nowMs)
+{
+  int size;
+
+  for(int i = 0; (i < SWITCHER_MAX_PACKETS_PER_UPDATE) && ((size = leanUdp.parsePacket()) > 0); i++)
+  {
+    IPAddress from = leanUdp.remoteIP();
+    uint8_t index = 1;
+    uint8_t *p = scratch;
+
+    while((index < SWITCHER_MAX_SESSIONS) && !(sessionInUse(sessions[index]) && (sessions[index].address == from)))
+    {
+      index++;
+    }
+    if((index == SWITCHER_MAX_SESSIONS) || (size < ATEM_HEADER_SIZE) || (leanUdp.read(scratch, ATEM_HEADER_SIZE) != ATEM_HEADER_SIZE))
+    {
+      continue;   /*the rest of the packet is dropped by the next parsePacket*/
+    }
+
+    switcherSession_t& s = sessions[index];
+    uint16_t word = getU16(&p);
+    uint8_t flags = (uint8_t)(word >> 11);
+    uint16_t packetLen = word & 0x07FF;
+    uint16_t sessionId = getU16(&p);
+    p = scratch + 10;
+    uint16_t remoteId = getU16(&p);
+
+    if((packetLen > size) || (packetLen < ATEM_HEADER_SIZE))
+    {
+      continue;
+    }
+    s.lastReceivedAt = nowMs;
+
+    if(flags & ATEM_FLAG_HELLO)
+    {
+      /*accepted: the switcher sends its state next, under the session id it assigns*/
+      leanSend(s, ATEM_FLAG_ACK, 0, NULL, 0);
+      continue;
+    }
+    setConnected(index, true, nowMs);
+    s.sessionId = sessionId;
+    if(flags & ATEM_FLAG_ACK_REQUEST)
+    {
+      leanSend(s, ATEM_FLAG_ACK, remoteId, NULL, 0);
+    }
+    leanParseCommands(s, packetLen - ATEM_HEADER_SIZE);
+  }
+}
+
+static void leanCheckTimeouts(uint32_t nowMs)
+{
+  for(uint8_t i = 1; i < SWITCHER_MAX_SESSIONS; i++)
+  {
+    switcherSession_t& s = sessions[i];
+
+    if(sessionInUse(s))
+    {
+      if(s.connected && ((nowMs - s.lastReceivedAt) >= SWITCHER_TIMEOUT_MS))
+      {
+        setConnected(i, false, nowMs);
+        leanHello(s, nowMs);
+      }
+      else if(!s.connected && ((nowMs - s.lastReceivedAt) >= SWITCHER_HELLO_RETRY_MS))
+      {
+        leanHello(s, nowMs);
+      }
+    }
+  }
+}
+
+static void mergeSessions(uint16_t rule, uint32_t nowMs)
+{
+  int8_t firstConnected = -1;
+  int8_t firstBackup = -1;
+  uint8_t connectedCount = 0;
+
+  merged.greenMask = 0;
+  merged.redMask = 0;
+  for(uint8_t i = 0; i < SWITCHER_MAX_SESSIONS; i++)
+  {
+    switcherSession_t& s = sessions[i];
+
+    if(s.connected)
+    {
+      connectedCount++;
+      firstConnected = ((firstConnected < 0) ? i : firstConnected);
+      firstBackup = (((firstBackup < 0) && (i > 0)) ? i : firstBackup);
+      if(rule == SWITCHER_MERGE_OR)
+      {
+        merged.greenMask |= peerTallyInputBit(s.preview);
+        merged.redMask |= peerTallyInputBit(s.program);
+      }
+    }
+    s.changed = false;
+  }
+
+  if(rule == SWITCHER_MERGE_PRIMARY_FALLBACK)
+  {
+    /*back to the primary once it has stayed connected for a while*/
+    if(sessions[0].connected && ((leader == 0) || (firstBackup < 0) || ((nowMs - sessions[0].connectedSince) >= SWITCHER_FALLBACK_RETURN_MS)))
+    {
+      leader = 0;
+    }
+    else if((leader <= 0) || !sessions[leader].connected)
+    {
+      leader = firstBackup;
+    }
+  }
+  else
+  {
+    leader = firstConnected;
+  }
+
+  if(leader >= 0)
+  {
+    switcherSession_t& s = sessions[leader];
+
+    merged.greenChannel = s.preview;
+    merged.redChannel = s.program;
+    /*a fade of one switcher would dim a camera that another one holds on air*/
+    merged.inTransition = (s.inTransition && ((rule != SWITCHER_MERGE_OR) || (connectedCount == 1)));
+    merged.transitionPosition = (merged.inTransition ? s.transitionPosition : 0);
+    if(rule != SWITCHER_MERGE_OR)
+    {
+      merged.greenMask = peerTallyInputBit(s.preview);
+      merged.redMask = peerTallyInputBit(s.program);
+    }
+  }
+  METRIC_SET(METRIC_SWITCHERS_CONNECTED, connectedCount);
+}
+
+static void tslListen(tallyBoxNetworkConfig_t& c)
+{
+  tslTallyReset(tslState, c.tslFirstCamera);
+  tslStream.inFrame = false;
+  tslStream.escape = false;
+  tslReceived = false;
+  if(!tslListening)
+  {
+    tslUdp.begin(TSL_PORT);
+    tslServer.begin();
+    tslListening = true;
+  }
+  LOG_INFO("Listening for TSL on port %u", TSL_PORT);
+}
+
+static void tslApply(uint16_t len, uint32_t nowMs)
+{
+  sessions[0].changed |= (tslApplyPacket(tslState, tslBuf, len) > 0);
+  tslReceivedAt = nowMs;
+  tslReceived = true;
+}
+
+/*a tcp client takes precedence, udp datagrams are then dropped*/
+static bool tslUpdate(uint32_t nowMs, peerTally_t& t)
+{
+  bool ret = false;
+
+  if(!tslClient.connected())
+  {
+    WiFiClient client = tslServer.accept();
+
+    if(client)
+    {
+      tslClient = client;
+      tslStream.inFrame = false;
+      tslStream.escape = false;
+      LOG_INFO("TSL client connected");
+    }
+  }
+
+  if(tslClient.connected())
+  {
+    /*bounded: at most one full packet per update*/
+    for(uint16_t n = 0; (n < TSL_MAX_PACKET) && (tslClient.available() > 0); )
+    {
+      int got = tslClient.read(scratch, sizeof(scratch));
+
+      if(got <= 0)
+      {
+        break;
+      }
+      for(int i = 0; i < got; i++)
+      {
+        if(tslStreamPut(tslStream, scratch[i]))
+        {
+          tslApply(tslStream.len, nowMs);
+        }
+      }
+      n += got;
+    }
+    for(int i = 0; (i < SWITCHER_MAX_PACKETS_PER_UPDATE) && (tslUdp.parsePacket() > 0); i++)
+    {
+      tslUdp.flush();     /*dropped while the tcp client is connected*/
+    }
+  }
+  else
+  {
+    for(int i = 0; (i < SWITCHER_MAX_PACKETS_PER_UPDATE) && (tslUdp.parsePacket() > 0); i++)
+    {
+      int size = tslUdp.read(tslBuf, sizeof(tslBuf));
+
+      if(size > 0)
+      {
+        tslApply((uint16_t)size, nowMs);
+      }
+    }
+  }
+  /*a connected client that has gone silent counts as lost as well*/
+  ret = (tslReceived && ((nowMs - tslReceivedAt) < SWITCHER_TSL_TIMEOUT_MS));
+
+  setConnected(0, ret, nowMs);
+  if(sessions[0].changed)
+  {
+    sessions[0].changed = false;
+    merged = tslState.tally;
+    METRIC_SET(METRIC_SWITCHERS_CONNECTED, (ret ? 1 : 0));
+  }
+  t = merged;
+  return ret;
+}
+
+void tallyBoxSwitchersBegin(tallyBoxNetworkConfig_t& c)
+{
+  uint32_t nowMs = millis();
+  bool leanInUse = false;
+
+  for(uint8_t i = 0; i < SWITCHER_MAX_SESSIONS; i++)
+  {
+    sessions[i] = {};
+  }
+  sessions[0].address = IPAddress(c.hostAddress);
+  sessions[1].address = IPAddress(c.switcherAddress2);
+  sessions[2].address = IPAddress(c.switcherAddress3);
+  merged = {};
+  leader = -1;
+  mergedRule = SWITCHER_MERGE_MAX;
+  protocol = c.switcherProtocol;
+
+  if(protocol == SWITCHER_PROTOCOL_TSL)
+  {
+    tslListen(c);
+    return;
+  }
+
+  AtemSwitcher.begin(IPAddress(c.hostAddress));
+  AtemSwitcher.serialOutput(0x80);
+  AtemSwitcher.connect();
+  sessions[0].lastReceivedAt = nowMs;
+
+  for(uint8_t i = 1; i < SWITCHER_MAX_SESSIONS; i++)
+  {
+    if(sessionInUse(sessions[i]))
+    {
+      if(!leanInUse)
+      {
+        leanUdp.begin(50100 + random(1000));
+        leanInUse = true;
+      }
+      leanHello(sessions[i], nowMs);
+    }
+  }
+  LOG_INFO("Connecting to ATEM");
+}
+
+bool tallyBoxSwitchersUpdate(tallyBoxNetworkConfig_t& c, peerTally_t& t)
+{
+  uint32_t nowMs = millis();
+  bool ret = false;
+  bool changed = (c.switcherMergeRule != mergedRule);
+
+  if(protocol == SWITCHER_PROTOCOL_TSL)
+  {
+    return tslUpdate(nowMs, t);   /*one source, nothing to merge*/
+  }
+
+  updatePrimary(nowMs);
+  if(sessionInUse(sessions[1]) || sessionInUse(sessions[2]))
+  {
+    leanReceive(nowMs);
+    leanCheckTimeouts(nowMs);
+  }
+
+  for(uint8_t i = 0; i < SWITCHER_MAX_SESSIONS; i++)
+  {
+    changed |= sessions[i].changed;
+    ret |= sessions[i].connected;
+  }
+  /*the return to the primary is due without a change of any session*/
+  changed |= ((c.switcherMergeRule == SWITCHER_MERGE_PRIMARY_FALLBACK) && (leader != 0) && sessions[0].connected);
+
+  if(changed)
+  {
+    mergedRule = c.switcherMergeRule;
+    mergeSessions(mergedRule, nowMs);
+  }
+  t = merged;
+  return ret;
+}
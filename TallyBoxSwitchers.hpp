@@ -0,0 +1,44 @@
+#ifndef __TALLYBOXSWITCHERS_HPP__
+#define __TALLYBOXSWITCHERS_HPP__
+#include "Arduino.h"
+#include "TallyBoxConfiguration.hpp"
+#include "TallyBoxPeerCodec.hpp"
+
+/*Switcher sessions of the master. The first switcher (hostAddress) uses the ATEM library, the
+  additional ones are lean tally-only sessions: program, preview and transition of the first
+  mix effect, sharing one socket and a small receive buffer. The tally of the sessions is merged
+  only when one of them changes.
+  With the TSL protocol the master instead listens for TSL UMD v5 from a switcher or tally
+  controller, over udp or one tcp connection, and takes the tally of all its displays.*/
+
+#define SWITCHER_MAX_SESSIONS                 3
+#define SWITCHER_ATEM_PORT                    9910
+#define SWITCHER_TIMEOUT_MS                   3000    /*nothing received: connect again*/
+#define SWITCHER_HELLO_RETRY_MS               1000
+#define SWITCHER_FALLBACK_RETURN_MS           10000   /*primary connected this long takes over again*/
+#define SWITCHER_MAX_PACKETS_PER_UPDATE       8
+#define SWITCHER_TSL_TIMEOUT_MS               10000   /*udp and tcp: TSL sources repeat their state*/
+
+typedef enum
+{
+  SWITCHER_PROTOCOL_ATEM = 0,
+  SWITCHER_PROTOCOL_TSL,
+  /**************/
+  SWITCHER_PROTOCOL_MAX
+} switcherProtocol_t;
+
+typedef enum
+{
+  SWITCHER_MERGE_OR = 0,              /*on air in any switcher, channels of the first connected one*/
+  SWITCHER_MERGE_PRIORITY,            /*the first connected switcher in configuration order*/
+  SWITCHER_MERGE_PRIMARY_FALLBACK,    /*the first switcher, a backup only while it is lost*/
+  /**************/
+  SWITCHER_MERGE_MAX
+} switcherMergeRule_t;
+
+void tallyBoxSwitchersBegin(tallyBoxNetworkConfig_t& c);
+
+/*the merged tally goes to t, returns true when at least one switcher is connected*/
+bool tallyBoxSwitchersUpdate(tallyBoxNetworkConfig_t& c, peerTally_t& t);
+
+#endif
@@ -0,0 +1,130 @@
+#include "TallyBoxTemplate.hpp"
+#include "Arduino.h"
+
+static void emitChar(templateReader_t& r, char ch)
+{
+  r.pending[r.pendingLen++] = ch;
+}
+
+static void emitText(templateReader_t& r, const char *text, size_t len)
+{
+  /*pending has room for a value or an unresolved placeholder and its delimiters*/
+  while((len-- > 0) && (r.pendingLen < sizeof(r.pending)))
+  {
+    r.pending[r.pendingLen++] = *text++;
+  }
+}
+
+static bool isPlaceholderChar(char ch)
+{
+  return isalnum((unsigned char)ch) || (ch == '_') || (ch == ':');
+}
+
+/*consumes one input character, the output of it goes to pending*/
+static void processChar(templateReader_t& r, char ch)
+{
+  if(!r.inPlaceholder)
+  {
+    if(ch == '%')
+    {
+      r.inPlaceholder = true;
+      r.placeholderLen = 0;
+    }
+    else
+    {
+      emitChar(r, ch);
+    }
+  }
+  else if(ch == '%')
+  {
+    char value[TEMPLATE_MAX_VALUE];
+
+    r.placeholder[r.placeholderLen] = 0;
+
+    if((r.placeholderLen > 0) && r.resolver(r.resolverCtx, r.placeholder, value, sizeof(value)))
+    {
+      emitText(r, value, strlen(value));
+      r.stats.placeholders++;
+      r.inPlaceholder = false;
+    }
+    else
+    {
+      /*not a placeholder, the closing '%' may start the next one*/
+      emitChar(r, '%');
+      emitText(r, r.placeholder, r.placeholderLen);
+      r.placeholderLen = 0;
+    }
+  }
+  else if(isPlaceholderChar(ch) && (r.placeholderLen < (sizeof(r.placeholder) - 1)))
+  {
+    r.placeholder[r.placeholderLen++] = ch;
+  }
+  else
+  {
+    /*plain text like "100% wide", copy it as it is*/
+    emitChar(r, '%');
+    emitText(r, r.placeholder, r.placeholderLen);
+    emitChar(r, ch);
+    r.inPlaceholder = false;
+  }
+}
+
+void templateBegin(templateReader_t& r, Stream& in, templateResolver_t resolver, void *resolverCtx)
+{
+  memset(&r, 0, sizeof(r));
+  r.in = &in;
+  r.resolver = resolver;
+  r.resolverCtx = resolverCtx;
+}
+
+size_t templateRead(templateReader_t& r, char *out, size_t maxLen)
+{
+  size_t len = 0;
+
+  while(len < maxLen)
+  {
+    if(r.pendingPos < r.pendingLen)
+    {
+      size_t n = min((size_t)(r.pendingLen - r.pendingPos), maxLen - len);
+
+      memcpy(out + len, r.pending + r.pendingPos, n);
+      r.pendingPos += n;
+      len += n;
+      continue;
+    }
+    r.pendingLen = r.pendingPos = 0;
+
+    if(r.chunkPos >= r.chunkLen)
+    {
+      if(r.endOfInput)
+      {
+        break;
+      }
+      /*at most one flash read per call*/
+      if(len > 0)
+      {
+        break;
+      }
+      r.chunkLen = r.in->readBytes(r.chunk, sizeof(r.chunk));
+      r.chunkPos = 0;
+      r.stats.bytesIn += r.chunkLen;
+
+      if(r.chunkLen == 0)
+      {
+        r.endOfInput = true;
+        if(r.inPlaceholder)
+        {
+          emitChar(r, '%');
+          emitText(r, r.placeholder, r.placeholderLen);
+          r.inPlaceholder = false;
+        }
+        continue;
+      }
+    }
+
+    processChar(r, r.chunk[r.chunkPos++]);
+  }
+
+  r.stats.bytesOut += len;
+  return len;
+}
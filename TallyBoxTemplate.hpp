@@ -0,0 +1,46 @@
+#ifndef __TALLYBOXTEMPLATE_HPP__
+#define __TALLYBOXTEMPLATE_HPP__
+#include "Arduino.h"
+
+/*streaming template renderer: the template is read in small chunks from a stream (e.g. a
+  LittleFS file) and %name% placeholders are replaced by the resolver. The caller pulls the
+  output piece by piece with templateRead(), so a page can be sent in bounded steps. Nothing
+  is allocated on the heap and the page size is not limited by any buffer.*/
+
+#define TEMPLATE_INPUT_CHUNK_SIZE   64
+#define TEMPLATE_MAX_PLACEHOLDER    32      /*including terminator*/
+#define TEMPLATE_MAX_VALUE          128     /*including terminator*/
+
+/*fills out with the value of placeholder, false = unknown placeholder, it is copied as it is*/
+typedef bool (*templateResolver_t)(void *ctx, const char *placeholder, char *out, size_t maxLen);
+
+typedef struct
+{
+  uint32_t bytesIn;
+  uint32_t bytesOut;
+  uint16_t placeholders;        /*resolved ones*/
+} templateStats_t;
+
+/*state of one rendering, kept by the caller between the reads*/
+typedef struct
+{
+  Stream *in;
+  templateResolver_t resolver;
+  void *resolverCtx;
+  char chunk[TEMPLATE_INPUT_CHUNK_SIZE];
+  uint8_t chunkLen;
+  uint8_t chunkPos;
+  char placeholder[TEMPLATE_MAX_PLACEHOLDER];
+  uint8_t placeholderLen;
+  bool inPlaceholder;           /*a '%' has been seen, the name may continue in the next chunk*/
+  bool endOfInput;
+  char pending[TEMPLATE_MAX_VALUE + TEMPLATE_MAX_PLACEHOLDER];   /*output not yet taken*/
+  uint8_t pendingLen;
+  uint8_t pendingPos;
+  templateStats_t stats;
+} templateReader_t;
+
+void templateBegin(templateReader_t& r, Stream& in, templateResolver_t resolver, void *resolverCtx);
+size_t templateRead(templateReader_t& r, char *out, size_t maxLen);    /*0 = end of the page*/
+
+#endif
@@ -2,156 +2,201 @@
 #include "Arduino.h"
 #include "TallyBoxInfra.hpp"
 #include <Arduino_CRC32.h>
+#include <stdarg.h>
 #include "TallyBoxOutput.hpp"
 #include "TallyBoxStateMachine.hpp"
+#include "TallyBoxConfigSchema.hpp"
+#include "TallyBoxPersistence.hpp"
+#include "TallyBoxTerminal.hpp"
+#include "TallyBoxLog.hpp"
+#include "TallyBoxProfiler.hpp"
 
-static WiFiServer server(7493);
-//WiFiClient client;
-static bool initialized = false;
+static const logModule_t logModule = LOG_MODULE_TERMINAL;
 
-void tallyBoxTerminalInitialize(tallyBoxConfig_t& c)
+/*several telnet sessions at a time, each with its own menu. Input is collected into a fixed
+  line buffer and output goes to a bounded buffer that is written as the socket has room, so
+  neither parsing nor a slow client touches the heap or holds the tick. Long listings (the
+  configuration and the log) are produced a line at a time when the buffer has room.*/
+
+typedef enum 
 {
-  server.begin();
-  initialized = true;
-}
+  MENU_MAIN,
+  MENU_RESTART,
+  MENU_BRIGHTNESS,
+  MENU_CONFIGURATION,
+  MENU_PROFILE,
+  /*************/
+  MENU_MAX
+} terminalMenuId_t;
 
-WiFiClient handleClientConnection()
+typedef enum
 {
-  static WiFiClient client;
+  LISTING_NONE,
+  LISTING_CONFIGURATION,
+  LISTING_LOG,
+  LISTING_PROFILE
+} terminalListing_t;
 
-  if(client)
-  {
-    if(client.connected())
-    {
-      /*we already have a connected client*/    
-      return client;
-    }
+typedef struct
+{
+  WiFiClient client;
+  bool open;                            /*the client turns false once it is gone, this stays until it is closed*/
+  terminalMenuId_t menu;
+  terminalMenuId_t prevMenu;            /*menu in which the previous line was entered*/
+  tallyBoxOutput_t brightnessChannel;
+  char line[TERMINAL_LINE_SIZE];
+  uint8_t lineLen;
+  bool lineTooLong;
+  char prevLine[TERMINAL_LINE_SIZE];    /*repeated by an empty line*/
+  char out[TERMINAL_OUT_SIZE];          /*ring, written to the client as it has room*/
+  uint16_t outStart;
+  uint16_t outLen;
+  terminalListing_t listing;
+  uint8_t listingSchema;
+  uint8_t listingField;
+  uint32_t logCursor;
+  uint32_t logEnd;
+  uint8_t profileNext;
+  bool promptPending;                   /*printed once the answer to the line is queued*/
+} terminalSession_t;
+
+typedef void (*terminalHandler_t)(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val);
 
-    /*disable, just in case*/
-    setBrightnessSettingMode(OUTPUT_NONE, false);
+typedef struct
+{
+  terminalMenuId_t menu;
+  const char *name;         /*a one character name matches the first character in either case, NULL = any other input*/
+  terminalHandler_t handler;
+  const char *help;         /*line of the menu*/
+} terminalCommand_t;
+
+static WiFiServer server(TERMINAL_PORT);
+static terminalSession_t sessions[TERMINAL_MAX_SESSIONS];
+static terminalStats_t myStats = {};
+static bool initialized = false;
+static bool restartPending = false;
+static uint32_t restartAtMs = 0;
 
-    /*drop zombie connection*/
-    client.stop();
-    Serial.println("client disconnected");
-  }
+static const char* const menuTitles[MENU_MAX] = {"Main menu:", "Restart", "Brightness", "Configuration", "Profile"};
+static const char* const channelNames[] = {"None", "Green", "Red", "Linked"};
+
+/*** output **************************************************/
+
+static uint16_t outputRoom(const terminalSession_t& s)
+{
+  return sizeof(s.out) - s.outLen;
+}
 
-  /*check if we have new client connecting*/
-  client = server.available();
-  if(client)
+static void sessionWrite(terminalSession_t& s, const char *data, size_t len)
+{
+  if(len > outputRoom(s))
   {
-    Serial.println("client connected");
+    /*the client does not keep up, rather lose text than wait for it*/
+    myStats.dropped += len;
+    return;
+  }
+  for(size_t i = 0; i < len; i++)
+  {
+    s.out[(s.outStart + s.outLen++) % sizeof(s.out)] = data[i];
   }
-  return client;
 }
 
-
-bool getUserInput(WiFiClient client, String& userInput)
+static void sessionPrintf(terminalSession_t& s, const char *fmt, ...)
 {
-  bool somethingReceived = false;
-  bool frameEndReceived = false;
+  char buf[TERMINAL_MAX_PRINT];
+  va_list args;
+  int n;
 
-  if(client.available())
+  va_start(args, fmt);
+  n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+
+  if(n > 0)
   {
-    somethingReceived = true;
-    while(client.available())
-    {
-      char c = client.read();
-      userInput += c;
-      if(c == '\n')
-        frameEndReceived = true;
-    }
+    sessionWrite(s, buf, min((size_t)n, sizeof(buf) - 1));
   }
-  return somethingReceived;
 }
 
-typedef enum
+static void flushOutput(terminalSession_t& s)
 {
-  USER_EVENT_NONE,
-  USER_EVENT_EMPTY,
-  USER_EVENT_COMMAND,
-  USER_EVENT_COMMAND_WITH_VALUE
-} terminalUserEvent_t;
-
-terminalUserEvent_t parseUserInput(WiFiClient client, String& cmd, String& val)
-{
-  terminalUserEvent_t event = USER_EVENT_NONE;
-  String ui = "";
-  bool uiReceived = getUserInput(client, ui);
-
-  if(!uiReceived)
+  while(s.outLen > 0)
   {
-    cmd = "";
-    val = "";
-    return USER_EVENT_NONE;
+    size_t room = s.client.availableForWrite();
+    size_t chunk = min((size_t)s.outLen, sizeof(s.out) - s.outStart);
+
+    if(room == 0)
+    {
+      break;
+    }
+    chunk = s.client.write((const uint8_t*)s.out + s.outStart, min(chunk, room));
+    if(chunk == 0)
+    {
+      break;
+    }
+    s.outStart = (s.outStart + chunk) % sizeof(s.out);
+    s.outLen -= chunk;
   }
+}
 
-  int delimiterFoundAt = ui.indexOf('=');
+/*continues a listing while there is room for its next line*/
+static void continueListing(terminalSession_t& s, tallyBoxConfig_t& c)
+{
+  const confSchema_t* const schemas[] = {&networkConfigSchema, &userConfigSchema};
+  const void* const bases[] = {&c.network, &c.user};
 
-  if(delimiterFoundAt >= 0)
+  while((s.listing == LISTING_CONFIGURATION) && (outputRoom(s) >= TERMINAL_MAX_PRINT))
   {
-    cmd = ui.substring(0, delimiterFoundAt);
-    val = ui.substring(delimiterFoundAt+1);
-    cmd.trim();
-    val.trim();
+    const confSchema_t& schema = *schemas[s.listingSchema];
+    char value[CONF_TEXT_MAX_LEN];
 
-    if(cmd.length() == 0)
+    if(s.listingField >= schema.count)
     {
-      event = USER_EVENT_EMPTY; /*cmd is empty after whitespaces are removed*/
+      s.listingField = 0;
+      if(++s.listingSchema >= (sizeof(schemas) / sizeof(schemas[0])))
+      {
+        s.listing = LISTING_NONE;
+      }
+      continue;
     }
-    else if(val.length() == 0)
+
+    const confField_t& f = schema.fields[s.listingField++];
+
+    if(f.flags & CONF_FIELD_FLAG_SECRET)
     {
-      event = USER_EVENT_COMMAND; /*cmd was fine, but value was empty*/
+      strlcpy(value, "<not shown>", sizeof(value));
     }
     else
     {
-      event = USER_EVENT_COMMAND_WITH_VALUE;
+      confFieldFormat(f, bases[s.listingSchema], value, sizeof(value));
     }
+    sessionPrintf(s, " - %-18s = %s\r\n", f.label, value);
   }
-  else
+
+  while((s.listing == LISTING_LOG) && (outputRoom(s) >= LOG_MAX_LINE))
   {
-    val = ""; /*no value found*/
-    cmd = ui;
-    cmd.trim();
-    if(cmd.length() == 0)
+    char buf[LOG_MAX_LINE];
+    size_t len = tallyBoxLogRead(s.logCursor, s.logEnd, buf, sizeof(buf));
+
+    if(len == 0)
     {
-      event = USER_EVENT_EMPTY; /*cmd is empty after whitespaces are removed*/
+      s.listing = LISTING_NONE;
     }
-    else
+    sessionWrite(s, buf, len);
+  }
+
+  while((s.listing == LISTING_PROFILE) && (outputRoom(s) >= PROF_MAX_LINE))
+  {
+    char buf[PROF_MAX_LINE];
+    size_t len = tallyBoxProfilerRead(s.profileNext, buf, sizeof(buf));
+
+    if(len == 0)
     {
-      event = USER_EVENT_COMMAND; /*cmd was fine, but value was empty*/
+      s.listing = LISTING_NONE;
     }
+    sessionWrite(s, buf, len);
   }
-
-  return event;
 }
 
-typedef enum 
-{
-  MENU_MAIN,
-  MENU_RESTART,
-  MENU_BRIGHTNESS,
-  /*************/
-  MENU_MAX
-} terminalMenuId_t;
-
-typedef struct
-{
-  String menuText;
-} terminalMenuItem_t;
-
-
-const terminalMenuItem_t terminalMenu[MENU_MAX] = 
-{
-  {"Main menu:\r\n  1 = Restart\r\n  2 = Brightness\r\n  -> "},
-  {"Restart\r\n  y/Y = yes\r\n  others = Return to main menu\r\n "},
-  {"Brightness\r\n  g/G = Preview\r\n  r/R = Program\r\n  l/L = Both channels linked\r\n  m/M = Return to main menu\r\n "}
-};
-
-
-const String channelNames[] = {"None", "Green", "Red", "Linked"};
-
-float myRation = 1.0;
-
 float calculateLinkedRatio(float green, float red)
 {
   if(green < 1)
@@ -218,27 +263,27 @@ void normalizeAdjustmentWithRatio(float ratio, float commonAdjValue, float& gAdj
   }
 }
 
-void adjustChannel(tallyBoxConfig_t& c, tallyBoxOutput_t ch, String& cmd)
+static void adjustChannel(tallyBoxConfig_t& c, tallyBoxOutput_t ch, const char *cmd)
 {
   float adjustment = 0.0;
-  char first = cmd.charAt(0);
+  char first = cmd[0];
   
   if(!brightnessValuesInitialized)
   {
     return;
   }
 
-  if(cmd == "+")
+  if(strcmp(cmd, "+") == 0)
   {
     adjustment = 1.0;
   }
-  else if(cmd == "-")
+  else if(strcmp(cmd, "-") == 0)
   {
     adjustment = -1.0;
   }
-  else if((first=='+' || first=='-') && (cmd.length() > 1))
+  else if((first=='+' || first=='-') && (cmd[1] != 0))
   {
-    adjustment = cmd.substring(1).toFloat();
+    adjustment = atof(cmd + 1);
 
     if(first == '-') adjustment *= -1.0;
   }
@@ -276,178 +321,450 @@ void adjustChannel(tallyBoxConfig_t& c, tallyBoxOutput_t ch, String& cmd)
 
   c.user.greenBrightnessPercent = myG;
   c.user.redBrightnessPercent = myR;
+  tallyBoxConfigurationChanged();
 }
 
+void dumpConfiguration(tallyBoxConfig_t& c, WiFiClient& client)
+{
+  client.print("\r\n");
+  confDump(networkConfigSchema, &c.network, client);
+  confDump(userConfigSchema, &c.user, client);
+}
 
-void userInterface(tallyBoxConfig_t& c, WiFiClient client)
+/*** commands ************************************************/
+
+static void startListing(terminalSession_t& s, terminalListing_t listing)
 {
-  static terminalMenuId_t myState = MENU_MAIN;
-  static tallyBoxOutput_t selectedBrightnessChannel = OUTPUT_NONE;
-  static String prevCommand;
-  static String prevVal;
-  static terminalUserEvent_t prevEvent;
-  static terminalMenuId_t prevState = MENU_MAIN;
+  s.listing = listing;
+  s.listingSchema = 0;
+  s.listingField = 0;
+  s.logCursor = tallyBoxLogOldest();
+  s.logEnd = tallyBoxGetLogStats().written;
+  s.profileNext = 0;
+  sessionPrintf(s, "\r\n");
+}
+
+static void cmdGoToMenu(terminalSession_t& s, terminalMenuId_t menu)
+{
+  s.menu = menu;
+}
 
-  if(!client || !(client.connected()))
+static void cmdMainMenu(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  cmdGoToMenu(s, MENU_MAIN);
+}
+
+static void cmdRestartMenu(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  cmdGoToMenu(s, MENU_RESTART);
+}
+
+static void cmdBrightnessMenu(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  sampleBrightnessValues(c);
+  s.brightnessChannel = OUTPUT_NONE;
+  cmdGoToMenu(s, MENU_BRIGHTNESS);
+}
+
+static void cmdConfigurationMenu(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  startListing(s, LISTING_CONFIGURATION);
+  cmdGoToMenu(s, MENU_CONFIGURATION);
+}
+
+static void cmdLog(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  startListing(s, LISTING_LOG);
+}
+
+static void cmdProfileMenu(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  startListing(s, LISTING_PROFILE);
+  cmdGoToMenu(s, MENU_PROFILE);
+}
+
+static void cmdShowProfile(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  startListing(s, LISTING_PROFILE);
+}
+
+static void cmdResetProfile(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  tallyBoxProfilerReset();
+  sessionPrintf(s, "\r\nHistograms cleared\r\n");
+}
+
+static void cmdRestart(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  /*the restart waits for the text to reach the client*/
+  sessionPrintf(s, "\r\nRESTARTING\r\n");
+  LOG_WARN("restart requested from the terminal");
+  restartPending = true;
+  restartAtMs = millis() + TERMINAL_RESTART_DELAY_MS;
+}
+
+static void cmdSelectGreen(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  s.brightnessChannel = OUTPUT_GREEN;
+}
+
+static void cmdSelectRed(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  s.brightnessChannel = OUTPUT_RED;
+}
+
+static void cmdSelectLinked(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  sampleBrightnessValues(c);
+  s.brightnessChannel = OUTPUT_LINKED;
+}
+
+static void cmdAdjust(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  adjustChannel(c, s.brightnessChannel, cmd);
+}
+
+static void cmdShowConfiguration(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  startListing(s, LISTING_CONFIGURATION);
+}
+
+static void cmdChangeConfiguration(terminalSession_t& s, tallyBoxConfig_t& c, const char *cmd, const char *val)
+{
+  const confField_t* f;
+  bool accepted = false;
+
+  if(val == NULL)
   {
+    sessionPrintf(s, "\r\nUnknown command '%s'\r\n", cmd);
     return;
   }
 
+  /*field names are unique over both configurations*/
+  if((f = confFindField(networkConfigSchema, cmd)) != NULL)
+  {
+    if((accepted = confFieldParse(*f, &c.network, val)))
+    {
+      tallyBoxScheduleConfigurationWrite(c.network);
+      sessionPrintf(s, "\r\n'%s' changed, restart to take it into use\r\n", f->name);
+    }
+  }
+  else if((f = confFindField(userConfigSchema, cmd)) != NULL)
+  {
+    if((accepted = confFieldParse(*f, &c.user, val)))
+    {
+      tallyBoxScheduleConfigurationWrite(c.user);
+      sessionPrintf(s, "\r\n'%s' changed\r\n", f->name);
+    }
+  }
+  else
+  {
+    sessionPrintf(s, "\r\nUnknown field '%s'\r\n", cmd);
+    return;
+  }
 
-  /*removeme begin: report master status*/
-  static bool prevMasterConnection = false;
-  bool masterConnection = tallyDataIsValid();
+  if(!accepted)
+  {
+    sessionPrintf(s, "\r\nInvalid value for '%s'\r\n", f->name);
+  }
+}
+
+/*all commands of all menus, listed in the menus in this order*/
+static const terminalCommand_t commands[] =
+{
+  {MENU_MAIN,           "1",  cmdRestartMenu,         "1 = Restart"},
+  {MENU_MAIN,           "2",  cmdBrightnessMenu,      "2 = Brightness"},
+  {MENU_MAIN,           "3",  cmdConfigurationMenu,   "3 = Configuration"},
+  {MENU_MAIN,           "4",  cmdLog,                 "4 = Log"},
+  {MENU_MAIN,           "5",  cmdProfileMenu,         "5 = Profile"},
+
+  {MENU_RESTART,        "y",  cmdRestart,             "y/Y = yes"},
+  {MENU_RESTART,        NULL, cmdMainMenu,            "others = Return to main menu"},
+
+  {MENU_BRIGHTNESS,     "g",  cmdSelectGreen,         "g/G = Preview"},
+  {MENU_BRIGHTNESS,     "r",  cmdSelectRed,           "r/R = Program"},
+  {MENU_BRIGHTNESS,     "l",  cmdSelectLinked,        "l/L = Both channels linked"},
+  {MENU_BRIGHTNESS,     "+",  cmdAdjust,              "+/+n = Increase"},
+  {MENU_BRIGHTNESS,     "-",  cmdAdjust,              "-/-n = Decrease"},
+  {MENU_BRIGHTNESS,     "m",  cmdMainMenu,            "m/M = Return to main menu"},
+
+  {MENU_CONFIGURATION,  "d",  cmdShowConfiguration,   "d/D = Show"},
+  {MENU_CONFIGURATION,  "m",  cmdMainMenu,            "m/M = Return to main menu"},
+  {MENU_CONFIGURATION,  NULL, cmdChangeConfiguration, "name=value = Change and store a field"},
+
+  {MENU_PROFILE,        "d",  cmdShowProfile,         "d/D = Show"},
+  {MENU_PROFILE,        "r",  cmdResetProfile,        "r/R = Reset"},
+  {MENU_PROFILE,        "m",  cmdMainMenu,            "m/M = Return to main menu"},
+};
 
-  if(masterConnection != prevMasterConnection)
+static bool commandMatches(const terminalCommand_t& e, const char *cmd)
+{
+  if(e.name[1] == 0)
   {
-    client.print("*** " + String(millis()));
-    if(masterConnection)
-      client.println(": Master CONNECTED");
-    else
-      client.println(": Master connection BROKEN");
+    return (tolower(cmd[0]) == tolower(e.name[0]));
+  }
+  return (strcasecmp(cmd, e.name) == 0);
+}
+
+static void printPrompt(terminalSession_t& s)
+{
+  uint8_t i;
 
-    prevMasterConnection = masterConnection;
+  sessionPrintf(s, "\r\n%s\r\n", menuTitles[s.menu]);
+  for(i = 0; i < (sizeof(commands) / sizeof(commands[0])); i++)
+  {
+    if(commands[i].menu == s.menu)
+    {
+      sessionPrintf(s, "  %s\r\n", commands[i].help);
+    }
   }
-  /*removeme end: report master status*/
 
+  /*state dependent appending of prompt*/
+  if(s.menu == MENU_BRIGHTNESS)
+  {
+    switch(s.brightnessChannel)
+    {
+      case OUTPUT_GREEN:
+      case OUTPUT_RED:
+      case OUTPUT_LINKED:
+        sessionPrintf(s, " [G=%u%%, R=%u%%] %s -> ", (uint16_t)myG, (uint16_t)myR, channelNames[s.brightnessChannel]);
+        break;
+      default:
+        sessionPrintf(s, " Select channel -> ");
+        break;
+    }
+  }
+  else
+  {
+    sessionPrintf(s, " -> ");
+  }
+}
 
-  /*removeme begin: report tick compensation status*/
-  static int32_t prevCompensationValue = false;
-  int32_t compensationValue = getTickCompensationValue();
+/*** input ***************************************************/
 
-  if(compensationValue != prevCompensationValue)
+static char* trim(char *text)
+{
+  char *end;
+
+  while(isspace(*text))
   {
-    client.print("*** " + String(millis()));
+    text++;
+  }
+  end = text + strlen(text);
+  while((end > text) && isspace(end[-1]))
+  {
+    *--end = 0;
+  }
+  return text;
+}
 
-    client.println(": TickCompensation="+String(compensationValue));
+/*splits "cmd" or "cmd=value" in place and runs the matching command of the menu*/
+static void executeLine(terminalSession_t& s, tallyBoxConfig_t& c, char *line)
+{
+  const terminalCommand_t *fallback = NULL;
+  const terminalCommand_t *match = NULL;
+  char *cmd = line;
+  char *val = strchr(line, '=');
 
-    prevCompensationValue = compensationValue;
+  if(val)
+  {
+    *val++ = 0;
+    val = trim(val);
+    if(*val == 0)
+    {
+      val = NULL;     /*cmd was fine, but value was empty*/
+    }
+  }
+  cmd = trim(cmd);
+  if(*cmd == 0)
+  {
+    return;
+  }
+
+  for(uint8_t i = 0; (i < (sizeof(commands) / sizeof(commands[0]))) && (match == NULL); i++)
+  {
+    const terminalCommand_t& e = commands[i];
+
+    if(e.menu != s.menu)
+    {
+      continue;
+    }
+    if(e.name == NULL)
+    {
+      fallback = &e;
+    }
+    else if((val == NULL) && commandMatches(e, cmd))
+    {
+      match = &e;
+    }
+  }
+
+  match = (match ? match : fallback);
+  if(match)
+  {
+    match->handler(s, c, cmd, val);
   }
-  /*removeme end: report tick compensation status*/
+  myStats.commands++;
+}
 
-  String cmd;
-  String val;
-  terminalUserEvent_t ev = parseUserInput(client, cmd, val);
+static void handleLine(terminalSession_t& s, tallyBoxConfig_t& c)
+{
+  char work[TERMINAL_LINE_SIZE];
+  terminalMenuId_t menuBefore = s.menu;
 
-  if(ev!=USER_EVENT_NONE)
+  s.line[s.lineLen] = 0;
+
+  if(s.lineTooLong)
+  {
+    sessionPrintf(s, "\r\nLine too long, at most %u characters\r\n", TERMINAL_LINE_SIZE - 1);
+  }
+  else
   {
     /*repeat previous command if just enter was pressed. This eases up setting the levels etc.*/
-    if((ev==USER_EVENT_EMPTY) && (myState == prevState) && (prevCommand != ""))
+    if((trim(s.line)[0] == 0) && (s.menu == s.prevMenu) && (s.prevLine[0] != 0))
     {
-      cmd = prevCommand;
-      val = prevVal;
-      ev = prevEvent;
+      strlcpy(s.line, s.prevLine, sizeof(s.line));
     }
+    strlcpy(s.prevLine, s.line, sizeof(s.prevLine));
+    s.prevMenu = menuBefore;
+
+    /*parsed in a copy, the line is kept for repeating*/
+    strlcpy(work, s.line, sizeof(work));
+    executeLine(s, c, work);
+  }
 
-    /*store state before proceeding to state machine*/
-    prevState = myState;
+  s.lineLen = 0;
+  s.lineTooLong = false;
+  s.promptPending = true;
 
-    char cmdFirst = cmd.charAt(0);
-    switch(myState)
+  /*keep visualization active in this state*/
+  setBrightnessSettingMode(s.brightnessChannel, s.menu == MENU_BRIGHTNESS);
+}
+
+static void readInput(terminalSession_t& s, tallyBoxConfig_t& c)
+{
+  for(uint16_t i = 0; (i < TERMINAL_READ_PER_UPDATE) && s.client.available(); i++)
+  {
+    char ch = s.client.read();
+
+    /*one line at a time, the rest waits until the output of this one has room*/
+    if(ch == '\n')
     {
-      case MENU_MAIN:
-        switch(ev)
-        {
-          case USER_EVENT_COMMAND:
-            if(cmd=="1")
-            {
-              myState = MENU_RESTART;
-            }
-            else if(cmd=="2")
-            {
-              sampleBrightnessValues(c);
-              selectedBrightnessChannel = OUTPUT_NONE;
-              myState = MENU_BRIGHTNESS;
-            }
-            break;
-          default:
-            break;
-        }
-        break;
-      case MENU_RESTART:
-        switch(ev)
-        {
-          case USER_EVENT_COMMAND:
-            if(cmdFirst=='y' || cmdFirst=='Y')
-            {
-              client.println("\r\nRESTARTING\r\n");
-              delay(1000);
-              ESP.restart();
-            }
-            else
-            {
-              myState = MENU_MAIN;
-            }
-            break;
-          default:
-            break;
-        }
-        break;
-      case MENU_BRIGHTNESS:
-        switch(ev)
-        {
-          case USER_EVENT_COMMAND:
-            if(cmdFirst=='g' || cmdFirst=='G')
-            {
-              selectedBrightnessChannel = OUTPUT_GREEN;
-            }
-            else if(cmdFirst=='r' || cmdFirst=='R')
-            {
-              selectedBrightnessChannel = OUTPUT_RED;
-            }
-            else if(cmdFirst=='l' || cmdFirst=='L')
-            {
-              sampleBrightnessValues(c);
-              selectedBrightnessChannel = OUTPUT_LINKED;
-            }
-            else if(cmdFirst=='m' || cmdFirst=='M')
-            {
-              myState = MENU_MAIN;
-            }
-            else if(cmdFirst=='+' || cmdFirst=='-')
-            {
-              adjustChannel(c, selectedBrightnessChannel, cmd);
-            }
-            break;
-          default:
-            break;
-        }
-        break;
-      default:
-        myState = MENU_MAIN;
-        break;
+      handleLine(s, c);
+      break;
+    }
+    if(ch == '\r')
+    {
+      continue;
+    }
+    if(s.lineLen < (sizeof(s.line) - 1))
+    {
+      s.line[s.lineLen++] = ch;
     }
-    /*store previous command so that we can repeat it by just "enter"*/
-    prevCommand = cmd;
-    prevVal = val;
-    prevEvent = ev;
+    else
+    {
+      s.lineTooLong = true;
+    }
+  }
+}
 
-    /*print prompt*/
-    client.print("\r\n"+terminalMenu[myState].menuText);
+/*** sessions ************************************************/
 
-    /*keep visualization active in this state*/
-    setBrightnessSettingMode(selectedBrightnessChannel, myState == MENU_BRIGHTNESS);
+static void closeSession(terminalSession_t& s)
+{
+  if(s.menu == MENU_BRIGHTNESS)
+  {
+    /*disable, just in case*/
+    setBrightnessSettingMode(OUTPUT_NONE, false);
+  }
+  s.client.stop();
+  s.client = WiFiClient();
+  s.open = false;
+  myStats.sessions--;
+  LOG_INFO("client disconnected");
+}
 
-    /*state dependent appending of prompt*/
-    switch(myState)
+static void openSession(terminalSession_t& s, WiFiClient& client)
+{
+  s.client = client;
+  s.client.setNoDelay(true);
+  s.open = true;
+  s.menu = MENU_MAIN;
+  s.prevMenu = MENU_MAIN;
+  s.brightnessChannel = OUTPUT_NONE;
+  s.lineLen = 0;
+  s.lineTooLong = false;
+  s.prevLine[0] = 0;
+  s.outStart = 0;
+  s.outLen = 0;
+  s.listing = LISTING_NONE;
+  s.promptPending = true;
+  myStats.sessions++;
+  LOG_INFO("client connected");
+}
+
+static void acceptClients()
+{
+  WiFiClient client = server.accept();
+  uint8_t i;
+
+  if(!client)
+  {
+    return;
+  }
+  for(i = 0; (i < TERMINAL_MAX_SESSIONS) && sessions[i].open; i++)
+  {
+  }
+  if(i < TERMINAL_MAX_SESSIONS)
+  {
+    openSession(sessions[i], client);
+  }
+  else
+  {
+    client.print("All terminal sessions are in use\r\n");
+    client.stop();
+    myStats.rejected++;
+  }
+}
+
+/*status changes reported to every session*/
+static void reportStatus()
+{
+  /*removeme begin: report master status*/
+  static bool prevMasterConnection = false;
+  bool masterConnection = tallyDataIsValid();
+  /*removeme begin: report tick compensation status*/
+  static int32_t prevCompensationValue = false;
+  int32_t compensationValue = getTickCompensationValue();
+
+  for(uint8_t i = 0; i < TERMINAL_MAX_SESSIONS; i++)
+  {
+    terminalSession_t& s = sessions[i];
+
+    if(!s.open)
     {
-      case MENU_BRIGHTNESS:
-        switch(selectedBrightnessChannel)
-        {
-          case OUTPUT_GREEN:
-          case OUTPUT_RED:
-          case OUTPUT_LINKED:
-            client.print("[G="+String((uint16_t)myG)+"%, R="+String((uint16_t)myR)+"%] "+channelNames[selectedBrightnessChannel]+" -> ");
-            break;
-          default:
-            client.print("Select channel -> ");
-            break;
-        }
-        break;
+      continue;
+    }
+    if(masterConnection != prevMasterConnection)
+    {
+      sessionPrintf(s, "*** %u: %s\r\n", (unsigned)millis(), (masterConnection ? "Master CONNECTED" : "Master connection BROKEN"));
+    }
+    if(compensationValue != prevCompensationValue)
+    {
+      sessionPrintf(s, "*** %u: TickCompensation=%d\r\n", (unsigned)millis(), (int)compensationValue);
     }
   }
+  prevMasterConnection = masterConnection;
+  prevCompensationValue = compensationValue;
+  /*removeme end*/
 }
 
+void tallyBoxTerminalInitialize(tallyBoxConfig_t& c)
+{
+  server.begin();
+  server.setNoDelay(true);
+  initialized = true;
+}
 
 void tallyBoxTerminalUpdate(tallyBoxConfig_t& c)
 {
@@ -456,7 +773,44 @@ void tallyBoxTerminalUpdate(tallyBoxConfig_t& c)
     return;
   }
 
-  auto client = handleClientConnection();
-  userInterface(c, client);
+  acceptClients();
+  reportStatus();
 
+  for(uint8_t i = 0; i < TERMINAL_MAX_SESSIONS; i++)
+  {
+    terminalSession_t& s = sessions[i];
+
+    if(!s.open)
+    {
+      continue;
+    }
+    if(!s.client.connected() && (s.client.available() == 0))
+    {
+      closeSession(s);
+      continue;
+    }
+
+    /*a new line only when the answer to the previous one has been queued*/
+    continueListing(s, c);
+    if((s.listing == LISTING_NONE) && s.promptPending && (outputRoom(s) >= TERMINAL_PROMPT_ROOM))
+    {
+      printPrompt(s);
+      s.promptPending = false;
+    }
+    if(!s.promptPending)
+    {
+      readInput(s, c);
+    }
+    flushOutput(s);
+  }
+
+  if(restartPending && ((int32_t)(millis() - restartAtMs) >= 0))
+  {
+    ESP.restart();
+  }
+}
+
+const terminalStats_t& tallyBoxGetTerminalStats()
+{
+  return myStats;
 }
@@ -1,7 +1,26 @@
 #ifndef __TALLYBOXTERMINAL_HPP__
 #define __TALLYBOXTERMINAL_HPP__
+#include "TallyBoxConfiguration.hpp"
+
+#define TERMINAL_PORT                 7493
+#define TERMINAL_MAX_SESSIONS         3
+#define TERMINAL_LINE_SIZE            64      /*longer lines are rejected*/
+#define TERMINAL_OUT_SIZE             512     /*per session, text that does not fit is dropped*/
+#define TERMINAL_MAX_PRINT            128     /*one formatted piece of output*/
+#define TERMINAL_PROMPT_ROOM          256     /*free output needed before a menu is printed*/
+#define TERMINAL_READ_PER_UPDATE      64
+#define TERMINAL_RESTART_DELAY_MS     1000
+
+typedef struct
+{
+  uint8_t sessions;           /*open right now*/
+  uint32_t rejected;          /*all sessions were in use*/
+  uint32_t commands;
+  uint32_t dropped;           /*bytes of output lost to slow clients*/
+} terminalStats_t;
 
 void tallyBoxTerminalInitialize(tallyBoxConfig_t& c);
 void tallyBoxTerminalUpdate(tallyBoxConfig_t& c);
+const terminalStats_t& tallyBoxGetTerminalStats();
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,269 @@
+#include "TallyBoxTsl.hpp"
+#include "Arduino.h"
+
+#define TSL_PROGRAM     0x01    /*the lamp values are the flags: red = program, green = preview*/
+#define TSL_PREVIEW     0x02
+
+
+static uint16_t getLe16(const uint8_t *p)
+{
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static void putLe16(uint8_t *p, uint16_t value)
+{
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+
+bool tslBegin(tslReader_t& r, const uint8_t *buf, uint16_t len)
+{
+  bool ret = false;
+
+  if(len >= TSL_HEADER_SIZE)
+  {
+    uint16_t pbc = getLe16(buf);
+
+    /*the byte count does not include itself, a longer datagram is cut to it*/
+    if((pbc + 2 <= len) && (pbc + 2 >= TSL_HEADER_SIZE))
+    {
+      r.flags = buf[3];
+      r.screen = getLe16(buf + 4);
+      r.p = buf + TSL_HEADER_SIZE;
+      r.end = buf + pbc + 2;
+      ret = true;
+    }
+  }
+  return ret;
+}
+
+bool tslNextDisplay(tslReader_t& r, tslDisplay_t& d)
+{
+  bool ret = false;
+
+  if(!(r.flags & TSL_FLAG_SCREEN_CONTROL) && ((r.end - r.p) >= TSL_DISPLAY_HEADER_SIZE))
+  {
+    uint16_t textLen = getLe16(r.p + 4);
+
+    if((r.end - r.p - TSL_DISPLAY_HEADER_SIZE) >= textLen)
+    {
+      d.index = getLe16(r.p);
+      d.control = getLe16(r.p + 2);
+      d.text = r.p + TSL_DISPLAY_HEADER_SIZE;
+      d.textLen = textLen;
+      r.p += TSL_DISPLAY_HEADER_SIZE + textLen;
+      ret = true;
+    }
+  }
+  return ret;
+}
+
+void tslTallyReset(tslTallyState_t& s, uint16_t firstCamera)
+{
+  memset(s.lamps, 0, sizeof(s.lamps));
+  s.firstCamera = firstCamera;
+  s.tally = {};
+}
+
+/*a camera leaving the channel hands it to the lowest camera still in the mask*/
+static void setSignal(uint64_t& mask, uint16_t& channel, uint16_t camera, bool on)
+{
+  uint64_t bit = peerTallyInputBit(camera);
+
+  if(on)
+  {
+    mask |= bit;
+    channel = camera;
+  }
+  else
+  {
+    mask &= ~bit;
+    if(channel == camera)
+    {
+      channel = ((mask != 0) ? (uint16_t)(__builtin_ctzll(mask) + 1) : 0);
+    }
+  }
+}
+
+static uint16_t setDisplay(tslTallyState_t& s, uint16_t index, uint8_t state)
+{
+  uint8_t shift = (index & 3) * 2;
+  uint8_t& lamps = s.lamps[index >> 2];
+  uint8_t prev = (lamps >> shift) & 0x03;
+  uint16_t ret = 0;
+
+  if(state != prev)
+  {
+    uint16_t camera = index + s.firstCamera;
+
+    lamps = (uint8_t)((lamps & ~(0x03 << shift)) | (state << shift));
+    if((state ^ prev) & TSL_PROGRAM)
+    {
+      setSignal(s.tally.redMask, s.tally.redChannel, camera, (state & TSL_PROGRAM));
+    }
+    if((state ^ prev) & TSL_PREVIEW)
+    {
+      setSignal(s.tally.greenMask, s.tally.greenChannel, camera, (state & TSL_PREVIEW));
+    }
+    ret = 1;
+  }
+  return ret;
+}
+
+uint16_t tslApplyPacket(tslTallyState_t& s, const uint8_t *buf, uint16_t len)
+{
+  uint16_t ret = 0;
+  tslReader_t r;
+  tslDisplay_t d;
+
+  if(tslBegin(r, buf, len))
+  {
+    while(tslNextDisplay(r, d))
+    {
+      /*any lamp counts, amber is both*/
+      uint8_t state = (uint8_t)((d.control | (d.control >> 2) | (d.control >> 4)) & 0x03);
+
+      if(d.index == TSL_BROADCAST_INDEX)
+      {
+        for(uint16_t i = 0; i < TSL_MAX_DISPLAYS; i++)
+        {
+          ret += setDisplay(s, i, state);
+        }
+      }
+      else if(d.index < TSL_MAX_DISPLAYS)
+      {
+        ret += setDisplay(s, d.index, state);
+      }
+    }
+  }
+  return ret;
+}
+
+static void streamAppend(tslStream_t& s, uint8_t byte)
+{
+  if(s.len < s.maxLen)
+  {
+    s.buf[s.len++] = byte;
+  }
+  else
+  {
+    s.inFrame = false;    /*too long: dropped up to the next start*/
+  }
+}
+
+bool tslStreamPut(tslStream_t& s, uint8_t byte)
+{
+  bool ret = false;
+
+  if(s.escape)
+  {
+    s.escape = false;
+    if(byte == TSL_STX)
+    {
+      s.inFrame = true;
+      s.len = 0;
+    }
+    else if((byte == TSL_DLE) && s.inFrame)
+    {
+      streamAppend(s, byte);
+    }
+    else
+    {
+      s.inFrame = false;
+    }
+  }
+  else if(byte == TSL_DLE)
+  {
+    s.escape = true;
+  }
+  else if(s.inFrame)
+  {
+    streamAppend(s, byte);
+  }
+
+  /*complete when the byte count is reached*/
+  if(s.inFrame && !s.escape && (s.len >= 2) && (s.len == getLe16(s.buf) + 2))
+  {
+    s.inFrame = false;
+    ret = true;
+  }
+  return ret;
+}
+
+void tslWriterBegin(tslWriter_t& w, uint8_t *buf, uint16_t maxLen, uint16_t screen)
+{
+  w.buf = buf;
+  w.maxLen = maxLen;
+  w.len = 0;
+  if(maxLen >= TSL_HEADER_SIZE)
+  {
+    buf[2] = 0x80;    /*version 5.0*/
+    buf[3] = 0;
+    putLe16(buf + 4, screen);
+    w.len = TSL_HEADER_SIZE;
+  }
+}
+
+bool tslWriterAdd(tslWriter_t& w, uint16_t index, uint16_t control, const uint8_t *text, uint16_t textLen)
+{
+  bool ret = false;
+
+  if((w.len >= TSL_HEADER_SIZE) && ((uint32_t)w.len + TSL_DISPLAY_HEADER_SIZE + textLen <= w.maxLen))
+  {
+    uint8_t *p = w.buf + w.len;
+
+    putLe16(p, index);
+    putLe16(p + 2, control);
+    putLe16(p + 4, textLen);
+    if(textLen > 0)
+    {
+      memcpy(p + TSL_DISPLAY_HEADER_SIZE, text, textLen);
+    }
+    w.len += TSL_DISPLAY_HEADER_SIZE + textLen;
+    ret = true;
+  }
+  return ret;
+}
+
+uint16_t tslWriterEnd(tslWriter_t& w)
+{
+  if(w.len >= TSL_HEADER_SIZE)
+  {
+    putLe16(w.buf, w.len - 2);
+  }
+  return w.len;
+}
+
+uint16_t tslControl(bool program, bool preview)
+{
+  uint16_t lamp = (program ? TSL_LAMP_RED : 0) | (preview ? TSL_LAMP_GREEN : 0);
+
+  return (uint16_t)(lamp | (lamp << 2) | (lamp << 4) | (0x03 << 6));
+}
+
+uint16_t tslStuff(const uint8_t *packet, uint16_t len, uint8_t *out, uint16_t maxLen)
+{
+  uint16_t ret = 0;
+
+  if(maxLen >= 2)
+  {
+    out[ret++] = TSL_DLE;
+    out[ret++] = TSL_STX;
+    for(uint16_t i = 0; (i < len) && (ret > 0); i++)
+    {
+      if(ret + ((packet[i] == TSL_DLE) ? 2 : 1) > maxLen)
+      {
+        ret = 0;
+      }
+      else
+      {
+        if(packet[i] == TSL_DLE)
+        {
+          out[ret++] = TSL_DLE;
+        }
+        out[ret++] = packet[i];
+      }
+    }
+  }
+  return ret;
+}
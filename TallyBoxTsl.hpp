@@ -0,0 +1,95 @@
+#ifndef __TALLYBOXTSL_HPP__
+#define __TALLYBOXTSL_HPP__
+#include "Arduino.h"
+#include "TallyBoxPeerCodec.hpp"
+
+/*TSL UMD protocol version 5.0. A packet holds the messages of any number of displays:
+  pbc(2) version(1) flags(1) screen(2), then per display index(2) control(2) length(2) text.
+  Little endian. Over TCP the packets are framed with DLE/STX, a DLE in the packet is doubled.
+  No network dependency, the host tools use the same code.*/
+
+#define TSL_PORT                        8900
+#define TSL_MAX_PACKET                  1472    /*one udp datagram on ethernet*/
+#define TSL_MAX_DISPLAYS                512     /*displays 0...511 are followed*/
+#define TSL_HEADER_SIZE                 6
+#define TSL_DISPLAY_HEADER_SIZE         6
+#define TSL_BROADCAST_INDEX             0xFFFF
+
+#define TSL_FLAG_UNICODE                0x01    /*text in UTF-16LE*/
+#define TSL_FLAG_SCREEN_CONTROL         0x02    /*screen control message instead of displays*/
+#define TSL_CONTROL_DATA                0x8000  /*control data instead of text*/
+
+#define TSL_DLE                         0xFE
+#define TSL_STX                         0x02
+
+/*lamp values of the control word: right hand (bits 0-1), text (2-3), left hand (4-5)*/
+#define TSL_LAMP_OFF                    0
+#define TSL_LAMP_RED                    1
+#define TSL_LAMP_GREEN                  2
+#define TSL_LAMP_AMBER                  3
+
+typedef struct
+{
+  uint16_t index;
+  uint16_t control;
+  const uint8_t *text;          /*points into the packet, not terminated*/
+  uint16_t textLen;
+} tslDisplay_t;
+
+typedef struct
+{
+  const uint8_t *p;
+  const uint8_t *end;
+  uint16_t screen;
+  uint8_t flags;
+} tslReader_t;
+
+/*checks the header, the displays are then read one at a time without copying*/
+bool tslBegin(tslReader_t& r, const uint8_t *buf, uint16_t len);
+bool tslNextDisplay(tslReader_t& r, tslDisplay_t& d);
+
+/*tally of the displays, two bits per display: program (a red or amber lamp) and preview (a green
+  or amber lamp). Display index + firstCamera is the camera id.*/
+typedef struct
+{
+  uint8_t lamps[TSL_MAX_DISPLAYS / 4];
+  uint16_t firstCamera;
+  peerTally_t tally;            /*the latest camera taken is the channel, no transitions*/
+} tslTallyState_t;
+
+void tslTallyReset(tslTallyState_t& s, uint16_t firstCamera);
+/*returns the number of displays whose tally changed, the others are not touched*/
+uint16_t tslApplyPacket(tslTallyState_t& s, const uint8_t *buf, uint16_t len);
+
+/*TCP: the DLE stuffing is removed as the bytes arrive*/
+typedef struct
+{
+  uint8_t *buf;
+  uint16_t maxLen;
+  uint16_t len;
+  bool inFrame;
+  bool escape;
+} tslStream_t;
+
+/*true when buf holds a complete packet of len bytes*/
+bool tslStreamPut(tslStream_t& s, uint8_t byte);
+
+/*building a packet: the displays are appended in place, End fills in the byte count*/
+typedef struct
+{
+  uint8_t *buf;
+  uint16_t maxLen;
+  uint16_t len;
+} tslWriter_t;
+
+void tslWriterBegin(tslWriter_t& w, uint8_t *buf, uint16_t maxLen, uint16_t screen);
+bool tslWriterAdd(tslWriter_t& w, uint16_t index, uint16_t control, const uint8_t *text, uint16_t textLen);
+uint16_t tslWriterEnd(tslWriter_t& w);
+
+/*the same lamp on all three positions, full brightness*/
+uint16_t tslControl(bool program, bool preview);
+
+/*TCP: DLE/STX in front and every DLE doubled, 0 when out is too small*/
+uint16_t tslStuff(const uint8_t *packet, uint16_t len, uint8_t *out, uint16_t maxLen);
+
+#endif
@@ -0,0 +1,349 @@
+#include "TallyBoxUmd.hpp"
+#include "Arduino.h"
+#include <WiFiClient.h>
+#include <WiFiUdp.h>
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxLog.hpp"
+
+static const logModule_t logModule = LOG_MODULE_UMD;
+
+typedef struct
+{
+  IPAddress address;              /*0.0.0.0 = not in use*/
+  uint16_t port;
+  bool tcp;
+  WiFiClient client;
+  uint32_t connectedAt;           /*or the latest connection attempt*/
+  bool needsFull;                 /*just connected or a packet dropped: the next one has all displays*/
+  uint8_t queue[UMD_QUEUE_SIZE];  /*ring, udp: length and packet, tcp: the framed stream*/
+  uint16_t queueStart;
+  uint16_t queueLen;
+} umdDestination_t;
+
+static umdDestination_t destinations[UMD_MAX_DESTINATIONS];
+static WiFiUDP umdUdp;
+static bool udpBegun = false;
+static uint8_t packet[UMD_MAX_PACKET];
+static uint8_t stuffed[2 * UMD_MAX_PACKET + 2];
+static uint64_t program = 0;      /*the lamps of the latest packet*/
+static uint64_t preview = 0;
+static uint32_t publishedAt = 0;
+static uint32_t refreshedAt = 0;
+static bool wasValid = false;     /*t was valid in the previous update*/
+
+/*** INTERNAL FUNCTIONS **************************************/
+static bool parseDestination(const char *text, umdDestination_t& d);
+static uint64_t displayMask(uint16_t firstCamera);
+static uint16_t buildPacket(uint64_t displays, uint16_t firstCamera);
+static void enqueue(umdDestination_t& d, const uint8_t *data, uint16_t len);
+static bool canSend(umdDestination_t& d);
+static bool publish(uint64_t displays, uint16_t firstCamera, bool full);
+static void flushTcp(umdDestination_t& d);
+static void flushUdp(umdDestination_t& d);
+/*************************************************************/
+
+
+/*[udp:|tcp:]address[:port]*/
+static bool parseDestination(const char *text, umdDestination_t& d)
+{
+  char address[CONF_NETWORK_NAME_LEN_UMD_DESTINATION+1];
+  char *portText;
+  bool ret = true;
+
+  d.tcp = (strncmp(text, "tcp:", 4) == 0);
+  if(d.tcp || (strncmp(text, "udp:", 4) == 0))
+  {
+    text += 4;
+  }
+  strlcpy(address, text, sizeof(address));
+  d.port = TSL_PORT;
+  portText = strchr(address, ':');
+  if(portText != NULL)
+  {
+    char *end;
+    long port;
+
+    *portText++ = '\0';
+    port = strtol(portText, &end, 10);
+    ret = ((*end == '\0') && (port > 0) && (port <= 0xFFFF));
+    d.port = (uint16_t)port;
+  }
+  ret = ret && d.address.fromString(address) && ((uint32_t)d.address != 0);
+  if(!ret)
+  {
+    d.address = IPAddress(0, 0, 0, 0);
+  }
+  return ret;
+}
+
+/*the cameras that have a display: tslFirstCamera and above*/
+static uint64_t displayMask(uint16_t firstCamera)
+{
+  uint64_t ret = ~0ULL;
+
+  if(firstCamera > PEERNETWORK_TALLY_MASK_INPUTS)
+  {
+    ret = 0;
+  }
+  else if(firstCamera > 1)
+  {
+    ret <<= (firstCamera - 1);
+  }
+  return ret;
+}
+
+static uint16_t buildPacket(uint64_t displays, uint16_t firstCamera)
+{
+  tslWriter_t w;
+
+  tslWriterBegin(w, packet, sizeof(packet), 0);
+  while(displays != 0)
+  {
+    uint8_t bit = (uint8_t)__builtin_ctzll(displays);
+
+    displays &= displays - 1;
+    tslWriterAdd(w, (uint16_t)(bit + 1 - firstCamera), tslControl((program >> bit) & 1, (preview >> bit) & 1), NULL, 0);
+  }
+  return tslWriterEnd(w);
+}
+
+/*whole packets or nothing, so that a tcp stream stays framed*/
+static void enqueue(umdDestination_t& d, const uint8_t *data, uint16_t len)
+{
+  uint16_t needed = len + (d.tcp ? 0 : 2);
+
+  if((len == 0) || (needed > (sizeof(d.queue) - d.queueLen)))
+  {
+    METRIC_INC(METRIC_UMD_DROPPED);
+    d.needsFull = true;
+    return;
+  }
+  if(!d.tcp)
+  {
+    d.queue[(d.queueStart + d.queueLen++) % sizeof(d.queue)] = (uint8_t)len;
+    d.queue[(d.queueStart + d.queueLen++) % sizeof(d.queue)] = (uint8_t)(len >> 8);
+  }
+  for(uint16_t i = 0; i < len; i++)
+  {
+    d.queue[(d.queueStart + d.queueLen++) % sizeof(d.queue)] = data[i];
+  }
+  METRIC_INC(METRIC_UMD_PACKETS_SENT);
+}
+
+static bool canSend(umdDestination_t& d)
+{
+  return (((uint32_t)d.address != 0) && (!d.tcp || d.client.connected()));
+}
+
+/*a full packet goes to the destinations that need one, the changes to the others*/
+static bool publish(uint64_t displays, uint16_t firstCamera, bool full)
+{
+  uint16_t len = 0;
+  uint16_t stuffedLen = 0;
+  bool ret = false;
+
+  for(uint8_t i = 0; i < UMD_MAX_DESTINATIONS; i++)
+  {
+    umdDestination_t& d = destinations[i];
+
+    if(!canSend(d) || (d.needsFull != full))
+    {
+      continue;
+    }
+    len = ((len == 0) ? buildPacket(displays, firstCamera) : len);
+    d.needsFull = false;
+    ret = true;
+    if(d.tcp)
+    {
+      stuffedLen = ((stuffedLen == 0) ? tslStuff(packet, len, stuffed, sizeof(stuffed)) : stuffedLen);
+      enqueue(d, stuffed, stuffedLen);
+    }
+    else
+    {
+      enqueue(d, packet, len);
+    }
+  }
+  return ret;
+}
+
+/*written as the socket has room, the connection is made from the idle time*/
+static void flushTcp(umdDestination_t& d)
+{
+  if(!d.client.connected())
+  {
+    d.queueLen = 0;
+    d.needsFull = true;
+    return;
+  }
+
+  while(d.queueLen > 0)
+  {
+    size_t room = d.client.availableForWrite();
+    size_t chunk = min((size_t)d.queueLen, sizeof(d.queue) - d.queueStart);
+
+    if(room == 0)
+    {
+      break;
+    }
+    chunk = d.client.write(d.queue + d.queueStart, min(chunk, room));
+    if(chunk == 0)
+    {
+      break;
+    }
+    d.queueStart = (d.queueStart + chunk) % sizeof(d.queue);
+    d.queueLen -= chunk;
+  }
+}
+
+static void flushUdp(umdDestination_t& d)
+{
+  for(uint8_t n = 0; (n < UMD_MAX_PACKETS_PER_UPDATE) && (d.queueLen > 2); n++)
+  {
+    uint16_t len = d.queue[d.queueStart] | (d.queue[(d.queueStart + 1) % sizeof(d.queue)] << 8);
+    uint16_t start = (d.queueStart + 2) % sizeof(d.queue);
+    uint16_t chunk = min(len, (uint16_t)(sizeof(d.queue) - start));
+
+    umdUdp.beginPacket(d.address, d.port);
+    umdUdp.write(d.queue + start, chunk);
+    umdUdp.write(d.queue, len - chunk);
+    umdUdp.endPacket();
+    d.queueStart = (start + len) % sizeof(d.queue);
+    d.queueLen -= len + 2;
+  }
+}
+
+void tallyBoxUmdBegin(tallyBoxNetworkConfig_t& c)
+{
+  const char* const texts[UMD_MAX_DESTINATIONS] = {c.umdDestination1, c.umdDestination2, c.umdDestination3};
+
+  for(uint8_t i = 0; i < UMD_MAX_DESTINATIONS; i++)
+  {
+    umdDestination_t& d = destinations[i];
+
+    d.client.stop();
+    d.address = IPAddress(0, 0, 0, 0);
+    d.connectedAt = millis() - UMD_CONNECT_RETRY_MS;
+    d.needsFull = true;
+    d.queueStart = 0;
+    d.queueLen = 0;
+    if(texts[i][0] != '\0')
+    {
+      if(parseDestination(texts[i], d))
+      {
+        LOG_INFO("Republishing TSL to %s", texts[i]);
+        if(!d.tcp && !udpBegun)
+        {
+          umdUdp.begin(50200 + random(1000));
+          udpBegun = true;
+        }
+      }
+      else
+      {
+        LOG_WARN("UMD destination %u not understood: %s", i + 1, texts[i]);
+      }
+    }
+  }
+  program = 0;
+  preview = 0;
+  wasValid = false;
+  refreshedAt = millis() - UMD_REFRESH_MS;
+}
+
+void tallyBoxUmdUpdate(tallyBoxNetworkConfig_t& c, const peerTally_t& t, bool valid)
+{
+  uint32_t nowMs = millis();
+
+  if(valid && ((nowMs - publishedAt) >= c.umdIntervalMs))
+  {
+    bool published = false;
+    uint64_t displays = displayMask(c.tslFirstCamera);
+    uint64_t red = t.redMask | peerTallyInputBit(t.redChannel);
+    uint64_t green = t.greenMask | peerTallyInputBit(t.greenChannel);
+    /*the camera coming in on a transition is on air already, on air is red only*/
+    uint64_t newProgram = red | (t.inTransition ? green : 0);
+    uint64_t newPreview = green & ~newProgram;
+    uint64_t changed = ((newProgram ^ program) | (newPreview ^ preview)) & displays;
+    bool refresh = ((nowMs - refreshedAt) >= UMD_REFRESH_MS);
+
+    program = newProgram;
+    preview = newPreview;
+    if(refresh)
+    {
+      refreshedAt = nowMs;
+      for(uint8_t i = 0; i < UMD_MAX_DESTINATIONS; i++)
+      {
+        destinations[i].needsFull = true;
+      }
+    }
+    if(changed != 0)
+    {
+      published |= publish(changed, c.tslFirstCamera, false);
+    }
+    if(displays != 0)
+    {
+      published |= publish(displays, c.tslFirstCamera, true);
+    }
+    publishedAt = (published ? nowMs : publishedAt);
+  }
+  else if(!valid && wasValid)
+  {
+    /*the lamps of the lost source would stay lit on the displays: one full packet with all off*/
+    program = 0;
+    preview = 0;
+    for(uint8_t i = 0; i < UMD_MAX_DESTINATIONS; i++)
+    {
+      destinations[i].needsFull = true;
+    }
+    publish(displayMask(c.tslFirstCamera), c.tslFirstCamera, true);
+    publishedAt = nowMs;
+    refreshedAt = nowMs;
+  }
+  wasValid = valid;
+
+  for(uint8_t i = 0; i < UMD_MAX_DESTINATIONS; i++)
+  {
+    umdDestination_t& d = destinations[i];
+
+    if((uint32_t)d.address == 0)
+    {
+      continue;
+    }
+    if(d.tcp)
+    {
+      flushTcp(d);
+    }
+    else
+    {
+      flushUdp(d);
+    }
+  }
+}
+
+/*one attempt per call, and only if it fits in the idle time left before the next tick: a
+  receiver that does not answer in time is tried again after UMD_CONNECT_RETRY_MS*/
+void tallyBoxUmdIdle(uint32_t idleMs)
+{
+  uint32_t nowMs = millis();
+
+  if(idleMs < UMD_CONNECT_MIN_IDLE_MS)
+  {
+    return;
+  }
+  for(uint8_t i = 0; i < UMD_MAX_DESTINATIONS; i++)
+  {
+    umdDestination_t& d = destinations[i];
+
+    if(((uint32_t)d.address == 0) || !d.tcp || d.client.connected() || ((nowMs - d.connectedAt) < UMD_CONNECT_RETRY_MS))
+    {
+      continue;
+    }
+    d.connectedAt = nowMs;
+    d.client.setTimeout(idleMs);
+    if(d.client.connect(d.address, d.port))
+    {
+      d.client.setNoDelay(true);
+      LOG_INFO("UMD destination %s connected", d.address.toString().c_str());
+    }
+    break;
+  }
+}
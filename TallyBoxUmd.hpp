@@ -0,0 +1,32 @@
+#ifndef __TALLYBOXUMD_HPP__
+#define __TALLYBOXUMD_HPP__
+#include "Arduino.h"
+#include "TallyBoxConfiguration.hpp"
+#include "TallyBoxPeerCodec.hpp"
+#include "TallyBoxTsl.hpp"
+
+/*TSL UMD v5 republishing of the master's tally, for monitor walls and multiviewers. Camera
+  tslFirstCamera + n is display n, for the cameras 1...64 of the tally masks. The displays whose
+  lamps changed since the previous packet go out together, at most one packet per umdIntervalMs,
+  and all displays are sent again every UMD_REFRESH_MS. When the tally becomes invalid, all
+  displays are sent once with their lamps off. Each destination has its own queue that is
+  written as its socket has room: a slow or lost receiver loses packets, not tally time.*/
+
+#define UMD_MAX_DESTINATIONS          3
+#define UMD_MAX_PACKET                (TSL_HEADER_SIZE + PEERNETWORK_TALLY_MASK_INPUTS * TSL_DISPLAY_HEADER_SIZE)
+#define UMD_QUEUE_SIZE                1024    /*per destination, two full packets framed for tcp*/
+#define UMD_REFRESH_MS                2000
+#define UMD_CONNECT_RETRY_MS          5000
+#define UMD_CONNECT_MIN_IDLE_MS       2       /*less idle time left: the connection waits for the next*/
+#define UMD_MAX_PACKETS_PER_UPDATE    2       /*udp datagrams sent per destination and tick*/
+
+void tallyBoxUmdBegin(tallyBoxNetworkConfig_t& c);
+
+/*t is published only while valid, the displays are cleared once when it stops being valid and
+  the queues are written in any case*/
+void tallyBoxUmdUpdate(tallyBoxNetworkConfig_t& c, const peerTally_t& t, bool valid);
+
+/*from the idle time between the ticks, idleMs until the next one: connects the tcp destinations*/
+void tallyBoxUmdIdle(uint32_t idleMs);
+
+#endif
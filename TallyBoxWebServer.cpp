@@ -1,33 +1,44 @@
 #include <ESP8266WiFi.h>
 #include <WiFiClient.h>
-#include <ESP8266WebServer.h>
-#include <ESP8266HTTPUpdateServer.h>
+#include <Updater.h>
+#include <flash_hal.h>
 #include <FS.h>
 #include <LittleFS.h>
 #include "TallyBoxWebServer.hpp"
+#include "TallyBoxHttp.hpp"
 #include "TallyBoxOutput.hpp"
+#include "TallyBoxPersistence.hpp"
+#include "TallyBoxConfigSchema.hpp"
+#include "TallyBoxFleet.hpp"
+#include "TallyBoxTemplate.hpp"
+#include "TallyBoxAssets.hpp"
+#include "TallyBoxLive.hpp"
+#include "TallyBoxMetrics.hpp"
+#include "TallyBoxLog.hpp"
+#include "TallyBoxTerminal.hpp"
+#include "TallyBoxProfiler.hpp"
+#include "TallyBoxFirmware.hpp"
+#include "TallyBoxRollout.hpp"
+#include "OTAUpgrade.hpp"
+#include "TallyBoxStateMachine.hpp"
 #include <malloc.h>
 #include <math.h>
 
+static const logModule_t logModule = LOG_MODULE_WEB;
+
 static FS* filesystem = &LittleFS;
 
 extern const char* TallyboxFirmwareVersion;
 
 #define DBG_OUTPUT_PORT Serial
 
-static ESP8266WebServer server(80);
-ESP8266HTTPUpdateServer httpUpdater;
-
-static char *myIndexHtmBuf = NULL;
-static char *myRestartHtmBuf = NULL;
-static char *myConfigNetworkHtmBuf = NULL;
-static char *myConfigUserHtmBuf = NULL;
-
-//holds the current upload
-File fsUploadFile;
-
+#define RESTART_DELAY_MS      1000    /*lets the response reach the browser*/
 
+static tallyBoxConfig_t *myConf = NULL;
 static bool initialized = false;
+static bool restartPending = false;
+static bool restartWhenOffAir = false;    /*after an update, as for OTA and the rollout*/
+static uint32_t restartAtMs = 0;
 
 String formatBytes(size_t bytes) {
   if (bytes < 1024) {
@@ -41,8 +52,8 @@ String formatBytes(size_t bytes) {
   }
 }
 
-String getContentType(String filename) {
-  if (server.hasArg("download")) {
+String getContentType(httpConnection_t& conn, String filename) {
+  if (httpHasArg(conn, "download")) {
     return "application/octet-stream";
   } else if (filename.endsWith(".htm")) {
     return "text/html";
@@ -76,36 +87,44 @@ String getContentType(String filename) {
   return "text/plain";
 }
 
+/*the restart is done from the update, after the response has been sent. A restart into a new
+  image also waits until the box is off air.*/
+static void scheduleRestart(bool whenOffAir)
+{
+  restartPending = true;
+  restartWhenOffAir = whenOffAir;
+  restartAtMs = millis() + RESTART_DELAY_MS;
+}
+
 
-void handleFileCreate() {
-  if (server.args() == 0) {
-    return server.send(500, "text/plain", "BAD ARGS");
+void handleFileCreate(httpConnection_t& conn) {
+  if (httpArgCount(conn) == 0) {
+    return httpSend(conn, 500, "text/plain", "BAD ARGS");
   }
-  String path = server.arg(0);
-  DBG_OUTPUT_PORT.println("handleFileCreate: " + path);
+  String path = httpArgValue(conn, 0);
+  LOG_INFO("handleFileCreate: %s", path);
   if (path == "/") {
-    return server.send(500, "text/plain", "BAD PATH");
+    return httpSend(conn, 500, "text/plain", "BAD PATH");
   }
   if (filesystem->exists(path)) {
-    return server.send(500, "text/plain", "FILE EXISTS");
+    return httpSend(conn, 500, "text/plain", "FILE EXISTS");
   }
   File file = filesystem->open(path, "w");
   if (file) {
     file.close();
   } else {
-    return server.send(500, "text/plain", "CREATE FAILED");
+    return httpSend(conn, 500, "text/plain", "CREATE FAILED");
   }
-  server.send(200, "text/plain", "");
-  path = String();
+  httpSend(conn, 200, "text/plain", "");
 }
-void handleFileList() {
-  if (!server.hasArg("dir")) {
-    server.send(500, "text/plain", "BAD ARGS");
+void handleFileList(httpConnection_t& conn) {
+  if (!httpHasArg(conn, "dir")) {
+    httpSend(conn, 500, "text/plain", "BAD ARGS");
     return;
   }
 
-  String path = server.arg("dir");
-  DBG_OUTPUT_PORT.println("handleFileList: " + path);
+  String path = httpArg(conn, "dir");
+  LOG_DEBUG("handleFileList: %s", path);
   Dir dir = filesystem->openDir(path);
   path = String();
 
@@ -129,129 +148,311 @@ void handleFileList() {
   }
 
   output += "]";
-  server.send(200, "text/json", output);
+  httpSend(conn, 200, "text/json", output);
+}
+/*answers an indexed asset, 304 when the browser already has this version*/
+static bool sendAsset(httpConnection_t& conn, assetEntry_t& a)
+{
+  uint32_t start = millis();
+  size_t sent = 0;
+  char fileName[ASSET_MAX_PATH + 3];
+
+  snprintf(fileName, sizeof(fileName), "%s.gz", a.path);
+
+  a.requests++;
+  httpAddHeader(conn, "ETag", a.etag);
+  httpAddHeader(conn, "Cache-Control", ASSET_CACHE_CONTROL);
+
+  if(strcmp(httpIfNoneMatch(conn), a.etag) == 0)
+  {
+    httpSend(conn, 304, a.contentType, "");
+    a.notModified++;
+  }
+  else
+  {
+    File& file = httpFile(conn);
+
+    file = filesystem->open(fileName, "r");
+    if(!file)
+    {
+      return false;
+    }
+    /*sent from the http update as the socket has room, closed by the server*/
+    sent = file.size();
+    httpAddHeader(conn, "Content-Encoding", "gzip");
+    httpSendFile(conn, 200, a.contentType, file);
+    a.bytesSent += sent;
+  }
+  a.lastRequestMs = millis() - start;
+
+  LOG_DEBUG("%s: %u bytes, %u ms", a.path, (unsigned)sent, a.lastRequestMs);
+  return true;
+}
+
+/*a file of the bundle that is replaced or removed at runtime is served from the filesystem again*/
+static void forgetAsset(const String& path)
+{
+  if(tallyBoxAssetForget(path.c_str()) && !path.endsWith(".gz"))
+  {
+    filesystem->remove(path + ".gz");
+  }
 }
-bool handleFileRead(String path) {
-  DBG_OUTPUT_PORT.println("handleFileRead: " + path);
+
+bool handleFileRead(httpConnection_t& conn, String path) {
+  LOG_DEBUG("handleFileRead: %s", path);
   if (path.endsWith("/")) {
     path += "index.htm";
   }
-  String contentType = getContentType(path);
+  assetEntry_t *asset = tallyBoxAssetFind(path.c_str());
+  if (asset && !httpHasArg(conn, "download")) {
+    return sendAsset(conn, *asset);
+  }
+  String contentType = getContentType(conn, path);
   String pathWithGz = path + ".gz";
   if (filesystem->exists(pathWithGz) || filesystem->exists(path)) {
     if (filesystem->exists(pathWithGz)) {
       path += ".gz";
+      if (contentType != "application/x-gzip") {
+        httpAddHeader(conn, "Content-Encoding", "gzip");
+      }
     }
-    File file = filesystem->open(path, "r");
-    server.streamFile(file, contentType);
-    file.close();
+    File& file = httpFile(conn);
+    file = filesystem->open(path, "r");
+    httpSendFile(conn, 200, contentType.c_str(), file);
     return true;
   }
   return false;
 }
 
-bool getRawHtm(const char* fileName, char *bufContent, size_t maxLen)
+#define MAX_FEEDBACK_LEN      96
+
+/*state of one page rendering, used by the placeholder resolver*/
+typedef struct
+{
+  tallyBoxConfig_t *c;
+  bool validated;
+  bool restartEnabled;
+  const char *feedback;
+} pageContext_t;
+
+/*everything a page being sent needs, kept in the connection until the page is done*/
+typedef struct
 {
-  bool dataValid = false;
-  static size_t bufLen = 0;
+  templateReader_t reader;
+  pageContext_t ctx;
+  char feedback[MAX_FEEDBACK_LEN];
+  uint32_t startMs;
+  uint32_t heapAtStart;
+  uint32_t minHeap;
+} pageRender_t;
+
+/*resource usage of the page rendering, reported in /all*/
+typedef struct
+{
+  uint32_t pagesServed;
+  uint32_t lastPageBytes;
+  uint32_t lastPageMs;
+  uint32_t peakHeapUsed;        /*worst heap used while a page was sent, over all pages*/
+} pageStats_t;
 
-  if(filesystem->exists(fileName))
-  {
-    File file = filesystem->open(fileName, "r");
+static pageStats_t myPageStats = {};
 
-    bufLen = file.readBytes(bufContent, maxLen);
-    if(bufLen > 0)
-    {
-      bufContent[bufLen] = 0; /*terminate*/
-      dataValid = true;
-    }
-    file.close();
-  }
+static void formatIpAddress(const IPAddress& ip, char *out, size_t maxLen)
+{
+  snprintf(out, maxLen, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+}
+
+static bool resolvePlaceholder(pageContext_t& ctx, const char *placeholder, char *out, size_t maxLen)
+{
+  tallyBoxNetworkConfig_t& n = ctx.c->network;
 
-  return dataValid;
+  /*page state first, then the configuration fields*/
+  if(strcmp(placeholder, "version") == 0)
+  {
+    strlcpy(out, TallyboxFirmwareVersion, maxLen);
+  }
+  else if(strcmp(placeholder, "feedback") == 0)
+  {
+    strlcpy(out, ctx.feedback, maxLen);
+  }
+  else if(strcmp(placeholder, "storeState") == 0)
+  {
+    strlcpy(out, (ctx.validated ? "enabled" : "disabled"), maxLen);
+  }
+  else if(strcmp(placeholder, "restart:checked") == 0)
+  {
+    strlcpy(out, (ctx.restartEnabled ? "checked" : ""), maxLen);
+  }
+  else if(strcmp(placeholder, "restart:unchecked") == 0)
+  {
+    strlcpy(out, (ctx.restartEnabled ? "" : "checked"), maxLen);
+  }
+  else if(!n.hasStaticIp && (strcmp(placeholder, "ownAddress") == 0))
+  {
+    /*without static ip show what dhcp gave us*/
+    formatIpAddress(WiFi.localIP(), out, maxLen);
+  }
+  else if(!n.hasStaticIp && (strcmp(placeholder, "subnetMask") == 0))
+  {
+    formatIpAddress(WiFi.subnetMask(), out, maxLen);
+  }
+  else if(!n.hasStaticIp && (strcmp(placeholder, "defaultGateway") == 0))
+  {
+    formatIpAddress(WiFi.gatewayIP(), out, maxLen);
+  }
+  else if(!confResolvePlaceholder(networkConfigSchema, &ctx.c->network, placeholder, out, maxLen)
+          && !confResolvePlaceholder(userConfigSchema, &ctx.c->user, placeholder, out, maxLen))
+  {
+    return false;
+  }
+  return true;
 }
 
+static bool templateResolver(void *ctx, const char *placeholder, char *out, size_t maxLen)
+{
+  return resolvePlaceholder(*(pageContext_t*)ctx, placeholder, out, maxLen);
+}
 
-#define MAX_HTML_FILE_SIZE    4000
+/*body reader of a template page, called by the http layer as the socket has room*/
+static size_t pageReader(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  pageRender_t *p = (pageRender_t*)httpContext(conn, sizeof(pageRender_t));
+  size_t len = 0;
+  size_t n;
 
-bool handleIndexHtm(tallyBoxConfig_t& c, ESP8266WebServer& s, bool useServerArgs) {
-  static bool fileHasBeenRead = false;
-  char *bufContent = myIndexHtmBuf;
-  String path = s.uri();
+  /*one flash read per templateRead(), fill the buffer so that the packets are not tiny*/
+  while((len < maxLen) && ((n = templateRead(p->reader, out + len, maxLen - len)) > 0))
+  {
+    len += n;
+  }
 
-  DBG_OUTPUT_PORT.println("handleIndexHtm: " + path);
-  if (path.endsWith("/")) {
-    path += "index.htm";
+  if(ESP.getFreeHeap() < p->minHeap)
+  {
+    p->minHeap = ESP.getFreeHeap();
   }
 
-  String contentType = getContentType(path);
-  if(!fileHasBeenRead)
+  if(len == 0)
   {
-    if(!getRawHtm("index.htm", bufContent, MAX_HTML_FILE_SIZE))
+    myPageStats.pagesServed++;
+    myPageStats.lastPageBytes = p->reader.stats.bytesOut;
+    myPageStats.lastPageMs = millis() - p->startMs;
+    if((p->heapAtStart - p->minHeap) > myPageStats.peakHeapUsed)
     {
-      Serial.println("file access failed");
-      return false;
+      myPageStats.peakHeapUsed = p->heapAtStart - p->minHeap;
     }
-    fileHasBeenRead = true;
+
+    LOG_DEBUG("%s: %u bytes, %u ms, heap used %u bytes", httpPath(conn),
+              p->reader.stats.bytesOut, myPageStats.lastPageMs, p->heapAtStart - p->minHeap);
   }
+  return len;
+}
 
-  /*allocate buffer for final html*/
-  char *myBuf = (char*)malloc(MAX_HTML_FILE_SIZE);
+/*starts sending the template, it is read from flash piece by piece while the connection has room*/
+static bool sendTemplate(httpConnection_t& conn, const char *fileName, const pageContext_t& ctx)
+{
+  bool ret = false;
+  pageRender_t *p = (pageRender_t*)httpContext(conn, sizeof(pageRender_t));
+  File& file = httpFile(conn);
 
-  if(myBuf)
+  if(p && filesystem->exists(fileName) && (file = filesystem->open(fileName, "r")))
   {
-    snprintf(myBuf, MAX_HTML_FILE_SIZE, bufContent, 
-            TallyboxFirmwareVersion
-            );
-
-    server.send(200, "text/html", myBuf);
+    p->ctx = ctx;
+    if(ctx.feedback)
+    {
+      /*the feedback of the form lives on the stack of the handler*/
+      strlcpy(p->feedback, ctx.feedback, sizeof(p->feedback));
+      p->ctx.feedback = p->feedback;
+    }
+    p->startMs = millis();
+    p->heapAtStart = p->minHeap = ESP.getFreeHeap();
 
-    free(myBuf);
+    templateBegin(p->reader, file, templateResolver, &p->ctx);
+    httpSendReader(conn, 200, "text/html", pageReader);
+    ret = true;
   }
   else
   {
-    Serial.println("malloc failed");
-    server.send(404, "text/html", "malloc failed");
+    LOG_ERROR("file access failed");
   }
+  return ret;
+}
 
-  return true;
+static bool serverArgLookup(void *ctx, const char *name, char *value, size_t maxLen)
+{
+  bool ret = false;
+  httpConnection_t& conn = *(httpConnection_t*)ctx;
+
+  if(httpHasArg(conn, name))
+  {
+    strlcpy(value, httpArg(conn, name), maxLen);
+    ret = true;
+  }
+  return ret;
 }
 
-bool handleConfigUserHtm(tallyBoxConfig_t& c, ESP8266WebServer& s, bool useServerArgs) {
-  //char bufContent[MAX_HTML_FILE_SIZE] = "";
-  char *bufContent = myConfigUserHtmBuf;
-  String path = s.uri();
-  bool validated = false;
-  String userFeedback = "";
-  static bool fileHasBeenRead = false;
+/*applies the posted form to the configuration, only when every field is valid*/
+template <typename T>
+bool handleConfigForm(httpConnection_t& conn, T& c, const confSchema_t& schema, char *feedback, bool& validated)
+{
+  T edited = c;
+  uint8_t rejected = confParseForm(schema, &edited, serverArgLookup, &conn);
 
-  DBG_OUTPUT_PORT.println("handleConfigUserHtm: " + path);
-  if (path.endsWith("/")) {
-    path += "config_user.htm";
+  if(rejected > 0)
+  {
+    snprintf(feedback, MAX_FEEDBACK_LEN, "%u invalid value(s), nothing changed.", rejected);
+    return false;
   }
 
-  String contentType = getContentType(path);
+  c = edited;
+  tallyBoxConfigurationChanged();
 
-  if(!fileHasBeenRead)
+  if(strcmp(httpArg(conn, "verify"), "Verify") == 0)
   {
-    if(!getRawHtm("config_user.htm", bufContent, MAX_HTML_FILE_SIZE))
-    {
-      Serial.println("file access failed");
-      return false;
-    }
-    fileHasBeenRead = true;
+    strlcpy(feedback, "Verified. The configuration can now be stored.", MAX_FEEDBACK_LEN);
+    validated = true;
   }
 
-  if(useServerArgs)
+  if(strcmp(httpArg(conn, "store"), "Store parameters") == 0)
+  {
+    /*the flash write is done in the background, not inside this request*/
+    tallyBoxScheduleConfigurationWrite(c);
+  }
+  return true;
+}
+
+template <typename T>
+void appendWriteStatus(T& c, char *feedback)
+{
+  persistenceStatus_t writeStatus = tallyBoxGetConfigurationWriteStatus(c);
+
+  if(writeStatus != PERSISTENCE_STATUS_CLEAN)
   {
-    c.user.cameraId = (uint16_t)(server.arg("cameraId").toInt());
+    size_t len = strlen(feedback);
+    snprintf(feedback + len, MAX_FEEDBACK_LEN - len, " Configuration is %s.", tallyBoxGetConfigurationWriteStatusText(writeStatus));
+  }
+}
+
+bool handleIndexHtm(tallyBoxConfig_t& c, httpConnection_t& conn, bool useServerArgs) {
+  pageContext_t ctx = {&c, false, false, ""};
+
+  LOG_DEBUG("handleIndexHtm: %s", httpPath(conn));
 
+  return sendTemplate(conn, "index.htm", ctx);
+}
+
+bool handleConfigUserHtm(tallyBoxConfig_t& c, httpConnection_t& conn, bool useServerArgs) {
+  char userFeedback[MAX_FEEDBACK_LEN] = "";
+  pageContext_t ctx = {&c, false, false, userFeedback};
+
+  LOG_DEBUG("handleConfigUserHtm: %s", httpPath(conn));
+
+  if(useServerArgs)
+  {
     tallyBoxOutput_t ch = OUTPUT_NONE;
     float oldGreen = c.user.greenBrightnessPercent;
     float oldRed = c.user.redBrightnessPercent;
 
-    c.user.greenBrightnessPercent = round(server.arg("greenBrightnessPercent").toFloat());
-    c.user.redBrightnessPercent = round(server.arg("redBrightnessPercent").toFloat());
+    handleConfigForm(conn, c.user, userConfigSchema, userFeedback, ctx.validated);
 
     if(c.user.greenBrightnessPercent != oldGreen)
     {
@@ -270,322 +471,541 @@ bool handleConfigUserHtm(tallyBoxConfig_t& c, ESP8266WebServer& s, bool useServe
     }
 
     setBrightnessSettingMode(ch, (ch != OUTPUT_NONE));
+  }
 
-    if(server.arg("verify") == "Verify")
-    {
-      userFeedback += "Verified. The configuration can now be stored.";
-      validated = true;
-    }
+  appendWriteStatus(c.user, userFeedback);
 
-    if(server.arg("store") == "Store parameters")
-    {
-      if(tallyBoxWriteConfiguration(c.user))
-      {
-        /*success!*/
-        userFeedback += "Configuration stored successfully!";
-      }
-      else
-      {
-        userFeedback += "Configuration storing FAILED!";
-      }
-    }
-  }
+  return sendTemplate(conn, "config_user.htm", ctx);
+}
 
-  /*allocate buffer for final html*/
-  char *myBuf = (char*)malloc(MAX_HTML_FILE_SIZE);
 
-  if(myBuf)
-  {
-    snprintf(myBuf, MAX_HTML_FILE_SIZE, bufContent, 
-            TallyboxFirmwareVersion,
-            c.user.cameraId,
-            (uint16_t)round(c.user.greenBrightnessPercent),
-            (c.network.isMaster ? "enabled" : "disabled"),
-            (uint16_t)round(c.user.redBrightnessPercent),
-            (c.network.isMaster ? "enabled" : "disabled"),
-            (validated?"enabled":"disabled"),
-            userFeedback.c_str()
-            );
+bool handleConfigNetworkHtm(tallyBoxConfig_t& c, httpConnection_t& conn, bool useServerArgs) {
+  char userFeedback[MAX_FEEDBACK_LEN] = "";
+  pageContext_t ctx = {&c, false, false, userFeedback};
 
-    server.send(200, "text/html", myBuf);
+  LOG_DEBUG("handleConfigNetworkHtm: %s", httpPath(conn));
 
-    free(myBuf);
-  }
-  else
+  if(useServerArgs)
   {
-    Serial.println("malloc failed");
-    server.send(404, "text/html", "malloc failed");
+    handleConfigForm(conn, c.network, networkConfigSchema, userFeedback, ctx.validated);
   }
-  return true;
+
+  appendWriteStatus(c.network, userFeedback);
+
+  return sendTemplate(conn, "config_network.htm", ctx);
 }
 
 
-bool handleConfigNetworkHtm(tallyBoxConfig_t& c, ESP8266WebServer& s, bool useServerArgs) {
-  char *bufContent = myConfigNetworkHtmBuf;
-  String path = s.uri();
-  bool validated = false;
-  String userFeedback = "";
+bool handleRestartHtm(tallyBoxConfig_t& c, httpConnection_t& conn, bool useServerArgs) {
+  pageContext_t ctx = {&c, false, false, ""};
 
-  DBG_OUTPUT_PORT.println("handleConfigNetworkHtm: " + path);
-  if (path.endsWith("/")) {
-    path += "config_network.htm";
-  }
+  LOG_DEBUG("handleRestartHtm: %s", httpPath(conn));
 
-  String contentType = getContentType(path);
-  if(!getRawHtm("config_network.htm", bufContent, MAX_HTML_FILE_SIZE))
-  {
-    return false;
-  }
-  
   if(useServerArgs)
   {
-    strlcpy(c.network.wifiSSID, server.arg("wifiSSID").c_str(), sizeof(c.network.wifiSSID));
-    strlcpy(c.network.wifiPasswd, server.arg("wifiPassword").c_str(), sizeof(c.network.wifiPasswd));
+    ctx.restartEnabled = (strcmp(httpArg(conn, "action"), "restart") == 0);
+
+    if(strcmp(httpArg(conn, "submit"), "Submit") == 0)
+    {
+      if(ctx.restartEnabled)
+      {
+        LOG_WARN("restart requested from the web page");
+        httpSend(conn, 200, "text/html", "<html>Restarting.... wait 30 seconds before reconnecting</html>");
+        scheduleRestart(false);
+        return true;
+      }
+    }
+  }
+
+  return sendTemplate(conn, "restart.htm", ctx);
+}
+
+/*page handlers, a POST carries the form*/
+#define PAGE_HANDLER(name, handler) \
+  static void name(httpConnection_t& conn) \
+  { \
+    if(!handler(*myConf, conn, (httpMethod(conn) == HTTP_METHOD_POST))) \
+    { \
+      httpSend(conn, 404, "text/plain", "FileNotFound"); \
+    } \
+  }
+
+PAGE_HANDLER(handleIndexPage, handleIndexHtm)
+PAGE_HANDLER(handleConfigUserPage, handleConfigUserHtm)
+PAGE_HANDLER(handleConfigNetworkPage, handleConfigNetworkHtm)
+PAGE_HANDLER(handleRestartPage, handleRestartHtm)
+
+
 
-    c.network.isMaster = (server.arg("connectionType") == "master");
 
-    String ha = server.arg("hostAddress");
-    c.network.hostAddress.fromString(ha);
 
-    c.network.hasStaticIp = (server.arg("staticIpInUse") == "staticIpInUse");
 
-    if(c.network.hasStaticIp)
-    {
-      String oa = server.arg("ownAddress");
-      c.network.ownAddress.fromString(oa);
 
-      String snm = server.arg("subnetMask");
-      c.network.subnetMask.fromString(snm);
 
-      String dg = server.arg("defaultGateway");
-      c.network.defaultGateway.fromString(dg);
-    }
 
 
-    Serial.println("MDNSHOST = '"+server.arg("mDnsHostName")+"'");
+#define MAX_JSON_EXPORT_SIZE  3072    /*fleet profile with all overrides*/
 
+template <typename T>
+void handleConfigurationExport(httpConnection_t& conn, T& c)
+{
+  char *jsonBuf = (char*)malloc(MAX_JSON_EXPORT_SIZE);
+
+  if(jsonBuf)
+  {
+    tallyBoxExportConfiguration(c, jsonBuf, MAX_JSON_EXPORT_SIZE);
+    httpSend(conn, 200, "application/json", jsonBuf);
+    free(jsonBuf);
+  }
+  else
+  {
+    httpSend(conn, 500, "text/plain", "malloc failed");
+  }
+}
 
-    String hostName = server.arg("mDnsHostName");
-    strlcpy(c.network.mdnsHostName, hostName.c_str(), sizeof(c.network.mdnsHostName));
+void handleFleetStatus(httpConnection_t& conn)
+{
+  char *jsonBuf = (char*)malloc(MAX_JSON_EXPORT_SIZE);
 
-    if(server.arg("verify") == "Verify")
+  if(jsonBuf)
+  {
+    if(tallyBoxFleetStatusJson(jsonBuf, MAX_JSON_EXPORT_SIZE) > 0)
     {
-      userFeedback += "Verified. The configuration can now be stored.";
-      validated = true;
+      httpSend(conn, 200, "application/json", jsonBuf);
     }
-
-    if(server.arg("store") == "Store parameters")
+    else
     {
-      if(tallyBoxWriteConfiguration(c.network))
-      {
-        /*success!*/
-        userFeedback += "Configuration stored successfully!";
-      }
-      else
-      {
-        userFeedback += "Configuration storing FAILED!";
-      }
+      httpSend(conn, 500, "text/plain", "status does not fit");
     }
-  }
-
-  /*allocate buffer for final html*/
-  char *myBuf = (char*)malloc(MAX_HTML_FILE_SIZE);
-
-  if(myBuf)
-  {
-    snprintf(myBuf, MAX_HTML_FILE_SIZE, bufContent, 
-            TallyboxFirmwareVersion,
-            c.network.wifiSSID,
-            c.network.wifiPasswd,
-            (c.network.isMaster ? "checked" : ""),
-            (c.network.isMaster ? "" : "checked"),
-            c.network.hostAddress.toString().c_str(),
-            (c.network.isMaster ? "enabled" : "disabled"),
-            (c.network.hasStaticIp ? "checked" : ""),
-            (c.network.hasStaticIp ? 
-                c.network.ownAddress.toString().c_str() 
-                : WiFi.localIP().toString().c_str()),
-            (c.network.hasStaticIp ? "enabled" : "disabled"),
-            (c.network.hasStaticIp ? 
-                c.network.subnetMask.toString().c_str() 
-                : WiFi.subnetMask().toString().c_str()),
-            (c.network.hasStaticIp ? "enabled" : "disabled"),
-            (c.network.hasStaticIp ? 
-                c.network.defaultGateway.toString().c_str() 
-                : WiFi.gatewayIP().toString().c_str()),
-            (c.network.hasStaticIp ? "enabled" : "disabled"),
-            c.network.mdnsHostName,
-            (validated ? "enabled" : "disabled"),
-            userFeedback.c_str()
-            );
-
-    server.send(200, "text/html", myBuf);
-    free(myBuf);
+    free(jsonBuf);
   }
   else
   {
-    Serial.println("malloc failed");
-    server.send(404, "text/html", "malloc failed");
+    httpSend(conn, 500, "text/plain", "malloc failed");
   }
-
-  return true;
 }
 
+static size_t metricsReader(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  uint8_t *next = (uint8_t*)httpContext(conn, sizeof(uint8_t));
 
+  return tallyBoxMetricsRead(*next, out, maxLen);
+}
 
+/*rendered a few metrics at a time as the socket has room, a scrape needs no more ram than that*/
+void handleMetrics(httpConnection_t& conn)
+{
+  *(uint8_t*)httpContext(conn, sizeof(uint8_t)) = 0;
+  httpSendReader(conn, 200, METRICS_CONTENT_TYPE, metricsReader);
+}
 
+typedef struct
+{
+  uint32_t cursor;
+  uint32_t end;
+} logReader_t;
 
+static size_t logReader(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  logReader_t *r = (logReader_t*)httpContext(conn, sizeof(logReader_t));
 
+  return tallyBoxLogRead(r->cursor, r->end, out, maxLen);
+}
 
+/*the records in the ring when the request came, ?level=debug|info|warn|error also sets the level*/
+void handleLog(httpConnection_t& conn)
+{
+  logReader_t *r = (logReader_t*)httpContext(conn, sizeof(logReader_t));
 
+  if(httpHasArg(conn, "level"))
+  {
+    for(uint8_t i = 0; i < LOG_LEVEL_MAX; i++)
+    {
+      if(strcmp(httpArg(conn, "level"), tallyBoxLogLevelName((logLevel_t)i)) == 0)
+      {
+        tallyBoxLogSetLevel((logLevel_t)i);
+      }
+    }
+  }
+  r->cursor = tallyBoxLogOldest();
+  r->end = tallyBoxGetLogStats().written;
+  httpAddHeader(conn, "X-Log-Level", tallyBoxLogLevelName((logLevel_t)tallyBoxLogLevel));
+  httpSendReader(conn, 200, "text/plain", logReader);
+}
 
+typedef struct
+{
+  uint8_t next;
+  bool reset;
+} profileReader_t;
 
+static size_t profileReader(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  profileReader_t *r = (profileReader_t*)httpContext(conn, sizeof(profileReader_t));
+  size_t len = tallyBoxProfilerRead(r->next, out, maxLen);
 
+  /*reset once the histograms have been sent*/
+  if((len == 0) && r->reset)
+  {
+    tallyBoxProfilerReset();
+    r->reset = false;
+  }
+  return len;
+}
 
+/*time spent in the stages of the tick, ?reset=1 starts new histograms after this answer*/
+void handleProfile(httpConnection_t& conn)
+{
+  profileReader_t *r = (profileReader_t*)httpContext(conn, sizeof(profileReader_t));
 
-bool handleRestartHtm(tallyBoxConfig_t& c, ESP8266WebServer& s, bool useServerArgs) {
-  char *bufContent = myRestartHtmBuf;
-  String path = s.uri();
-  bool restartEnabled = false;
-  String userFeedback = "";
+  r->next = 0;
+  r->reset = httpHasArg(conn, "reset");
+  httpSendReader(conn, 200, "text/plain", profileReader);
+}
 
-  DBG_OUTPUT_PORT.println("handleRestartHtm: " + path);
-  if (path.endsWith("/")) {
-    path += "restart.htm";
-  }
+/*the image for the rollout to the other boxes, kept while no rollout reads it*/
+static void handleRolloutUpload(httpConnection_t& conn, httpUploadStatus_t status, const char *fileName, const uint8_t *data, size_t len)
+{
+  File& imageFile = httpFile(conn);
 
-  String contentType = getContentType(path);
-  if(!getRawHtm("restart.htm", bufContent, MAX_HTML_FILE_SIZE))
+  if(status == HTTP_UPLOAD_START)
   {
-    return false;
+    if(!tallyBoxFirmwareRolloutBusy())
+    {
+      LOG_INFO("rollout image: %s", fileName);
+      imageFile = filesystem->open(FIRMWARE_IMAGE_PATH, "w");
+    }
   }
-  
-  if(useServerArgs)
+  else if(status == HTTP_UPLOAD_WRITE)
   {
-    restartEnabled = (server.arg("action") == "restart");
-
-    if(server.arg("submit") == "Submit")
+    if(imageFile && (imageFile.write(data, len) != len))
     {
-      if(restartEnabled)
-      {
-        Serial.println("*******************************************");
-        Serial.println("*******  RESTART  *************************");
-        Serial.println("*******************************************");
-        server.send(200, "text/html", "<html>Restarting.... wait 30 seconds before reconnecting</html>");
-        delay(1000);
-        ESP.restart();
-      }
+      LOG_ERROR("rollout image does not fit");
+      imageFile.close();
+      filesystem->remove(FIRMWARE_IMAGE_PATH);
     }
   }
+  else if(imageFile)
+  {
+    imageFile.close();
+  }
+}
 
-  /*allocate buffer for final html*/
-  char *myBuf = (char*)malloc(MAX_HTML_FILE_SIZE);
+/*POST uploads the image, ?action=start[&concurrency=N] and ?action=abort control the rollout*/
+void handleRollout(httpConnection_t& conn)
+{
+  const char *action = httpArg(conn, "action");
 
-  if(myBuf)
+  if(strcmp(action, "start") == 0)
   {
-    snprintf(myBuf, MAX_HTML_FILE_SIZE, bufContent, 
-            TallyboxFirmwareVersion,
-            (restartEnabled ? "checked" : ""),
-            (restartEnabled ? "" : "checked"),
-            "enabled"
-            );
+    uint8_t concurrency = httpHasArg(conn, "concurrency") ? (uint8_t)atoi(httpArg(conn, "concurrency")) : ROLLOUT_DEFAULT_CONCURRENCY;
 
-    server.send(200, "text/html", myBuf);
-    free(myBuf);
+    if(tallyBoxFirmwareRolloutStart(concurrency))
+    {
+      httpSend(conn, 200, "text/plain", "Rollout started.");
+    }
+    else
+    {
+      httpSend(conn, 409, "text/plain", "Rollout not started: a rollout is running, no image or no boxes online.");
+    }
+  }
+  else if(strcmp(action, "abort") == 0)
+  {
+    tallyBoxFirmwareRolloutAbort();
+    httpSend(conn, 200, "text/plain", "Rollout aborted.");
+  }
+  else if(httpMethod(conn) == HTTP_METHOD_POST)
+  {
+    if(tallyBoxFirmwareRolloutBusy())
+    {
+      httpSend(conn, 409, "text/plain", "Image not stored: a rollout is running.");
+    }
+    else
+    {
+      httpSend(conn, 200, "text/plain", filesystem->exists(FIRMWARE_IMAGE_PATH) ? "Image stored." : "Image not stored.");
+    }
   }
   else
   {
-    Serial.println("malloc failed");
-    server.send(404, "text/html", "malloc failed");
+    httpSend(conn, 400, "text/plain", "BAD ARGS");
   }
-
-  return true;
 }
 
+static size_t rolloutReader(httpConnection_t& conn, char *out, size_t maxLen)
+{
+  uint8_t *next = (uint8_t*)httpContext(conn, sizeof(uint8_t));
 
+  return tallyBoxFirmwareRolloutRead(*next, out, maxLen);
+}
 
+void handleRolloutStatus(httpConnection_t& conn)
+{
+  *(uint8_t*)httpContext(conn, sizeof(uint8_t)) = 0;
+  httpSendReader(conn, 200, "application/json", rolloutReader);
+}
 
+void handleAssetStats(httpConnection_t& conn)
+{
+  String json = "[";
 
+  for(uint8_t i = 0; i < tallyBoxAssetCount(); i++)
+  {
+    assetEntry_t& a = tallyBoxAssetGet(i);
+
+    json += (i > 0) ? ",\n" : "\n";
+    json += "{\"path\":\"" + String(a.path) + "\"";
+    json += ", \"size\":" + String(a.size);
+    json += ", \"requests\":" + String(a.requests);
+    json += ", \"notModified\":" + String(a.notModified);
+    json += ", \"bytesSent\":" + String(a.bytesSent);
+    json += ", \"lastRequestMs\":" + String(a.lastRequestMs) + "}";
+  }
+  json += "\n]";
+  httpSend(conn, 200, "application/json", json);
+}
 
+template <typename T>
+void handleConfigurationImport(httpConnection_t& conn, T& c)
+{
+  /*json document is posted as the request body, parsed in place*/
+  if(tallyBoxImportConfiguration(c, (char*)httpBody(conn)))
+  {
+    tallyBoxScheduleConfigurationWrite(c);
+    httpSend(conn, 200, "text/plain", "Configuration imported. Restart to take the network settings into use.");
+  }
+  else
+  {
+    httpSend(conn, 400, "text/plain", "Configuration import FAILED!");
+  }
+}
 
+/*GET exports, POST imports*/
+#define CONFIG_JSON_HANDLER(name, member) \
+  static void name(httpConnection_t& conn) \
+  { \
+    if(httpMethod(conn) == HTTP_METHOD_POST) \
+    { \
+      handleConfigurationImport(conn, myConf->member); \
+    } \
+    else \
+    { \
+      handleConfigurationExport(conn, myConf->member); \
+    } \
+  }
 
+CONFIG_JSON_HANDLER(handleConfigNetworkJson, network)
+CONFIG_JSON_HANDLER(handleConfigUserJson, user)
+CONFIG_JSON_HANDLER(handleConfigFleetJson, fleet)
 
+void handleFileUpload(httpConnection_t& conn, httpUploadStatus_t status, const char *fileName, const uint8_t *data, size_t len) {
+  /*the upload is written to the file of the connection, the server closes it if the upload breaks*/
+  File& fsUploadFile = httpFile(conn);
 
-
-
-
-
-void handleFileUpload() {
-  if (server.uri() != "/edit") {
-    return;
-  }
-  HTTPUpload& upload = server.upload();
-  if (upload.status == UPLOAD_FILE_START) {
-    String filename = upload.filename;
+  if (status == HTTP_UPLOAD_START) {
+    String filename = fileName;
     if (!filename.startsWith("/")) {
       filename = "/" + filename;
     }
-    DBG_OUTPUT_PORT.print("handleFileUpload Name: "); DBG_OUTPUT_PORT.println(filename);
+    LOG_INFO("handleFileUpload Name: %s", filename);
+    forgetAsset(filename);
     fsUploadFile = filesystem->open(filename, "w");
     filename = String();
-  } else if (upload.status == UPLOAD_FILE_WRITE) {
-    //DBG_OUTPUT_PORT.print("handleFileUpload Data: "); DBG_OUTPUT_PORT.println(upload.currentSize);
+  } else if (status == HTTP_UPLOAD_WRITE) {
     if (fsUploadFile) {
-      fsUploadFile.write(upload.buf, upload.currentSize);
+      fsUploadFile.write(data, len);
     }
-  } else if (upload.status == UPLOAD_FILE_END) {
+  } else if (status == HTTP_UPLOAD_END) {
     if (fsUploadFile) {
+      LOG_INFO("handleFileUpload Size: %u", (unsigned)fsUploadFile.size());
       fsUploadFile.close();
     }
-    DBG_OUTPUT_PORT.print("handleFileUpload Size: "); DBG_OUTPUT_PORT.println(upload.totalSize);
+  } else if (fsUploadFile) {
+    fsUploadFile.close();
   }
 }
-void handleFileDelete() {
-  if (server.args() == 0) {
-    return server.send(500, "text/plain", "BAD ARGS");
+void handleFileDelete(httpConnection_t& conn) {
+  if (httpArgCount(conn) == 0) {
+    return httpSend(conn, 500, "text/plain", "BAD ARGS");
   }
-  String path = server.arg(0);
-  DBG_OUTPUT_PORT.println("handleFileDelete: " + path);
+  String path = httpArgValue(conn, 0);
+  LOG_INFO("handleFileDelete: %s", path);
   if (path == "/") {
-    return server.send(500, "text/plain", "BAD PATH");
+    return httpSend(conn, 500, "text/plain", "BAD PATH");
   }
+  forgetAsset(path);
   if (!filesystem->exists(path)) {
-    return server.send(404, "text/plain", "FileNotFound");
+    return httpSend(conn, 404, "text/plain", "FileNotFound");
   }
   filesystem->remove(path);
-  server.send(200, "text/plain", "");
-  path = String();
+  httpSend(conn, 200, "text/plain", "");
 }
 
+void handleEdit(httpConnection_t& conn) {
+  switch (httpMethod(conn)) {
+    case HTTP_METHOD_GET:
+      if (!handleFileRead(conn, "/edit.htm")) {
+        httpSend(conn, 404, "text/plain", "FileNotFound");
+      }
+      break;
+    case HTTP_METHOD_PUT:
+      handleFileCreate(conn);
+      break;
+    case HTTP_METHOD_DELETE:
+      handleFileDelete(conn);
+      break;
+    default:
+      //the upload itself has been handled by handleFileUpload
+      httpSend(conn, 200, "text/plain", "");
+      break;
+  }
+}
 
-
-
-void tallyBoxWebServerInitialize(tallyBoxConfig_t& c)
+/*firmware and filesystem update, the same form and answers as the ESP8266HTTPUpdateServer had*/
+static const char updatePage[] =
+  "<!DOCTYPE html><html lang='en'><head><meta name='viewport' content='width=device-width,initial-scale=1'/>"
+  "<meta charset='utf-8'></head><body>"
+  "<form method='POST' action='/update?target=firmware' enctype='multipart/form-data'>"
+  "Firmware:<br><input type='file' accept='.bin,.bin.gz' name='firmware'>"
+  "<input type='submit' value='Update Firmware'></form>"
+  "<form method='POST' action='/update?target=filesystem' enctype='multipart/form-data'>"
+  "FileSystem:<br><input type='file' accept='.bin,.bin.gz' name='filesystem'>"
+  "<input type='submit' value='Update FileSystem'></form>"
+  "</body></html>";
+
+static httpConnection_t *updateOwner = NULL;    /*one update at a time*/
+static bool updateBegun = false;                /*the Updater is ours: only then it is ended here*/
+static String updateError;
+
+/*OTA and the rollout use the Updater as well: a running update is never taken over or ended*/
+static void handleUpdateUpload(httpConnection_t& conn, httpUploadStatus_t status, const char *fileName, const uint8_t *data, size_t len)
 {
+  if(status == HTTP_UPLOAD_START)
+  {
+    if((updateOwner == NULL) && !Update.isRunning())
+    {
+      updateOwner = &conn;
+      updateError = String();
+      LOG_INFO("update: %s", fileName);
 
-  if((myIndexHtmBuf = (char*)malloc(MAX_HTML_FILE_SIZE)) == NULL)
+      if(strcmp(httpArg(conn, "target"), "filesystem") == 0)
+      {
+        close_all_fs();
+        updateBegun = Update.begin((size_t)FS_end - (size_t)FS_start, U_FS);
+      }
+      else
+      {
+        updateBegun = Update.begin((ESP.getFreeSketchSpace() - 0x1000) & 0xFFFFF000, U_FLASH);
+      }
+      if(!updateBegun)
+      {
+        updateError = Update.getErrorString();
+      }
+    }
+  }
+  else if(updateOwner != &conn)
   {
-    Serial.println("malloc failed: myIndexHtmBuf");
     return;
   }
-  if((myRestartHtmBuf = (char*)malloc(MAX_HTML_FILE_SIZE)) == NULL)
+  else if(status == HTTP_UPLOAD_WRITE)
   {
-    Serial.println("malloc failed: myRestartHtmBuf");
-    return;
+    if(updateBegun && (updateError.length() == 0) && (Update.write(data, len) != len))
+    {
+      updateError = Update.getErrorString();
+    }
   }
-  if((myConfigNetworkHtmBuf = (char*)malloc(MAX_HTML_FILE_SIZE)) == NULL)
+  else if(status == HTTP_UPLOAD_END)
   {
-    Serial.println("malloc failed: myConfigNetworkHtmBuf");
-    return;
+    if(updateBegun && (updateError.length() == 0) && !Update.end(true))
+    {
+      updateError = Update.getErrorString();
+    }
+    else if(updateBegun && (updateError.length() > 0))
+    {
+      Update.end();       /*an image that is not complete is dropped*/
+    }
+    updateBegun = false;
   }
-  if((myConfigUserHtmBuf = (char*)malloc(MAX_HTML_FILE_SIZE)) == NULL)
+  else
   {
-    Serial.println("malloc failed: myConfigUserHtmBuf");
-    return;
+    if(updateBegun)
+    {
+      Update.end();
+      updateBegun = false;
+    }
+    updateOwner = NULL;
   }
+}
+
+void handleUpdate(httpConnection_t& conn)
+{
+  if(httpMethod(conn) != HTTP_METHOD_POST)
+  {
+    httpSend(conn, 200, "text/html", updatePage);
+  }
+  else if(updateOwner != &conn)
+  {
+    httpSend(conn, 400, "text/plain", "Update FAILED: no image received or another update running");
+  }
+  else
+  {
+    if((updateError.length() == 0))
+    {
+      httpSend(conn, 200, "text/html", "<META http-equiv=\"refresh\" content=\"15;URL=/\">Update Success! Rebooting once the tally is off...");
+      scheduleRestart(true);
+    }
+    else
+    {
+      httpSend(conn, 200, "text/html", "Update error: " + updateError);
+    }
+    updateOwner = NULL;
+  }
+}
+
+void handleNotFound(httpConnection_t& conn) {
+  if (!handleFileRead(conn, httpPath(conn))) {
+    httpSend(conn, 404, "text/plain", "FileNotFound");
+  }
+}
+
+//get heap status, analog input value and all GPIO statuses in one json call
+void handleAll(httpConnection_t& conn) {
+  const httpStats_t& h = tallyBoxGetHttpStats();
+  String json = "{";
+  json += "\"heap\":" + String(ESP.getFreeHeap());
+  json += ", \"analog\":" + String(analogRead(A0));
+  json += ", \"gpio\":" + String((uint32_t)(((GPI | GPO) & 0xFFFF) | ((GP16I & 0x01) << 16)));
+  json += ", \"configWrites\":" + String(tallyBoxGetPersistenceStats().commits);
+  json += ", \"configWritesSaved\":" + String(tallyBoxGetPersistenceStats().mergedRequests);
+  json += ", \"configFlushLatencyMs\":" + String(tallyBoxGetPersistenceStats().worstFlushLatencyMs);
+  json += ", \"pagesServed\":" + String(myPageStats.pagesServed);
+  json += ", \"pageHeapPeak\":" + String(myPageStats.peakHeapUsed);
+  json += ", \"lastPageBytes\":" + String(myPageStats.lastPageBytes);
+  json += ", \"lastPageMs\":" + String(myPageStats.lastPageMs);
+  json += ", \"liveClients\":" + String(tallyBoxLiveClients());
+  json += ", \"liveDropped\":" + String(tallyBoxGetLiveStats().dropped);
+  json += ", \"httpConnections\":" + String(h.connections);
+  json += ", \"httpTimeouts\":" + String(h.timeouts);
+  json += ", \"httpRejected\":" + String(h.rejected);
+  json += ", \"httpWorstUpdateUs\":" + String(h.worstUpdateUs);
+  json += ", \"httpWorstStepUs\":" + String(h.worstStepUs);
+  json += ", \"terminalSessions\":" + String(tallyBoxGetTerminalStats().sessions);
+  json += ", \"terminalDropped\":" + String(tallyBoxGetTerminalStats().dropped);
+  json += ", \"logWritten\":" + String(tallyBoxGetLogStats().written);
+  json += ", \"logSuppressed\":" + String(tallyBoxGetLogStats().suppressed);
+  json += ", \"logOverwritten\":" + String(tallyBoxGetLogStats().overwritten);
+  json += ", \"otaBytesPerSecond\":" + String(OTAGetStats().bytesPerSecond);
+  json += ", \"otaWorstStallUs\":" + String(OTAGetStats().worstStallUs);
+  json += "}";
+  httpSend(conn, 200, "text/json", json);
+}
+
+
+void tallyBoxWebServerInitialize(tallyBoxConfig_t& c)
+{
+  myConf = &c;
 
   Dir dir = filesystem->openDir("/");
-  while (dir.next()) 
+  while (dir.next())
   {
     String fileName = dir.fileName();
     size_t fileSize = dir.fileSize();
@@ -593,123 +1013,71 @@ void tallyBoxWebServerInitialize(tallyBoxConfig_t& c)
   }
   DBG_OUTPUT_PORT.printf("\n");
 
+  tallyBoxAssetsInitialize(*filesystem);
+
   DBG_OUTPUT_PORT.print("Open http://");
   DBG_OUTPUT_PORT.print(c.network.mdnsHostName);
   DBG_OUTPUT_PORT.println(".local/edit to see the file browser");
 
   //SERVER INIT
-  //list directory
-  server.on("/list", HTTP_GET, handleFileList);
+  tallyBoxHttpInitialize(80);
 
+  //list directory
+  tallyBoxHttpOn("/list", HTTP_METHOD_GET, handleFileList);
 
-  server.on("/edit", HTTP_GET, []() {
-    if (!handleFileRead("/edit.htm")) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
-
-  //create file
-  server.on("/edit", HTTP_PUT, handleFileCreate);
-  //delete file
-  server.on("/edit", HTTP_DELETE, handleFileDelete);
-  //first callback is called after the request has ended with all parsed arguments
-  //second callback handles file uploads at that location
-  server.on("/edit", HTTP_POST, []() {
-    server.send(200, "text/plain", "");
-  }, handleFileUpload);
-
-  server.on("/", HTTP_GET, [&]() {
-    if (!handleIndexHtm(c, server, false)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
-
-  server.on("/index.htm", HTTP_GET, [&]() {
-    if (!handleIndexHtm(c, server, false)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  //GET editor, PUT create file, DELETE delete file, POST upload file
+  tallyBoxHttpOn("/edit", HTTP_METHOD_ANY, handleEdit, handleFileUpload);
 
-  server.on("/index.htm", HTTP_POST, [&]() {
-    if (!handleIndexHtm(c, server, true)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  tallyBoxHttpOn("/", HTTP_METHOD_GET, handleIndexPage);
+  tallyBoxHttpOn("/index.htm", HTTP_METHOD_GET, handleIndexPage);
+  tallyBoxHttpOn("/index.htm", HTTP_METHOD_POST, handleIndexPage);
+  tallyBoxHttpOn("/config_user.htm", HTTP_METHOD_GET, handleConfigUserPage);
+  tallyBoxHttpOn("/config_user.htm", HTTP_METHOD_POST, handleConfigUserPage);
+  tallyBoxHttpOn("/config_network.htm", HTTP_METHOD_GET, handleConfigNetworkPage);
+  tallyBoxHttpOn("/config_network.htm", HTTP_METHOD_POST, handleConfigNetworkPage);
+  tallyBoxHttpOn("/restart.htm", HTTP_METHOD_GET, handleRestartPage);
+  tallyBoxHttpOn("/restart.htm", HTTP_METHOD_POST, handleRestartPage);
 
+  tallyBoxHttpOn("/config_network.json", HTTP_METHOD_GET, handleConfigNetworkJson);
+  tallyBoxHttpOn("/config_network.json", HTTP_METHOD_POST, handleConfigNetworkJson);
+  tallyBoxHttpOn("/config_user.json", HTTP_METHOD_GET, handleConfigUserJson);
+  tallyBoxHttpOn("/config_user.json", HTTP_METHOD_POST, handleConfigUserJson);
+  tallyBoxHttpOn("/config_fleet.json", HTTP_METHOD_GET, handleConfigFleetJson);
+  tallyBoxHttpOn("/config_fleet.json", HTTP_METHOD_POST, handleConfigFleetJson);
 
-  server.on("/config_user.htm", HTTP_GET, [&]() {
-    if (!handleConfigUserHtm(c, server, false)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  /*counters for monitoring, Prometheus text format*/
+  tallyBoxHttpOn("/metrics", HTTP_METHOD_GET, handleMetrics);
 
-  server.on("/config_user.htm", HTTP_POST, [&]() {
-    if (!handleConfigUserHtm(c, server, true)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  /*bytes sent and request time of the bundled assets*/
+  tallyBoxHttpOn("/assets.json", HTTP_METHOD_GET, handleAssetStats);
 
-  server.on("/config_network.htm", HTTP_GET, [&]() {
-    if (!handleConfigNetworkHtm(c, server, false)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  /*rollout progress of the fleet profile, meaningful on the master*/
+  tallyBoxHttpOn("/fleet.json", HTTP_METHOD_GET, handleFleetStatus);
 
-  server.on("/config_network.htm", HTTP_POST, [&]() {
-    if (!handleConfigNetworkHtm(c, server, true)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  /*firmware rollout to the other boxes: image upload, start and abort, progress per box*/
+  tallyBoxHttpOn("/rollout", HTTP_METHOD_GET, handleRollout);
+  tallyBoxHttpOn("/rollout", HTTP_METHOD_POST, handleRollout, handleRolloutUpload);
+  tallyBoxHttpOn("/rollout.json", HTTP_METHOD_GET, handleRolloutStatus);
 
-  server.on("/restart.htm", HTTP_GET, [&]() {
-    if (!handleRestartHtm(c, server, false)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  tallyBoxHttpOn("/all", HTTP_METHOD_GET, handleAll);
 
-  server.on("/restart.htm", HTTP_POST, [&]() {
-    if (!handleRestartHtm(c, server, true)) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  /*recent log records as text*/
+  tallyBoxHttpOn("/log", HTTP_METHOD_GET, handleLog);
 
+  /*execution time histograms of the tick*/
+  tallyBoxHttpOn("/profile", HTTP_METHOD_GET, handleProfile);
 
-  server.on("/config_network.json", HTTP_GET, []() {
-    if (!handleFileRead(server.uri())) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
-
-  server.on("/config_network.json", HTTP_POST, []() {
-    if (!handleFileRead(server.uri())) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
+  /*firmware and filesystem images*/
+  tallyBoxHttpOn("/update", HTTP_METHOD_GET, handleUpdate);
+  tallyBoxHttpOn("/update", HTTP_METHOD_POST, handleUpdate, handleUpdateUpload);
 
   //called when the url is not defined here
-  //use it to load content from SPIFFS
-  server.onNotFound([]() {
-    Serial.println("not found, trying from FS");
-    if (!handleFileRead(server.uri())) {
-      server.send(404, "text/plain", "FileNotFound");
-    }
-  });
-
-  //get heap status, analog input value and all GPIO statuses in one json call
-  server.on("/all", HTTP_GET, []() {
-    String json = "{";
-    json += "\"heap\":" + String(ESP.getFreeHeap());
-    json += ", \"analog\":" + String(analogRead(A0));
-    json += ", \"gpio\":" + String((uint32_t)(((GPI | GPO) & 0xFFFF) | ((GP16I & 0x01) << 16)));
-    json += "}";
-    server.send(200, "text/json", json);
-    json = String();
-  });
+  //use it to load content from the filesystem
+  tallyBoxHttpOnNotFound(handleNotFound);
 
+  /*live status and control over a WebSocket*/
+  tallyBoxLiveInitialize(c);
 
-  httpUpdater.setup(&server);
-
-  server.begin();
   DBG_OUTPUT_PORT.println("HTTP server started");
 
   initialized = true;
@@ -722,5 +1090,11 @@ void tallyBoxWebServerUpdate()
       return;
   }
 
-  server.handleClient();
+  tallyBoxHttpUpdate();
+  tallyBoxLiveUpdate();
+
+  if(restartPending && ((int32_t)(millis() - restartAtMs) >= 0) && !(restartWhenOffAir && tallyBoxIsOnAir()))
+  {
+    ESP.restart();
+  }
 }
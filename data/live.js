@@ -0,0 +1,96 @@
+// Live status and control of the TallyBox over the WebSocket at /ws.
+// The page updates in place, the form still works without it.
+(function () {
+  var ws = null;
+  var pending = {};
+  var timer = null;
+  var fields = ['cameraId', 'greenBrightnessPercent', 'redBrightnessPercent'];
+
+  function input(name) {
+    return document.querySelector("input[name='" + name + "']");
+  }
+
+  function show(s) {
+    var tally = document.getElementById('liveTally');
+    var state = document.getElementById('liveState');
+    var text = 'no tally data';
+    var cls = 'invalid';
+
+    if (s.valid) {
+      cls = s.program ? 'program' : (s.preview ? 'preview' : 'idle');
+      text = s.program ? 'PROGRAM' : (s.preview ? 'PREVIEW' : 'not used');
+      if (s.transition) {
+        text += ' (in transition)';
+      }
+    }
+    if (tally) {
+      tally.textContent = text;
+      tally.className = 'tally ' + cls;
+    }
+    if (state) {
+      state.textContent = s.state + (s.identify ? ', identifying' : '') +
+        (s.bsm !== 'none' ? ', showing ' + s.bsm + ' brightness' : '');
+    }
+    fields.forEach(function (name) {
+      var el = input(name);
+      if (el && (name in s) && document.activeElement !== el) {
+        el.value = s[name];
+      }
+    });
+  }
+
+  // the latest value of each field, at most every 100 ms
+  function flush() {
+    timer = null;
+    if (ws && ws.readyState === 1) {
+      for (var name in pending) {
+        ws.send(name + '=' + pending[name]);
+      }
+    }
+    pending = {};
+  }
+
+  function queue(name, value) {
+    pending[name] = value;
+    if (!timer) {
+      timer = setTimeout(flush, 100);
+    }
+  }
+
+  function connect() {
+    ws = new WebSocket('ws://' + location.host + '/ws');
+    ws.onmessage = function (ev) {
+      show(JSON.parse(ev.data));
+    };
+    ws.onclose = function () {
+      var state = document.getElementById('liveState');
+      if (state) {
+        state.textContent = 'disconnected, retrying...';
+      }
+      setTimeout(connect, 2000);
+    };
+  }
+
+  window.addEventListener('load', function () {
+    fields.forEach(function (name) {
+      var el = input(name);
+      if (el) {
+        // camera id on change only, not for every typed digit
+        el.addEventListener(name === 'cameraId' ? 'change' : 'input', function () {
+          if (el.checkValidity()) {
+            queue(name, el.value);
+          }
+        });
+      }
+    });
+    var identify = document.getElementById('identify');
+    if (identify) {
+      identify.addEventListener('click', function () {
+        if (ws && ws.readyState === 1) {
+          ws.send('identify');
+        }
+      });
+    }
+    connect();
+  });
+})();
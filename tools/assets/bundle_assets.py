@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+"""Builds the LittleFS image of the TallyBox from data/.
+
+Static assets are gzip-compressed and listed in assets.idx together with an ETag (CRC32 of the
+uncompressed content), so that the web server can answer them from the index without probing
+the filesystem and answer revalidations with 304. The page templates and the legacy JSON
+configuration files are copied as they are, they are read by the firmware itself.
+
+usage: bundle_assets.py [--data DIR] [--stage DIR] [--image FILE] [--mklittlefs TOOL]
+"""
+
+import argparse
+import gzip
+import os
+import shutil
+import subprocess
+import sys
+import zlib
+
+# read by the firmware, must stay uncompressed
+RAW_FILES = {
+    "index.htm", "config_network.htm", "config_user.htm", "restart.htm",
+    "config_network.json", "config_user.json",
+}
+
+CONTENT_TYPES = {
+    ".htm": "text/html", ".html": "text/html", ".css": "text/css",
+    ".js": "application/javascript", ".json": "application/json",
+    ".png": "image/png", ".gif": "image/gif", ".jpg": "image/jpeg",
+    ".ico": "image/x-icon", ".svg": "image/svg+xml", ".xml": "text/xml",
+}
+
+INDEX_NAME = "assets.idx"
+MAX_ENTRIES = 16          # ASSET_MAX_ENTRIES in TallyBoxAssets.hpp
+MAX_PATH = 31             # ASSET_MAX_PATH - 1
+
+# nodemcu, 4M flash with 2M filesystem, as used for bin/TallyBox.mklittlefs.bin
+IMAGE_SIZE = 0x1FA000
+IMAGE_PAGE = 256
+IMAGE_BLOCK = 8192
+
+
+def content_type(name):
+    return CONTENT_TYPES.get(os.path.splitext(name)[1].lower(), "text/plain")
+
+
+def bundle(data_dir, stage_dir):
+    if os.path.isdir(stage_dir):
+        shutil.rmtree(stage_dir)
+    os.makedirs(stage_dir)
+
+    entries = []
+    for name in sorted(os.listdir(data_dir)):
+        src = os.path.join(data_dir, name)
+        if not os.path.isfile(src) or name == INDEX_NAME:
+            continue
+
+        with open(src, "rb") as f:
+            content = f.read()
+
+        if name in RAW_FILES or name.endswith(".gz"):
+            shutil.copyfile(src, os.path.join(stage_dir, name))
+            continue
+
+        path = "/" + name
+        if len(path) > MAX_PATH:
+            sys.exit("%s: name too long for the asset index" % name)
+
+        # mtime 0 keeps the image reproducible
+        packed = gzip.compress(content, compresslevel=9, mtime=0)
+        with open(os.path.join(stage_dir, name + ".gz"), "wb") as f:
+            f.write(packed)
+
+        etag = "%08x" % (zlib.crc32(content) & 0xFFFFFFFF)
+        entries.append((path, etag, len(packed), content_type(name)))
+        print("%-24s %6u -> %6u bytes  etag %s" % (path, len(content), len(packed), etag))
+
+    if len(entries) > MAX_ENTRIES:
+        sys.exit("%u assets, the index holds %u" % (len(entries), MAX_ENTRIES))
+
+    # one asset per line: path etag compressed-size content-type
+    with open(os.path.join(stage_dir, INDEX_NAME), "w", newline="\n") as f:
+        for e in entries:
+            f.write("%s %s %u %s\n" % e)
+
+
+def build_image(tool, stage_dir, image):
+    cmd = [tool, "-c", stage_dir, "-p", str(IMAGE_PAGE), "-b", str(IMAGE_BLOCK),
+           "-s", str(IMAGE_SIZE), image]
+    print(" ".join(cmd))
+    subprocess.check_call(cmd)
+
+
+def main():
+    root = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", ".."))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--data", default=os.path.join(root, "data"))
+    ap.add_argument("--stage", default=os.path.join(root, "tools", "assets", "stage"))
+    ap.add_argument("--image", default=os.path.join(root, "bin", "TallyBox.mklittlefs.bin"))
+    ap.add_argument("--mklittlefs", default="mklittlefs")
+    args = ap.parse_args()
+
+    bundle(args.data, args.stage)
+
+    if shutil.which(args.mklittlefs):
+        build_image(args.mklittlefs, args.stage, args.image)
+    else:
+        print("%s not found, upload the files in %s instead" % (args.mklittlefs, args.stage))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,219 @@
+/*
+  Power-loss test for the A/B configuration journal (TallyBoxConfigJournal).
+
+  A simulated flash backend cuts the power after every possible number of written bytes of a
+  commit. After each cut the box "reboots" and loads the configuration: the load must return
+  either the previous record or the new one, never garbage and never nothing (once a first
+  commit has succeeded). The next commit after the reboot must succeed as well.
+
+  Two pessimistic write models are used:
+    - truncate: the slot is emptied when it is opened for writing, then filled byte by byte
+    - in place: the old slot content stays behind the bytes written so far
+*/
+#include "Arduino.h"
+#include "TallyBoxConfigJournal.hpp"
+#include "TallyBoxConfigSchema.hpp"
+#include <vector>
+
+typedef enum
+{
+  WRITE_MODEL_TRUNCATE,
+  WRITE_MODEL_IN_PLACE,
+  /************/
+  WRITE_MODEL_MAX
+} writeModel_t;
+
+static const char* writeModelNames[WRITE_MODEL_MAX] = {"truncate", "in place"};
+
+struct PowerCut {};
+
+typedef struct
+{
+  std::vector<uint8_t> slot[CONFIG_JOURNAL_SLOTS];
+  writeModel_t model;
+  long bytesUntilPowerCut;    /*negative = no power cut*/
+  uint32_t bytesWritten;
+  uint32_t bytesRead;
+} simFlash_t;
+
+static uint16_t simReadSlot(void *ctx, configRecordType_t type, uint8_t slot, uint8_t *buf, uint16_t maxLen)
+{
+  simFlash_t *f = (simFlash_t*)ctx;
+  std::vector<uint8_t>& s = f->slot[slot];
+  uint16_t len = 0;
+
+  if((s.size() > 0) && (s.size() <= maxLen))
+  {
+    len = (uint16_t)s.size();
+    memcpy(buf, s.data(), len);
+    f->bytesRead += len;
+  }
+  return len;
+}
+
+static bool simWriteSlot(void *ctx, configRecordType_t type, uint8_t slot, const uint8_t *buf, uint16_t len)
+{
+  simFlash_t *f = (simFlash_t*)ctx;
+  std::vector<uint8_t>& s = f->slot[slot];
+
+  if(f->model == WRITE_MODEL_TRUNCATE)
+  {
+    s.clear();
+  }
+
+  for(uint16_t i = 0; i < len; i++)
+  {
+    if(f->bytesUntilPowerCut == 0)
+    {
+      throw PowerCut();
+    }
+    if(f->bytesUntilPowerCut > 0)
+    {
+      f->bytesUntilPowerCut--;
+    }
+
+    if(i < s.size())
+    {
+      s[i] = buf[i];
+    }
+    else
+    {
+      s.push_back(buf[i]);
+    }
+    f->bytesWritten++;
+  }
+
+  /*the file ends where the write ended*/
+  s.resize(len);
+  return true;
+}
+
+static void makePayload(uint8_t *payload, uint16_t len, uint32_t seed)
+{
+  for(uint16_t i = 0; i < len; i++)
+  {
+    payload[i] = (uint8_t)((seed * 31u) + (i * 7u) + (seed >> 3));
+  }
+}
+
+static bool loadEquals(simFlash_t& flash, const uint8_t *payload, uint16_t len)
+{
+  configJournalBackend_t b = {simReadSlot, simWriteSlot, &flash};
+  configJournalBuffer_t buf;
+  configJournalRecord_t rec;
+
+  return (configJournalLoad(b, CONFIG_RECORD_NETWORK, buf, rec)
+          && (rec.payloadLen == len)
+          && (memcmp(rec.payload, payload, len) == 0));
+}
+
+static bool loadFails(simFlash_t& flash)
+{
+  configJournalBackend_t b = {simReadSlot, simWriteSlot, &flash};
+  configJournalBuffer_t buf;
+  configJournalRecord_t rec;
+
+  return !configJournalLoad(b, CONFIG_RECORD_NETWORK, buf, rec);
+}
+
+int main(int argc, char **argv)
+{
+  /*the records that ship, and the largest one the journal takes (the fleet profile)*/
+  const uint16_t payloadLens[] = {confBinarySize(networkConfigSchema), confBinarySize(userConfigSchema), CONFIG_RECORD_MAX_PAYLOAD_SIZE};
+  const int maxHistory = 4;         /*commits done before the interrupted one*/
+  uint32_t scenarios = 0;
+  uint32_t failures = 0;
+  uint32_t worstCommitIoBytes = 0;
+
+  for(uint8_t s = 0; s < (sizeof(payloadLens) / sizeof(payloadLens[0])); s++)
+  {
+    const uint16_t payloadLen = payloadLens[s];
+
+    for(int m = 0; m < WRITE_MODEL_MAX; m++)
+    {
+      for(int history = 0; history <= maxHistory; history++)
+      {
+        uint8_t payloads[maxHistory + 1][CONFIG_RECORD_MAX_PAYLOAD_SIZE];
+        simFlash_t base;
+        base.model = (writeModel_t)m;
+        base.bytesUntilPowerCut = -1;
+        configJournalBackend_t baseBackend = {simReadSlot, simWriteSlot, &base};
+
+        for(int i = 0; i <= history; i++)
+        {
+          makePayload(payloads[i], payloadLen, i + 1);
+        }
+        for(int i = 0; i < history; i++)
+        {
+          configJournalBuffer_t buf;
+          configJournalCommit(baseBackend, CONFIG_RECORD_NETWORK, 1, payloads[i], payloadLen, buf);
+        }
+
+        uint16_t recordLen = CONFIG_RECORD_HEADER_SIZE + payloadLen + CONFIG_RECORD_FOOTER_SIZE;
+
+        for(long cutAt = 0; cutAt <= recordLen; cutAt++)
+        {
+          simFlash_t flash = base;
+          flash.bytesUntilPowerCut = cutAt;
+          flash.bytesWritten = 0;
+          flash.bytesRead = 0;
+          configJournalBackend_t b = {simReadSlot, simWriteSlot, &flash};
+          configJournalBuffer_t buf;
+          bool interrupted = false;
+
+          scenarios++;
+
+          try
+          {
+            configJournalCommit(b, CONFIG_RECORD_NETWORK, 1, payloads[history], payloadLen, buf);
+          }
+          catch(PowerCut&)
+          {
+            interrupted = true;
+          }
+
+          if(!interrupted)
+          {
+            worstCommitIoBytes = max(worstCommitIoBytes, flash.bytesWritten + flash.bytesRead);
+          }
+
+          /*reboot: old or new record, nothing else*/
+          flash.bytesUntilPowerCut = -1;
+          bool bootOk;
+          if(!interrupted)
+          {
+            bootOk = loadEquals(flash, payloads[history], payloadLen);
+          }
+          else if(history == 0)
+          {
+            bootOk = loadFails(flash) || loadEquals(flash, payloads[history], payloadLen);
+          }
+          else
+          {
+            bootOk = loadEquals(flash, payloads[history - 1], payloadLen) || loadEquals(flash, payloads[history], payloadLen);
+          }
+
+          /*the box must be able to store the configuration again after the reboot*/
+          bool recommitOk = configJournalCommit(b, CONFIG_RECORD_NETWORK, 1, payloads[history], payloadLen, buf)
+                            && loadEquals(flash, payloads[history], payloadLen);
+
+          if(!bootOk || !recommitOk)
+          {
+            failures++;
+            printf("FAIL: %u byte payload, model '%s', history %d, power cut after %ld bytes: boot %s, recommit %s\n",
+                    payloadLen, writeModelNames[m], history, cutAt, (bootOk ? "ok" : "FAILED"), (recommitOk ? "ok" : "FAILED"));
+          }
+        }
+      }
+    }
+  }
+
+  const configJournalStats_t& stats = configJournalGetStats();
+
+  printf("config journal crash test: payloads of %u, %u and %u bytes, %u power cut scenarios, %u failures\n",
+         payloadLens[0], payloadLens[1], payloadLens[2], scenarios, failures);
+  printf("commits: %u ok, %u failed (interrupted commits are not counted)\n", stats.commits, stats.failedCommits);
+  printf("worst-case commit: %u bytes of flash I/O, %u us on this host\n", worstCommitIoBytes, stats.worstCommitTimeUs);
+
+  return (failures == 0 ? 0 : 1);
+}
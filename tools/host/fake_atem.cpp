@@ -0,0 +1,928 @@
+/*
+  A fake ATEM switcher for Linux, and the latency from a cut to the peer frame on the wire.
+
+    fake_atem [--port PORT] [--capture PORT] [--script FILE] [--seed N] [--json FILE]
+
+  It speaks the UDP session protocol of the switcher as far as the master needs it: the
+  hello, the state dump followed by the first ping (the ATEMbase library of the firmware
+  starts to acknowledge only after that), the acknowledgements, the resends of packets
+  that are not acknowledged and the resends the client asks for. The state is the program
+  and preview input and the transition of the first mix effect (PrgI, PrvI, TrPs).
+
+  The script (see defaultScript below for the format) cuts, sets inputs, runs transitions,
+  loses packets in both directions and drops the sessions, as a switcher that restarts. The
+  peer frames of the master are received on the capture port (7493 by default: the frames a
+  master box broadcasts on the network) with kernel timestamps. The latency of a change is
+  the time from the packet that carries it leaving the fake switcher to the first peer frame
+  that shows the new program and preview. A change that is followed by the next one before a
+  frame shows it is counted as superseded, not as a latency.
+*/
+#include "Arduino.h"
+#include "TallyBoxPeerCodec.hpp"
+#include "TallyBoxInfra.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define ATEM_PORT                 9910
+#define ATEM_HEADER_SIZE          12
+#define ATEM_MAX_PACKET           1400
+#define MAX_SESSIONS              8
+#define RESEND_RING               128       /*packets kept per session for resends*/
+#define RESEND_AFTER_MS           200
+#define RESEND_MAX_TRIES          8
+#define SESSION_TIMEOUT_MS        3000      /*nothing from the client*/
+#define PING_PERIOD_MS            500
+#define TRANSITION_FRAME_MS       20        /*TrPs during a transition, 50 fields per second*/
+#define UNSEEN_AFTER_MS           2000      /*a change not seen by then is missed*/
+
+#define ATEM_FLAG_ACK_REQUEST     0x01
+#define ATEM_FLAG_HELLO           0x02
+#define ATEM_FLAG_RESEND          0x04
+#define ATEM_FLAG_REQUEST_NEXT    0x08
+#define ATEM_FLAG_ACK             0x10
+
+/*time in ms from the start, command, arguments. "cuts COUNT PERIOD": a cut every PERIOD ms
+  and half way between two cuts a new preview. "autos COUNT PERIOD DURATION": transitions.
+  "loss PERCENT": of the packets in both directions. "drop MS": the switcher forgets its
+  sessions and stays silent for MS. "end": stop.*/
+static const char *defaultScript =
+  "0      program 1\n"
+  "0      preview 2\n"
+  "500    cuts 12 250\n"
+  "3500   autos 2 1000 500\n"
+  "5500   loss 10\n"
+  "5600   cuts 6 500\n"          /*far enough apart for the resends to show*/
+  "8600   loss 0\n"
+  "9000   drop 1000\n"
+  "13000  cuts 8 250\n"
+  "15500  end\n";
+
+typedef enum
+{
+  STEP_PROGRAM = 0,
+  STEP_PREVIEW,
+  STEP_RANDOM_PREVIEW,
+  STEP_CUT,
+  STEP_AUTO,
+  STEP_LOSS,
+  STEP_DROP,
+  STEP_END
+} stepType_t;
+
+typedef struct
+{
+  uint32_t atMs;
+  stepType_t type;
+  uint32_t arg;
+} step_t;
+
+typedef struct
+{
+  uint16_t id;
+  uint16_t len;
+  uint32_t sentAt;
+  uint8_t tries;
+  bool pending;                       /*waiting for the acknowledgement*/
+  uint8_t buf[ATEM_MAX_PACKET];
+} sentPacket_t;
+
+typedef struct
+{
+  bool used;
+  bool established;                   /*state dump sent*/
+  sockaddr_in client;
+  uint16_t clientSessionId;           /*of the hello*/
+  uint16_t sessionId;                 /*assigned by the switcher*/
+  uint16_t nextId;
+  uint32_t lastHeardAt;
+  uint32_t lastSentAt;
+  sentPacket_t sent[RESEND_RING];
+} session_t;
+
+typedef struct
+{
+  uint16_t program;
+  uint16_t preview;
+  uint64_t sentAtUs;                  /*wall clock, as the capture timestamps*/
+  uint32_t sentAtMs;
+  bool seen;
+  bool superseded;
+  uint32_t latencyUs;
+} change_t;
+
+typedef struct
+{
+  uint32_t sessions;
+  uint32_t sessionTimeouts;
+  uint32_t packetsSent;
+  uint32_t packetsLost;               /*by the script, both directions*/
+  uint32_t resends;
+  uint32_t requestedResends;
+  uint32_t framesCaptured;
+  uint32_t framesBad;
+} atemStats_t;
+
+static int atemFd = -1;
+static int captureFd = -1;
+static session_t sessions[MAX_SESSIONS];
+static uint16_t nextSessionId = 0x8001;
+static std::vector<step_t> script;
+static size_t nextStep = 0;
+static uint32_t startMs = 0;
+static std::mt19937 rng(9910);
+static uint32_t lossPercent = 0;
+static uint32_t silentUntil = 0;
+static bool silent = false;
+
+static uint16_t program = 0;
+static uint16_t preview = 0;
+static bool inTransition = false;
+static uint32_t transitionStart = 0;
+static uint32_t transitionDuration = 0;
+static uint32_t lastTransitionFrame = 0;
+
+static std::vector<change_t> changes;
+static atemStats_t stats;
+
+
+static uint64_t realtimeUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static uint32_t nowMs()
+{
+  return (uint32_t)(millis() - startMs);
+}
+
+static bool lost()
+{
+  bool ret = ((lossPercent > 0) && ((rng() % 100) < lossPercent));
+
+  stats.packetsLost += ret;
+  return ret;
+}
+
+/*** script **************************************************/
+
+static bool parseScript(const char *text)
+{
+  const char *p = text;
+  int lineNo = 0;
+
+  while(*p)
+  {
+    char line[128];
+    size_t n = strcspn(p, "\n");
+    char command[16];
+    unsigned at, a = 0, b = 0, c = 0;
+
+    lineNo++;
+    snprintf(line, sizeof(line), "%.*s", (int)min(n, sizeof(line) - 1), p);
+    p += n + ((p[n] == '\n') ? 1 : 0);
+    line[strcspn(line, "#")] = 0;
+
+    int fields = sscanf(line, "%u %15s %u %u %u", &at, command, &a, &b, &c);
+
+    if(fields <= 0)
+    {
+      continue;
+    }
+    if(fields < 2)
+    {
+      fprintf(stderr, "script line %d: no command\n", lineNo);
+      return false;
+    }
+    if(strcmp(command, "program") == 0)
+    {
+      script.push_back({at, STEP_PROGRAM, a});
+    }
+    else if(strcmp(command, "preview") == 0)
+    {
+      script.push_back({at, STEP_PREVIEW, a});
+    }
+    else if(strcmp(command, "cut") == 0)
+    {
+      script.push_back({at, STEP_CUT, 0});
+    }
+    else if(strcmp(command, "auto") == 0)
+    {
+      script.push_back({at, STEP_AUTO, a});
+    }
+    else if((strcmp(command, "cuts") == 0) && (fields == 4))
+    {
+      for(unsigned i = 0; i < a; i++)
+      {
+        script.push_back({at + i * b, STEP_CUT, 0});
+        script.push_back({at + i * b + b / 2, STEP_RANDOM_PREVIEW, 0});
+      }
+    }
+    else if((strcmp(command, "autos") == 0) && (fields == 5))
+    {
+      for(unsigned i = 0; i < a; i++)
+      {
+        script.push_back({at + i * b, STEP_AUTO, c});
+        script.push_back({at + i * b + c + (b - c) / 2, STEP_RANDOM_PREVIEW, 0});
+      }
+    }
+    else if(strcmp(command, "loss") == 0)
+    {
+      script.push_back({at, STEP_LOSS, a});
+    }
+    else if(strcmp(command, "drop") == 0)
+    {
+      script.push_back({at, STEP_DROP, a});
+    }
+    else if(strcmp(command, "end") == 0)
+    {
+      script.push_back({at, STEP_END, 0});
+    }
+    else
+    {
+      fprintf(stderr, "script line %d: unknown command '%s'\n", lineNo, command);
+      return false;
+    }
+  }
+  std::stable_sort(script.begin(), script.end(), [](const step_t& x, const step_t& y) { return x.atMs < y.atMs; });
+  return true;
+}
+
+/*** packets *************************************************/
+
+static void putHeader(uint8_t *buf, uint8_t flags, uint16_t len, uint16_t sessionId, uint16_t ackId, uint16_t packetId)
+{
+  uint8_t *p = buf;
+
+  putU16(&p, (uint16_t)((flags << 11) | len));
+  putU16(&p, sessionId);
+  putU16(&p, ackId);
+  putU16(&p, 0);
+  putU16(&p, 0);
+  putU16(&p, packetId);
+}
+
+static void putCommand(uint8_t **p, const char *name, const uint8_t *data, uint16_t len)
+{
+  putU16(p, (uint16_t)(8 + len));
+  putU16(p, 0);
+  putBytes(p, (const uint8_t*)name, 4);
+  putBytes(p, data, len);
+}
+
+static void putProgram(uint8_t **p)
+{
+  uint8_t d[4] = {0, 0, (uint8_t)(program >> 8), (uint8_t)program};
+
+  putCommand(p, "PrgI", d, sizeof(d));
+}
+
+static void putPreview(uint8_t **p)
+{
+  uint8_t d[8] = {0, 0, (uint8_t)(preview >> 8), (uint8_t)preview, 0, 0, 0, 0};
+
+  putCommand(p, "PrvI", d, sizeof(d));
+}
+
+static void putTransition(uint8_t **p, uint16_t position)
+{
+  uint8_t framesRemaining = inTransition ? (uint8_t)((transitionDuration - min(transitionDuration, nowMs() - transitionStart)) / TRANSITION_FRAME_MS) : 0;
+  uint8_t d[8] = {0, (uint8_t)inTransition, framesRemaining, 0, (uint8_t)(position >> 8), (uint8_t)position, 0, 0};
+
+  putCommand(p, "TrPs", d, sizeof(d));
+}
+
+static void sendRaw(const session_t& s, const uint8_t *buf, uint16_t len)
+{
+  stats.packetsSent++;
+  if(!lost())
+  {
+    sendto(atemFd, buf, len, 0, (const sockaddr*)&s.client, sizeof(s.client));
+  }
+}
+
+/*payload of commands as a packet that asks for an acknowledgement, kept for resends*/
+static void sendReliable(session_t& s, const uint8_t *payload, uint16_t payloadLen)
+{
+  uint16_t id = s.nextId;
+  sentPacket_t& sp = s.sent[id % RESEND_RING];
+
+  s.nextId = (uint16_t)((s.nextId + 1) & 0x7FFF);
+  sp.id = id;
+  sp.len = (uint16_t)(ATEM_HEADER_SIZE + payloadLen);
+  sp.sentAt = nowMs();
+  sp.tries = 1;
+  sp.pending = true;
+  putHeader(sp.buf, ATEM_FLAG_ACK_REQUEST, sp.len, s.sessionId, 0, id);
+  memcpy(sp.buf + ATEM_HEADER_SIZE, payload, payloadLen);
+  s.lastSentAt = sp.sentAt;
+  sendRaw(s, sp.buf, sp.len);
+}
+
+static void resend(session_t& s, sentPacket_t& sp)
+{
+  uint8_t *p = sp.buf;
+
+  putU16(&p, (uint16_t)(((ATEM_FLAG_ACK_REQUEST | ATEM_FLAG_RESEND) << 11) | sp.len));
+  sp.sentAt = nowMs();
+  sp.tries++;
+  stats.resends++;
+  sendRaw(s, sp.buf, sp.len);
+}
+
+/*the same commands go to every client. Returns the time the first copy left*/
+static uint64_t broadcastState(bool withProgram, bool withPreview, bool withTransition, uint16_t position)
+{
+  uint8_t payload[64];
+  uint8_t *p = payload;
+  uint64_t sentAtUs = realtimeUs();
+
+  if(withProgram)
+  {
+    putProgram(&p);
+  }
+  if(withPreview)
+  {
+    putPreview(&p);
+  }
+  if(withTransition)
+  {
+    putTransition(&p, position);
+  }
+  for(int i = 0; i < MAX_SESSIONS; i++)
+  {
+    if(sessions[i].used && sessions[i].established)
+    {
+      sendReliable(sessions[i], payload, (uint16_t)(p - payload));
+    }
+  }
+  return sentAtUs;
+}
+
+static void sendStateDump(session_t& s)
+{
+  static const uint8_t version[4] = {0x00, 0x02, 0x00, 0x1C};
+  uint8_t product[44] = {};
+  uint8_t payload[ATEM_MAX_PACKET];
+  uint8_t *p = payload;
+
+  strcpy((char*)product, "Fake ATEM");
+  putCommand(&p, "_ver", version, sizeof(version));
+  putCommand(&p, "_pin", product, sizeof(product));
+  sendReliable(s, payload, (uint16_t)(p - payload));
+
+  p = payload;
+  putProgram(&p);
+  putPreview(&p);
+  putTransition(&p, 0);
+  sendReliable(s, payload, (uint16_t)(p - payload));
+
+  static const uint8_t complete[4] = {0x01, 0, 0, 0};
+
+  p = payload;
+  putCommand(&p, "InCm", complete, sizeof(complete));
+  sendReliable(s, payload, (uint16_t)(p - payload));
+
+  /*the first empty packet after the dump: from here on the library acknowledges*/
+  sendReliable(s, NULL, 0);
+  s.established = true;
+}
+
+/*** changes and their latency *******************************/
+
+static void recordChange(uint64_t sentAtUs)
+{
+  bool anySession = false;
+
+  for(int i = 0; i < MAX_SESSIONS; i++)
+  {
+    anySession |= (sessions[i].used && sessions[i].established);
+  }
+  if(!anySession)
+  {
+    return;     /*nobody to tell*/
+  }
+  if(!changes.empty() && !changes.back().seen)
+  {
+    changes.back().superseded = true;
+  }
+  changes.push_back({program, preview, sentAtUs, nowMs(), false, false, 0});
+}
+
+static void setProgram(uint16_t source)
+{
+  if(source != program)
+  {
+    program = source;
+    recordChange(broadcastState(true, false, false, 0));
+  }
+}
+
+static void setPreview(uint16_t source)
+{
+  if(source != preview)
+  {
+    preview = source;
+    recordChange(broadcastState(false, true, false, 0));
+  }
+}
+
+static void cut()
+{
+  std::swap(program, preview);
+  recordChange(broadcastState(true, true, false, 0));
+}
+
+static void transitionUpdate()
+{
+  uint32_t now = nowMs();
+
+  if(!inTransition || ((now - lastTransitionFrame) < TRANSITION_FRAME_MS))
+  {
+    return;
+  }
+  lastTransitionFrame = now;
+  if((now - transitionStart) >= transitionDuration)
+  {
+    inTransition = false;
+    std::swap(program, preview);
+    recordChange(broadcastState(true, true, true, 0));
+  }
+  else
+  {
+    broadcastState(false, false, true, (uint16_t)((uint64_t)(now - transitionStart) * 10000 / transitionDuration));
+  }
+}
+
+static void runScript()
+{
+  while((nextStep < script.size()) && (script[nextStep].atMs <= nowMs()))
+  {
+    const step_t& s = script[nextStep++];
+
+    switch(s.type)
+    {
+      case STEP_PROGRAM:
+        setProgram((uint16_t)s.arg);
+        break;
+      case STEP_PREVIEW:
+        setPreview((uint16_t)s.arg);
+        break;
+      case STEP_RANDOM_PREVIEW:
+      {
+        uint16_t source;
+
+        do
+        {
+          source = (uint16_t)(1 + rng() % 8);
+        } while((source == program) || (source == preview));
+        setPreview(source);
+        break;
+      }
+      case STEP_CUT:
+        if(!inTransition)
+        {
+          cut();
+        }
+        break;
+      case STEP_AUTO:
+        inTransition = true;
+        transitionStart = nowMs();
+        transitionDuration = max((uint32_t)TRANSITION_FRAME_MS, s.arg);
+        lastTransitionFrame = transitionStart;
+        broadcastState(false, false, true, 0);
+        break;
+      case STEP_LOSS:
+        lossPercent = min((uint32_t)100, s.arg);
+        printf("%6u ms  loss %u%%\n", nowMs(), lossPercent);
+        break;
+      case STEP_DROP:
+        printf("%6u ms  sessions dropped, silent for %u ms\n", nowMs(), s.arg);
+        memset(sessions, 0, sizeof(sessions));
+        silent = true;
+        silentUntil = nowMs() + s.arg;
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+/*** sessions ************************************************/
+
+static session_t* findSession(const sockaddr_in& from)
+{
+  for(int i = 0; i < MAX_SESSIONS; i++)
+  {
+    if(sessions[i].used && (sessions[i].client.sin_addr.s_addr == from.sin_addr.s_addr) && (sessions[i].client.sin_port == from.sin_port))
+    {
+      return &sessions[i];
+    }
+  }
+  return NULL;
+}
+
+static void handleHello(const sockaddr_in& from, uint16_t clientSessionId)
+{
+  session_t *s = findSession(from);
+  uint8_t answer[20] = {};
+
+  for(int i = 0; (s == NULL) && (i < MAX_SESSIONS); i++)
+  {
+    if(!sessions[i].used)
+    {
+      s = &sessions[i];
+    }
+  }
+  putHeader(answer, ATEM_FLAG_HELLO, sizeof(answer), clientSessionId, 0, 0);
+  if(s == NULL)
+  {
+    session_t full = {};
+
+    full.client = from;
+    answer[ATEM_HEADER_SIZE] = 0x03;    /*no room for another client*/
+    sendRaw(full, answer, sizeof(answer));
+    return;
+  }
+
+  memset(s, 0, sizeof(session_t));
+  s->used = true;
+  s->client = from;
+  s->clientSessionId = clientSessionId;
+  s->sessionId = nextSessionId;
+  s->nextId = 1;
+  s->lastHeardAt = nowMs();
+  nextSessionId = (uint16_t)(0x8000 | ((nextSessionId + 1) & 0x7FFF));
+  stats.sessions++;
+
+  answer[ATEM_HEADER_SIZE] = 0x02;      /*accepted*/
+  sendRaw(*s, answer, sizeof(answer));
+  printf("%6u ms  session %04X for %s:%u\n", nowMs(), s->sessionId, inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+}
+
+static void atemReceive()
+{
+  uint8_t buf[ATEM_MAX_PACKET];
+  sockaddr_in from;
+  socklen_t fromLen = sizeof(from);
+  ssize_t len;
+
+  while((len = recvfrom(atemFd, buf, sizeof(buf), MSG_DONTWAIT, (sockaddr*)&from, &fromLen)) >= 0)
+  {
+    fromLen = sizeof(from);
+    if(silent || (len < ATEM_HEADER_SIZE) || lost())
+    {
+      continue;
+    }
+
+    uint8_t *p = buf;
+    uint16_t word = getU16(&p);
+    uint8_t flags = (uint8_t)(word >> 11);
+    uint16_t sessionId = getU16(&p);
+    uint16_t ackId = getU16(&p);
+    uint16_t resendFrom = getU16(&p);
+    session_t *s;
+
+    if(flags & ATEM_FLAG_HELLO)
+    {
+      handleHello(from, sessionId);
+      continue;
+    }
+    if((s = findSession(from)) == NULL)
+    {
+      continue;
+    }
+    s->lastHeardAt = nowMs();
+    if(!s->established)
+    {
+      sendStateDump(*s);    /*the client acknowledged the hello*/
+    }
+    if(flags & ATEM_FLAG_ACK)
+    {
+      sentPacket_t& sp = s->sent[ackId % RESEND_RING];
+
+      if(sp.id == ackId)
+      {
+        sp.pending = false;
+      }
+    }
+    if(flags & ATEM_FLAG_REQUEST_NEXT)
+    {
+      for(uint16_t id = (uint16_t)((resendFrom + 1) & 0x7FFF); id != s->nextId; id = (uint16_t)((id + 1) & 0x7FFF))
+      {
+        sentPacket_t& sp = s->sent[id % RESEND_RING];
+
+        if(sp.id == id)
+        {
+          stats.requestedResends++;
+          resend(*s, sp);
+        }
+      }
+    }
+  }
+}
+
+static void sessionsUpdate()
+{
+  uint32_t now = nowMs();
+
+  if(silent && ((int32_t)(now - silentUntil) >= 0))
+  {
+    silent = false;
+    printf("%6u ms  switcher back\n", now);
+  }
+  for(int i = 0; i < MAX_SESSIONS; i++)
+  {
+    session_t& s = sessions[i];
+
+    if(!s.used)
+    {
+      continue;
+    }
+    if((now - s.lastHeardAt) >= SESSION_TIMEOUT_MS)
+    {
+      printf("%6u ms  session %04X timed out\n", now, s.sessionId);
+      stats.sessionTimeouts++;
+      s.used = false;
+      continue;
+    }
+    for(int k = 0; k < RESEND_RING; k++)
+    {
+      sentPacket_t& sp = s.sent[k];
+
+      if(sp.pending && ((now - sp.sentAt) >= RESEND_AFTER_MS))
+      {
+        if(sp.tries >= RESEND_MAX_TRIES)
+        {
+          sp.pending = false;
+        }
+        else
+        {
+          resend(s, sp);
+        }
+      }
+    }
+    if(s.established && ((now - s.lastSentAt) >= PING_PERIOD_MS))
+    {
+      sendReliable(s, NULL, 0);
+    }
+  }
+}
+
+/*** capture of the peer frames ******************************/
+
+static void captureReceive()
+{
+  uint8_t buf[PEERNETWORK_MAX_MESSAGE_SIZE];
+  char control[64];
+
+  for(;;)
+  {
+    iovec iov = {buf, sizeof(buf)};
+    msghdr msg = {};
+    uint64_t receivedAtUs = 0;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t len = recvmsg(captureFd, &msg, MSG_DONTWAIT);
+
+    if(len < 0)
+    {
+      break;
+    }
+    for(cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c))
+    {
+      if((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPNS))
+      {
+        timespec ts;
+
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        receivedAtUs = ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+      }
+    }
+
+    uint16_t messageId;
+    uint16_t tick;
+    uint8_t *payload;
+    uint16_t payloadLen;
+    peerTally_t t;
+
+    if((peerNetworkDeSerialize(buf, (uint16_t)len, messageId, tick, payload, payloadLen) != PEER_FRAME_OK)
+       || (messageId != PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16) || !peerTallyDecode(payload, payloadLen, t))
+    {
+      stats.framesBad++;
+      continue;
+    }
+    stats.framesCaptured++;
+
+    /*only the latest change can still be seen, the earlier ones are seen or superseded*/
+    if(!changes.empty())
+    {
+      change_t& c = changes.back();
+
+      if(!c.seen && (t.redChannel == c.program) && (t.greenChannel == c.preview))
+      {
+        c.seen = true;
+        c.latencyUs = (uint32_t)(((receivedAtUs != 0) ? receivedAtUs : realtimeUs()) - c.sentAtUs);
+      }
+    }
+  }
+}
+
+/*************************************************************/
+
+static uint32_t percentile(const std::vector<uint32_t>& v, double p)
+{
+  return v.empty() ? 0 : v[min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void report(const char *jsonPath)
+{
+  std::vector<uint32_t> latencies;
+  uint32_t superseded = 0;
+  uint32_t missed = 0;
+  static const uint32_t bucketsMs[] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000};
+  uint32_t histogram[sizeof(bucketsMs) / sizeof(bucketsMs[0]) + 1] = {};
+
+  for(size_t i = 0; i < changes.size(); i++)
+  {
+    if(changes[i].seen)
+    {
+      size_t b = 0;
+
+      latencies.push_back(changes[i].latencyUs);
+      while((b < (sizeof(bucketsMs) / sizeof(bucketsMs[0]))) && (changes[i].latencyUs >= bucketsMs[b] * 1000))
+      {
+        b++;
+      }
+      histogram[b]++;
+    }
+    else if(changes[i].superseded)
+    {
+      superseded++;
+    }
+    else
+    {
+      missed++;
+    }
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  printf("\n%u sessions (%u timed out), %u packets sent, %u lost by the script, %u resent (%u asked for)\n", stats.sessions,
+         stats.sessionTimeouts, stats.packetsSent, stats.packetsLost, stats.resends, stats.requestedResends);
+  printf("%u peer frames captured, %u not tally frames\n", stats.framesCaptured, stats.framesBad);
+  printf("%zu changes: %zu seen, %u superseded, %u missed\n", changes.size(), latencies.size(), superseded, missed);
+  printf("cut to peer frame on the wire: min %u us  p50 %u us  p90 %u us  p99 %u us  max %u us\n",
+         percentile(latencies, 0.0), percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99),
+         percentile(latencies, 1.0));
+  for(size_t b = 0; b <= (sizeof(bucketsMs) / sizeof(bucketsMs[0])); b++)
+  {
+    if(b < (sizeof(bucketsMs) / sizeof(bucketsMs[0])))
+    {
+      printf("  < %4u ms  %5u\n", bucketsMs[b], histogram[b]);
+    }
+    else
+    {
+      printf("  >=%4u ms  %5u\n", bucketsMs[b - 1], histogram[b]);
+    }
+  }
+
+  if(jsonPath != NULL)
+  {
+    FILE *f = fopen(jsonPath, "w");
+
+    if(f != NULL)
+    {
+      fprintf(f, "{\"changes\": %zu, \"seen\": %zu, \"superseded\": %u, \"missed\": %u, \"sessions\": %u, \"resends\": %u,\n"
+                 " \"latencyUs\": {\"min\": %u, \"p50\": %u, \"p90\": %u, \"p99\": %u, \"max\": %u}}\n",
+              changes.size(), latencies.size(), superseded, missed, stats.sessions, stats.resends, percentile(latencies, 0.0),
+              percentile(latencies, 0.5), percentile(latencies, 0.9), percentile(latencies, 0.99), percentile(latencies, 1.0));
+      fclose(f);
+    }
+  }
+}
+
+static bool openSocket(int& fd, uint16_t port, bool timestamps)
+{
+  sockaddr_in a = {};
+  int on = 1;
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  a.sin_family = AF_INET;
+  a.sin_port = htons(port);
+  a.sin_addr.s_addr = htonl(INADDR_ANY);
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+  if(timestamps)
+  {
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+  }
+  return ((fd >= 0) && (bind(fd, (sockaddr*)&a, sizeof(a)) == 0));
+}
+
+static std::string readFile(const char *path)
+{
+  std::string s;
+  FILE *f = fopen(path, "r");
+  char buf[512];
+  size_t n;
+
+  while((f != NULL) && ((n = fread(buf, 1, sizeof(buf), f)) > 0))
+  {
+    s.append(buf, n);
+  }
+  if(f != NULL)
+  {
+    fclose(f);
+  }
+  return s;
+}
+
+int main(int argc, char **argv)
+{
+  uint16_t port = ATEM_PORT;
+  uint16_t capturePort = PEERNETWORK_PORT;
+  std::string scriptText = defaultScript;
+  const char *jsonPath = NULL;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if((strcmp(argv[i], "--port") == 0) && ((i + 1) < argc))
+    {
+      port = (uint16_t)atoi(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--capture") == 0) && ((i + 1) < argc))
+    {
+      capturePort = (uint16_t)atoi(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--script") == 0) && ((i + 1) < argc))
+    {
+      scriptText = readFile(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--seed") == 0) && ((i + 1) < argc))
+    {
+      rng.seed((uint32_t)atoi(argv[++i]));
+    }
+    else if((strcmp(argv[i], "--json") == 0) && ((i + 1) < argc))
+    {
+      jsonPath = argv[++i];
+    }
+    else
+    {
+      fprintf(stderr, "usage: fake_atem [--port PORT] [--capture PORT] [--script FILE] [--seed N] [--json FILE]\n");
+      return 2;
+    }
+  }
+
+  if(!parseScript(scriptText.c_str()) || script.empty())
+  {
+    fprintf(stderr, "no script\n");
+    return 2;
+  }
+  if(!openSocket(atemFd, port, false) || !openSocket(captureFd, capturePort, true))
+  {
+    fprintf(stderr, "cannot bind the ports %u and %u: %s\n", port, capturePort, strerror(errno));
+    return 1;
+  }
+  printf("fake ATEM on port %u, peer frames captured on port %u\n", port, capturePort);
+  fflush(stdout);
+
+  startMs = millis();
+  while((nextStep < script.size()) && (script[nextStep].type != STEP_END || script[nextStep].atMs > nowMs()))
+  {
+    pollfd fds[2] = {{atemFd, POLLIN, 0}, {captureFd, POLLIN, 0}};
+
+    poll(fds, 2, 1);
+    atemReceive();
+    captureReceive();
+    sessionsUpdate();
+    runScript();
+    transitionUpdate();
+    fflush(stdout);
+  }
+
+  /*a last look for the frames of the latest change*/
+  for(int i = 0; i < 100; i++)
+  {
+    captureReceive();
+    delay(1);
+  }
+  if(!changes.empty() && !changes.back().seen && ((nowMs() - changes.back().sentAtMs) < UNSEEN_AFTER_MS))
+  {
+    changes.back().superseded = true;   /*too late to tell*/
+  }
+  report(jsonPath);
+  return 0;
+}
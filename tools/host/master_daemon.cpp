@@ -0,0 +1,788 @@
+/*
+  TallyBox master on a Linux host.
+
+  Takes the tally of one or more studios, each from an ATEM switcher (UDP 9910) or from a
+  scripted source, and sends the peer network tally frames to the boxes of the studio. The
+  frames are built with the firmware's own codec (TallyBoxPeerCodec). Like the master box, the
+  daemon sends the tally to every box once per 10 ms tick; a change is sent at once, without
+  waiting for the tick. All boxes of a studio get the same frame in batched sendmmsg() calls.
+
+    master_daemon --studio NAME SOURCE TARGETS [--studio ...] [--bench SECONDS]
+
+    SOURCE   atem:HOST[:PORT]   an ATEM switcher, or a stand-in such as fake_atem
+             script:PERIOD_MS  cuts between random cameras every PERIOD_MS
+    TARGETS  ADDRESS[:PORT],...  boxes or a broadcast address (default port 7493)
+             @FILE               one ADDRESS[:PORT] per line
+
+  --bench SECONDS runs for that time and reports the send rate, the CPU use and the latency
+  from a tally change to the frames handed to the network. The latency starts when the ATEM
+  packet arrived at the socket (kernel timestamp) or when the script made the cut. Without
+  --studio, --bench creates --bench-studios studios of --bench-boxes boxes each, with scripted
+  cuts every --cut-ms, and sends to a local sink that checks every frame it receives.
+*/
+#include "Arduino.h"
+#include "TallyBoxPeerCodec.hpp"
+#include "TallyBoxInfra.hpp"
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <random>
+#include <signal.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <netdb.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+
+#define TICK_US                   10000
+#define SEND_BATCH                256       /*messages per sendmmsg()*/
+#define SINK_BATCH                256
+#define ATEM_PORT                 9910
+#define ATEM_HEADER_SIZE          12
+#define ATEM_MAX_PACKET           1500
+#define ATEM_TIMEOUT_MS           3000      /*nothing received: connect again*/
+#define ATEM_HELLO_RETRY_MS       1000
+#define REPORT_PERIOD_MS          10000     /*statistics without --bench*/
+
+/*header flags of the ATEM protocol, upper 5 bits of the first byte*/
+#define ATEM_FLAG_ACK_REQUEST     0x01
+#define ATEM_FLAG_HELLO           0x02
+#define ATEM_FLAG_RESEND          0x04
+#define ATEM_FLAG_REQUEST_NEXT    0x08
+#define ATEM_FLAG_ACK             0x10
+
+typedef enum
+{
+  SOURCE_ATEM = 0,
+  SOURCE_SCRIPT
+} sourceType_t;
+
+typedef struct
+{
+  int fd;
+  sockaddr_in address;
+  bool connected;
+  uint16_t sessionId;
+  uint32_t lastReceivedAt;
+  uint32_t helloSentAt;
+  uint32_t reconnects;
+} atemSession_t;
+
+typedef struct
+{
+  std::string name;
+  sourceType_t sourceType;
+  atemSession_t atem;
+  uint32_t cutPeriodMs;
+  uint32_t nextCutAt;
+  peerTally_t tally;
+  std::vector<sockaddr_in> targets;
+  std::vector<mmsghdr> messages;    /*one per target, all pointing at the same frame*/
+  iovec frame;
+  uint8_t frameBuf[PEERNETWORK_MAX_MESSAGE_SIZE];
+  uint64_t changes;
+  uint64_t framesSent;
+  uint64_t sendErrors;
+} studio_t;
+
+typedef struct
+{
+  uint64_t sendCalls;
+  uint64_t framesSent;
+  uint64_t bytesSent;
+  uint64_t sinkFrames;
+  uint64_t sinkBadFrames;
+  std::vector<uint32_t> firstBoxUs;   /*change -> first batch handed to the kernel*/
+  std::vector<uint32_t> lastBoxUs;    /*change -> frames for every box of the studio handed over*/
+} daemonStats_t;
+
+static volatile sig_atomic_t running = 1;
+static int sendFd = -1;
+static int sinkFd = -1;
+static std::vector<studio_t*> studios;
+static daemonStats_t stats;
+static std::mt19937 rng(9910);
+
+
+static uint64_t monotonicUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+/*wall clock: comparable with the kernel receive timestamps*/
+static uint64_t realtimeUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static void onSignal(int)
+{
+  running = 0;
+}
+
+static bool parseAddress(const std::string& text, uint16_t defaultPort, sockaddr_in& out)
+{
+  std::string host = text;
+  uint16_t port = defaultPort;
+  size_t colon = text.find(':');
+  addrinfo hints = {};
+  addrinfo *result = NULL;
+
+  if(colon != std::string::npos)
+  {
+    host = text.substr(0, colon);
+    port = (uint16_t)atoi(text.c_str() + colon + 1);
+  }
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_DGRAM;
+  if(getaddrinfo(host.c_str(), NULL, &hints, &result) != 0)
+  {
+    return false;
+  }
+  out = *(sockaddr_in*)result->ai_addr;
+  out.sin_port = htons(port);
+  freeaddrinfo(result);
+  return true;
+}
+
+static bool parseTargets(const std::string& text, std::vector<sockaddr_in>& targets)
+{
+  std::vector<std::string> items;
+
+  if(!text.empty() && (text[0] == '@'))
+  {
+    FILE *f = fopen(text.c_str() + 1, "r");
+    char line[128];
+
+    if(f == NULL)
+    {
+      return false;
+    }
+    while(fgets(line, sizeof(line), f))
+    {
+      line[strcspn(line, "\r\n#")] = 0;
+      if(line[0] != 0)
+      {
+        items.push_back(line);
+      }
+    }
+    fclose(f);
+  }
+  else
+  {
+    size_t start = 0;
+
+    while(start <= text.size())
+    {
+      size_t comma = text.find(',', start);
+
+      if(comma == std::string::npos)
+      {
+        comma = text.size();
+      }
+      if(comma > start)
+      {
+        items.push_back(text.substr(start, comma - start));
+      }
+      start = comma + 1;
+    }
+  }
+
+  for(size_t i = 0; i < items.size(); i++)
+  {
+    sockaddr_in a;
+
+    if(!parseAddress(items[i], PEERNETWORK_PORT, a))
+    {
+      fprintf(stderr, "bad target '%s'\n", items[i].c_str());
+      return false;
+    }
+    targets.push_back(a);
+  }
+  return !targets.empty();
+}
+
+/*** peer frames *********************************************/
+
+static void prepareMessages(studio_t& s)
+{
+  s.frame.iov_base = s.frameBuf;
+  s.frame.iov_len = 0;
+  s.messages.resize(s.targets.size());
+  for(size_t i = 0; i < s.targets.size(); i++)
+  {
+    memset(&s.messages[i], 0, sizeof(mmsghdr));
+    s.messages[i].msg_hdr.msg_name = &s.targets[i];
+    s.messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+    s.messages[i].msg_hdr.msg_iov = &s.frame;
+    s.messages[i].msg_hdr.msg_iovlen = 1;
+  }
+}
+
+/*one frame for the whole studio, sent to every box in batches. changedAtUs != 0: the frame
+  carries a change, the latency is recorded*/
+static void sendTally(studio_t& s, uint64_t changedAtUs)
+{
+  uint8_t payload[PEERNETWORK_TALLY_PAYLOAD_SIZE];
+  size_t sent = 0;
+
+  peerTallyEncode(s.tally, payload);
+  s.frame.iov_len = peerNetworkSerialize(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, getCurrentTick(), payload, sizeof(payload),
+                                         s.frameBuf, sizeof(s.frameBuf));
+
+  while(sent < s.messages.size())
+  {
+    unsigned batch = (unsigned)min((size_t)SEND_BATCH, s.messages.size() - sent);
+    int n = sendmmsg(sendFd, &s.messages[sent], batch, 0);
+
+    stats.sendCalls++;
+    if(n <= 0)
+    {
+      /*a full socket buffer drops the rest of this round, the next tick sends again*/
+      s.sendErrors += (s.messages.size() - sent);
+      break;
+    }
+    if((changedAtUs != 0) && (sent == 0))
+    {
+      stats.firstBoxUs.push_back((uint32_t)(realtimeUs() - changedAtUs));
+    }
+    sent += n;
+  }
+  if((changedAtUs != 0) && (sent == s.messages.size()))
+  {
+    stats.lastBoxUs.push_back((uint32_t)(realtimeUs() - changedAtUs));
+  }
+  s.framesSent += sent;
+  stats.framesSent += sent;
+  stats.bytesSent += sent * s.frame.iov_len;
+}
+
+/*** ATEM client *********************************************/
+
+static void atemSendHeader(atemSession_t& a, uint8_t flags, uint16_t ackId, const uint8_t *payload, uint16_t payloadLen)
+{
+  uint8_t buf[ATEM_HEADER_SIZE + 8];
+  uint8_t *p = buf;
+  uint16_t len = ATEM_HEADER_SIZE + payloadLen;
+
+  putU16(&p, (uint16_t)((flags << 11) | len));
+  putU16(&p, a.sessionId);
+  putU16(&p, ackId);
+  putU16(&p, 0);
+  putU16(&p, 0);
+  putU16(&p, 0);    /*own packet id: only acknowledgements are sent, they are not numbered*/
+  putBytes(&p, payload, payloadLen);
+  sendto(a.fd, buf, len, 0, (sockaddr*)&a.address, sizeof(a.address));
+}
+
+static void atemHello(atemSession_t& a, uint32_t nowMs)
+{
+  static const uint8_t hello[8] = {0x01, 0, 0, 0, 0, 0, 0, 0};
+
+  a.connected = false;
+  a.sessionId = (uint16_t)(0x1000 + (rng() & 0x0FFF));
+  a.helloSentAt = nowMs;
+  atemSendHeader(a, ATEM_FLAG_HELLO, 0, hello, sizeof(hello));
+}
+
+static bool atemOpen(atemSession_t& a, const std::string& host)
+{
+  a.fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  int on = 1;
+
+  if((a.fd < 0) || !parseAddress(host, ATEM_PORT, a.address))
+  {
+    return false;
+  }
+  setsockopt(a.fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+  atemHello(a, millis());
+  return true;
+}
+
+/*the commands of the packet that carry the tally of mix effect 1, returns true on a change*/
+static bool atemParseCommands(studio_t& s, uint8_t *p, uint16_t len)
+{
+  bool changed = false;
+  uint8_t *end = p + len;
+
+  while((end - p) >= 8)
+  {
+    uint8_t *cmd = p;
+    uint16_t cmdLen = getU16(&cmd);
+    const char *name = (const char*)(p + 4);
+    uint8_t *data = p + 8;
+
+    if((cmdLen < 8) || (cmdLen > (end - p)))
+    {
+      break;
+    }
+    if((memcmp(name, "PrgI", 4) == 0) && (cmdLen >= 12) && (data[0] == 0))
+    {
+      uint8_t *d = data + 2;
+      uint16_t source = getU16(&d);
+
+      changed |= (source != s.tally.redChannel);
+      s.tally.redChannel = source;
+    }
+    else if((memcmp(name, "PrvI", 4) == 0) && (cmdLen >= 12) && (data[0] == 0))
+    {
+      uint8_t *d = data + 2;
+      uint16_t source = getU16(&d);
+
+      changed |= (source != s.tally.greenChannel);
+      s.tally.greenChannel = source;
+    }
+    else if((memcmp(name, "TrPs", 4) == 0) && (cmdLen >= 14) && (data[0] == 0))
+    {
+      uint8_t *d = data + 4;
+      bool inTransition = (data[1] & 0x01);
+      uint16_t position = inTransition ? getU16(&d) : 0;
+
+      changed |= ((inTransition != s.tally.inTransition) || (position != s.tally.transitionPosition));
+      s.tally.inTransition = inTransition;
+      s.tally.transitionPosition = position;
+    }
+    p += cmdLen;
+  }
+  return changed;
+}
+
+static void atemReceive(studio_t& s)
+{
+  atemSession_t& a = s.atem;
+  uint8_t buf[ATEM_MAX_PACKET];
+  char control[64];
+
+  for(;;)
+  {
+    iovec iov = {buf, sizeof(buf)};
+    msghdr msg = {};
+    uint64_t receivedAtUs = 0;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t len = recvmsg(a.fd, &msg, 0);
+
+    if(len < 0)
+    {
+      break;
+    }
+    for(cmsghdr *c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c))
+    {
+      if((c->cmsg_level == SOL_SOCKET) && (c->cmsg_type == SCM_TIMESTAMPNS))
+      {
+        timespec ts;
+
+        memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+        receivedAtUs = ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+      }
+    }
+    if(receivedAtUs == 0)
+    {
+      receivedAtUs = realtimeUs();
+    }
+    if(len < ATEM_HEADER_SIZE)
+    {
+      continue;
+    }
+
+    uint8_t *p = buf;
+    uint16_t word = getU16(&p);
+    uint8_t flags = (uint8_t)(word >> 11);
+    uint16_t packetLen = word & 0x07FF;
+    uint16_t sessionId = getU16(&p);
+    uint8_t *idAt = buf + 10;
+    uint16_t remoteId = getU16(&idAt);
+
+    if(packetLen > len)
+    {
+      continue;
+    }
+    a.lastReceivedAt = millis();
+
+    if(flags & ATEM_FLAG_HELLO)
+    {
+      /*accepted: the switcher sends its state next, under the session id it assigns*/
+      atemSendHeader(a, ATEM_FLAG_ACK, 0, NULL, 0);
+      continue;
+    }
+    if(!a.connected)
+    {
+      a.connected = true;
+      fprintf(stderr, "%s: connected to the switcher\n", s.name.c_str());
+    }
+    a.sessionId = sessionId;
+    if(flags & ATEM_FLAG_ACK_REQUEST)
+    {
+      atemSendHeader(a, ATEM_FLAG_ACK, remoteId, NULL, 0);
+    }
+    if(atemParseCommands(s, buf + ATEM_HEADER_SIZE, packetLen - ATEM_HEADER_SIZE))
+    {
+      s.changes++;
+      sendTally(s, receivedAtUs);
+    }
+  }
+}
+
+static void atemCheckTimeout(studio_t& s, uint32_t nowMs)
+{
+  atemSession_t& a = s.atem;
+
+  if(a.connected && ((nowMs - a.lastReceivedAt) >= ATEM_TIMEOUT_MS))
+  {
+    fprintf(stderr, "%s: switcher lost, connecting again\n", s.name.c_str());
+    a.reconnects++;
+    atemHello(a, nowMs);
+  }
+  else if(!a.connected && ((nowMs - a.helloSentAt) >= ATEM_HELLO_RETRY_MS))
+  {
+    atemHello(a, nowMs);
+  }
+}
+
+/*** scripted source *****************************************/
+
+static void scriptUpdate(studio_t& s, uint32_t nowMs)
+{
+  if((int32_t)(nowMs - s.nextCutAt) >= 0)
+  {
+    /*preview goes to program, a new camera to preview*/
+    s.tally.redChannel = s.tally.greenChannel;
+    s.tally.greenChannel = (uint16_t)(1 + rng() % 20);
+    s.nextCutAt = nowMs + s.cutPeriodMs;
+    s.changes++;
+    sendTally(s, realtimeUs());
+  }
+}
+
+/*** bench sink **********************************************/
+
+static void sinkReceive()
+{
+  static uint8_t bufs[SINK_BATCH][64];
+  static iovec iovs[SINK_BATCH];
+  static mmsghdr msgs[SINK_BATCH];
+
+  for(;;)
+  {
+    for(int i = 0; i < SINK_BATCH; i++)
+    {
+      iovs[i].iov_base = bufs[i];
+      iovs[i].iov_len = sizeof(bufs[i]);
+      memset(&msgs[i], 0, sizeof(mmsghdr));
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(sinkFd, msgs, SINK_BATCH, MSG_DONTWAIT, NULL);
+
+    if(n <= 0)
+    {
+      break;
+    }
+    for(int i = 0; i < n; i++)
+    {
+      uint16_t messageId;
+      uint16_t tick;
+      uint8_t *payload;
+      uint16_t payloadLen;
+      peerTally_t t;
+
+      if((peerNetworkDeSerialize(bufs[i], (uint16_t)msgs[i].msg_len, messageId, tick, payload, payloadLen) == PEER_FRAME_OK)
+         && (messageId == PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16) && peerTallyDecode(payload, payloadLen, t))
+      {
+        stats.sinkFrames++;
+      }
+      else
+      {
+        stats.sinkBadFrames++;
+      }
+    }
+  }
+}
+
+static bool createBench(int studioCount, int boxes, uint32_t cutMs)
+{
+  sockaddr_in sink = {};
+  socklen_t sinkLen = sizeof(sink);
+  int size = 8 * 1024 * 1024;
+
+  sinkFd = socket(AF_INET, SOCK_DGRAM, 0);
+  sink.sin_family = AF_INET;
+  sink.sin_addr.s_addr = htonl(INADDR_ANY);
+  setsockopt(sinkFd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  if((bind(sinkFd, (sockaddr*)&sink, sizeof(sink)) != 0) || (getsockname(sinkFd, (sockaddr*)&sink, &sinkLen) != 0))
+  {
+    return false;
+  }
+
+  for(int i = 0; i < studioCount; i++)
+  {
+    studio_t *s = new studio_t();
+
+    s->name = "bench" + std::to_string(i + 1);
+    s->sourceType = SOURCE_SCRIPT;
+    s->cutPeriodMs = cutMs;
+    s->nextCutAt = millis() + (rng() % cutMs);
+    for(int b = 0; b < boxes; b++)
+    {
+      sockaddr_in a = {};
+      uint32_t box = (uint32_t)(i * boxes + b);
+
+      /*every box has its own loopback address, the sink takes them all*/
+      a.sin_family = AF_INET;
+      a.sin_port = sink.sin_port;
+      a.sin_addr.s_addr = htonl((127u << 24) | ((1 + box / 250) << 8) | (1 + box % 250));
+      s->targets.push_back(a);
+    }
+    studios.push_back(s);
+  }
+  return true;
+}
+
+/*************************************************************/
+
+static uint32_t percentile(std::vector<uint32_t>& v, double p)
+{
+  if(v.empty())
+  {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static double cpuSeconds()
+{
+  rusage r;
+
+  getrusage(RUSAGE_SELF, &r);
+  return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) + (r.ru_utime.tv_usec + r.ru_stime.tv_usec) / 1e6;
+}
+
+static void report(double seconds, double cpu, bool bench)
+{
+  size_t boxes = 0;
+
+  for(size_t i = 0; i < studios.size(); i++)
+  {
+    studio_t& s = *studios[i];
+
+    boxes += s.targets.size();
+    printf("%-12s %5zu boxes  %8llu changes  %10llu frames  %6llu not sent", s.name.c_str(), s.targets.size(),
+           (unsigned long long)s.changes, (unsigned long long)s.framesSent, (unsigned long long)s.sendErrors);
+    if(s.sourceType == SOURCE_ATEM)
+    {
+      printf("  switcher %s, %u reconnects", (s.atem.connected ? "connected" : "not connected"), s.atem.reconnects);
+    }
+    printf("\n");
+  }
+  printf("%zu studios, %zu boxes, %.1f s\n", studios.size(), boxes, seconds);
+  printf("send rate   %.0f frames/s, %.0f sendmmsg calls/s, %.2f MB/s\n", stats.framesSent / seconds,
+         stats.sendCalls / seconds, stats.bytesSent / seconds / 1e6);
+  printf("cpu         %.1f%% of one core (%.2f us per frame)\n", 100.0 * cpu / seconds,
+         (stats.framesSent > 0) ? (cpu * 1e6 / stats.framesSent) : 0.0);
+  printf("change to first box   p50 %u us  p99 %u us  max %u us  (%zu changes)\n", percentile(stats.firstBoxUs, 0.5),
+         percentile(stats.firstBoxUs, 0.99), percentile(stats.firstBoxUs, 1.0), stats.firstBoxUs.size());
+  printf("change to every box   p50 %u us  p99 %u us  max %u us\n", percentile(stats.lastBoxUs, 0.5),
+         percentile(stats.lastBoxUs, 0.99), percentile(stats.lastBoxUs, 1.0));
+  if(bench && (sinkFd >= 0))
+  {
+    printf("sink        %llu frames received, %llu bad, %.2f%% lost\n", (unsigned long long)stats.sinkFrames,
+           (unsigned long long)stats.sinkBadFrames,
+           (stats.framesSent > 0) ? (100.0 * (1.0 - (double)stats.sinkFrames / stats.framesSent)) : 0.0);
+  }
+  fflush(stdout);
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: master_daemon --studio NAME SOURCE TARGETS [--studio ...] [--bench SECONDS]\n"
+                  "                     [--bench-studios N] [--bench-boxes N] [--cut-ms MS]\n"
+                  "  SOURCE   atem:HOST[:PORT] | script:PERIOD_MS\n"
+                  "  TARGETS  ADDRESS[:PORT],... | @FILE\n");
+}
+
+int main(int argc, char **argv)
+{
+  double benchSeconds = 0;
+  int benchStudios = 4;
+  int benchBoxes = 250;
+  uint32_t cutMs = 200;
+  int size = 4 * 1024 * 1024;
+  int on = 1;
+
+  for(int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+
+    if((arg == "--studio") && ((i + 3) < argc))
+    {
+      studio_t *s = new studio_t();
+      std::string source = argv[i + 2];
+
+      s->name = argv[i + 1];
+      if(!parseTargets(argv[i + 3], s->targets))
+      {
+        fprintf(stderr, "%s: no usable targets\n", s->name.c_str());
+        return 2;
+      }
+      if(source.compare(0, 5, "atem:") == 0)
+      {
+        s->sourceType = SOURCE_ATEM;
+        if(!atemOpen(s->atem, source.substr(5)))
+        {
+          fprintf(stderr, "%s: bad switcher address\n", s->name.c_str());
+          return 2;
+        }
+      }
+      else if(source.compare(0, 7, "script:") == 0)
+      {
+        s->sourceType = SOURCE_SCRIPT;
+        s->cutPeriodMs = max(10, atoi(source.c_str() + 7));
+        s->nextCutAt = millis();
+      }
+      else
+      {
+        usage();
+        return 2;
+      }
+      studios.push_back(s);
+      i += 3;
+    }
+    else if((arg == "--bench") && ((i + 1) < argc))
+    {
+      benchSeconds = atof(argv[++i]);
+    }
+    else if((arg == "--bench-studios") && ((i + 1) < argc))
+    {
+      benchStudios = atoi(argv[++i]);
+    }
+    else if((arg == "--bench-boxes") && ((i + 1) < argc))
+    {
+      benchBoxes = atoi(argv[++i]);
+    }
+    else if((arg == "--cut-ms") && ((i + 1) < argc))
+    {
+      cutMs = (uint32_t)max(10, atoi(argv[++i]));
+    }
+    else
+    {
+      usage();
+      return 2;
+    }
+  }
+
+  if(studios.empty() && (benchSeconds > 0) && !createBench(benchStudios, benchBoxes, cutMs))
+  {
+    fprintf(stderr, "no bench sink\n");
+    return 1;
+  }
+  if(studios.empty())
+  {
+    usage();
+    return 2;
+  }
+
+  sendFd = socket(AF_INET, SOCK_DGRAM, 0);
+  setsockopt(sendFd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+  setsockopt(sendFd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+  for(size_t i = 0; i < studios.size(); i++)
+  {
+    prepareMessages(*studios[i]);
+  }
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  uint64_t startUs = monotonicUs();
+  uint64_t nextTickUs = startUs;
+  uint64_t nextReportUs = startUs + REPORT_PERIOD_MS * 1000ULL;
+  double startCpu = cpuSeconds();
+  std::vector<pollfd> fds;
+
+  for(size_t i = 0; i < studios.size(); i++)
+  {
+    if(studios[i]->sourceType == SOURCE_ATEM)
+    {
+      fds.push_back({studios[i]->atem.fd, POLLIN, 0});
+    }
+  }
+  if(sinkFd >= 0)
+  {
+    fds.push_back({sinkFd, POLLIN, 0});
+  }
+
+  while(running)
+  {
+    uint64_t nowUs = monotonicUs();
+    int timeoutMs = (nextTickUs > nowUs) ? (int)((nextTickUs - nowUs + 999) / 1000) : 0;
+
+    poll(fds.data(), fds.size(), timeoutMs);
+
+    for(size_t i = 0; i < studios.size(); i++)
+    {
+      if(studios[i]->sourceType == SOURCE_ATEM)
+      {
+        atemReceive(*studios[i]);
+      }
+      else
+      {
+        scriptUpdate(*studios[i], millis());
+      }
+    }
+    if(sinkFd >= 0)
+    {
+      sinkReceive();
+    }
+
+    nowUs = monotonicUs();
+    if(nowUs >= nextTickUs)
+    {
+      /*every box gets the tally every tick, as from the master box*/
+      for(size_t i = 0; i < studios.size(); i++)
+      {
+        if(studios[i]->sourceType == SOURCE_ATEM)
+        {
+          atemCheckTimeout(*studios[i], millis());
+        }
+        sendTally(*studios[i], 0);
+      }
+      nextTickUs += TICK_US;
+      if(nextTickUs < nowUs)
+      {
+        nextTickUs = nowUs + TICK_US;    /*held up: do not send the missed ticks in a burst*/
+      }
+    }
+
+    if((benchSeconds > 0) && ((nowUs - startUs) >= (uint64_t)(benchSeconds * 1e6)))
+    {
+      break;
+    }
+    if((benchSeconds == 0) && (nowUs >= nextReportUs))
+    {
+      report((nowUs - startUs) / 1e6, cpuSeconds() - startCpu, false);
+      nextReportUs += REPORT_PERIOD_MS * 1000ULL;
+    }
+  }
+
+  if(sinkFd >= 0)
+  {
+    delay(50);
+    sinkReceive();
+  }
+  report((monotonicUs() - startUs) / 1e6, cpuSeconds() - startCpu, benchSeconds > 0);
+  return 0;
+}
@@ -0,0 +1,258 @@
+/*
+  Throughput of the peer network frames on the host: serialize, deserialize (CRC32 included)
+  and the receive path of the firmware (peerNetworkReceive() with the datagrams queued in the
+  stub WiFiUDP), for a tally frame and for a frame of the largest size.
+
+    peer_frame_bench [--record FILE] [--baseline FILE] [--tolerance FRACTION]
+
+  --record writes the results as the baseline. --baseline compares with it and fails when a
+  rate is lower than the baseline by more than the tolerance (default 0.5, the machines that
+  run this differ), or when the tally frame is not the same byte for byte: a change of the
+  protocol then shows up here first.
+*/
+#include "Arduino.h"
+#include "peer_links.hpp"
+#include <string>
+#include <vector>
+#include <time.h>
+
+#define RUN_US              300000      /*per measurement*/
+#define ROUNDS              3           /*the best round counts*/
+#define CALLS_PER_CHECK     256         /*between two readings of the clock*/
+
+typedef struct
+{
+  std::string name;
+  double value;
+} result_t;
+
+static std::vector<result_t> results;
+static volatile uint32_t sink;       /*keeps the work from being optimized away*/
+
+
+static uint64_t nowUs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+/*frames per second of fn, which handles batch frames per call*/
+template <typename F>
+static double measure(F fn, uint32_t batch)
+{
+  double best = 0;
+
+  for(int r = 0; r < ROUNDS; r++)
+  {
+    uint64_t start = nowUs();
+    uint64_t elapsed;
+    uint64_t frames = 0;
+
+    do
+    {
+      for(int i = 0; i < CALLS_PER_CHECK; i++)
+      {
+        fn();
+      }
+      frames += batch * CALLS_PER_CHECK;
+      elapsed = nowUs() - start;
+    } while(elapsed < RUN_US);
+    best = max(best, frames * 1e6 / elapsed);
+  }
+  return best;
+}
+
+static void report(const char *name, double fps, uint16_t frameLen)
+{
+  printf("%-24s %12.0f frames/s %9.1f MB/s\n", name, fps, fps * frameLen / 1e6);
+  results.push_back({name, fps});
+}
+
+static std::string hex(const uint8_t *buf, uint16_t len)
+{
+  std::string s;
+  char b[3];
+
+  for(uint16_t i = 0; i < len; i++)
+  {
+    snprintf(b, sizeof(b), "%02x", buf[i]);
+    s += b;
+  }
+  return s;
+}
+
+static bool recordBaseline(const char *path, const std::string& golden)
+{
+  FILE *f = fopen(path, "w");
+
+  if(f == NULL)
+  {
+    return false;
+  }
+  fprintf(f, "# peer_frame_bench baseline: frames per second, best of %d rounds of %d ms, g++ %s\n", ROUNDS, RUN_US / 1000, __VERSION__);
+  fprintf(f, "tally_frame %s\n", golden.c_str());
+  for(size_t i = 0; i < results.size(); i++)
+  {
+    fprintf(f, "%s %.0f\n", results[i].name.c_str(), results[i].value);
+  }
+  fclose(f);
+  return true;
+}
+
+static bool checkBaseline(const char *path, const std::string& golden, double tolerance)
+{
+  FILE *f = fopen(path, "r");
+  char line[256];
+  bool ret = true;
+
+  if(f == NULL)
+  {
+    printf("no baseline %s\n", path);
+    return false;
+  }
+  while(fgets(line, sizeof(line), f))
+  {
+    char name[64];
+    char value[128];
+
+    if((line[0] == '#') || (sscanf(line, "%63s %127s", name, value) != 2))
+    {
+      continue;
+    }
+    if(strcmp(name, "tally_frame") == 0)
+    {
+      if(golden != value)
+      {
+        printf("REGRESSION tally frame changed: %s, baseline %s\n", golden.c_str(), value);
+        ret = false;
+      }
+      continue;
+    }
+    for(size_t i = 0; i < results.size(); i++)
+    {
+      if(results[i].name == name)
+      {
+        double base = atof(value);
+        double ratio = results[i].value / base;
+
+        printf("%-24s %6.2fx baseline%s\n", name, ratio, ((ratio < (1.0 - tolerance)) ? "  REGRESSION" : ""));
+        ret = ret && (ratio >= (1.0 - tolerance));
+      }
+    }
+  }
+  fclose(f);
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  const char *recordPath = NULL;
+  const char *baselinePath = NULL;
+  double tolerance = 0.5;
+  tallyBoxConfig_t c = {};
+  uint8_t tallyPayload[PEERNETWORK_TALLY_PAYLOAD_SIZE];
+  uint8_t blockPayload[PEERNETWORK_MAX_MESSAGE_SIZE - PEERNETWORK_HEADER_SIZE - PEERNETWORK_FOOTER_SIZE];
+  uint8_t tallyFrame[PEERNETWORK_MAX_MESSAGE_SIZE];
+  uint8_t blockFrame[PEERNETWORK_MAX_MESSAGE_SIZE];
+  uint8_t out[PEERNETWORK_MAX_MESSAGE_SIZE];
+  peerTally_t t = {3, 7, true, 4200};
+  uint16_t tick = 0;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if((strcmp(argv[i], "--record") == 0) && ((i + 1) < argc))
+    {
+      recordPath = argv[++i];
+    }
+    else if((strcmp(argv[i], "--baseline") == 0) && ((i + 1) < argc))
+    {
+      baselinePath = argv[++i];
+    }
+    else if((strcmp(argv[i], "--tolerance") == 0) && ((i + 1) < argc))
+    {
+      tolerance = atof(argv[++i]);
+    }
+    else
+    {
+      fprintf(stderr, "usage: peer_frame_bench [--record FILE] [--baseline FILE] [--tolerance FRACTION]\n");
+      return 2;
+    }
+  }
+
+  peerTallyEncode(t, tallyPayload);
+  for(size_t i = 0; i < sizeof(blockPayload); i++)
+  {
+    blockPayload[i] = (uint8_t)(i * 31);
+  }
+  uint16_t tallyLen = peerNetworkSerialize(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, 100, tallyPayload, sizeof(tallyPayload), tallyFrame, sizeof(tallyFrame));
+  uint16_t blockLen = peerNetworkSerialize(PEERNETWORK_ROLLOUT_BLOCK_IDENTIFIER_U16, 100, blockPayload, sizeof(blockPayload), blockFrame, sizeof(blockFrame));
+  std::string golden = hex(tallyFrame, tallyLen);
+
+  printf("tally frame %u bytes: %s\n", tallyLen, golden.c_str());
+
+  report("serialize_tally", measure([&]() {
+    sink += peerNetworkSerialize(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, tick++, tallyPayload, sizeof(tallyPayload), out, sizeof(out));
+  }, 1), tallyLen);
+
+  report("serialize_block", measure([&]() {
+    sink += peerNetworkSerialize(PEERNETWORK_ROLLOUT_BLOCK_IDENTIFIER_U16, tick++, blockPayload, sizeof(blockPayload), out, sizeof(out));
+  }, 1), blockLen);
+
+  report("deserialize_tally", measure([&]() {
+    uint16_t messageId, frameTick, payloadLen;
+    uint8_t *payload;
+    peerTally_t decoded;
+
+    if((peerNetworkDeSerialize(tallyFrame, tallyLen, messageId, frameTick, payload, payloadLen) == PEER_FRAME_OK)
+       && peerTallyDecode(payload, payloadLen, decoded))
+    {
+      sink += decoded.redChannel;
+    }
+  }, 1), tallyLen);
+
+  report("deserialize_block", measure([&]() {
+    uint16_t messageId, frameTick, payloadLen;
+    uint8_t *payload;
+
+    sink += peerNetworkDeSerialize(blockFrame, blockLen, messageId, frameTick, payload, payloadLen);
+  }, 1), blockLen);
+
+  /*a frame with a bit error is rejected at the CRC*/
+  report("deserialize_bad_crc", measure([&]() {
+    uint16_t messageId, frameTick, payloadLen;
+    uint8_t *payload;
+
+    tallyFrame[10] ^= 0x01;
+    sink += peerNetworkDeSerialize(tallyFrame, tallyLen, messageId, frameTick, payload, payloadLen);
+    tallyFrame[10] ^= 0x01;
+  }, 1), tallyLen);
+
+  /*the firmware receive path, 4 frames per call as in a tick*/
+  hostDatagram_t d = {std::vector<uint8_t>(tallyFrame, tallyFrame + tallyLen), IPAddress(192, 168, 1, 100)};
+  report("receive_tally", measure([&]() {
+    peerTally_t received;
+
+    for(int i = 0; i < 4; i++)
+    {
+      Udp.received.push_back(d);
+    }
+    if(peerNetworkReceive(c, received))
+    {
+      sink += received.redChannel;
+    }
+  }, 4), tallyLen);
+
+  bool ret = true;
+
+  if(recordPath != NULL)
+  {
+    ret = recordBaseline(recordPath, golden);
+    printf("baseline written to %s\n", recordPath);
+  }
+  if(baselinePath != NULL)
+  {
+    ret = checkBaseline(baselinePath, golden, tolerance);
+  }
+  return ret ? 0 : 1;
+}
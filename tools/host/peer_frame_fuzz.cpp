@@ -0,0 +1,626 @@
+/*
+  Coverage-guided fuzzer for the receive path of the peer network (peerNetworkReceive() and
+  the codec), built with AddressSanitizer and UndefinedBehaviorSanitizer.
+
+    peer_frame_fuzz [--seconds S] [--runs N] [--seed N] [--corpus DIR]
+
+  Every input is one datagram, received once by a slave and once by the master. A reference
+  decoder written here, independently of the firmware, tells what the datagram is. After
+  each receive the fuzzer checks that:
+  - a slave takes the tally only from a complete, valid tally frame, exactly as sent;
+  - the master never takes a tally from the network;
+  - anything else leaves the tally outputs, the configuration (the brightness among it)
+    and the tick compensation as they were;
+  - fleet and firmware messages are handed on only when the frame is valid;
+  - the received frame counter counts the valid frames only.
+  A violation or a sanitizer report writes the input to peer_frame_fuzz-crash.bin.
+
+  The firmware sources are compiled with -fsanitize-coverage=trace-pc,trace-cmp (gcc has no
+  libFuzzer). trace-pc gives the edges, an input that reaches a new edge or a new hit count
+  class is kept. trace-cmp gives the operands of the comparisons, so that the fuzzer can put
+  the expected value into the input: that is how it gets past the protocol identifier and
+  the CRC.
+*/
+#include "Arduino.h"
+#include "peer_links.hpp"
+#include "TallyBoxInfra.hpp"
+#include "TallyBoxMetrics.hpp"
+#include <vector>
+#include <string>
+#include <random>
+#include <dirent.h>
+#include <time.h>
+#include <sanitizer/common_interface_defs.h>
+
+#define MAP_SIZE            65536
+#define MAX_TOUCHED         4096
+#define CMP_LOG_SIZE        64
+#define MAX_INPUT_SIZE      1024          /*larger than the receive buffer of the firmware*/
+#define MAX_STACKED         8             /*mutations per new input*/
+#define CRASH_PATH          "peer_frame_fuzz-crash.bin"
+
+#define SENTINEL_GREEN      0xA5A5
+#define SENTINEL_RED        0x5A5A
+#define SENTINEL_POSITION   0xBEEF
+#define SENTINEL_MASK       0x0123456789ABCDEFULL
+#define SENTINEL_COMP       12345
+
+typedef std::vector<uint8_t> input_t;
+
+typedef struct
+{
+  uint64_t a;
+  uint64_t b;
+  uint8_t size;
+} cmpEntry_t;
+
+/*coverage, filled by the instrumented firmware*/
+static uint8_t hits[MAP_SIZE];
+static uint8_t seen[MAP_SIZE];            /*hit count classes seen so far, one bit each*/
+static uint16_t touched[MAX_TOUCHED];
+static uint32_t touchedCount = 0;
+static uint32_t prevLocation = 0;
+static cmpEntry_t cmpLog[CMP_LOG_SIZE];
+static uint32_t cmpCount = 0;
+
+static std::vector<input_t> corpus;
+static std::mt19937_64 rng;
+static const input_t *currentInput = NULL;
+static uint64_t execs = 0;
+static uint32_t edges = 0;
+
+
+/*** instrumentation callbacks *******************************/
+
+extern "C" void __sanitizer_cov_trace_pc()
+{
+  uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+  uint32_t location = (uint32_t)((pc >> 4) ^ (pc << 8)) & (MAP_SIZE - 1);
+  uint32_t index = location ^ prevLocation;
+
+  if((hits[index]++ == 0) && (touchedCount < MAX_TOUCHED))
+  {
+    touched[touchedCount++] = (uint16_t)index;
+  }
+  prevLocation = location >> 1;
+}
+
+static void logCmp(uint64_t a, uint64_t b, uint8_t size)
+{
+  if((a != b) && (cmpCount < CMP_LOG_SIZE))
+  {
+    cmpLog[cmpCount++] = {a, b, size};
+  }
+}
+
+extern "C" void __sanitizer_cov_trace_cmp1(uint8_t a, uint8_t b) { logCmp(a, b, 1); }
+extern "C" void __sanitizer_cov_trace_cmp2(uint16_t a, uint16_t b) { logCmp(a, b, 2); }
+extern "C" void __sanitizer_cov_trace_cmp4(uint32_t a, uint32_t b) { logCmp(a, b, 4); }
+extern "C" void __sanitizer_cov_trace_cmp8(uint64_t a, uint64_t b) { logCmp(a, b, 8); }
+extern "C" void __sanitizer_cov_trace_const_cmp1(uint8_t a, uint8_t b) { logCmp(a, b, 1); }
+extern "C" void __sanitizer_cov_trace_const_cmp2(uint16_t a, uint16_t b) { logCmp(a, b, 2); }
+extern "C" void __sanitizer_cov_trace_const_cmp4(uint32_t a, uint32_t b) { logCmp(a, b, 4); }
+extern "C" void __sanitizer_cov_trace_const_cmp8(uint64_t a, uint64_t b) { logCmp(a, b, 8); }
+extern "C" void __sanitizer_cov_trace_cmpf(float a, float b) {}
+extern "C" void __sanitizer_cov_trace_cmpd(double a, double b) {}
+
+/*cases[0] is the number of cases, cases[1] the size in bits, then the case values*/
+extern "C" void __sanitizer_cov_trace_switch(uint64_t value, void *table)
+{
+  const uint64_t *cases = (const uint64_t*)table;
+
+  for(uint64_t i = 0; i < cases[0]; i++)
+  {
+    logCmp(value, cases[2 + i], (uint8_t)(cases[1] / 8));
+  }
+}
+
+/*** reference decoder ***************************************/
+
+typedef struct
+{
+  bool valid;                     /*complete frame, CRC, protocol and version right*/
+  uint16_t messageId;
+  uint16_t tick;
+  uint16_t payloadLen;
+  peerTally_t tally;
+  bool isTally;                   /*valid tally frame with a tally payload*/
+} refFrame_t;
+
+static uint32_t refCrc32(const uint8_t *data, size_t len)
+{
+  uint32_t crc = 0xFFFFFFFF;
+
+  for(size_t i = 0; i < len; i++)
+  {
+    crc ^= data[i];
+    for(int k = 0; k < 8; k++)
+    {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t be(const uint8_t *p, int bytes)
+{
+  uint32_t v = 0;
+
+  for(int i = 0; i < bytes; i++)
+  {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static refFrame_t refDecode(const input_t& d)
+{
+  refFrame_t r = {};
+  size_t len = d.size();
+
+  if((len >= 13) && (len <= PEERNETWORK_MAX_MESSAGE_SIZE))
+  {
+    r.valid = ((refCrc32(d.data(), len - 4) == be(&d[len - 4], 4)) && (be(&d[0], 4) == 0x7A61696D) && (d[4] == 4));
+    r.messageId = (uint16_t)be(&d[5], 2);
+    r.tick = (uint16_t)be(&d[7], 2);
+    r.payloadLen = (uint16_t)(len - 13);
+    r.isTally = (r.valid && (r.messageId == 0x0001) && (r.payloadLen == 23));
+    if(r.isTally)
+    {
+      r.tally.greenChannel = (uint16_t)be(&d[9], 2);
+      r.tally.redChannel = (uint16_t)be(&d[11], 2);
+      r.tally.inTransition = (d[13] != 0);
+      r.tally.transitionPosition = (uint16_t)be(&d[14], 2);
+      r.tally.greenMask = ((uint64_t)be(&d[16], 4) << 32) | be(&d[20], 4);
+      r.tally.redMask = ((uint64_t)be(&d[24], 4) << 32) | be(&d[28], 4);
+    }
+  }
+  return r;
+}
+
+/*** execution ***********************************************/
+
+static void saveInput(const input_t& in, const char *path)
+{
+  FILE *f = fopen(path, "wb");
+
+  if(f != NULL)
+  {
+    fwrite(in.data(), 1, in.size(), f);
+    fclose(f);
+  }
+}
+
+static void printInput(const input_t& in)
+{
+  for(size_t i = 0; i < in.size(); i++)
+  {
+    printf("%02x", in[i]);
+  }
+  printf("\n");
+}
+
+static void onSanitizerReport()
+{
+  if(currentInput != NULL)
+  {
+    saveInput(*currentInput, CRASH_PATH);
+    fprintf(stderr, "input written to %s\n", CRASH_PATH);
+  }
+}
+
+static void fail(const input_t& in, bool isMaster, const char *what)
+{
+  printf("VIOLATION (%s): %s\ninput (%zu bytes): ", (isMaster ? "master" : "slave"), what, in.size());
+  printInput(in);
+  saveInput(in, CRASH_PATH);
+  printf("input written to %s\n", CRASH_PATH);
+  exit(1);
+}
+
+static void receiveAs(const input_t& in, const refFrame_t& ref, bool isMaster)
+{
+  tallyBoxConfig_t c = {};
+  tallyBoxConfig_t before;
+  peerTally_t t = {SENTINEL_GREEN, SENTINEL_RED, true, SENTINEL_POSITION, SENTINEL_MASK, SENTINEL_MASK};
+  peerLinkCalls_t linksBefore = peerLinkCalls;
+  uint32_t framesBefore = tallyBoxMetrics[METRIC_PEER_FRAMES_RECEIVED];
+
+  c.network.isMaster = isMaster;
+  c.user.cameraId = 3;
+  c.user.greenBrightnessPercent = 40.0f;
+  c.user.redBrightnessPercent = 70.0f;
+  memcpy((void*)&before, (void*)&c, sizeof(c));
+  setTickCompensationValue(SENTINEL_COMP);
+
+  Udp.received.clear();
+  Udp.received.push_back({in, IPAddress(192, 168, 1, 100)});
+  bool ret = peerNetworkReceive(c, t);
+  bool expected = (ref.isTally && !isMaster);
+
+  if(ret != expected)
+  {
+    fail(in, isMaster, (ret ? "tally taken from a frame that is not a valid tally frame" : "valid tally frame not taken"));
+  }
+  if(ret && ((t.greenChannel != ref.tally.greenChannel) || (t.redChannel != ref.tally.redChannel) || (t.inTransition != ref.tally.inTransition)
+             || (t.transitionPosition != ref.tally.transitionPosition) || (t.greenMask != ref.tally.greenMask) || (t.redMask != ref.tally.redMask)))
+  {
+    fail(in, isMaster, "tally differs from the frame");
+  }
+  if(!ret && ((t.greenChannel != SENTINEL_GREEN) || (t.redChannel != SENTINEL_RED) || !t.inTransition || (t.transitionPosition != SENTINEL_POSITION)
+              || (t.greenMask != SENTINEL_MASK) || (t.redMask != SENTINEL_MASK)))
+  {
+    fail(in, isMaster, "tally outputs changed without a valid tally frame");
+  }
+  if(memcmp((void*)&before, (void*)&c, sizeof(c)) != 0)
+  {
+    fail(in, isMaster, "configuration (brightness) changed");
+  }
+  if(!ret && (getTickCompensationValue() != SENTINEL_COMP))
+  {
+    fail(in, isMaster, "tick compensation changed without a valid tally frame");
+  }
+  if((peerLinkCalls.fleetMessages != linksBefore.fleetMessages) && !(ref.valid && (ref.messageId >= 0x0002) && (ref.messageId <= 0x0005)))
+  {
+    fail(in, isMaster, "fleet message handed on from a frame that is not valid");
+  }
+  if((peerLinkCalls.firmwareMessages != linksBefore.firmwareMessages) && !(ref.valid && (ref.messageId >= 0x0006) && (ref.messageId <= 0x0009)))
+  {
+    fail(in, isMaster, "firmware message handed on from a frame that is not valid");
+  }
+  if(((peerLinkCalls.fleetMessages + peerLinkCalls.firmwareMessages) != (linksBefore.fleetMessages + linksBefore.firmwareMessages))
+     && (peerLinkCalls.lastLen != ref.payloadLen))
+  {
+    fail(in, isMaster, "payload handed on with the wrong length");
+  }
+  if((tallyBoxMetrics[METRIC_PEER_FRAMES_RECEIVED] - framesBefore) != (ref.valid ? 1u : 0u))
+  {
+    fail(in, isMaster, "received frame counter wrong");
+  }
+}
+
+/*returns true when the input reached a new edge or a new hit count class*/
+static bool execute(const input_t& in)
+{
+  static const uint8_t classes[9] = {0, 1, 2, 4, 8, 8, 8, 8, 16};
+  bool ret = false;
+  refFrame_t ref = refDecode(in);
+
+  for(uint32_t i = 0; i < touchedCount; i++)
+  {
+    hits[touched[i]] = 0;
+  }
+  touchedCount = 0;
+  prevLocation = 0;
+  cmpCount = 0;
+  currentInput = &in;
+
+  receiveAs(in, ref, false);
+  receiveAs(in, ref, true);
+  execs++;
+
+  for(uint32_t i = 0; i < touchedCount; i++)
+  {
+    uint8_t n = hits[touched[i]];
+    uint8_t bit = (n < 9) ? classes[n] : ((n < 32) ? 32 : ((n < 128) ? 64 : 128));
+
+    if(!(seen[touched[i]] & bit))
+    {
+      edges += (seen[touched[i]] == 0);
+      seen[touched[i]] |= bit;
+      ret = true;
+    }
+  }
+  return ret;
+}
+
+/*** mutation ************************************************/
+
+static uint32_t randBelow(uint32_t n)
+{
+  return (n == 0) ? 0 : (uint32_t)(rng() % n);
+}
+
+static void putValue(input_t& in, size_t at, uint64_t v, uint8_t size, bool bigEndian)
+{
+  for(uint8_t i = 0; i < size; i++)
+  {
+    in[at + i] = (uint8_t)(v >> (8 * (bigEndian ? (size - 1 - i) : i)));
+  }
+}
+
+static bool hasValue(const input_t& in, size_t at, uint64_t v, uint8_t size, bool bigEndian)
+{
+  for(uint8_t i = 0; i < size; i++)
+  {
+    if(in[at + i] != (uint8_t)(v >> (8 * (bigEndian ? (size - 1 - i) : i))))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*input to state: where one operand of a comparison is found in the input, put the other*/
+static bool replaceOperand(input_t& in, const cmpEntry_t *log, uint32_t count)
+{
+  if((count == 0) || in.empty())
+  {
+    return false;
+  }
+
+  const cmpEntry_t& e = log[randBelow(count)];
+
+  for(int order = 0; order < 4; order++)
+  {
+    uint64_t from = (order & 1) ? e.b : e.a;
+    uint64_t to = (order & 1) ? e.a : e.b;
+    bool bigEndian = (order < 2);
+
+    for(size_t at = 0; (at + e.size) <= in.size(); at++)
+    {
+      if(hasValue(in, at, from, e.size, bigEndian))
+      {
+        putValue(in, at, to, e.size, bigEndian);
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static void mutate(input_t& in, const cmpEntry_t *log, uint32_t count)
+{
+  static const uint8_t interesting[] = {0x00, 0x01, 0x03, 0x7F, 0x80, 0xFF};
+  static const size_t lengths[] = {0, 1, 12, 13, 20, 21, PEERNETWORK_MAX_MESSAGE_SIZE - 1, PEERNETWORK_MAX_MESSAGE_SIZE,
+                                   PEERNETWORK_MAX_MESSAGE_SIZE + 1, MAX_INPUT_SIZE};
+  uint32_t stacked = 1 + randBelow(MAX_STACKED);
+
+  for(uint32_t s = 0; s < stacked; s++)
+  {
+    switch(randBelow(9))
+    {
+      case 0:
+        if(!in.empty())
+        {
+          in[randBelow(in.size())] ^= (uint8_t)(1 << randBelow(8));
+        }
+        break;
+      case 1:
+        if(!in.empty())
+        {
+          in[randBelow(in.size())] = (uint8_t)rng();
+        }
+        break;
+      case 2:
+        if(!in.empty())
+        {
+          in[randBelow(in.size())] = interesting[randBelow(sizeof(interesting))];
+        }
+        break;
+      case 3:
+      {
+        size_t at = randBelow(in.size() + 1);
+        size_t n = 1 + randBelow(16);
+
+        for(size_t i = 0; i < n; i++)
+        {
+          in.insert(in.begin() + at, (uint8_t)rng());
+        }
+        break;
+      }
+      case 4:
+        if(!in.empty())
+        {
+          size_t at = randBelow(in.size());
+          size_t n = 1 + randBelow(min((size_t)16, in.size() - at));
+
+          in.erase(in.begin() + at, in.begin() + at + n);
+        }
+        break;
+      case 5:
+        if(in.size() >= 2)
+        {
+          /*16 bit field, big endian as on the wire*/
+          size_t at = randBelow(in.size() - 1);
+          uint16_t v = (uint16_t)((in[at] << 8) | in[at + 1]);
+
+          v += (uint16_t)(randBelow(33) - 16);
+          in[at] = (uint8_t)(v >> 8);
+          in[at + 1] = (uint8_t)v;
+        }
+        break;
+      case 6:
+      {
+        const input_t& other = corpus[randBelow(corpus.size())];
+
+        if(!other.empty())
+        {
+          size_t at = randBelow(other.size());
+
+          in.resize(randBelow(in.size() + 1));
+          in.insert(in.end(), other.begin() + at, other.end());
+        }
+        break;
+      }
+      case 7:
+        in.resize(lengths[randBelow(sizeof(lengths) / sizeof(lengths[0]))], (uint8_t)rng());
+        break;
+      default:
+        replaceOperand(in, log, count);
+        break;
+    }
+  }
+  if(in.size() > MAX_INPUT_SIZE)
+  {
+    in.resize(MAX_INPUT_SIZE);
+  }
+}
+
+/*** corpus **************************************************/
+
+static input_t frame(uint16_t messageId, uint16_t tick, const uint8_t *payload, uint16_t len)
+{
+  uint8_t buf[PEERNETWORK_MAX_MESSAGE_SIZE];
+  uint16_t n = peerNetworkSerialize(messageId, tick, payload, len, buf, sizeof(buf));
+
+  return input_t(buf, buf + n);
+}
+
+static void seedCorpus()
+{
+  uint8_t payload[PEERNETWORK_MAX_MESSAGE_SIZE] = {};
+  peerTally_t t = {2, 3, true, 5000};
+
+  peerTallyEncode(t, payload);
+  corpus.push_back(frame(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, 0, payload, PEERNETWORK_TALLY_PAYLOAD_SIZE));
+  corpus.push_back(frame(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, 17, payload, PEERNETWORK_TALLY_PAYLOAD_SIZE));
+  corpus.push_back(frame(PEERNETWORK_FLEET_ANNOUNCE_IDENTIFIER_U16, 1, payload, 12));
+  corpus.push_back(frame(PEERNETWORK_ROLLOUT_BLOCK_IDENTIFIER_U16, 1, payload, PEERNETWORK_MAX_MESSAGE_SIZE - 13));
+  corpus.push_back(input_t(PEERNETWORK_MAX_MESSAGE_SIZE + 1, 0x55));
+  corpus.push_back(input_t(13, 0));
+  corpus.push_back(input_t(1, 0));
+}
+
+static void loadCorpus(const std::string& dir)
+{
+  DIR *d = opendir(dir.c_str());
+  dirent *e;
+
+  if(d == NULL)
+  {
+    return;
+  }
+  while((e = readdir(d)) != NULL)
+  {
+    std::string path = dir + "/" + e->d_name;
+    FILE *f = (e->d_name[0] != '.') ? fopen(path.c_str(), "rb") : NULL;
+
+    if(f != NULL)
+    {
+      input_t in(MAX_INPUT_SIZE);
+
+      in.resize(fread(in.data(), 1, in.size(), f));
+      fclose(f);
+      corpus.push_back(in);
+    }
+  }
+  closedir(d);
+}
+
+static uint64_t nowMs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000ULL) + (ts.tv_nsec / 1000000);
+}
+
+int main(int argc, char **argv)
+{
+  double seconds = 10;
+  uint64_t runs = 0;
+  uint64_t seed = 1;
+  std::string corpusDir;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if((strcmp(argv[i], "--seconds") == 0) && ((i + 1) < argc))
+    {
+      seconds = atof(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--runs") == 0) && ((i + 1) < argc))
+    {
+      runs = strtoull(argv[++i], NULL, 10);
+    }
+    else if((strcmp(argv[i], "--seed") == 0) && ((i + 1) < argc))
+    {
+      seed = strtoull(argv[++i], NULL, 10);
+    }
+    else if((strcmp(argv[i], "--corpus") == 0) && ((i + 1) < argc))
+    {
+      corpusDir = argv[++i];
+    }
+    else
+    {
+      fprintf(stderr, "usage: peer_frame_fuzz [--seconds S] [--runs N] [--seed N] [--corpus DIR]\n");
+      return 2;
+    }
+  }
+
+  rng.seed(seed);
+  __sanitizer_set_death_callback(onSanitizerReport);
+  seedCorpus();
+  if(!corpusDir.empty())
+  {
+    loadCorpus(corpusDir);
+  }
+  for(size_t i = 0; i < corpus.size(); i++)
+  {
+    execute(corpus[i]);
+  }
+  printf("corpus %zu inputs, %u edges\n", corpus.size(), edges);
+
+  uint64_t startMs = nowMs();
+  uint64_t nextReportMs = startMs + 1000;
+  uint32_t saved = 0;
+  cmpEntry_t parentLog[CMP_LOG_SIZE];
+
+  while((runs == 0) ? ((nowMs() - startMs) < (uint64_t)(seconds * 1000)) : (execs < runs))
+  {
+    input_t parent = corpus[randBelow(corpus.size())];
+
+    /*the comparisons the parent makes guide its mutations*/
+    execute(parent);
+    uint32_t parentCmpCount = cmpCount;
+
+    memcpy(parentLog, cmpLog, sizeof(cmpEntry_t) * parentCmpCount);
+
+    for(int m = 0; m < 64; m++)
+    {
+      input_t in = parent;
+
+      mutate(in, parentLog, parentCmpCount);
+      bool isNew = execute(in);
+
+      /*one more step on the comparisons of the mutant itself: a changed payload needs a new CRC*/
+      if(!isNew && (cmpCount > 0) && (randBelow(2) == 0))
+      {
+        cmpEntry_t ownLog[CMP_LOG_SIZE];
+        uint32_t ownCount = cmpCount;
+
+        memcpy(ownLog, cmpLog, sizeof(cmpEntry_t) * ownCount);
+        if(replaceOperand(in, ownLog, ownCount))
+        {
+          isNew = execute(in);
+        }
+      }
+      if(isNew)
+      {
+        corpus.push_back(in);
+        if(!corpusDir.empty())
+        {
+          char name[32];
+
+          snprintf(name, sizeof(name), "/%08x", refCrc32(in.data(), in.size()));
+          saveInput(in, (corpusDir + name).c_str());
+          saved++;
+        }
+      }
+    }
+
+    if(nowMs() >= nextReportMs)
+    {
+      printf("%6.0f s  %10llu execs  %8.0f execs/s  %4u edges  %5zu inputs\n", (nowMs() - startMs) / 1000.0,
+             (unsigned long long)execs, execs * 1000.0 / (nowMs() - startMs), edges, corpus.size());
+      fflush(stdout);
+      nextReportMs += 1000;
+    }
+  }
+
+  uint64_t elapsedMs = max((uint64_t)1, nowMs() - startMs);
+
+  printf("done: %llu execs in %.1f s (%.0f/s), %u edges, %zu inputs (%u saved), no violations\n", (unsigned long long)execs,
+         elapsedMs / 1000.0, execs * 1000.0 / elapsedMs, edges, corpus.size(), saved);
+  printf("valid frames reached: %u fleet, %u firmware\n", peerLinkCalls.fleetMessages, peerLinkCalls.firmwareMessages);
+  return 0;
+}
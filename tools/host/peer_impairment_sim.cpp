@@ -0,0 +1,531 @@
+/*
+  The peer network on a bad radio link, simulated. A master sends the tally with
+  peerNetworkSend() and the slaves receive it with peerNetworkReceive(), the firmware code
+  for both. Every slave has its own link between the two. The link loses, corrupts,
+  delays, duplicates and reorders the frames as its impairment profile says. A slave keeps
+  its own tick and goes frozen as in stateRunningPeerNetwork(). The master follows a
+  scripted tally sequence (random by default).
+
+    peer_impairment_sim [--profile NAME:KEY=VALUE,...]... [--tolerance TICKS,...] [--period TICKS,...]
+                        [--slaves N] [--seconds S] [--seed N] [--script FILE]
+
+  Profile keys: loss=PERCENT, burst=ENTER/LEAVE (percent per 10 ms into and out of a burst in
+  which every frame is lost), delay=MS, jitter=MS (uniform, added to the delay), dup=PERCENT,
+  reorder=PERCENT (held back 10..30 ms), corrupt=PERCENT (one bit flipped). Without --profile
+  a built-in set is run. --tolerance is the frozen threshold in ticks (the firmware uses
+  INCOMING_FAULT_TOLERANCE_IN_10MS_TICKS), --period sends every that many ticks, and always
+  at once on a change. Both take a list, every combination is run.
+
+  Per profile: time from a change of the master to the slave showing it (superseded changes
+  are left out), time the slaves show anything else than the master (frozen included), the
+  longest such stretch, and the entries into frozen, which are all false: the master never
+  stops.
+  The script file has lines "TIME_MS PROGRAM PREVIEW".
+*/
+#include "Arduino.h"
+#include "peer_links.hpp"
+#include "TallyBoxInfra.hpp"
+#include "TallyBoxStateMachine.hpp"
+#include <vector>
+#include <string>
+#include <queue>
+#include <random>
+#include <algorithm>
+
+#define TICK_US               10000
+#define STEP_US               1000
+#define WARMUP_US             1000000     /*before the measurement starts*/
+#define CAMERAS               8
+
+typedef struct
+{
+  std::string name;
+  double loss;
+  double burstEnter;
+  double burstLeave;
+  double delayMs;
+  double jitterMs;
+  double dup;
+  double reorder;
+  double corrupt;
+} profile_t;
+
+typedef struct
+{
+  uint64_t atUs;
+  uint16_t program;
+  uint16_t preview;
+} tallyChange_t;
+
+typedef struct
+{
+  uint64_t atUs;
+  uint64_t seq;                     /*equal times are delivered in the order sent*/
+  uint16_t slave;
+  std::vector<uint8_t> data;
+} delivery_t;
+
+struct laterFirst
+{
+  bool operator()(const delivery_t& a, const delivery_t& b) const
+  {
+    return (a.atUs != b.atUs) ? (a.atUs > b.atUs) : (a.seq > b.seq);
+  }
+};
+
+typedef struct
+{
+  tallyBoxConfig_t c;
+  std::deque<hostDatagram_t> queue;
+  int32_t tickCompensation;
+  uint32_t offsetUs;                /*phase of its tick against the master*/
+  uint32_t ticks;
+  uint32_t lastReceivedTick;
+  bool frozen;
+  uint16_t green;
+  uint16_t red;
+  bool burst;                       /*link in a burst*/
+  uint64_t pendingSince;            /*change of the master not shown yet, 0: none*/
+  uint64_t wrongSince;              /*0: shows the master's state*/
+} slave_t;
+
+typedef struct
+{
+  uint64_t framesSent;
+  uint64_t framesDelivered;
+  std::vector<uint32_t> timeToCorrectUs;
+  uint64_t superseded;
+  uint64_t wrongUs;
+  uint64_t longestWrongUs;
+  uint64_t frozenUs;
+  uint32_t frozenEntries;
+} runStats_t;
+
+static const profile_t builtinProfiles[] =
+{
+  /*name        loss burstIn burstOut delay jitter dup reorder corrupt*/
+  {"clean",        0,    0,     0,      1,    0,    0,   0,     0},
+  {"loss5",        5,    0,     0,      1,    0,    0,   0,     0},
+  {"loss30",      30,    0,     0,      1,    0,    0,   0,     0},
+  {"jitter",       0,    0,     0,      5,   40,    0,   0,     0},
+  {"dup-reorder",  0,    0,     0,      2,    2,    5,   5,     1},
+  {"burst200ms",   1,  0.2,     5,      1,    0,    0,   0,     0},
+  {"burst2s",      1, 0.05,   0.5,      1,    0,    0,   0,     0},
+  {"bad-rf",      10,  0.2,     2,      3,   20,    1,   2,   0.5},
+};
+
+static std::mt19937_64 rng;
+
+
+static double uniform()
+{
+  return (double)(rng() >> 11) / (double)(1ULL << 53);
+}
+
+static bool chance(double percent)
+{
+  return (percent > 0) && ((uniform() * 100.0) < percent);
+}
+
+static bool parseProfile(const std::string& spec, profile_t& p)
+{
+  size_t colon = spec.find(':');
+
+  p = {};
+  p.name = spec.substr(0, colon);
+  p.delayMs = 1;
+  if(colon == std::string::npos)
+  {
+    return true;
+  }
+
+  std::string rest = spec.substr(colon + 1);
+  size_t start = 0;
+
+  while(start < rest.size())
+  {
+    size_t comma = rest.find(',', start);
+    std::string kv = rest.substr(start, (comma == std::string::npos) ? std::string::npos : comma - start);
+    size_t eq = kv.find('=');
+    std::string key = kv.substr(0, eq);
+    const char *value = (eq == std::string::npos) ? "" : kv.c_str() + eq + 1;
+
+    if(key == "loss")         p.loss = atof(value);
+    else if(key == "delay")   p.delayMs = atof(value);
+    else if(key == "jitter")  p.jitterMs = atof(value);
+    else if(key == "dup")     p.dup = atof(value);
+    else if(key == "reorder") p.reorder = atof(value);
+    else if(key == "corrupt") p.corrupt = atof(value);
+    else if((key == "burst") && (sscanf(value, "%lf/%lf", &p.burstEnter, &p.burstLeave) == 2)) {}
+    else
+    {
+      fprintf(stderr, "bad profile key '%s'\n", kv.c_str());
+      return false;
+    }
+    start = (comma == std::string::npos) ? rest.size() : comma + 1;
+  }
+  return true;
+}
+
+static std::vector<uint32_t> parseList(const char *text)
+{
+  std::vector<uint32_t> v;
+  const char *p = text;
+
+  while(*p)
+  {
+    v.push_back((uint32_t)strtoul(p, (char**)&p, 10));
+    p += (*p == ',');
+  }
+  return v;
+}
+
+/*a live show: mostly a change every few seconds, now and then fast cutting*/
+static std::vector<tallyChange_t> randomScript(uint64_t durationUs)
+{
+  std::vector<tallyChange_t> changes;
+  uint16_t program = 1;
+  uint16_t preview = 2;
+  uint64_t t = 0;
+
+  changes.push_back({0, program, preview});
+  for(;;)
+  {
+    t += (uint64_t)((uniform() < 0.3) ? (200 + uniform() * 400) : (1000 + uniform() * 4000)) * 1000;
+    if(t >= durationUs)
+    {
+      break;
+    }
+    if(uniform() < 0.6)
+    {
+      std::swap(program, preview);
+    }
+    else
+    {
+      uint16_t source;
+
+      do
+      {
+        source = (uint16_t)(1 + (rng() % CAMERAS));
+      } while((source == program) || (source == preview));
+      preview = source;
+    }
+    changes.push_back({t, program, preview});
+  }
+  return changes;
+}
+
+static bool readScript(const char *path, std::vector<tallyChange_t>& changes)
+{
+  FILE *f = fopen(path, "r");
+  char line[128];
+
+  if(f == NULL)
+  {
+    return false;
+  }
+  while(fgets(line, sizeof(line), f))
+  {
+    unsigned ms, program, preview;
+
+    if((line[0] != '#') && (sscanf(line, "%u %u %u", &ms, &program, &preview) == 3))
+    {
+      changes.push_back({(uint64_t)ms * 1000, (uint16_t)program, (uint16_t)preview});
+    }
+  }
+  fclose(f);
+  return !changes.empty();
+}
+
+/*one frame of the master over the link of one slave*/
+static void transmit(const profile_t& p, slave_t& s, uint16_t slaveIndex, const std::vector<uint8_t>& frame, uint64_t nowUs,
+                     std::priority_queue<delivery_t, std::vector<delivery_t>, laterFirst>& air, uint64_t& seq)
+{
+  if(s.burst || chance(p.loss))
+  {
+    return;
+  }
+
+  int copies = chance(p.dup) ? 2 : 1;
+
+  for(int i = 0; i < copies; i++)
+  {
+    delivery_t d = {nowUs, seq++, slaveIndex, frame};
+    double delayMs = p.delayMs + uniform() * p.jitterMs;
+
+    if(chance(p.reorder))
+    {
+      delayMs += 10 + uniform() * 20;
+    }
+    if(i > 0)
+    {
+      delayMs += uniform() * 2;
+    }
+    if(chance(p.corrupt))
+    {
+      size_t bit = rng() % (d.data.size() * 8);
+
+      d.data[bit / 8] ^= (uint8_t)(1 << (bit % 8));
+    }
+    d.atUs += (uint64_t)(delayMs * 1000);
+    air.push(d);
+  }
+}
+
+static void slaveTick(slave_t& s, const tallyChange_t& truth, uint64_t nowUs, uint32_t tolerance, runStats_t& st)
+{
+  peerTally_t t;
+  bool measuring = (nowUs >= WARMUP_US);
+
+  /*the slave's own receive queue and tick compensation*/
+  std::swap(Udp.received, s.queue);
+  setTickCompensationValue(s.tickCompensation);
+  bool received = peerNetworkReceive(s.c, t);
+  s.tickCompensation = getTickCompensationValue();
+  std::swap(Udp.received, s.queue);
+
+  /*as in stateRunningPeerNetwork()*/
+  s.ticks++;
+  if(received)
+  {
+    s.green = t.greenChannel;
+    s.red = t.redChannel;
+    s.lastReceivedTick = s.ticks;
+    s.frozen = false;
+  }
+  if((s.ticks - s.lastReceivedTick) > tolerance)
+  {
+    if(!s.frozen && measuring)
+    {
+      st.frozenEntries++;
+    }
+    s.frozen = true;
+  }
+
+  bool correct = (!s.frozen && (s.green == truth.preview) && (s.red == truth.program));
+
+  if(s.pendingSince && correct)
+  {
+    if(s.pendingSince >= WARMUP_US)
+    {
+      st.timeToCorrectUs.push_back((uint32_t)(nowUs - s.pendingSince));
+    }
+    s.pendingSince = 0;
+  }
+  if(!measuring)
+  {
+    return;
+  }
+  if(s.frozen)
+  {
+    st.frozenUs += TICK_US;
+  }
+  if(!correct)
+  {
+    st.wrongUs += TICK_US;
+    if(s.wrongSince == 0)
+    {
+      s.wrongSince = nowUs;
+    }
+    st.longestWrongUs = max(st.longestWrongUs, nowUs + TICK_US - s.wrongSince);
+  }
+  else
+  {
+    s.wrongSince = 0;
+  }
+}
+
+static runStats_t simulate(const profile_t& p, const std::vector<tallyChange_t>& script, uint64_t durationUs, uint16_t slaveCount,
+                           uint32_t tolerance, uint32_t period, uint64_t seed)
+{
+  runStats_t st = {};
+  std::vector<slave_t> slaves(slaveCount);
+  std::priority_queue<delivery_t, std::vector<delivery_t>, laterFirst> air;
+  tallyBoxConfig_t master = {};
+  size_t nextChange = 0;
+  tallyChange_t truth = {0, 0, 0};
+  uint32_t masterTicks = 0;
+  uint64_t seq = 0;
+  bool changed = false;
+
+  rng.seed(seed);
+  master.network.isMaster = true;
+  for(uint16_t i = 0; i < slaveCount; i++)
+  {
+    slaves[i].c.user.cameraId = (uint16_t)(1 + (i % CAMERAS));
+    slaves[i].offsetUs = (uint32_t)((rng() % (TICK_US / STEP_US)) * STEP_US);
+  }
+
+  for(uint64_t now = 0; now < durationUs; now += STEP_US)
+  {
+    hostSetClock(now);
+
+    /*the master reads the switcher and sends at its tick*/
+    if((now % TICK_US) == 0)
+    {
+      while((nextChange < script.size()) && (script[nextChange].atUs <= now))
+      {
+        truth = script[nextChange++];
+        changed = true;
+        for(uint16_t i = 0; i < slaveCount; i++)
+        {
+          st.superseded += (slaves[i].pendingSince != 0);
+          slaves[i].pendingSince = now;
+        }
+      }
+      /*bursts last in time, whatever is sent*/
+      for(uint16_t i = 0; i < slaveCount; i++)
+      {
+        slaves[i].burst = slaves[i].burst ? !chance(p.burstLeave) : chance(p.burstEnter);
+      }
+      if(changed || ((masterTicks % period) == 0))
+      {
+        Udp.sent.clear();
+        peerTally_t t = {truth.preview, truth.program, false, 0};
+
+        peerNetworkSend(master, t);
+        for(uint16_t i = 0; i < slaveCount; i++)
+        {
+          transmit(p, slaves[i], i, Udp.sent.back().data, now, air, seq);
+        }
+        st.framesSent += slaveCount;
+        changed = false;
+      }
+      masterTicks++;
+    }
+
+    while(!air.empty() && (air.top().atUs <= now))
+    {
+      const delivery_t& d = air.top();
+
+      slaves[d.slave].queue.push_back({d.data, IPAddress(192, 168, 1, 100)});
+      st.framesDelivered++;
+      air.pop();
+    }
+
+    for(uint16_t i = 0; i < slaveCount; i++)
+    {
+      if((now % TICK_US) == slaves[i].offsetUs)
+      {
+        slaveTick(slaves[i], truth, now, tolerance, st);
+      }
+    }
+  }
+  return st;
+}
+
+static uint32_t percentileMs(std::vector<uint32_t>& v, double p)
+{
+  if(v.empty())
+  {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[min(v.size() - 1, (size_t)(p * v.size()))] / 1000;
+}
+
+int main(int argc, char **argv)
+{
+  std::vector<profile_t> profiles;
+  std::vector<uint32_t> tolerances = {INCOMING_FAULT_TOLERANCE_IN_10MS_TICKS};
+  std::vector<uint32_t> periods = {1};
+  std::vector<tallyChange_t> script;
+  uint16_t slaveCount = 20;
+  double seconds = 600;
+  uint64_t seed = 1;
+  const char *scriptPath = NULL;
+
+  for(int i = 1; i < argc; i++)
+  {
+    if((strcmp(argv[i], "--profile") == 0) && ((i + 1) < argc))
+    {
+      profile_t p;
+
+      if(!parseProfile(argv[++i], p))
+      {
+        return 2;
+      }
+      profiles.push_back(p);
+    }
+    else if((strcmp(argv[i], "--tolerance") == 0) && ((i + 1) < argc))
+    {
+      tolerances = parseList(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--period") == 0) && ((i + 1) < argc))
+    {
+      periods = parseList(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--slaves") == 0) && ((i + 1) < argc))
+    {
+      slaveCount = (uint16_t)max(1, atoi(argv[++i]));
+    }
+    else if((strcmp(argv[i], "--seconds") == 0) && ((i + 1) < argc))
+    {
+      seconds = atof(argv[++i]);
+    }
+    else if((strcmp(argv[i], "--seed") == 0) && ((i + 1) < argc))
+    {
+      seed = strtoull(argv[++i], NULL, 10);
+    }
+    else if((strcmp(argv[i], "--script") == 0) && ((i + 1) < argc))
+    {
+      scriptPath = argv[++i];
+    }
+    else
+    {
+      fprintf(stderr, "usage: peer_impairment_sim [--profile NAME:KEY=VALUE,...]... [--tolerance TICKS,...] [--period TICKS,...]\n"
+                      "                           [--slaves N] [--seconds S] [--seed N] [--script FILE]\n");
+      return 2;
+    }
+  }
+  if(profiles.empty())
+  {
+    profiles.assign(builtinProfiles, builtinProfiles + (sizeof(builtinProfiles) / sizeof(builtinProfiles[0])));
+  }
+  if(tolerances.empty() || periods.empty() || (std::find(periods.begin(), periods.end(), 0u) != periods.end()))
+  {
+    fprintf(stderr, "bad --tolerance or --period\n");
+    return 2;
+  }
+
+  uint64_t durationUs = (uint64_t)(seconds * 1e6);
+
+  rng.seed(seed);
+  if(scriptPath != NULL)
+  {
+    if(!readScript(scriptPath, script))
+    {
+      fprintf(stderr, "no script in %s\n", scriptPath);
+      return 2;
+    }
+  }
+  else
+  {
+    script = randomScript(durationUs);
+  }
+
+  printf("%u slaves, %.0f s, %zu tally changes, times in ms\n", slaveCount, seconds, script.size());
+  printf("%-12s %5s %4s %7s | %8s %8s %8s %8s | %7s %8s | %9s %8s\n", "profile", "tol", "per", "deliv%", "ttc p50", "ttc p99",
+         "ttc max", "supersd", "wrong%", "longest", "frozen/h", "frozen%");
+
+  for(size_t p = 0; p < profiles.size(); p++)
+  {
+    for(size_t t = 0; t < tolerances.size(); t++)
+    {
+      for(size_t k = 0; k < periods.size(); k++)
+      {
+        runStats_t st = simulate(profiles[p], script, durationUs, slaveCount, tolerances[t], periods[k], seed);
+        double slaveHours = slaveCount * (durationUs - WARMUP_US) / 3.6e9;
+        double slaveUs = (double)slaveCount * (durationUs - WARMUP_US);
+
+        printf("%-12s %5u %4u %7.2f | %8u %8u %8u %8llu | %7.3f %8llu | %9.2f %8.3f\n", profiles[p].name.c_str(), tolerances[t],
+               periods[k], 100.0 * st.framesDelivered / max((uint64_t)1, st.framesSent), percentileMs(st.timeToCorrectUs, 0.5),
+               percentileMs(st.timeToCorrectUs, 0.99), percentileMs(st.timeToCorrectUs, 1.0), (unsigned long long)st.superseded,
+               100.0 * st.wrongUs / slaveUs, (unsigned long long)(st.longestWrongUs / 1000), st.frozenEntries / slaveHours,
+               100.0 * st.frozenUs / slaveUs);
+        fflush(stdout);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#include "peer_links.hpp"
+#include "TallyBoxFleet.hpp"
+#include "TallyBoxFirmware.hpp"
+
+peerLinkCalls_t peerLinkCalls = {};
+
+void tallyBoxFleetReceive(tallyBoxConfig_t& c, uint16_t messageId, uint8_t *payload, uint16_t len, IPAddress from)
+{
+  peerLinkCalls.fleetMessages++;
+  peerLinkCalls.lastMessageId = messageId;
+  peerLinkCalls.lastLen = len;
+}
+
+void tallyBoxFirmwareReceive(tallyBoxConfig_t& c, uint16_t messageId, uint8_t *payload, uint16_t len, IPAddress from)
+{
+  peerLinkCalls.firmwareMessages++;
+  peerLinkCalls.lastMessageId = messageId;
+  peerLinkCalls.lastLen = len;
+}
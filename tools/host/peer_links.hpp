@@ -0,0 +1,18 @@
+#ifndef __PEER_LINKS_HPP__
+#define __PEER_LINKS_HPP__
+/*stand-ins for the modules TallyBoxPeerNetwork.cpp hands messages to, for the host tools that
+  link the peer network itself*/
+#include "TallyBoxPeerNetwork.hpp"
+
+typedef struct
+{
+  uint32_t fleetMessages;
+  uint32_t firmwareMessages;
+  uint16_t lastMessageId;
+  uint16_t lastLen;
+} peerLinkCalls_t;
+
+extern WiFiUDP Udp;                 /*TallyBoxPeerNetwork.cpp*/
+extern peerLinkCalls_t peerLinkCalls;
+
+#endif
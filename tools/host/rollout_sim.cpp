@@ -0,0 +1,345 @@
+/*
+  Firmware rollout simulation (TallyBoxRollout).
+
+  One master pushes an image to simulated boxes over a simulated network that loses, delays
+  and corrupts messages. The program and preview cameras change every few seconds. During the
+  rollout some boxes lose the network for a while (the transfer must resume where it stopped)
+  and one box restarts in the middle of its transfer (it must start over and still finish).
+
+  Checked at the end: every box runs the new image with identical bytes, no box restarted while
+  its camera was in program or preview, and the interrupted boxes resumed instead of starting
+  over. Time is simulated in 10 ms ticks, as on the box, and the boxes write the blocks they have
+  taken from the idle time between the ticks.
+*/
+#include "Arduino.h"
+#include "TallyBoxRollout.hpp"
+#include <vector>
+#include <deque>
+#include <random>
+
+#define SIM_BOXES                 25
+#define SIM_IMAGE_SIZE            (420 * 1024)
+#define SIM_TICK_MS               10
+#define SIM_LOSS_PERCENT          2
+#define SIM_CORRUPT_PER_MILLE     2
+#define SIM_REORDER_PERCENT       1         /*delivered a few ticks late*/
+#define SIM_INTERRUPTIONS         4
+#define SIM_CUT_INTERVAL_MS       (3000 + 400 * (rng() % 8))
+#define SIM_OFFLINE_MS            3000
+#define SIM_BOOT_MS               1500
+#define SIM_LIMIT_MS              (15 * 60 * 1000)
+#define SIM_IDLE_WRITES_PER_TICK  2         /*blocks written between two ticks, a sector erase takes most of one*/
+#define MASTER_ADDRESS            1
+
+typedef struct
+{
+  uint32_t deliverAt;
+  uint32_t from;
+  uint32_t to;
+  rolloutMessage_t type;
+  std::vector<uint8_t> payload;
+} simMessage_t;
+
+typedef struct
+{
+  uint16_t cameraId;
+  rolloutSlave_t slave;
+  std::vector<uint8_t> flash;       /*image being written*/
+  std::vector<uint8_t> installed;   /*image the box runs*/
+  bool writing;
+  uint32_t bytesWritten;            /*over the whole run, resends of a resumed transfer included*/
+  uint32_t offlineUntil;
+  uint32_t bootedAt;                /*0 = running*/
+  uint32_t restarts;
+  uint32_t restartsOnAir;
+  bool interrupted;
+  bool powerCycled;
+} simBox_t;
+
+static std::mt19937 rng(7493);
+static uint32_t now = 0;
+static std::vector<uint8_t> image;
+static simBox_t boxes[SIM_BOXES];
+static std::deque<simMessage_t> network;
+static uint16_t programCamera = 1;
+static uint16_t previewCamera = 2;
+static uint32_t messagesSent = 0;
+static uint32_t messagesLost = 0;
+static uint32_t messagesCorrupted = 0;
+
+static uint32_t addressOf(uint8_t box)
+{
+  return 100 + box;
+}
+
+static bool cameraOnAir(uint16_t cameraId)
+{
+  return ((cameraId == programCamera) || (cameraId == previewCamera));
+}
+
+static void simSend(uint32_t from, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len)
+{
+  simMessage_t msg;
+
+  messagesSent++;
+  if((uint32_t)(rng() % 100) < SIM_LOSS_PERCENT)
+  {
+    messagesLost++;
+    return;
+  }
+  msg.deliverAt = now + SIM_TICK_MS * (((uint32_t)(rng() % 100) < SIM_REORDER_PERCENT) ? 3 : 1);
+  msg.from = from;
+  msg.to = to;
+  msg.type = type;
+  msg.payload.assign(payload, payload + len);
+
+  /*a flipped bit that the frame check of the network would not see: left to the block crc*/
+  if((type == ROLLOUT_MESSAGE_BLOCK) && ((uint32_t)(rng() % 1000) < SIM_CORRUPT_PER_MILLE))
+  {
+    msg.payload[12 + rng() % (len - 12)] ^= (uint8_t)(1 << (rng() % 8));
+    messagesCorrupted++;
+  }
+  network.push_back(msg);
+}
+
+/*** master backend ******************************************/
+
+static void masterSend(void *ctx, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len)
+{
+  simSend(MASTER_ADDRESS, type, to, payload, len);
+}
+
+static bool masterReadImage(void *ctx, uint32_t offset, uint8_t *buf, uint16_t len)
+{
+  if((offset + len) > image.size())
+  {
+    return false;
+  }
+  memcpy(buf, image.data() + offset, len);
+  return true;
+}
+
+static bool masterIsOnAir(void *ctx, uint16_t cameraId)
+{
+  return cameraOnAir(cameraId);
+}
+
+static const rolloutMasterBackend_t masterBackend = {masterSend, masterReadImage, masterIsOnAir, NULL};
+
+/*** box backend *********************************************/
+
+static void boxSend(void *ctx, rolloutMessage_t type, uint32_t to, const uint8_t *payload, uint16_t len)
+{
+  simBox_t *box = (simBox_t*)ctx;
+
+  simSend(addressOf((uint8_t)(box - boxes)), type, to, payload, len);
+}
+
+static bool boxFlashBegin(void *ctx, uint32_t size)
+{
+  simBox_t *box = (simBox_t*)ctx;
+
+  box->flash.clear();
+  box->flash.reserve(size);
+  box->writing = true;
+  return true;
+}
+
+static bool boxFlashWrite(void *ctx, const uint8_t *data, uint16_t len)
+{
+  simBox_t *box = (simBox_t*)ctx;
+
+  if(!box->writing)
+  {
+    return false;
+  }
+  box->flash.insert(box->flash.end(), data, data + len);
+  box->bytesWritten += len;
+  return true;
+}
+
+static bool boxFlashEnd(void *ctx, bool commit)
+{
+  simBox_t *box = (simBox_t*)ctx;
+
+  box->writing = false;
+  return commit;
+}
+
+static bool boxIsOnAir(void *ctx)
+{
+  return cameraOnAir(((simBox_t*)ctx)->cameraId);
+}
+
+static void boxRestart(void *ctx, uint32_t imageId)
+{
+  simBox_t *box = (simBox_t*)ctx;
+
+  box->restarts++;
+  box->restartsOnAir += cameraOnAir(box->cameraId);
+  box->installed = box->flash;
+  box->bootedAt = now + SIM_BOOT_MS;
+  rolloutSlaveInitialize(box->slave, imageId);
+}
+
+static rolloutSlaveBackend_t boxBackend(simBox_t& box)
+{
+  rolloutSlaveBackend_t b = {boxSend, boxFlashBegin, boxFlashWrite, boxFlashEnd, boxIsOnAir, boxRestart, &box};
+  return b;
+}
+
+/*** simulation **********************************************/
+
+static void deliver(rolloutMaster_t& master)
+{
+  size_t pending = network.size();
+
+  for(size_t i = 0; i < pending; i++)
+  {
+    simMessage_t msg = network.front();
+
+    network.pop_front();
+    if(msg.deliverAt > now)
+    {
+      network.push_back(msg);
+      continue;
+    }
+    if(msg.to == MASTER_ADDRESS)
+    {
+      rolloutMasterReceive(masterBackend, master, msg.from, msg.payload.data(), (uint16_t)msg.payload.size(), now);
+      continue;
+    }
+
+    simBox_t& box = boxes[msg.to - addressOf(0)];
+
+    if((now < box.offlineUntil) || (box.bootedAt > now))
+    {
+      continue;
+    }
+    rolloutSlaveReceive(boxBackend(box), box.slave, msg.type, msg.from, msg.payload.data(), (uint16_t)msg.payload.size());
+  }
+}
+
+/*cuts the network of a box in the middle of its transfer, and once powers a box off and on*/
+static void interrupt()
+{
+  static uint32_t nextCutAt = 2000;
+  static bool powerCycleDone = false;
+  static uint8_t interruptions = 0;
+
+  if((now < nextCutAt) || (interruptions >= SIM_INTERRUPTIONS))
+  {
+    return;
+  }
+  nextCutAt = now + SIM_CUT_INTERVAL_MS;
+
+  for(uint8_t i = 0; i < SIM_BOXES; i++)
+  {
+    simBox_t& box = boxes[(i + now / 7) % SIM_BOXES];
+
+    if((box.slave.state == ROLLOUT_SLAVE_RECEIVING) && (box.slave.nextOffset > (SIM_IMAGE_SIZE / 4))
+       && !box.interrupted && !box.powerCycled)
+    {
+      if(!powerCycleDone)
+      {
+        /*the image written so far is lost with the power*/
+        printf("%7.2f s: camera %2u powered off at %u bytes\n", now / 1000.0, box.cameraId, box.slave.nextOffset);
+        box.powerCycled = true;
+        box.writing = false;
+        box.bootedAt = now + SIM_BOOT_MS;
+        rolloutSlaveInitialize(box.slave, 0);
+        powerCycleDone = true;
+        interruptions++;
+      }
+      else
+      {
+        box.interrupted = true;
+        box.offlineUntil = now + SIM_OFFLINE_MS;
+        interruptions++;
+        printf("%7.2f s: camera %2u off the network at %u bytes\n", now / 1000.0, box.cameraId, box.slave.nextOffset);
+      }
+      return;
+    }
+  }
+}
+
+static void cutCameras()
+{
+  static uint32_t nextCutAt = 0;
+
+  if(now >= nextCutAt)
+  {
+    programCamera = previewCamera;
+    previewCamera = 1 + rng() % SIM_BOXES;
+    nextCutAt = now + 2000 + rng() % 4000;
+  }
+}
+
+int main()
+{
+  static rolloutMaster_t master;
+  bool ok = true;
+  uint32_t maxDurationMs = 0;
+
+  image.resize(SIM_IMAGE_SIZE);
+  for(size_t i = 0; i < image.size(); i++)
+  {
+    image[i] = (uint8_t)rng();
+  }
+
+  rolloutMasterInitialize(master);
+  for(uint8_t i = 0; i < SIM_BOXES; i++)
+  {
+    boxes[i].cameraId = i + 1;
+    rolloutSlaveInitialize(boxes[i].slave, 0);
+    rolloutMasterAddTarget(master, addressOf(i), boxes[i].cameraId);
+  }
+  rolloutMasterStart(master, SIM_IMAGE_SIZE, ROLLOUT_DEFAULT_CONCURRENCY, now);
+
+  printf("%u boxes, image %u bytes, concurrency %u, %u%% loss, %u/1000 blocks corrupted\n",
+         SIM_BOXES, SIM_IMAGE_SIZE, ROLLOUT_DEFAULT_CONCURRENCY, SIM_LOSS_PERCENT, SIM_CORRUPT_PER_MILLE);
+
+  while((master.phase != ROLLOUT_FINISHED) && (now < SIM_LIMIT_MS))
+  {
+    now += SIM_TICK_MS;
+    cutCameras();
+    interrupt();
+    deliver(master);
+    rolloutMasterUpdate(masterBackend, master, now);
+    for(uint8_t i = 0; i < SIM_BOXES; i++)
+    {
+      if(boxes[i].bootedAt <= now)
+      {
+        for(uint8_t n = 0; n < SIM_IDLE_WRITES_PER_TICK; n++)
+        {
+          rolloutSlaveIdle(boxBackend(boxes[i]), boxes[i].slave);
+        }
+        rolloutSlaveUpdate(boxBackend(boxes[i]), boxes[i].slave);
+      }
+    }
+  }
+
+  printf("\ncamera wave attempts  state       duration s  written kB  resent blocks\n");
+  for(uint8_t i = 0; i < master.targetCount; i++)
+  {
+    rolloutTarget_t& t = master.targets[i];
+    simBox_t& box = boxes[i];
+    uint32_t durationMs = t.finishedAt - t.startedAt;
+    bool boxOk = (t.state == ROLLOUT_BOX_DONE) && (box.installed == image) && (box.restartsOnAir == 0) && (box.restarts == 1)
+                 && (box.powerCycled || (box.bytesWritten == SIM_IMAGE_SIZE));
+
+    maxDurationMs = max(maxDurationMs, durationMs);
+    printf("%6u %4u %8u  %-10s %11.2f %11u %14u%s%s%s\n", t.cameraId, t.wave, t.attempts, rolloutBoxStateName(t.state),
+           durationMs / 1000.0, box.bytesWritten / 1024, t.resentBlocks,
+           (box.interrupted ? " resumed" : ""), (box.powerCycled ? " power cycled" : ""), (boxOk ? "" : " FAILED"));
+    ok &= boxOk;
+  }
+
+  printf("\nrollout %s in %.2f s (%u waves), longest box %.2f s\n", (ok ? "ok" : "FAILED"),
+         (master.finishedAt - master.startedAt) / 1000.0, master.waves, maxDurationMs / 1000.0);
+  printf("messages %u, lost %u, corrupted %u, blocks sent %u (%.1f%% over the image size)\n",
+         messagesSent, messagesLost, messagesCorrupted, master.blocksSent,
+         100.0 * ((double)master.blocksSent * ROLLOUT_BLOCK_SIZE / ((double)SIM_IMAGE_SIZE * SIM_BOXES) - 1.0));
+
+  return (ok ? 0 : 1);
+}
@@ -0,0 +1,92 @@
+#include "Arduino.h"
+#include <time.h>
+
+static uint64_t monotonicMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+static bool simulatedClock = false;
+static uint64_t simulatedMicros = 0;
+
+void hostSetClock(uint64_t us)
+{
+  simulatedClock = true;
+  simulatedMicros = us;
+}
+
+unsigned long millis()
+{
+  return (unsigned long)((simulatedClock ? simulatedMicros : monotonicMicros()) / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)(simulatedClock ? simulatedMicros : monotonicMicros());
+}
+
+void delay(unsigned long ms)
+{
+  struct timespec ts = {(time_t)(ms / 1000), (long)((ms % 1000) * 1000000L)};
+  nanosleep(&ts, NULL);
+}
+
+size_t strlcpy(char *dst, const char *src, size_t size)
+{
+  size_t len = strlen(src);
+
+  if(size > 0)
+  {
+    size_t n = min(len, size - 1);
+    memcpy(dst, src, n);
+    dst[n] = 0;
+  }
+  return len;
+}
+
+int hostPins[HOST_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  hostPins[pin % HOST_PINS] = value;
+}
+
+void analogWrite(uint8_t pin, int value)
+{
+  hostPins[pin % HOST_PINS] = value;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+size_t Print::printf(const char *fmt, ...)
+{
+  char buf[256];
+  va_list args;
+  int n;
+
+  va_start(args, fmt);
+  n = vsnprintf(buf, sizeof(buf), fmt, args);
+  va_end(args);
+  return (n > 0) ? write((const uint8_t*)buf, min((size_t)n, sizeof(buf) - 1)) : 0;
+}
+
+EspClass ESP;
+HostSerial Serial;
+
+size_t HostSerial::write(const uint8_t *buf, size_t len)
+{
+  if(echo)
+  {
+    fwrite(buf, 1, len, stderr);
+  }
+  return len;
+}
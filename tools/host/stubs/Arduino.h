@@ -0,0 +1,85 @@
+#ifndef __HOST_ARDUINO_H__
+#define __HOST_ARDUINO_H__
+/*minimal Arduino API for compiling TallyBox modules on a Linux host*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <ctype.h>
+#include <strings.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <string>
+
+using std::min;
+using std::max;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+
+/*simulations: from the first call on, millis() and micros() return this time*/
+void hostSetClock(uint64_t us);
+
+size_t strlcpy(char *dst, const char *src, size_t size);
+
+/*pins of the NodeMCU board, the last written value is kept in hostPins*/
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define LED_BUILTIN   2
+#define D7            13
+#define D8            15
+#define HOST_PINS     17
+
+extern int hostPins[HOST_PINS];
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void analogWrite(uint8_t pin, int value);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *buf, size_t len) = 0;
+  size_t write(uint8_t b) { return write(&b, 1); }
+  size_t print(const char *s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class EspClass
+{
+public:
+  void restart() { exit(0); }
+  uint32_t getCycleCount() { return (uint32_t)micros() * 80; }
+  uint8_t getCpuFreqMHz() { return 80; }
+};
+
+extern EspClass ESP;
+
+class String
+{
+public:
+  String(const char *s = "") : str(s) {}
+  const char* c_str() const { return str.c_str(); }
+private:
+  std::string str;
+};
+
+/*output is dropped unless echo is set*/
+class HostSerial
+{
+public:
+  bool echo = false;
+  int availableForWrite() { return 256; }
+  size_t write(const uint8_t *buf, size_t len);
+};
+
+extern HostSerial Serial;
+
+#endif
@@ -0,0 +1,33 @@
+#include "Arduino_CRC32.h"
+
+static uint32_t crcTable[256];
+static bool crcTableInitialized = false;
+
+static void initCrcTable()
+{
+  for(uint32_t i = 0; i < 256; i++)
+  {
+    uint32_t c = i;
+    for(int k = 0; k < 8; k++)
+    {
+      c = (c & 1) ? (0xEDB88320UL ^ (c >> 1)) : (c >> 1);
+    }
+    crcTable[i] = c;
+  }
+  crcTableInitialized = true;
+}
+
+uint32_t Arduino_CRC32::calc(uint8_t const data[], size_t const len)
+{
+  uint32_t crc = 0xFFFFFFFFUL;
+
+  if(!crcTableInitialized)
+  {
+    initCrcTable();
+  }
+  for(size_t i = 0; i < len; i++)
+  {
+    crc = crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFUL;
+}
@@ -0,0 +1,13 @@
+#ifndef __HOST_ARDUINO_CRC32_H__
+#define __HOST_ARDUINO_CRC32_H__
+/*same polynomial and conventions as the Arduino_CRC32 library (CRC-32/ISO-HDLC)*/
+#include <stdint.h>
+#include <stddef.h>
+
+class Arduino_CRC32
+{
+public:
+  uint32_t calc(uint8_t const data[], size_t const len);
+};
+
+#endif
@@ -0,0 +1,4 @@
+#ifndef __HOST_EEPROM_H__
+#define __HOST_EEPROM_H__
+/*included by TallyBoxConfiguration.hpp, not used by the host tools*/
+#endif
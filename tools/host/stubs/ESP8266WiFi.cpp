@@ -0,0 +1,36 @@
+#include "ESP8266WiFi.h"
+
+static hostTcpConnection_t *pending = NULL;
+
+void hostTcpConnect(hostTcpConnection_t *connection)
+{
+  connection->connected = true;
+  pending = connection;
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t len)
+{
+  if(!connected())
+  {
+    return 0;
+  }
+  conn->written += len;
+  return len;
+}
+
+void WiFiClient::stop()
+{
+  if(conn)
+  {
+    conn->connected = false;
+  }
+  conn = NULL;
+}
+
+WiFiClient WiFiServer::accept()
+{
+  WiFiClient client(pending);
+
+  pending = NULL;
+  return client;
+}
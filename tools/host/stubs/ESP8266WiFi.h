@@ -0,0 +1,58 @@
+#ifndef __HOST_ESP8266WIFI_H__
+#define __HOST_ESP8266WIFI_H__
+/*IPAddress, and TCP connections that the host tool feeds: no real network*/
+#include "Arduino.h"
+
+class IPAddress
+{
+public:
+  IPAddress() : address(0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address(a | (b << 8) | (c << 16) | ((uint32_t)d << 24)) {}
+  IPAddress(uint32_t a) : address(a) {}
+  operator uint32_t() const { return address; }
+  uint8_t operator[](int i) const { return (uint8_t)(address >> (8 * i)); }
+private:
+  uint32_t address;     /*network byte order, as on the ESP8266*/
+};
+
+/*one TCP connection: the host tool sets the input the firmware reads, the output is counted*/
+typedef struct
+{
+  const char *input;
+  size_t inputLen;
+  size_t inputPos;
+  size_t written;
+  bool connected;
+} hostTcpConnection_t;
+
+class WiFiClient : public Print
+{
+public:
+  WiFiClient(hostTcpConnection_t *connection = NULL) : conn(connection) {}
+  explicit operator bool() { return (available() > 0) || connected(); }
+  int available() { return (conn && (conn->inputPos < conn->inputLen)) ? (int)(conn->inputLen - conn->inputPos) : 0; }
+  int read() { return (available() > 0) ? (uint8_t)conn->input[conn->inputPos++] : -1; }
+  uint8_t connected() { return (conn && conn->connected) ? 1 : 0; }
+  int availableForWrite() { return connected() ? 1460 : 0; }
+  size_t write(const uint8_t *buf, size_t len) override;
+  using Print::write;
+  void stop();
+  void setNoDelay(bool noDelay) {}
+
+private:
+  hostTcpConnection_t *conn;
+};
+
+class WiFiServer
+{
+public:
+  WiFiServer(uint16_t port) {}
+  void begin() {}
+  void setNoDelay(bool noDelay) {}
+  WiFiClient accept();
+};
+
+/*accept() of every WiFiServer returns this connection once*/
+void hostTcpConnect(hostTcpConnection_t *connection);
+
+#endif
@@ -0,0 +1,45 @@
+#include "WiFiUdp.h"
+
+int WiFiUDP::parsePacket()
+{
+  int ret = 0;
+
+  readPos = 0;
+  current.data.clear();
+  if(!received.empty())
+  {
+    current = received.front();
+    received.pop_front();
+    ret = (int)current.data.size();
+  }
+  return ret;
+}
+
+/*like the ESP8266: what does not fit is dropped with the datagram*/
+int WiFiUDP::read(uint8_t *buf, size_t len)
+{
+  size_t n = min(len, current.data.size() - readPos);
+
+  memcpy(buf, current.data.data() + readPos, n);
+  readPos += n;
+  return (int)n;
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+  outgoing.data.clear();
+  outgoing.address = ip;
+  return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buf, size_t len)
+{
+  outgoing.data.insert(outgoing.data.end(), buf, buf + len);
+  return len;
+}
+
+int WiFiUDP::endPacket()
+{
+  sent.push_back(outgoing);
+  return 1;
+}
@@ -0,0 +1,38 @@
+#ifndef __HOST_WIFIUDP_H__
+#define __HOST_WIFIUDP_H__
+/*WiFiUDP without a network: the datagrams to receive are queued by the host tool, the sent
+  ones are kept for it to look at*/
+#include "Arduino.h"
+#include "ESP8266WiFi.h"
+#include <deque>
+#include <vector>
+
+typedef struct
+{
+  std::vector<uint8_t> data;
+  IPAddress address;
+} hostDatagram_t;
+
+class WiFiUDP
+{
+public:
+  std::deque<hostDatagram_t> received;    /*queued by the host tool*/
+  std::vector<hostDatagram_t> sent;
+
+  uint8_t begin(uint16_t port) { return 1; }
+  int parsePacket();
+  int read(uint8_t *buf, size_t len);
+  int read(char *buf, size_t len) { return read((uint8_t*)buf, len); }
+  IPAddress remoteIP() { return current.address; }
+  uint16_t remotePort() { return 0; }
+  int beginPacket(IPAddress ip, uint16_t port);
+  size_t write(const uint8_t *buf, size_t len);
+  int endPacket();
+
+private:
+  hostDatagram_t current;
+  size_t readPos = 0;
+  hostDatagram_t outgoing;
+};
+
+#endif
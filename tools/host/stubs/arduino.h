@@ -0,0 +1,2 @@
+/*TallyBoxConfiguration.hpp includes the header in lower case*/
+#include "Arduino.h"
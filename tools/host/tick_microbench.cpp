@@ -0,0 +1,525 @@
+/*
+  What the pieces of one pass of tallyBoxStateMachineUpdate() cost, measured on the host with
+  Google Benchmark: the tick, the output with the pins stubbed, the status LED, the peer frame
+  codec, the TSL UMD packets of the master (received, unstuffed from tcp and republished) and a
+  line of terminal input. Next to the time per call each benchmark reports the heap allocations
+  per call (allocs_per_op). The tick must not allocate, so any allocation fails the run.
+
+    tick_microbench [--baseline FILE] [--tolerance FRACTION] [benchmark flags]
+
+  --benchmark_out=FILE --benchmark_out_format=json stores the results. Give an earlier result
+  file as --baseline to compare: a time per call longer than the baseline by more than the
+  tolerance (default 0.5) fails the run.
+  The times are of the host CPU. Compare them with each other and with earlier runs on the same
+  machine, not with the ESP8266.
+*/
+#include "Arduino.h"
+#include "TallyBoxInfra.hpp"
+#include "TallyBoxOutput.hpp"
+#include "TallyBoxPeerCodec.hpp"
+#include "TallyBoxPersistence.hpp"
+#include "TallyBoxStateMachine.hpp"
+#include "TallyBoxTerminal.hpp"
+#include "TallyBoxTsl.hpp"
+#include <benchmark/benchmark.h>
+#include <map>
+#include <string>
+
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t n, size_t size);
+extern "C" void* __libc_realloc(void *p, size_t size);
+extern "C" void __libc_free(void *p);
+
+static uint64_t allocations = 0;
+
+
+/*every allocation, operator new included, goes through these*/
+extern "C" void* malloc(size_t size)
+{
+  allocations++;
+  return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size)
+{
+  allocations++;
+  return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void *p, size_t size)
+{
+  allocations++;
+  return __libc_realloc(p, size);
+}
+
+extern "C" void free(void *p)
+{
+  __libc_free(p);
+}
+
+/*stand-ins for the state machine and the persistence, which the terminal calls*/
+bool tallyDataIsValid()
+{
+  return true;
+}
+
+void tallyBoxScheduleConfigurationWrite(tallyBoxNetworkConfig_t& c)
+{
+}
+
+void tallyBoxScheduleConfigurationWrite(tallyBoxUserConfig_t& c)
+{
+}
+
+void tallyBoxConfigurationChanged()
+{
+}
+
+static void reportAllocations(benchmark::State& state, uint64_t before)
+{
+  state.counters["allocs_per_op"] = benchmark::Counter((double)(allocations - before), benchmark::Counter::kAvgIterations);
+}
+
+/*** the benchmarks ******************************************/
+
+static void BM_getCurrentTick(benchmark::State& state)
+{
+  uint64_t before = allocations;
+
+  for(auto _ : state)
+  {
+    benchmark::DoNotOptimize(getCurrentTick());
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_getCurrentTick);
+
+static void BM_convertBrightnessValueToRaw(benchmark::State& state)
+{
+  volatile float percent = 80.0;
+  uint64_t before = allocations;
+
+  for(auto _ : state)
+  {
+    benchmark::DoNotOptimize(convertBrightnessValueToRaw(percent));
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_convertBrightnessValueToRaw);
+
+static void BM_getWarningLevels(benchmark::State& state)
+{
+  uint16_t tick = 0;
+  int32_t green, red;
+  uint64_t before = allocations;
+
+  for(auto _ : state)
+  {
+    getWarningLevels(tick, green, red);
+    benchmark::DoNotOptimize(green);
+    benchmark::DoNotOptimize(red);
+    tick = (tick + 1) % 320;
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_getWarningLevels);
+
+typedef enum
+{
+  OUTPUT_CASE_STEADY,       /*valid data, no transition*/
+  OUTPUT_CASE_TRANSITION,   /*following the transition position*/
+  OUTPUT_CASE_WARNING       /*no valid data*/
+} outputCase_t;
+
+static void BM_outputUpdate(benchmark::State& state)
+{
+  static const char* const labels[] = {"steady", "transition", "warning"};
+  outputCase_t outputCase = (outputCase_t)state.range(0);
+  tallyBoxConfig_t c = {};
+  uint16_t tick = 0;
+  uint16_t position = 0;
+  uint64_t before = allocations;
+
+  c.user.greenBrightnessPercent = DEFAULT_GREEN_BRIGHTNESS_PCT;
+  c.user.redBrightnessPercent = DEFAULT_RED_BRIGHTNESS_PCT;
+  for(auto _ : state)
+  {
+    outputUpdate(c, tick, (outputCase != OUTPUT_CASE_WARNING), true, false, (outputCase == OUTPUT_CASE_TRANSITION), position);
+    benchmark::DoNotOptimize(hostPins);
+    tick = (tick + 1) % 320;
+    position = (position + 97) % TRANSITION_POSITION_MAX;
+  }
+  state.SetLabel(labels[outputCase]);
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_outputUpdate)->Arg(OUTPUT_CASE_STEADY)->Arg(OUTPUT_CASE_TRANSITION)->Arg(OUTPUT_CASE_WARNING);
+
+static void BM_updateLed(benchmark::State& state)
+{
+  uint16_t tick = 0;
+  uint64_t before = allocations;
+
+  for(auto _ : state)
+  {
+    outputUpdateStatusLed(0x55555555, tick);
+    benchmark::DoNotOptimize(hostPins);
+    tick = (tick + 1) % 320;
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_updateLed);
+
+static void BM_peerNetworkSerialize(benchmark::State& state)
+{
+  peerTally_t t = {3, 7, true, 4200};
+  uint8_t payload[PEERNETWORK_TALLY_PAYLOAD_SIZE];
+  uint8_t frame[PEERNETWORK_MAX_MESSAGE_SIZE];
+  uint16_t tick = 0;
+  uint64_t before = allocations;
+
+  for(auto _ : state)
+  {
+    peerTallyEncode(t, payload);
+    benchmark::DoNotOptimize(peerNetworkSerialize(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, tick++, payload, sizeof(payload), frame, sizeof(frame)));
+    benchmark::ClobberMemory();
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_peerNetworkSerialize);
+
+static void BM_peerNetworkDeSerialize(benchmark::State& state)
+{
+  peerTally_t t = {3, 7, true, 4200};
+  uint8_t payload[PEERNETWORK_TALLY_PAYLOAD_SIZE];
+  uint8_t frame[PEERNETWORK_MAX_MESSAGE_SIZE];
+  uint16_t len;
+  uint64_t before;
+
+  peerTallyEncode(t, payload);
+  len = peerNetworkSerialize(PEERNETWORK_TALLY_BROADCAST_IDENTIFIER_U16, 100, payload, sizeof(payload), frame, sizeof(frame));
+  before = allocations;
+  for(auto _ : state)
+  {
+    uint16_t messageId, frameTick, payloadLen;
+    uint8_t *received;
+    peerTally_t decoded;
+
+    benchmark::DoNotOptimize(frame);
+    if((peerNetworkDeSerialize(frame, len, messageId, frameTick, received, payloadLen) == PEER_FRAME_OK)
+       && peerTallyDecode(received, payloadLen, decoded))
+    {
+      benchmark::DoNotOptimize(decoded);
+    }
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_peerNetworkDeSerialize);
+
+/*a TSL packet of count displays without text, the lamps of display i are lamps(i)*/
+static uint16_t tslPacket(uint8_t *buf, uint16_t count, uint16_t (*lamps)(uint16_t), uint8_t phase)
+{
+  uint8_t *p = buf + TSL_HEADER_SIZE;
+
+  for(uint16_t i = 0; i < count; i++)
+  {
+    uint16_t control = lamps(i + phase);
+
+    *p++ = (uint8_t)i;
+    *p++ = (uint8_t)(i >> 8);
+    *p++ = (uint8_t)control;
+    *p++ = (uint8_t)(control >> 8);
+    *p++ = 0;
+    *p++ = 0;
+  }
+  buf[0] = (uint8_t)(p - buf - 2);
+  buf[1] = (uint8_t)((p - buf - 2) >> 8);
+  buf[2] = 0x80;
+  buf[3] = 0;
+  buf[4] = 0;
+  buf[5] = 0;
+  return (uint16_t)(p - buf);
+}
+
+static uint16_t tslLamps(uint16_t i)
+{
+  return (i % 3);   /*off, red, green*/
+}
+
+/*displays per packet (240 fill a datagram), every display changed or none*/
+static void BM_tslApplyPacket(benchmark::State& state)
+{
+  uint16_t count = (uint16_t)state.range(0);
+  bool changing = (state.range(1) != 0);
+  uint8_t packets[2][TSL_MAX_PACKET];
+  uint16_t len[2];
+  tslTallyState_t s;
+  uint32_t n = 0;
+  uint64_t before;
+
+  len[0] = tslPacket(packets[0], count, tslLamps, 0);
+  len[1] = tslPacket(packets[1], count, tslLamps, (changing ? 1 : 0));
+  tslTallyReset(s, 1);
+  before = allocations;
+  for(auto _ : state)
+  {
+    uint8_t k = (uint8_t)(n++ & 1);
+
+    benchmark::DoNotOptimize(tslApplyPacket(s, packets[k], len[k]));
+    benchmark::ClobberMemory();
+  }
+  reportAllocations(state, before);
+  state.counters["displays"] = benchmark::Counter((double)count * state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_tslApplyPacket)->Args({16, 1})->Args({64, 1})->Args({240, 1})->Args({240, 0});
+
+static uint16_t tslLampsEscaped(uint16_t i)
+{
+  return 0xFEFE;    /*every control byte is a DLE, doubled on the stream*/
+}
+
+/*a full packet arriving over tcp, byte by byte through the DLE unstuffing*/
+static void BM_tslStreamPut(benchmark::State& state)
+{
+  uint8_t packet[TSL_MAX_PACKET];
+  uint8_t stream[2 * TSL_MAX_PACKET + 2];
+  uint8_t buf[TSL_MAX_PACKET];
+  tslStream_t s = {buf, sizeof(buf), 0, false, false};
+  uint16_t len = tslPacket(packet, 240, tslLampsEscaped, 0);
+  uint16_t streamLen = 0;
+  uint64_t before;
+
+  stream[streamLen++] = TSL_DLE;
+  stream[streamLen++] = TSL_STX;
+  for(uint16_t i = 0; i < len; i++)
+  {
+    stream[streamLen++] = packet[i];
+    if(packet[i] == TSL_DLE)
+    {
+      stream[streamLen++] = TSL_DLE;
+    }
+  }
+
+  before = allocations;
+  for(auto _ : state)
+  {
+    bool complete = false;
+
+    for(uint16_t i = 0; i < streamLen; i++)
+    {
+      complete |= tslStreamPut(s, stream[i]);
+    }
+    benchmark::DoNotOptimize(complete);
+  }
+  reportAllocations(state, before);
+  state.SetBytesProcessed((int64_t)streamLen * state.iterations());
+}
+BENCHMARK(BM_tslStreamPut);
+
+/*the republished packet with all 64 displays, framed for tcp*/
+static void BM_tslEncode(benchmark::State& state)
+{
+  uint8_t packet[TSL_HEADER_SIZE + 64 * TSL_DISPLAY_HEADER_SIZE];
+  uint8_t stuffed[2 * sizeof(packet) + 2];
+  uint64_t program = 0x0000000000000004ULL;
+  uint64_t preview = 0x0000000000000001ULL;
+  uint64_t before = allocations;
+
+  for(auto _ : state)
+  {
+    tslWriter_t w;
+
+    tslWriterBegin(w, packet, sizeof(packet), 0);
+    for(uint8_t bit = 0; bit < 64; bit++)
+    {
+      tslWriterAdd(w, bit, tslControl((program >> bit) & 1, (preview >> bit) & 1), NULL, 0);
+    }
+    benchmark::DoNotOptimize(tslStuff(packet, tslWriterEnd(w), stuffed, sizeof(stuffed)));
+    benchmark::ClobberMemory();
+  }
+  reportAllocations(state, before);
+}
+BENCHMARK(BM_tslEncode);
+
+/*a line typed into a terminal session: read, parsed, run and the next prompt printed*/
+static void terminalLines(benchmark::State& state, const char* const lines[2])
+{
+  tallyBoxConfig_t c = {};
+  hostTcpConnection_t connection = {};
+  uint32_t n = 0;
+  uint64_t before;
+
+  tallyBoxTerminalInitialize(c);
+  hostTcpConnect(&connection);
+  tallyBoxTerminalUpdate(c);      /*the session is opened and shows the main menu*/
+
+  before = allocations;
+  for(auto _ : state)
+  {
+    connection.input = lines[n++ & 1];
+    connection.inputLen = strlen(connection.input);
+    connection.inputPos = 0;
+    tallyBoxTerminalUpdate(c);
+  }
+  reportAllocations(state, before);
+
+  state.counters["bytes_out_per_op"] = benchmark::Counter((double)connection.written, benchmark::Counter::kAvgIterations);
+
+  connection.connected = false;
+  connection.inputPos = connection.inputLen;
+  tallyBoxTerminalUpdate(c);      /*closed*/
+}
+
+static void BM_terminalMenu(benchmark::State& state)
+{
+  static const char* const lines[2] = {"2\n", "m\n"};    /*into the brightness menu and back*/
+
+  terminalLines(state, lines);
+}
+BENCHMARK(BM_terminalMenu);
+
+static void BM_terminalSetField(benchmark::State& state)
+{
+  static const char* const lines[2] = {"3\n", "cameraId = 4\n"};   /*a field changed in the configuration menu*/
+
+  terminalLines(state, lines);
+}
+BENCHMARK(BM_terminalSetField);
+
+/*** the check ***********************************************/
+
+typedef struct
+{
+  double ns;
+  double allocs;
+} result_t;
+
+/*the console output, and the results kept for the check*/
+class checkingReporter : public benchmark::ConsoleReporter
+{
+public:
+  std::map<std::string, result_t> results;
+
+  void ReportRuns(const std::vector<Run>& reports) override
+  {
+    for(size_t i = 0; i < reports.size(); i++)
+    {
+      const Run& r = reports[i];
+      std::map<std::string, benchmark::Counter>::const_iterator allocs = r.counters.find("allocs_per_op");
+
+      if((r.run_type == Run::RT_Iteration) && !r.error_occurred)
+      {
+        results[r.benchmark_name()] = {r.GetAdjustedCPUTime() * 1e9 / benchmark::GetTimeUnitMultiplier(r.time_unit),
+                                       ((allocs != r.counters.end()) ? allocs->second.value : 0)};
+      }
+    }
+    ConsoleReporter::ReportRuns(reports);
+  }
+};
+
+/*the JSON of --benchmark_out has one key per line*/
+static bool readBaseline(const char *path, std::map<std::string, result_t>& baseline)
+{
+  FILE *f = fopen(path, "r");
+  char line[512];
+  std::string name;
+  bool iteration = true;
+
+  if(f == NULL)
+  {
+    return false;
+  }
+  while(fgets(line, sizeof(line), f))
+  {
+    char text[256];
+    double value;
+
+    if(sscanf(line, " \"name\": \"%255[^\"]\"", text) == 1)
+    {
+      name = text;
+      iteration = true;
+    }
+    else if(sscanf(line, " \"run_type\": \"%255[^\"]\"", text) == 1)
+    {
+      iteration = (strcmp(text, "iteration") == 0);
+    }
+    else if((sscanf(line, " \"cpu_time\": %lf", &value) == 1) && iteration && !name.empty())
+    {
+      baseline[name].ns = value;    /*time_unit is ns, the default*/
+    }
+  }
+  fclose(f);
+  return !baseline.empty();
+}
+
+static bool check(const std::map<std::string, result_t>& results, const char *baselinePath, double tolerance)
+{
+  std::map<std::string, result_t> baseline;
+  bool ret = true;
+
+  for(std::map<std::string, result_t>::const_iterator i = results.begin(); i != results.end(); ++i)
+  {
+    if(i->second.allocs > 0)
+    {
+      printf("REGRESSION %s allocates %.3f times per call\n", i->first.c_str(), i->second.allocs);
+      ret = false;
+    }
+  }
+  if(baselinePath == NULL)
+  {
+    return ret;
+  }
+  if(!readBaseline(baselinePath, baseline))
+  {
+    printf("no baseline in %s\n", baselinePath);
+    return false;
+  }
+  for(std::map<std::string, result_t>::const_iterator i = results.begin(); i != results.end(); ++i)
+  {
+    std::map<std::string, result_t>::const_iterator b = baseline.find(i->first);
+
+    if((b != baseline.end()) && (b->second.ns > 0))
+    {
+      double ratio = i->second.ns / b->second.ns;
+      bool slower = (ratio > (1.0 + tolerance));
+
+      printf("%-36s %9.1f ns %6.2fx baseline%s\n", i->first.c_str(), i->second.ns, ratio, (slower ? "  REGRESSION" : ""));
+      ret = ret && !slower;
+    }
+  }
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  const char *baselinePath = NULL;
+  double tolerance = 0.5;
+  checkingReporter reporter;
+  int n = 1;
+
+  benchmark::Initialize(&argc, argv);
+  for(int i = 1; i < argc; i++)
+  {
+    if((strcmp(argv[i], "--baseline") == 0) && ((i + 1) < argc))
+    {
+      baselinePath = argv[++i];
+    }
+    else if((strcmp(argv[i], "--tolerance") == 0) && ((i + 1) < argc))
+    {
+      tolerance = atof(argv[++i]);
+    }
+    else
+    {
+      argv[n++] = argv[i];
+    }
+  }
+  if(benchmark::ReportUnrecognizedArguments(n, argv))
+  {
+    return 2;
+  }
+
+  /*well past the first round, so that the tick compensation takes part*/
+  hostSetClock(10000000);
+  benchmark::RunSpecifiedBenchmarks(&reporter);
+  benchmark::Shutdown();
+  return check(reporter.results, baselinePath, tolerance) ? 0 : 1;
+}